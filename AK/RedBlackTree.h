@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/Assertions.h>
+#include <AK/Optional.h>
+#include <AK/StdLibExtras.h>
+#include <AK/Types.h>
+
+namespace AK {
+
+// An ordered map from keys to values, kept balanced so that lookups, insertions and removals are O(log n).
+// Besides exact lookups, it can find the closest key on either side of a given one, which is what you
+// need to find the interval containing an address. Iteration visits the entries in ascending key order.
+template<typename K, typename V>
+class RedBlackTree {
+    struct Node {
+        template<typename U>
+        Node(K key, U&& value)
+            : key(key)
+            , value(forward<U>(value))
+        {
+        }
+
+        K key;
+        V value;
+        Node* parent { nullptr };
+        Node* left { nullptr };
+        Node* right { nullptr };
+        bool is_red { true };
+    };
+
+public:
+    template<typename NodeType, typename ValueType>
+    class IteratorBase {
+    public:
+        bool operator!=(const IteratorBase& other) const { return m_node != other.m_node; }
+        bool operator==(const IteratorBase& other) const { return m_node == other.m_node; }
+        IteratorBase& operator++()
+        {
+            m_node = successor(m_node);
+            return *this;
+        }
+        ValueType& operator*() { return m_node->value; }
+        ValueType* operator->() { return &m_node->value; }
+        const K& key() const { return m_node->key; }
+        bool is_end() const { return !m_node; }
+
+    private:
+        friend class RedBlackTree;
+        explicit IteratorBase(NodeType* node)
+            : m_node(node)
+        {
+        }
+        NodeType* m_node { nullptr };
+    };
+
+    using Iterator = IteratorBase<Node, V>;
+    using ConstIterator = IteratorBase<const Node, const V>;
+
+    RedBlackTree() { }
+    RedBlackTree(const RedBlackTree& other) { *this = other; }
+    RedBlackTree(RedBlackTree&& other)
+        : m_root(exchange(other.m_root, nullptr))
+        , m_size(exchange(other.m_size, 0))
+    {
+    }
+    ~RedBlackTree() { clear(); }
+
+    RedBlackTree& operator=(const RedBlackTree& other)
+    {
+        if (this != &other) {
+            clear();
+            m_root = clone(other.m_root, nullptr);
+            m_size = other.m_size;
+        }
+        return *this;
+    }
+
+    RedBlackTree& operator=(RedBlackTree&& other)
+    {
+        if (this != &other) {
+            clear();
+            m_root = exchange(other.m_root, nullptr);
+            m_size = exchange(other.m_size, 0);
+        }
+        return *this;
+    }
+
+    bool is_empty() const { return !m_size; }
+    size_t size() const { return m_size; }
+
+    V* find(K key)
+    {
+        auto* node = find_node(key);
+        return node ? &node->value : nullptr;
+    }
+    const V* find(K key) const { return const_cast<RedBlackTree&>(*this).find(key); }
+
+    // Finds the value with the largest key that is not above the given one.
+    V* find_largest_not_above(K key)
+    {
+        Node* best = nullptr;
+        for (auto* node = m_root; node;) {
+            if (node->key == key)
+                return &node->value;
+            if (node->key < key) {
+                best = node;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return best ? &best->value : nullptr;
+    }
+    const V* find_largest_not_above(K key) const { return const_cast<RedBlackTree&>(*this).find_largest_not_above(key); }
+
+    // Finds the value with the smallest key that is not below the given one.
+    V* find_smallest_not_below(K key)
+    {
+        Node* best = nullptr;
+        for (auto* node = m_root; node;) {
+            if (node->key == key)
+                return &node->value;
+            if (key < node->key) {
+                best = node;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return best ? &best->value : nullptr;
+    }
+    const V* find_smallest_not_below(K key) const { return const_cast<RedBlackTree&>(*this).find_smallest_not_below(key); }
+
+    // The key must not be in the tree yet.
+    template<typename U>
+    V& insert(K key, U&& value)
+    {
+        Node* parent = nullptr;
+        Node** link = &m_root;
+        while (*link) {
+            parent = *link;
+            ASSERT(key != parent->key);
+            link = key < parent->key ? &parent->left : &parent->right;
+        }
+        auto* node = new Node(key, forward<U>(value));
+        node->parent = parent;
+        *link = node;
+        ++m_size;
+        insert_fixup(node);
+        return node->value;
+    }
+
+    bool remove(K key)
+    {
+        auto* node = find_node(key);
+        if (!node)
+            return false;
+        remove_node(node);
+        delete node;
+        return true;
+    }
+
+    Optional<V> take(K key)
+    {
+        auto* node = find_node(key);
+        if (!node)
+            return {};
+        remove_node(node);
+        Optional<V> value = move(node->value);
+        delete node;
+        return value;
+    }
+
+    void clear()
+    {
+        destroy(m_root);
+        m_root = nullptr;
+        m_size = 0;
+    }
+
+    Iterator begin() { return Iterator(leftmost(m_root)); }
+    Iterator end() { return Iterator(nullptr); }
+    ConstIterator begin() const { return ConstIterator(leftmost(m_root)); }
+    ConstIterator end() const { return ConstIterator(nullptr); }
+
+private:
+    template<typename NodeType>
+    static NodeType* leftmost(NodeType* node)
+    {
+        if (!node)
+            return nullptr;
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+
+    template<typename NodeType>
+    static NodeType* successor(NodeType* node)
+    {
+        if (node->right)
+            return leftmost(node->right);
+        while (node->parent && node == node->parent->right)
+            node = node->parent;
+        return node->parent;
+    }
+
+    static bool is_red(const Node* node) { return node && node->is_red; }
+    static bool is_black(const Node* node) { return !is_red(node); }
+
+    Node* find_node(K key)
+    {
+        for (auto* node = m_root; node;) {
+            if (node->key == key)
+                return node;
+            node = key < node->key ? node->left : node->right;
+        }
+        return nullptr;
+    }
+
+    static Node* clone(const Node* node, Node* parent)
+    {
+        if (!node)
+            return nullptr;
+        auto* copy = new Node(node->key, node->value);
+        copy->parent = parent;
+        copy->is_red = node->is_red;
+        copy->left = clone(node->left, copy);
+        copy->right = clone(node->right, copy);
+        return copy;
+    }
+
+    static void destroy(Node* node)
+    {
+        if (!node)
+            return;
+        destroy(node->left);
+        destroy(node->right);
+        delete node;
+    }
+
+    void replace_child(Node* parent, Node* old_child, Node* new_child)
+    {
+        if (!parent)
+            m_root = new_child;
+        else if (parent->left == old_child)
+            parent->left = new_child;
+        else
+            parent->right = new_child;
+        if (new_child)
+            new_child->parent = parent;
+    }
+
+    void rotate_left(Node* node)
+    {
+        auto* pivot = node->right;
+        node->right = pivot->left;
+        if (pivot->left)
+            pivot->left->parent = node;
+        replace_child(node->parent, node, pivot);
+        pivot->left = node;
+        node->parent = pivot;
+    }
+
+    void rotate_right(Node* node)
+    {
+        auto* pivot = node->left;
+        node->left = pivot->right;
+        if (pivot->right)
+            pivot->right->parent = node;
+        replace_child(node->parent, node, pivot);
+        pivot->right = node;
+        node->parent = pivot;
+    }
+
+    void insert_fixup(Node* node)
+    {
+        while (is_red(node->parent)) {
+            auto* parent = node->parent;
+            auto* grandparent = parent->parent;
+            if (parent == grandparent->left) {
+                auto* uncle = grandparent->right;
+                if (is_red(uncle)) {
+                    parent->is_red = false;
+                    uncle->is_red = false;
+                    grandparent->is_red = true;
+                    node = grandparent;
+                    continue;
+                }
+                if (node == parent->right) {
+                    rotate_left(parent);
+                    node = parent;
+                    parent = node->parent;
+                }
+                parent->is_red = false;
+                grandparent->is_red = true;
+                rotate_right(grandparent);
+            } else {
+                auto* uncle = grandparent->left;
+                if (is_red(uncle)) {
+                    parent->is_red = false;
+                    uncle->is_red = false;
+                    grandparent->is_red = true;
+                    node = grandparent;
+                    continue;
+                }
+                if (node == parent->left) {
+                    rotate_right(parent);
+                    node = parent;
+                    parent = node->parent;
+                }
+                parent->is_red = false;
+                grandparent->is_red = true;
+                rotate_left(grandparent);
+            }
+        }
+        m_root->is_red = false;
+    }
+
+    // Unlinks the node from the tree without destroying it.
+    void remove_node(Node* node)
+    {
+        Node* child;
+        Node* child_parent;
+        bool removed_black;
+        if (!node->left || !node->right) {
+            child = node->left ? node->left : node->right;
+            child_parent = node->parent;
+            removed_black = !node->is_red;
+            replace_child(node->parent, node, child);
+        } else {
+            // Move the in-order successor into the node's place.
+            auto* next = leftmost(node->right);
+            removed_black = !next->is_red;
+            child = next->right;
+            if (next->parent == node) {
+                child_parent = next;
+            } else {
+                child_parent = next->parent;
+                replace_child(next->parent, next, next->right);
+                next->right = node->right;
+                next->right->parent = next;
+            }
+            replace_child(node->parent, node, next);
+            next->left = node->left;
+            next->left->parent = next;
+            next->is_red = node->is_red;
+        }
+        --m_size;
+        if (removed_black)
+            remove_fixup(child, child_parent);
+    }
+
+    void remove_fixup(Node* node, Node* parent)
+    {
+        while (node != m_root && is_black(node)) {
+            if (node == parent->left) {
+                auto* sibling = parent->right;
+                if (is_red(sibling)) {
+                    sibling->is_red = false;
+                    parent->is_red = true;
+                    rotate_left(parent);
+                    sibling = parent->right;
+                }
+                if (is_black(sibling->left) && is_black(sibling->right)) {
+                    sibling->is_red = true;
+                    node = parent;
+                    parent = node->parent;
+                    continue;
+                }
+                if (is_black(sibling->right)) {
+                    sibling->left->is_red = false;
+                    sibling->is_red = true;
+                    rotate_right(sibling);
+                    sibling = parent->right;
+                }
+                sibling->is_red = parent->is_red;
+                parent->is_red = false;
+                sibling->right->is_red = false;
+                rotate_left(parent);
+                node = m_root;
+            } else {
+                auto* sibling = parent->left;
+                if (is_red(sibling)) {
+                    sibling->is_red = false;
+                    parent->is_red = true;
+                    rotate_right(parent);
+                    sibling = parent->left;
+                }
+                if (is_black(sibling->left) && is_black(sibling->right)) {
+                    sibling->is_red = true;
+                    node = parent;
+                    parent = node->parent;
+                    continue;
+                }
+                if (is_black(sibling->left)) {
+                    sibling->right->is_red = false;
+                    sibling->is_red = true;
+                    rotate_left(sibling);
+                    sibling = parent->left;
+                }
+                sibling->is_red = parent->is_red;
+                parent->is_red = false;
+                sibling->left->is_red = false;
+                rotate_right(parent);
+                node = m_root;
+            }
+        }
+        if (node)
+            node->is_red = false;
+    }
+
+    Node* m_root { nullptr };
+    size_t m_size { 0 };
+};
+
+}
+
+using AK::RedBlackTree;
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/TestSuite.h>
+
+#include <AK/NonnullOwnPtr.h>
+#include <AK/QuickSort.h>
+#include <AK/RedBlackTree.h>
+#include <AK/Vector.h>
+#include <stdlib.h>
+
+TEST_CASE(construct)
+{
+    RedBlackTree<int, int> empty;
+    EXPECT(empty.is_empty());
+    EXPECT_EQ(empty.size(), 0u);
+    EXPECT(empty.begin() == empty.end());
+    EXPECT_EQ(empty.find(1), nullptr);
+    EXPECT_EQ(empty.find_largest_not_above(1), nullptr);
+    EXPECT_EQ(empty.find_smallest_not_below(1), nullptr);
+}
+
+TEST_CASE(ordered_iteration)
+{
+    RedBlackTree<int, int> tree;
+    for (int i : { 5, 3, 9, 1, 7, 2, 8, 4, 6, 0 })
+        tree.insert(i, i * 10);
+    EXPECT_EQ(tree.size(), 10u);
+
+    int expected = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        EXPECT_EQ(it.key(), expected);
+        EXPECT_EQ(*it, expected * 10);
+        ++expected;
+    }
+    EXPECT_EQ(expected, 10);
+}
+
+TEST_CASE(closest_keys)
+{
+    RedBlackTree<int, int> tree;
+    for (int i = 10; i <= 100; i += 10)
+        tree.insert(i, i);
+
+    EXPECT_EQ(tree.find_largest_not_above(5), nullptr);
+    EXPECT_EQ(*tree.find_largest_not_above(10), 10);
+    EXPECT_EQ(*tree.find_largest_not_above(15), 10);
+    EXPECT_EQ(*tree.find_largest_not_above(1000), 100);
+
+    EXPECT_EQ(*tree.find_smallest_not_below(5), 10);
+    EXPECT_EQ(*tree.find_smallest_not_below(50), 50);
+    EXPECT_EQ(*tree.find_smallest_not_below(51), 60);
+    EXPECT_EQ(tree.find_smallest_not_below(101), nullptr);
+}
+
+TEST_CASE(remove_and_take)
+{
+    RedBlackTree<int, NonnullOwnPtr<int>> tree;
+    for (int i = 0; i < 100; ++i)
+        tree.insert(i, make<int>(i));
+
+    EXPECT(!tree.remove(100));
+    EXPECT(tree.remove(50));
+    EXPECT_EQ(tree.find(50), nullptr);
+    EXPECT_EQ(*tree.find_largest_not_above(50)->ptr(), 49);
+
+    auto taken = tree.take(20);
+    EXPECT(taken.has_value());
+    EXPECT_EQ(*taken.value(), 20);
+    EXPECT(!tree.take(20).has_value());
+    EXPECT_EQ(tree.size(), 98u);
+
+    tree.clear();
+    EXPECT(tree.is_empty());
+}
+
+TEST_CASE(copy_and_move)
+{
+    RedBlackTree<int, int> tree;
+    for (int i = 0; i < 32; ++i)
+        tree.insert(i, i);
+
+    auto copy = tree;
+    copy.remove(0);
+    EXPECT_EQ(tree.size(), 32u);
+    EXPECT_EQ(copy.size(), 31u);
+    EXPECT_EQ(*tree.find(0), 0);
+
+    auto moved = move(copy);
+    EXPECT(copy.is_empty());
+    EXPECT_EQ(moved.size(), 31u);
+    EXPECT_EQ(*moved.begin(), 1);
+}
+
+TEST_CASE(random_operations)
+{
+    RedBlackTree<u32, u32> tree;
+    Vector<u32> keys;
+
+    srand(0);
+    for (int round = 0; round < 5000; ++round) {
+        u32 key = rand() % 1000;
+        bool present = keys.contains_slow(key);
+        if (rand() % 3 == 0) {
+            EXPECT_EQ(tree.remove(key), present);
+            if (present)
+                keys.remove_first_matching([&](auto& k) { return k == key; });
+        } else if (!present) {
+            tree.insert(key, key + 1);
+            keys.append(key);
+        }
+    }
+
+    quick_sort(keys);
+    EXPECT_EQ(tree.size(), keys.size());
+    size_t index = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it, ++index) {
+        EXPECT_EQ(it.key(), keys[index]);
+        EXPECT_EQ(*it, keys[index] + 1);
+    }
+
+    for (u32 probe = 0; probe < 1000; ++probe) {
+        auto* floor = tree.find_largest_not_above(probe);
+        Optional<u32> expected;
+        for (auto key : keys) {
+            if (key <= probe)
+                expected = key;
+        }
+        EXPECT_EQ(floor != nullptr, expected.has_value());
+        if (floor)
+            EXPECT_EQ(*floor, expected.value() + 1);
+    }
+}
+
+TEST_MAIN(RedBlackTree)
@@ -39,9 +39,22 @@ struct Parameter {
     Vector<String> attributes;
     String type;
     String name;
+
+    // Borrowed parameters point into the buffer the message was received in, instead of owning a copy.
+    bool is_borrowed() const { return type.contains("StringView") || type.contains("ReadonlyBytes"); }
 };
 
+static bool has_borrowed_parameters(const Vector<Parameter>& parameters)
+{
+    for (auto& parameter : parameters) {
+        if (parameter.is_borrowed())
+            return true;
+    }
+    return false;
+}
+
 struct Message {
+    Vector<String> attributes;
     String name;
     bool is_synchronous { false };
     Vector<Parameter> inputs;
@@ -54,9 +67,14 @@ struct Message {
         builder.append("Response");
         return builder.to_string();
     }
+
+    // "Latest wins" messages replace an earlier one with the same [CoalesceKey] parameters that is still queued for sending.
+    // The replacement is sent from the earlier message's place in the queue, ahead of anything posted in between.
+    bool is_coalescable() const { return attributes.contains_slow("Coalesce"); }
 };
 
 struct Endpoint {
+    Vector<String> attributes;
     String name;
     int magic;
     Vector<Message> messages;
@@ -93,26 +111,30 @@ int main(int argc, char** argv)
             lexer.ignore_until([](char ch) { return ch == '\n'; });
     };
 
+    auto parse_attributes = [&](Vector<String>& storage) {
+        if (!lexer.consume_specific('['))
+            return;
+        for (;;) {
+            if (lexer.consume_specific(']')) {
+                consume_whitespace();
+                break;
+            }
+            if (lexer.consume_specific(',')) {
+                consume_whitespace();
+            }
+            auto attribute = lexer.consume_until([](char ch) { return ch == ']' || ch == ','; });
+            storage.append(attribute);
+            consume_whitespace();
+        }
+    };
+
     auto parse_parameter = [&](Vector<Parameter>& storage) {
         for (;;) {
             Parameter parameter;
             consume_whitespace();
             if (lexer.peek() == ')')
                 break;
-            if (lexer.consume_specific('[')) {
-                for (;;) {
-                    if (lexer.consume_specific(']')) {
-                        consume_whitespace();
-                        break;
-                    }
-                    if (lexer.consume_specific(',')) {
-                        consume_whitespace();
-                    }
-                    auto attribute = lexer.consume_until([](char ch) { return ch == ']' || ch == ','; });
-                    parameter.attributes.append(attribute);
-                    consume_whitespace();
-                }
-            }
+            parse_attributes(parameter.attributes);
             parameter.type = lexer.consume_until([](char ch) { return isspace(ch); });
             consume_whitespace();
             parameter.name = lexer.consume_until([](char ch) { return isspace(ch) || ch == ',' || ch == ')'; });
@@ -140,6 +162,7 @@ int main(int argc, char** argv)
     auto parse_message = [&] {
         Message message;
         consume_whitespace();
+        parse_attributes(message.attributes);
         message.name = lexer.consume_until([](char ch) { return isspace(ch) || ch == '('; });
         consume_whitespace();
         assert_specific('(');
@@ -182,6 +205,7 @@ int main(int argc, char** argv)
     auto parse_endpoint = [&] {
         endpoints.empend();
         consume_whitespace();
+        parse_attributes(endpoints.last().attributes);
         lexer.consume_specific("endpoint");
         consume_whitespace();
         endpoints.last().name = lexer.consume_while([](char ch) { return !isspace(ch); });
@@ -200,6 +224,21 @@ int main(int argc, char** argv)
     while (lexer.tell() < file_contents.size())
         parse_endpoint();
 
+    for (auto& endpoint : endpoints) {
+        for (auto& message : endpoint.messages) {
+            // A response is encoded after its handler has returned, so it can't borrow from the handler's locals.
+            if (has_borrowed_parameters(message.outputs)) {
+                warnln("Error: {}::{} has a borrowed response parameter", endpoint.name, message.name);
+                return 1;
+            }
+            // Someone is waiting for the response to a synchronous message, so we can't drop it.
+            if (message.is_coalescable() && message.is_synchronous) {
+                warnln("Error: {}::{} is synchronous and can't be coalesced", endpoint.name, message.name);
+                return 1;
+            }
+        }
+    }
+
     StringBuilder builder;
     SourceGenerator generator { builder };
 
@@ -225,6 +264,7 @@ int main(int argc, char** argv)
 
         endpoint_generator.set("endpoint.name", endpoint.name);
         endpoint_generator.set("endpoint.magic", String::number(endpoint.magic));
+        endpoint_generator.set("endpoint.uses_shared_memory_transport", endpoint.attributes.contains_slow("SharedMemoryTransport") ? "true" : "false");
 
         endpoint_generator.append(R"~~~(
 namespace Messages::@endpoint.name@ {
@@ -293,11 +333,12 @@ enum class MessageID : i32 {
             return builder.to_string();
         };
 
-        auto do_message = [&](const String& name, const Vector<Parameter>& parameters, const String& response_type = {}) {
+        auto do_message = [&](const String& name, const Vector<Parameter>& parameters, const String& response_type = {}, bool is_coalescable = false) {
             auto message_generator = endpoint_generator.fork();
             message_generator.set("message.name", name);
             message_generator.set("message.response_type", response_type);
             message_generator.set("message.constructor", constructor_for_message(name, parameters));
+            bool is_borrowing = has_borrowed_parameters(parameters);
 
             message_generator.append(R"~~~(
 class @message.name@ final : public IPC::Message {
@@ -318,10 +359,23 @@ public:
     static i32 static_message_id() { return (int)MessageID::@message.name@; }
     virtual const char* message_name() const override { return "@endpoint.name@::@message.name@"; }
 
+)~~~");
+
+            if (is_borrowing) {
+                message_generator.append(R"~~~(
+    static OwnPtr<@message.name@> decode(InputMemoryStream& stream, int sockfd, const ByteBuffer& receive_buffer)
+    {
+        auto buffer = IPC::Decoder::buffer_for_borrowed_parameters(stream, receive_buffer);
+        InputMemoryStream buffer_stream { buffer.bytes().slice(buffer.size() - stream.remaining()) };
+        IPC::Decoder decoder { buffer_stream, sockfd };
+)~~~");
+            } else {
+                message_generator.append(R"~~~(
     static OwnPtr<@message.name@> decode(InputMemoryStream& stream, int sockfd)
     {
         IPC::Decoder decoder { stream, sockfd };
 )~~~");
+            }
 
             for (auto& parameter : parameters) {
                 auto parameter_generator = message_generator.fork();
@@ -358,10 +412,20 @@ public:
 
             message_generator.set("message.constructor_call_parameters", builder.build());
 
-            message_generator.append(R"~~~(
+            if (is_borrowing) {
+                message_generator.append(R"~~~(
+        stream.discard_or_error(buffer_stream.offset());
+        auto message = make<@message.name@>(@message.constructor_call_parameters@);
+        message->m_buffer = move(buffer);
+        return message;
+    }
+)~~~");
+            } else {
+                message_generator.append(R"~~~(
         return make<@message.name@>(@message.constructor_call_parameters@);
     }
 )~~~");
+            }
 
             message_generator.append(R"~~~(
     virtual IPC::MessageBuffer encode() const override
@@ -386,6 +450,35 @@ public:
     }
 )~~~");
 
+            if (is_coalescable) {
+                message_generator.append(R"~~~(
+    virtual bool is_coalescable() const override { return true; }
+)~~~");
+
+                Vector<const Parameter*> key_parameters;
+                for (auto& parameter : parameters) {
+                    if (parameter.attributes.contains_slow("CoalesceKey"))
+                        key_parameters.append(&parameter);
+                }
+
+                if (!key_parameters.is_empty()) {
+                    message_generator.append(R"~~~(
+    virtual void encode_coalescing_key(IPC::Encoder& stream) const override
+    {
+)~~~");
+                    for (auto* parameter : key_parameters) {
+                        auto parameter_generator = message_generator.fork();
+                        parameter_generator.set("parameter.name", parameter->name);
+                        parameter_generator.append(R"~~~(
+        stream << m_@parameter.name@;
+)~~~");
+                    }
+                    message_generator.append(R"~~~(
+    }
+)~~~");
+                }
+            }
+
             for (auto& parameter : parameters) {
                 auto parameter_generator = message_generator.fork();
                 parameter_generator.set("parameter.type", parameter.type);
@@ -408,6 +501,12 @@ private:
 )~~~");
             }
 
+            if (is_borrowing) {
+                message_generator.append(R"~~~(
+    ByteBuffer m_buffer;
+)~~~");
+            }
+
             message_generator.append(R"~~~(
 };
             )~~~");
@@ -418,7 +517,7 @@ private:
                 response_name = message.response_name();
                 do_message(response_name, message.outputs);
             }
-            do_message(message.name, message.inputs, response_name);
+            do_message(message.name, message.inputs, response_name, message.is_coalescable());
         }
 
         endpoint_generator.append(R"~~~(
@@ -435,8 +534,9 @@ public:
     virtual int magic() const override { return @endpoint.magic@; }
     static String static_name() { return "@endpoint.name@"; }
     virtual String name() const override { return "@endpoint.name@"; }
+    static constexpr bool uses_shared_memory_transport() { return @endpoint.uses_shared_memory_transport@; }
 
-    static OwnPtr<IPC::Message> decode_message(ReadonlyBytes buffer, int sockfd)
+    static OwnPtr<IPC::Message> decode_message(ReadonlyBytes buffer, int sockfd, [[maybe_unused]] const ByteBuffer& receive_buffer = {})
     {
         InputMemoryStream stream { buffer };
         i32 message_endpoint_magic = 0;
@@ -481,21 +581,22 @@ public:
 )~~~");
 
         for (auto& message : endpoint.messages) {
-            auto do_decode_message = [&](const String& name) {
+            auto do_decode_message = [&](const String& name, bool is_borrowing) {
                 auto message_generator = endpoint_generator.fork();
 
                 message_generator.set("message.name", name);
+                message_generator.set("message.decode_arguments", is_borrowing ? "stream, sockfd, receive_buffer" : "stream, sockfd");
 
                 message_generator.append(R"~~~(
         case (int)Messages::@endpoint.name@::MessageID::@message.name@:
-            message = Messages::@endpoint.name@::@message.name@::decode(stream, sockfd);
+            message = Messages::@endpoint.name@::@message.name@::decode(@message.decode_arguments@);
             break;
 )~~~");
             };
 
-            do_decode_message(message.name);
+            do_decode_message(message.name, has_borrowed_parameters(message.inputs));
             if (message.is_synchronous)
-                do_decode_message(message.response_name());
+                do_decode_message(message.response_name(), false);
         }
 
         endpoint_generator.append(R"~~~(
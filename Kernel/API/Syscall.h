@@ -42,6 +42,8 @@ struct timespec;
 struct sockaddr;
 struct siginfo;
 struct stat;
+struct iovec;
+struct epoll_event;
 typedef u32 socklen_t;
 }
 
@@ -197,7 +199,16 @@ namespace Kernel {
     S(allocate_tls)           \
     S(prctl)                  \
     S(mremap)                 \
-    S(set_coredump_metadata)
+    S(set_coredump_metadata)  \
+    S(sched_setaffinity)      \
+    S(sched_getaffinity)      \
+    S(sendfile)               \
+    S(readv)                  \
+    S(preadv)                 \
+    S(pwritev)                \
+    S(epoll_create1)          \
+    S(epoll_ctl)              \
+    S(epoll_wait)
 
 namespace Syscall {
 
@@ -448,9 +459,55 @@ struct SC_set_coredump_metadata_params {
     StringArgument value;
 };
 
+struct SC_sendfile_params {
+    int out_fd;
+    int in_fd;
+    ssize_t* offset;
+    size_t count;
+};
+
+struct SC_preadv_params {
+    int fd;
+    const struct iovec* iov;
+    int iov_count;
+    ssize_t offset;
+};
+
+struct SC_pwritev_params {
+    int fd;
+    const struct iovec* iov;
+    int iov_count;
+    ssize_t offset;
+};
+
+struct SC_epoll_ctl_params {
+    int epfd;
+    int op;
+    int fd;
+    struct epoll_event* event;
+};
+
+struct SC_epoll_wait_params {
+    int epfd;
+    struct epoll_event* events;
+    int max_events;
+    int timeout;
+};
+
 void initialize();
 int sync();
 
+#ifdef KERNEL
+struct BigLockStatistics {
+    u32 call_count { 0 };
+    u32 locked_call_count { 0 };
+    u64 cycles_held { 0 };
+};
+
+bool needs_big_process_lock(Function);
+BigLockStatistics big_lock_statistics(Function);
+#endif
+
 inline uintptr_t invoke(Function function)
 {
     uintptr_t result;
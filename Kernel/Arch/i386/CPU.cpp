@@ -929,6 +929,12 @@ u32 read_cr4()
     return cr4;
 }
 
+void write_cr4(u32 cr4)
+{
+    asm volatile("movl %%eax, %%cr4" ::"a"(cr4)
+                 : "memory");
+}
+
 u32 read_dr6()
 {
     u32 dr6;
@@ -943,6 +949,8 @@ static Vector<Processor*>* s_processors;
 static SpinLock s_processor_lock;
 volatile u32 Processor::g_total_processors;
 static volatile bool s_smp_enabled;
+static Atomic<u32> s_processors_without_active_page_directory;
+static Atomic<u32> s_tlb_shootdown_count;
 
 Vector<Processor*>& Processor::processors()
 {
@@ -1201,8 +1209,11 @@ void Processor::early_initialize(u32 cpu)
     m_message_queue = nullptr;
     m_idle_thread = nullptr;
     m_current_thread = nullptr;
+    m_active_page_directory = nullptr;
     m_scheduler_data = nullptr;
+    m_ready_queue = nullptr;
     m_mm_data = nullptr;
+    m_slab_data = nullptr;
     m_info = nullptr;
 
     m_halt_requested = false;
@@ -1213,6 +1224,10 @@ void Processor::early_initialize(u32 cpu)
         atomic_fetch_add(&g_total_processors, 1u, AK::MemoryOrder::memory_order_acq_rel);
     }
 
+    // Processors are tracked in 32-bit masks for TLB shootdowns.
+    ASSERT(cpu < 32);
+    s_processors_without_active_page_directory.fetch_or(1u << cpu);
+
     deferred_call_pool_init();
 
     cpu_setup();
@@ -1243,6 +1258,7 @@ void Processor::initialize(u32 cpu)
     }
 
     m_info = new ProcessorInfo(*this);
+    m_ready_queue = new ThreadReadyQueue;
 
     {
         ScopedSpinLock lock(s_processor_lock);
@@ -1438,8 +1454,11 @@ extern "C" void enter_thread_context(Thread* from_thread, Thread* to_thread)
     tls_descriptor.set_base(to_thread->thread_specific_data().as_ptr());
     tls_descriptor.set_limit(to_thread->thread_specific_region_size());
 
-    if (from_tss.cr3 != to_tss.cr3)
-        write_cr3(to_tss.cr3);
+    if (from_tss.cr3 != to_tss.cr3) {
+        // A thread inside a ProcessPagingScope runs on another process's page tables.
+        auto& page_directory = to_thread->process().page_directory();
+        processor.load_page_directory(to_tss.cr3, page_directory.cr3() == to_tss.cr3 ? &page_directory : nullptr);
+    }
 
     to_thread->set_cpu(processor.id());
 
@@ -1777,8 +1796,27 @@ void Processor::check_invoke_scheduler()
     }
 }
 
+void Processor::flush_global_tlb_local()
+{
+    // Toggling CR4.PGE also drops the global (kernel) entries, which a cr3 reload keeps.
+    auto cr4 = read_cr4();
+    if (!(cr4 & 0x80)) {
+        flush_entire_tlb_local();
+        return;
+    }
+    write_cr4(cr4 & ~0x80);
+    write_cr4(cr4);
+}
+
 void Processor::flush_tlb_local(VirtualAddress vaddr, size_t page_count)
 {
+    if (page_count > flush_entire_tlb_threshold) {
+        if (is_user_range(vaddr, page_count * PAGE_SIZE))
+            flush_entire_tlb_local();
+        else
+            flush_global_tlb_local();
+        return;
+    }
     auto ptr = vaddr.as_ptr();
     while (page_count > 0) {
         asm volatile("invlpg %0"
@@ -1792,10 +1830,51 @@ void Processor::flush_tlb_local(VirtualAddress vaddr, size_t page_count)
 
 void Processor::flush_tlb(const PageDirectory* page_directory, VirtualAddress vaddr, size_t page_count)
 {
-    if (s_smp_enabled)
-        smp_broadcast_flush_tlb(page_directory, vaddr, page_count);
-    else
-        flush_tlb_local(vaddr, page_count);
+    ScopedCritical critical;
+    TLBFlushRange range { vaddr, page_count };
+    auto* msg = s_smp_enabled ? smp_send_flush_tlb(page_directory, &range, 1) : nullptr;
+    // While the other processors handle this request, we'll flush ours
+    flush_tlb_local(vaddr, page_count);
+    // Now wait until everybody is done as well
+    if (msg)
+        smp_broadcast_wait_sync(*msg);
+}
+
+bool Processor::may_cache_page_directory(const PageDirectory& page_directory)
+{
+    // Same ordering concern as in smp_send_flush_tlb().
+    asm volatile("mfence" ::: "memory");
+    return (page_directory.active_processors() | s_processors_without_active_page_directory.load()) != 0;
+}
+
+u32 Processor::tlb_shootdown_count()
+{
+    return s_tlb_shootdown_count.load(AK::MemoryOrder::memory_order_relaxed);
+}
+
+void Processor::flush_tlb_remote(const PageDirectory* page_directory, const TLBFlushRange* ranges, size_t range_count)
+{
+    if (!s_smp_enabled || range_count == 0)
+        return;
+    ScopedCritical critical;
+    if (auto* msg = smp_send_flush_tlb(page_directory, ranges, range_count))
+        smp_broadcast_wait_sync(*msg);
+}
+
+void Processor::load_page_directory(u32 cr3, PageDirectory* page_directory)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    auto active_processors = [](PageDirectory* page_directory) -> Atomic<u32>& {
+        return page_directory ? page_directory->m_active_processors : s_processors_without_active_page_directory;
+    };
+    u32 cpu_bit = 1u << m_cpu;
+    // Announce ourselves before loading cr3 and withdraw only after we switched away,
+    // so that a shootdown never misses a processor that may still use the old entries.
+    active_processors(page_directory).fetch_or(cpu_bit);
+    write_cr3(cr3);
+    if (m_active_page_directory != page_directory)
+        active_processors(m_active_page_directory).fetch_and(~cpu_bit);
+    m_active_page_directory = page_directory;
 }
 
 static volatile ProcessorMessage* s_message_pool;
@@ -1910,21 +1989,21 @@ bool Processor::smp_process_pending_messages()
             case ProcessorMessage::CallbackWithData:
                 msg->callback_with_data.handler(msg->callback_with_data.data);
                 break;
-            case ProcessorMessage::FlushTlb:
-				if (is_user_address(VirtualAddress(msg->flush_tlb.ptr))) {
-					// We assume that we don't cross into kernel land!
-					ASSERT(is_user_range(VirtualAddress(msg->flush_tlb.ptr), msg->flush_tlb.page_count * PAGE_SIZE));
-					if (read_cr3() != msg->flush_tlb.page_directory->cr3()) {
-						//This processor isn't using this page directory right now, we can ignore this request
+            case ProcessorMessage::FlushTlb: {
+                auto& ranges = msg->flush_tlb;
+                // User ranges only need flushing if we're using this page directory right now.
+                // We assume that user ranges don't cross into kernel land!
+                if (ranges.page_directory && is_user_address(ranges.ranges[0].vaddr) && read_cr3() != ranges.page_directory->cr3()) {
 #ifdef SMP_DEBUG
-						dbg() << "SMP[" << id() << "]: No need to flush " << msg->flush_tlb.page_count << " pages at " << VirtualAddress(msg->flush_tlb.ptr);
+                    dbg() << "SMP[" << id() << "]: No need to flush " << ranges.range_count << " ranges at " << ranges.ranges[0].vaddr;
 #endif
-						break;
-					}
-				}
-                flush_tlb_local(VirtualAddress(msg->flush_tlb.ptr), msg->flush_tlb.page_count);
+                    break;
+                }
+                for (size_t i = 0; i < ranges.range_count; ++i)
+                    flush_tlb_local(ranges.ranges[i].vaddr, ranges.ranges[i].page_count);
                 break;
             }
+            }
 
             bool is_async = msg->async; // Need to cache this value *before* dropping the ref count!
             auto prev_refs = atomic_fetch_sub(&msg->refs, 1u, AK::MemoryOrder::memory_order_acq_rel);
@@ -1987,6 +2066,25 @@ void Processor::smp_broadcast_message(ProcessorMessage& msg)
         APIC::the().broadcast_ipi();
 }
 
+void Processor::smp_multicast_message(u32 cpu_mask, ProcessorMessage& msg)
+{
+    auto& cur_proc = Processor::current();
+    ASSERT(!(cpu_mask & (1u << cur_proc.id())));
+#ifdef SMP_DEBUG
+    dbg() << "SMP[" << cur_proc.id() << "]: Multicast message " << VirtualAddress(&msg) << " to cpu mask " << String::format("%08x", cpu_mask);
+#endif
+    atomic_store(&msg.refs, (u32)__builtin_popcount(cpu_mask), AK::MemoryOrder::memory_order_release);
+    ASSERT(msg.refs > 0);
+    for_each(
+        [&](Processor& proc) -> IterationDecision {
+            if (cpu_mask & (1u << proc.id())) {
+                if (proc.smp_queue_message(msg))
+                    APIC::the().send_ipi(proc.id());
+            }
+            return IterationDecision::Continue;
+        });
+}
+
 void Processor::smp_broadcast_wait_sync(ProcessorMessage& msg)
 {
     auto& cur_proc = Processor::current();
@@ -2079,19 +2177,32 @@ void Processor::smp_unicast(u32 cpu, void (*callback)(), bool async)
     smp_unicast_message(cpu, msg, async);
 }
 
-void Processor::smp_broadcast_flush_tlb(const PageDirectory* page_directory, VirtualAddress vaddr, size_t page_count)
-{
+ProcessorMessage* Processor::smp_send_flush_tlb(const PageDirectory* page_directory, const TLBFlushRange* ranges, size_t range_count)
+{
+    ASSERT(range_count > 0);
+    ASSERT(Processor::current().in_critical());
+    // Kernel mappings are shared by everyone, but user mappings can only be cached
+    // by processors that have the page directory loaded (or that we lost track of).
+    u32 all_processors = count() == 32 ? 0xffffffff : (1u << count()) - 1;
+    u32 target_processors = all_processors;
+    // The page table updates are plain stores, which x86 may let pass the load of the mask below.
+    // A processor that announces itself in load_page_directory() after that load must see them.
+    asm volatile("mfence" ::: "memory");
+    if (page_directory && is_user_address(ranges[0].vaddr))
+        target_processors = page_directory->active_processors() | s_processors_without_active_page_directory.load();
+    target_processors &= ~(1u << Processor::current().id());
+    if (!target_processors)
+        return nullptr;
+    s_tlb_shootdown_count.fetch_add(1, AK::MemoryOrder::memory_order_relaxed);
+
     auto& msg = smp_get_from_pool();
     msg.async = false;
     msg.type = ProcessorMessage::FlushTlb;
     msg.flush_tlb.page_directory = page_directory;
-    msg.flush_tlb.ptr = vaddr.as_ptr();
-    msg.flush_tlb.page_count = page_count;
-    smp_broadcast_message(msg);
-    // While the other processors handle this request, we'll flush ours
-    flush_tlb_local(vaddr, page_count);
-    // Now wait until everybody is done as well
-    smp_broadcast_wait_sync(msg);
+    msg.flush_tlb.ranges = ranges;
+    msg.flush_tlb.range_count = range_count;
+    smp_multicast_message(target_processors, msg);
+    return &msg;
 }
 
 void Processor::smp_broadcast_halt()
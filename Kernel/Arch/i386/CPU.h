@@ -36,6 +36,8 @@
 #define PAGE_SIZE 4096
 #define GENERIC_INTERRUPT_HANDLERS_COUNT (256 - IRQ_VECTOR_BASE)
 #define PAGE_MASK ((FlatPtr)0xfffff000u)
+// A PAE page directory entry with the Huge bit set maps this much directly.
+#define LARGE_PAGE_SIZE 0x200000
 
 namespace Kernel {
 
@@ -527,6 +529,7 @@ u32 read_cr0();
 u32 read_cr3();
 void write_cr3(u32);
 u32 read_cr4();
+void write_cr4(u32);
 
 u32 read_dr6();
 
@@ -644,8 +647,15 @@ static_assert(GDT_SELECTOR_CODE0 + 24 == GDT_SELECTOR_DATA3); // SS3 = CS0 + 32
 
 class ProcessorInfo;
 class SchedulerPerProcessorData;
+class ThreadReadyQueue;
 struct MemoryManagerData;
 struct ProcessorMessageEntry;
+struct SlabPerProcessorData;
+
+struct TLBFlushRange {
+    VirtualAddress vaddr;
+    size_t page_count;
+};
 
 struct ProcessorMessage {
     enum Type {
@@ -667,8 +677,8 @@ struct ProcessorMessage {
         } callback_with_data;
         struct {
             const PageDirectory* page_directory;
-            u8* ptr;
-            size_t page_count;
+            const TLBFlushRange* ranges;
+            size_t range_count;
         } flush_tlb;
     };
 
@@ -722,9 +732,12 @@ class Processor {
 
     ProcessorInfo* m_info;
     MemoryManagerData* m_mm_data;
+    SlabPerProcessorData* m_slab_data;
     SchedulerPerProcessorData* m_scheduler_data;
+    ThreadReadyQueue* m_ready_queue;
     Thread* m_current_thread;
     Thread* m_idle_thread;
+    PageDirectory* m_active_page_directory; // null if we don't know which one is loaded
 
     volatile ProcessorMessageEntry* m_message_queue; // atomic, LIFO
 
@@ -747,6 +760,7 @@ class Processor {
     bool smp_queue_message(ProcessorMessage& msg);
     static void smp_unicast_message(u32 cpu, ProcessorMessage& msg, bool async);
     static void smp_broadcast_message(ProcessorMessage& msg);
+    static void smp_multicast_message(u32 cpu_mask, ProcessorMessage& msg);
     static void smp_broadcast_wait_sync(ProcessorMessage& msg);
     static void smp_broadcast_halt();
 
@@ -786,9 +800,22 @@ public:
     {
         write_cr3(read_cr3());
     }
+    static void flush_global_tlb_local();
+
+    // Past this many pages, flushing the whole TLB is cheaper than invalidating them one by one.
+    static constexpr size_t flush_entire_tlb_threshold = 32;
 
     static void flush_tlb_local(VirtualAddress vaddr, size_t page_count);
     static void flush_tlb(const PageDirectory*, VirtualAddress, size_t);
+    static void flush_tlb_remote(const PageDirectory*, const TLBFlushRange*, size_t range_count);
+    // Whether any processor may have user entries of this page directory in its TLB.
+    static bool may_cache_page_directory(const PageDirectory&);
+    static u32 tlb_shootdown_count();
+
+    // Loads cr3 and remembers which page directory it belongs to, so that TLB
+    // shootdowns only interrupt processors that may have its entries cached.
+    void load_page_directory(u32 cr3, PageDirectory*);
+    PageDirectory* active_page_directory() { return m_active_page_directory; }
 
     Descriptor& get_gdt_entry(u16 selector);
     void flush_gdt();
@@ -834,6 +861,11 @@ public:
         return *m_scheduler_data;
     }
 
+    ALWAYS_INLINE ThreadReadyQueue& ready_queue() const
+    {
+        return *m_ready_queue;
+    }
+
     ALWAYS_INLINE void set_mm_data(MemoryManagerData& mm_data)
     {
         m_mm_data = &mm_data;
@@ -844,6 +876,16 @@ public:
         return *m_mm_data;
     }
 
+    ALWAYS_INLINE void set_slab_data(SlabPerProcessorData& slab_data)
+    {
+        m_slab_data = &slab_data;
+    }
+
+    ALWAYS_INLINE SlabPerProcessorData* get_slab_data() const
+    {
+        return m_slab_data;
+    }
+
     ALWAYS_INLINE Thread* idle_thread() const
     {
         return m_idle_thread;
@@ -992,7 +1034,7 @@ public:
     }
     static void smp_unicast(u32 cpu, void (*callback)(), bool async);
     static void smp_unicast(u32 cpu, void (*callback)(void*), void* data, void (*free_data)(void*), bool async);
-    static void smp_broadcast_flush_tlb(const PageDirectory*, VirtualAddress, size_t);
+    static ProcessorMessage* smp_send_flush_tlb(const PageDirectory*, const TLBFlushRange*, size_t range_count);
 
     template<typename Callback>
     static void deferred_call_queue(Callback callback)
@@ -25,8 +25,11 @@
  */
 
 #include <AK/IntrusiveList.h>
+#include <AK/QuickSort.h>
 #include <Kernel/FileSystem/BlockBasedFileSystem.h>
 #include <Kernel/Process.h>
+#include <Kernel/Tasks/SyncTask.h>
+#include <Kernel/Time/TimeManagement.h>
 
 //#define BBFS_DEBUG
 
@@ -37,6 +40,8 @@ struct CacheEntry {
     u32 block_index { 0 };
     u8* data { nullptr };
     bool has_data { false };
+    bool is_dirty { false };
+    u64 dirtied_at_ms { 0 };
 };
 
 class DiskCache {
@@ -57,22 +62,49 @@ public:
     bool is_dirty() const { return m_dirty; }
     void set_dirty(bool b) { m_dirty = b; }
 
+    size_t entry_count() const { return m_entry_count; }
+    size_t dirty_count() const { return m_dirty_count; }
+
     void mark_all_clean()
     {
-        while (auto* entry = m_dirty_list.first())
+        while (auto* entry = m_dirty_list.first()) {
+            entry->is_dirty = false;
             m_clean_list.prepend(*entry);
+        }
+        m_dirty_count = 0;
         m_dirty = false;
     }
 
     void mark_dirty(CacheEntry& entry)
     {
+        if (!entry.is_dirty) {
+            entry.is_dirty = true;
+            entry.dirtied_at_ms = TimeManagement::the().uptime_ms();
+            ++m_dirty_count;
+        }
         m_dirty_list.prepend(entry);
         m_dirty = true;
     }
 
     void mark_clean(CacheEntry& entry)
     {
+        if (entry.is_dirty) {
+            entry.is_dirty = false;
+            --m_dirty_count;
+        }
         m_clean_list.prepend(entry);
+        if (!m_dirty_count)
+            m_dirty = false;
+    }
+
+    CacheEntry* find(u32 block_index) const
+    {
+        auto it = m_hash.find(block_index);
+        if (it == m_hash.end())
+            return nullptr;
+        auto& entry = const_cast<CacheEntry&>(*it->value);
+        ASSERT(entry.block_index == block_index);
+        return &entry;
     }
 
     CacheEntry& get(u32 block_index) const
@@ -129,6 +161,7 @@ private:
     mutable IntrusiveList<CacheEntry, &CacheEntry::list_node> m_dirty_list;
     KBuffer m_cached_block_data;
     KBuffer m_entries;
+    size_t m_dirty_count { 0 };
     bool m_dirty { false };
 };
 
@@ -214,14 +247,55 @@ bool BlockBasedFS::raw_write_blocks(unsigned index, size_t count, const UserOrKe
     return true;
 }
 
+size_t BlockBasedFS::max_blocks_per_request() const
+{
+    // Storage devices read and write at most one page per request (the IDE channel's
+    // DMA uses a single one-page PRD entry), so runs of adjacent blocks are split there.
+    return max<size_t>(1, PAGE_SIZE / block_size());
+}
+
 int BlockBasedFS::write_blocks(unsigned index, unsigned count, const UserOrKernelBuffer& data, bool allow_cache)
 {
     ASSERT(m_logical_block_size);
 #ifdef BBFS_DEBUG
     klog() << "BlockBasedFileSystem::write_blocks " << index << " x" << count;
 #endif
-    for (unsigned i = 0; i < count; ++i)
-        write_block(index + i, data.offset(i * block_size()), block_size(), 0, allow_cache);
+    if (allow_cache) {
+        for (unsigned i = 0; i < count; ++i) {
+            int err = write_block(index + i, data.offset(i * block_size()), block_size(), 0, true);
+            if (err < 0)
+                return err;
+        }
+        return 0;
+    }
+
+    // Write runs of blocks that aren't in the cache with as few device requests as possible,
+    // and keep blocks that are cached up to date through the cache.
+    unsigned i = 0;
+    while (i < count) {
+        auto in = data.offset(i * block_size());
+        if (auto* entry = cache().find(index + i); entry && entry->has_data) {
+            int err = write_block(index + i, in, block_size(), 0, true);
+            if (err < 0)
+                return err;
+            ++i;
+            continue;
+        }
+        unsigned run_length = 1;
+        while (i + run_length < count && run_length < max_blocks_per_request()) {
+            auto* entry = cache().find(index + i + run_length);
+            if (entry && entry->has_data)
+                break;
+            ++run_length;
+        }
+        u32 base_offset = static_cast<u32>(index + i) * static_cast<u32>(block_size());
+        file_description().seek(base_offset, SEEK_SET);
+        auto nwritten = file_description().write(in, run_length * block_size());
+        if (nwritten.is_error())
+            return -EIO;
+        ASSERT(nwritten.value() == run_length * block_size());
+        i += run_length;
+    }
     return 0;
 }
 
@@ -234,7 +308,12 @@ int BlockBasedFS::read_block(unsigned index, UserOrKernelBuffer* buffer, size_t
 #endif
 
     if (!allow_cache) {
-        const_cast<BlockBasedFS*>(this)->flush_specific_block_if_needed(index);
+        // Bypass the cache, but don't miss (possibly dirty) data that is already in it.
+        if (auto* entry = cache().find(index); entry && entry->has_data) {
+            if (buffer && !buffer->write(entry->data + offset, count))
+                return -EFAULT;
+            return 0;
+        }
         u32 base_offset = static_cast<u32>(index) * static_cast<u32>(block_size()) + static_cast<u32>(offset);
         file_description().seek(base_offset, SEEK_SET);
         auto nread = file_description().read(*buffer, count);
@@ -267,6 +346,36 @@ int BlockBasedFS::read_blocks(unsigned index, unsigned count, UserOrKernelBuffer
         return false;
     if (count == 1)
         return read_block(index, &buffer, block_size(), 0, allow_cache);
+
+    if (!allow_cache) {
+        // Read runs of blocks that aren't in the cache with as few device requests as possible.
+        unsigned i = 0;
+        while (i < count) {
+            auto out = buffer.offset(i * block_size());
+            if (auto* entry = cache().find(index + i); entry && entry->has_data) {
+                if (!out.write(entry->data, block_size()))
+                    return -EFAULT;
+                ++i;
+                continue;
+            }
+            unsigned run_length = 1;
+            while (i + run_length < count && run_length < max_blocks_per_request()) {
+                auto* entry = cache().find(index + i + run_length);
+                if (entry && entry->has_data)
+                    break;
+                ++run_length;
+            }
+            u32 base_offset = static_cast<u32>(index + i) * static_cast<u32>(block_size());
+            file_description().seek(base_offset, SEEK_SET);
+            auto nread = file_description().read(out, run_length * block_size());
+            if (nread.is_error())
+                return -EIO;
+            ASSERT(nread.value() == run_length * block_size());
+            i += run_length;
+        }
+        return 0;
+    }
+
     auto out = buffer;
     for (unsigned i = 0; i < count; ++i) {
         auto err = read_block(index + i, &out, block_size(), 0, allow_cache);
@@ -300,22 +409,51 @@ void BlockBasedFS::flush_specific_block_if_needed(unsigned index)
         cache().mark_clean(*entry);
 }
 
+void BlockBasedFS::flush_dirty_entries(Vector<CacheEntry*>& entries)
+{
+    // Write in block order, and write runs of adjacent blocks with a single request.
+    quick_sort(entries, [](auto* a, auto* b) { return a->block_index < b->block_index; });
+
+    u8 run_buffer[PAGE_SIZE];
+    for (size_t i = 0; i < entries.size();) {
+        size_t run_length = 1;
+        while (i + run_length < entries.size() && run_length < max_blocks_per_request()
+            && entries[i + run_length]->block_index == entries[i]->block_index + run_length)
+            ++run_length;
+
+        u32 base_offset = static_cast<u32>(entries[i]->block_index) * static_cast<u32>(block_size());
+        file_description().seek(base_offset, SEEK_SET);
+        // FIXME: Should this error path be surfaced somehow?
+        if (run_length == 1) {
+            auto entry_data_buffer = UserOrKernelBuffer::for_kernel_buffer(entries[i]->data);
+            [[maybe_unused]] auto rc = file_description().write(entry_data_buffer, block_size());
+        } else {
+            for (size_t j = 0; j < run_length; ++j)
+                memcpy(run_buffer + j * block_size(), entries[i + j]->data, block_size());
+            auto run_data_buffer = UserOrKernelBuffer::for_kernel_buffer(run_buffer);
+            [[maybe_unused]] auto rc = file_description().write(run_data_buffer, run_length * block_size());
+        }
+        i += run_length;
+    }
+
+    // NOTE: We make a separate pass to mark entries clean since marking them clean
+    //       moves them out of the dirty list which we may have been iterating.
+    for (auto* entry : entries)
+        cache().mark_clean(*entry);
+    m_write_back_wait_queue.wake_all();
+}
+
 void BlockBasedFS::flush_writes_impl()
 {
     LOCKER(m_lock);
     if (!cache().is_dirty())
         return;
-    u32 count = 0;
+    Vector<CacheEntry*> entries;
     cache().for_each_dirty_entry([&](CacheEntry& entry) {
-        u32 base_offset = static_cast<u32>(entry.block_index) * static_cast<u32>(block_size());
-        file_description().seek(base_offset, SEEK_SET);
-        // FIXME: Should this error path be surfaced somehow?
-        auto entry_data_buffer = UserOrKernelBuffer::for_kernel_buffer(entry.data);
-        [[maybe_unused]] auto rc = file_description().write(entry_data_buffer, block_size());
-        ++count;
+        entries.append(&entry);
     });
-    cache().mark_all_clean();
-    dbg() << class_name() << ": Flushed " << count << " blocks to disk";
+    flush_dirty_entries(entries);
+    dbg() << class_name() << ": Flushed " << entries.size() << " blocks to disk";
 }
 
 void BlockBasedFS::flush_writes()
@@ -323,6 +461,49 @@ void BlockBasedFS::flush_writes()
     flush_writes_impl();
 }
 
+void BlockBasedFS::write_back()
+{
+    LOCKER(m_lock);
+    if (!cache().is_dirty())
+        return;
+
+    // Above the background threshold we write everything back, otherwise only
+    // blocks that have been dirty for a while, so blocks that are rewritten
+    // frequently don't go to the disk on every pass.
+    bool over_background_threshold = cache().dirty_count() * 100 >= cache().entry_count() * dirty_background_percent;
+    u64 now = TimeManagement::the().uptime_ms();
+    Vector<CacheEntry*> entries;
+    cache().for_each_dirty_entry([&](CacheEntry& entry) {
+        if (over_background_threshold || now - entry.dirtied_at_ms >= dirty_expire_ms)
+            entries.append(&entry);
+    });
+    if (entries.is_empty())
+        return;
+    flush_dirty_entries(entries);
+#ifdef BBFS_DEBUG
+    dbg() << class_name() << ": Wrote back " << entries.size() << " blocks";
+#endif
+}
+
+bool BlockBasedFS::is_over_dirty_threshold(size_t percent) const
+{
+    return cache().dirty_count() * 100 >= cache().entry_count() * percent;
+}
+
+void BlockBasedFS::throttle_writer()
+{
+    // Writers that outpace the disk wait here, without holding any locks,
+    // until the write-back task has caught up.
+    if (!is_over_dirty_threshold(dirty_background_percent))
+        return;
+    SyncTask::wake_write_back();
+    while (is_over_dirty_threshold(dirty_throttle_percent)) {
+        Thread::BlockTimeout timeout(false, &write_throttle_interval);
+        if (m_write_back_wait_queue.wait_on(timeout, "WriteThrottle").was_interrupted())
+            return;
+    }
+}
+
 DiskCache& BlockBasedFS::cache() const
 {
     if (!m_cache)
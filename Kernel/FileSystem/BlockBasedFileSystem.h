@@ -27,9 +27,12 @@
 #pragma once
 
 #include <Kernel/FileSystem/FileBackedFileSystem.h>
+#include <Kernel/WaitQueue.h>
 
 namespace Kernel {
 
+struct CacheEntry;
+
 class BlockBasedFS : public FileBackedFS {
 public:
     virtual ~BlockBasedFS() override;
@@ -39,6 +42,11 @@ public:
     virtual void flush_writes() override;
     void flush_writes_impl();
 
+    // Writes back blocks that have been dirty for longer than dirty_expire_ms,
+    // or all of them once more than dirty_background_percent of the cache is dirty.
+    virtual void write_back() override;
+    void throttle_writer();
+
 protected:
     explicit BlockBasedFS(FileDescription&);
 
@@ -57,8 +65,19 @@ protected:
     size_t m_logical_block_size { 512 };
 
 private:
+    static constexpr u64 dirty_expire_ms = 1000;
+    static constexpr size_t dirty_background_percent = 10;
+    static constexpr size_t dirty_throttle_percent = 40;
+    static constexpr timespec write_throttle_interval { 0, 50'000'000 };
+
+    size_t max_blocks_per_request() const;
+
     DiskCache& cache() const;
     void flush_specific_block_if_needed(unsigned index);
+    void flush_dirty_entries(Vector<CacheEntry*>&);
+    bool is_over_dirty_threshold(size_t percent) const;
+
+    WaitQueue m_write_back_wait_queue;
 
     mutable OwnPtr<DiskCache> m_cache;
 };
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Kernel/FileSystem/EventQueue.h>
+#include <Kernel/FileSystem/FileDescription.h>
+#include <Kernel/Net/Socket.h>
+
+namespace Kernel {
+
+NonnullRefPtr<EventQueue> EventQueue::create()
+{
+    return adopt(*new EventQueue);
+}
+
+EventQueue::EventQueue()
+{
+}
+
+EventQueue::~EventQueue()
+{
+}
+
+// Guards the per-description watch lists and the watches' file registrations,
+// which both the queue and a dying description can tear down.
+static SpinLock<u8> s_description_watches_lock;
+
+EventQueue::Watch::Watch(EventQueue& queue, int fd, FileDescription& description, const epoll_event& event)
+    : queue(queue)
+    , fd(fd)
+    , description(description.make_weak_ptr())
+    , file(description.file())
+    , event(event)
+{
+    // We don't use set_block_condition(), the Watch has to be gone from the
+    // block condition before it takes itself off the ready list in ~Watch().
+    // unblock() never asks to be removed, so this always succeeds.
+    ScopedSpinLock lock(s_description_watches_lock);
+    bool did_add = file->block_condition().add_blocker(*this, nullptr);
+    ASSERT(did_add);
+    description.event_queue_watches({}).append(*this);
+}
+
+EventQueue::Watch::~Watch()
+{
+    {
+        ScopedSpinLock lock(s_description_watches_lock);
+        if (description_list_node.is_in_list()) {
+            description_list_node.remove();
+            file->block_condition().remove_blocker(*this, nullptr);
+        }
+    }
+    ScopedSpinLock lock(queue.m_ready_lock);
+    if (ready_list_node.is_in_list())
+        queue.m_ready_list.remove(*this);
+}
+
+void EventQueue::detach_watches(WatchList& watches)
+{
+    ScopedSpinLock lock(s_description_watches_lock);
+    while (auto* watch = watches.take_first()) {
+        watch->file->block_condition().remove_blocker(*watch, nullptr);
+        watch->file = nullptr;
+        // The queue drops the watch once it sees that the description is gone.
+        watch->queue.mark_ready(*watch);
+    }
+}
+
+bool EventQueue::Watch::unblock(bool, void*)
+{
+    // Called with the watched file's block condition locked, so only queue
+    // ourselves here. Whether the description is really ready is checked later,
+    // when someone waits on the queue.
+    queue.mark_ready(*this);
+    return false;
+}
+
+bool EventQueue::append_to_ready_list(Watch& watch)
+{
+    ScopedSpinLock lock(m_ready_lock);
+    if (watch.ready_list_node.is_in_list())
+        return false;
+    m_ready_list.append(watch);
+    return true;
+}
+
+void EventQueue::mark_ready(Watch& watch)
+{
+    // Waiters were already woken when the watch went on the ready list.
+    if (append_to_ready_list(watch))
+        evaluate_block_conditions();
+}
+
+KResult EventQueue::add(int fd, FileDescription& description, const epoll_event& event)
+{
+    // Nested queues could wake each other up in a loop, so don't allow them.
+    if (description.file().is_event_queue())
+        return KResult(-EINVAL);
+
+    LOCKER(m_lock);
+    auto it = m_watches.find(fd);
+    if (it != m_watches.end()) {
+        if (it->value->description.unsafe_ptr() == &description)
+            return KResult(-EEXIST);
+        // The fd was closed and reused since it was added, drop the stale watch.
+        m_watches.remove(it);
+    }
+    m_watches.set(fd, make<Watch>(*this, fd, description, event));
+    return KSuccess;
+}
+
+KResult EventQueue::modify(int fd, const epoll_event& event)
+{
+    LOCKER(m_lock);
+    auto it = m_watches.find(fd);
+    if (it == m_watches.end() || it->value->description.is_null())
+        return KResult(-ENOENT);
+    auto& watch = *it->value;
+    watch.event = event;
+    // The new event mask may already be satisfied.
+    mark_ready(watch);
+    return KSuccess;
+}
+
+KResult EventQueue::remove(int fd)
+{
+    LOCKER(m_lock);
+    auto it = m_watches.find(fd);
+    if (it == m_watches.end())
+        return KResult(-ENOENT);
+    m_watches.remove(it);
+    return KSuccess;
+}
+
+static u32 hang_up_and_error_events(FileDescription& description)
+{
+    if (auto* fifo = description.fifo()) {
+        if (description.fifo_direction() == FIFO::Direction::Reader && !fifo->has_writers())
+            return EPOLLHUP;
+        if (description.fifo_direction() == FIFO::Direction::Writer && !fifo->has_readers())
+            return EPOLLERR;
+        return 0;
+    }
+    if (auto* socket = description.socket()) {
+        if (socket->has_hung_up(description))
+            return EPOLLHUP;
+    }
+    return 0;
+}
+
+size_t EventQueue::collect_ready_events(epoll_event* events, size_t max_events)
+{
+    LOCKER(m_lock);
+
+    Vector<Watch*, 32> candidates;
+    {
+        ScopedSpinLock lock(m_ready_lock);
+        while (!m_ready_list.is_empty())
+            candidates.append(m_ready_list.take_first());
+    }
+
+    size_t count = 0;
+    for (auto* watch : candidates) {
+        if (count == max_events) {
+            append_to_ready_list(*watch);
+            continue;
+        }
+
+        auto description = watch->description.strong_ref();
+        if (!description) {
+            // All references to the description are gone, so there is nothing left to watch.
+            m_watches.remove(watch->fd);
+            continue;
+        }
+
+        u32 block_flags = (u32)Thread::FileBlocker::BlockFlags::None;
+        if (watch->event.events & EPOLLIN)
+            block_flags |= (u32)Thread::FileBlocker::BlockFlags::Read;
+        if (watch->event.events & EPOLLOUT)
+            block_flags |= (u32)Thread::FileBlocker::BlockFlags::Write;
+        auto unblock_flags = (u32)description->should_unblock((Thread::FileBlocker::BlockFlags)block_flags);
+
+        u32 revents = 0;
+        if (unblock_flags & (u32)Thread::FileBlocker::BlockFlags::Read)
+            revents |= EPOLLIN;
+        if (unblock_flags & (u32)Thread::FileBlocker::BlockFlags::Write)
+            revents |= EPOLLOUT;
+        // Hang-ups and errors are always reported, whether they were asked for or not.
+        revents |= hang_up_and_error_events(*description);
+        // Not ready (anymore), the next notification from the file puts it back on the list.
+        if (!revents)
+            continue;
+
+        events[count++] = { revents, watch->event.data };
+
+        // Edge-triggered watches are reported once per notification, level-triggered
+        // ones stay on the ready list for as long as they remain ready.
+        if (!(watch->event.events & EPOLLET))
+            append_to_ready_list(*watch);
+    }
+    return count;
+}
+
+bool EventQueue::can_read(const FileDescription&, size_t) const
+{
+    ScopedSpinLock lock(m_ready_lock);
+    return !m_ready_list.is_empty();
+}
+
+}
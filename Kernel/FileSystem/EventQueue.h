@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/HashMap.h>
+#include <AK/IntrusiveList.h>
+#include <AK/NonnullOwnPtr.h>
+#include <AK/WeakPtr.h>
+#include <Kernel/FileSystem/File.h>
+#include <Kernel/Lock.h>
+#include <Kernel/SpinLock.h>
+#include <Kernel/UnixTypes.h>
+
+namespace Kernel {
+
+// An EventQueue is the kernel side of epoll(). Each watched file description gets
+// a Watch, which stays registered with the description's FileBlockCondition for
+// as long as it exists. Whenever that file evaluates its block conditions, the
+// Watch puts itself on the ready list. So a wait only looks at the descriptions
+// that changed, instead of rescanning every registered fd the way select() does.
+//
+// The queue itself becomes readable when the ready list is non-empty. That lets
+// epoll_wait() block with a regular ReadBlocker, and the queue can be polled too.
+class EventQueue final : public File {
+public:
+    static NonnullRefPtr<EventQueue> create();
+    virtual ~EventQueue() override;
+
+    static constexpr size_t max_events_per_wait = 256;
+
+    KResult add(int fd, FileDescription&, const epoll_event&);
+    KResult modify(int fd, const epoll_event&);
+    KResult remove(int fd);
+
+    // Fills in events for watched descriptions that are ready right now, without blocking.
+    size_t collect_ready_events(epoll_event* events, size_t max_events);
+
+    virtual bool can_read(const FileDescription&, size_t) const override;
+    virtual bool can_write(const FileDescription&, size_t) const override { return false; }
+    virtual KResultOr<size_t> read(FileDescription&, size_t, UserOrKernelBuffer&, size_t) override { return KResult(-EINVAL); }
+    virtual KResultOr<size_t> write(FileDescription&, size_t, const UserOrKernelBuffer&, size_t) override { return KResult(-EINVAL); }
+    virtual String absolute_path(const FileDescription&) const override { return "EventQueue"; }
+    virtual const char* class_name() const override { return "EventQueue"; }
+    virtual bool is_event_queue() const override { return true; }
+
+    class Watch final : public Thread::FileBlocker {
+    public:
+        Watch(EventQueue&, int fd, FileDescription&, const epoll_event&);
+        virtual ~Watch() override;
+
+        virtual const char* state_string() const override { return "Watching"; }
+        virtual bool unblock(bool, void*) override;
+        virtual void not_blocking(bool) override { }
+
+        EventQueue& queue;
+        const int fd;
+        WeakPtr<FileDescription> description;
+        RefPtr<File> file;
+        epoll_event event;
+        IntrusiveListNode ready_list_node;
+        IntrusiveListNode description_list_node;
+    };
+
+    using WatchList = IntrusiveList<Watch, &Watch::description_list_node>;
+
+    // Called when the last reference to a description goes away, so that its watches
+    // stop listening to the file right away instead of whenever the queue is next read.
+    static void detach_watches(WatchList&);
+
+private:
+    EventQueue();
+
+    void mark_ready(Watch&);
+    bool append_to_ready_list(Watch&);
+
+    Lock m_lock { "EventQueue" };
+    HashMap<int, NonnullOwnPtr<Watch>> m_watches;
+
+    mutable SpinLock<u8> m_ready_lock;
+    IntrusiveList<Watch, &Watch::ready_list_node> m_ready_list;
+};
+
+}
@@ -27,6 +27,7 @@
 #include <AK/Bitmap.h>
 #include <AK/HashMap.h>
 #include <AK/MemoryStream.h>
+#include <AK/QuickSort.h>
 #include <AK/StdLibExtras.h>
 #include <AK/StringView.h>
 #include <Kernel/Devices/BlockDevice.h>
@@ -35,6 +36,7 @@
 #include <Kernel/FileSystem/ext2_fs.h>
 #include <Kernel/Process.h>
 #include <Kernel/UnixTypes.h>
+#include <Kernel/VM/PageCache.h>
 #include <LibC/errno_numbers.h>
 
 //#define EXT2_DEBUG
@@ -71,6 +73,247 @@ static u8 to_ext2_file_type(mode_t mode)
     return EXT2_FT_UNKNOWN;
 }
 
+// Layout of the blocks of an indexed directory. The index root shares block 0 with the
+// "." and ".." entries, and every index node hides behind an empty directory entry that
+// spans the whole block, so the index is invisible to code that reads the directory linearly.
+static constexpr size_t directory_index_root_info_offset = 24;
+static constexpr size_t directory_index_root_entries_offset = 32;
+static constexpr size_t directory_index_node_entries_offset = 8;
+static constexpr u32 directory_index_no_hash = 0xffffffff;
+
+static inline u32 rotate_left(u32 value, unsigned shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static void directory_hash_tea_transform(u32 buffer[4], const u32 in[4])
+{
+    u32 sum = 0;
+    u32 b0 = buffer[0];
+    u32 b1 = buffer[1];
+    for (int i = 0; i < 16; ++i) {
+        sum += 0x9e3779b9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    buffer[0] += b0;
+    buffer[1] += b1;
+}
+
+static void directory_hash_half_md4_transform(u32 buffer[4], const u32 in[8])
+{
+    auto f = [](u32 x, u32 y, u32 z) { return z ^ (x & (y ^ z)); };
+    auto g = [](u32 x, u32 y, u32 z) { return (x & y) + ((x ^ y) & z); };
+    auto h = [](u32 x, u32 y, u32 z) { return x ^ y ^ z; };
+    constexpr u32 k2 = 013240474631;
+    constexpr u32 k3 = 015666365641;
+
+    u32 a = buffer[0];
+    u32 b = buffer[1];
+    u32 c = buffer[2];
+    u32 d = buffer[3];
+
+#define ROUND(function, a, b, c, d, x, s) a = rotate_left(a + function(b, c, d) + (x), s)
+    ROUND(f, a, b, c, d, in[0], 3);
+    ROUND(f, d, a, b, c, in[1], 7);
+    ROUND(f, c, d, a, b, in[2], 11);
+    ROUND(f, b, c, d, a, in[3], 19);
+    ROUND(f, a, b, c, d, in[4], 3);
+    ROUND(f, d, a, b, c, in[5], 7);
+    ROUND(f, c, d, a, b, in[6], 11);
+    ROUND(f, b, c, d, a, in[7], 19);
+
+    ROUND(g, a, b, c, d, in[1] + k2, 3);
+    ROUND(g, d, a, b, c, in[3] + k2, 5);
+    ROUND(g, c, d, a, b, in[5] + k2, 9);
+    ROUND(g, b, c, d, a, in[7] + k2, 13);
+    ROUND(g, a, b, c, d, in[0] + k2, 3);
+    ROUND(g, d, a, b, c, in[2] + k2, 5);
+    ROUND(g, c, d, a, b, in[4] + k2, 9);
+    ROUND(g, b, c, d, a, in[6] + k2, 13);
+
+    ROUND(h, a, b, c, d, in[3] + k3, 3);
+    ROUND(h, d, a, b, c, in[7] + k3, 9);
+    ROUND(h, c, d, a, b, in[2] + k3, 11);
+    ROUND(h, b, c, d, a, in[6] + k3, 15);
+    ROUND(h, a, b, c, d, in[1] + k3, 3);
+    ROUND(h, d, a, b, c, in[5] + k3, 9);
+    ROUND(h, c, d, a, b, in[0] + k3, 11);
+    ROUND(h, b, c, d, a, in[4] + k3, 15);
+#undef ROUND
+
+    buffer[0] += a;
+    buffer[1] += b;
+    buffer[2] += c;
+    buffer[3] += d;
+}
+
+static inline int directory_hash_character(char c, bool is_unsigned)
+{
+    return is_unsigned ? static_cast<int>(static_cast<unsigned char>(c)) : static_cast<int>(static_cast<signed char>(c));
+}
+
+static void directory_hash_fill_input(const char* characters, int length, u32* input, int count, bool is_unsigned)
+{
+    u32 pad = static_cast<u32>(length) | (static_cast<u32>(length) << 8);
+    pad |= pad << 16;
+
+    u32 value = pad;
+    if (length > count * 4)
+        length = count * 4;
+    for (int i = 0; i < length; ++i) {
+        value = directory_hash_character(characters[i], is_unsigned) + (value << 8);
+        if ((i % 4) == 3) {
+            *input++ = value;
+            value = pad;
+            --count;
+        }
+    }
+    if (--count >= 0)
+        *input++ = value;
+    while (--count >= 0)
+        *input++ = pad;
+}
+
+// Computes the same name hashes as other ext2 implementations, which is what the index is sorted by.
+static u32 directory_hash(const StringView& name, u8 hash_version, const u32 seed[4])
+{
+    u32 buffer[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    if (seed[0] || seed[1] || seed[2] || seed[3])
+        memcpy(buffer, seed, sizeof(buffer));
+
+    const char* characters = name.characters_without_null_termination();
+    int length = name.length();
+    u32 hash = 0;
+
+    switch (hash_version) {
+    case EXT2_HASH_LEGACY:
+    case EXT2_HASH_LEGACY_UNSIGNED: {
+        u32 hash0 = 0x12a3fe2d;
+        u32 hash1 = 0x37abe8f9;
+        for (int i = 0; i < length; ++i) {
+            u32 value = hash1 + (hash0 ^ static_cast<u32>(directory_hash_character(characters[i], hash_version == EXT2_HASH_LEGACY_UNSIGNED) * 7152373));
+            if (value & 0x80000000)
+                value -= 0x7fffffff;
+            hash1 = hash0;
+            hash0 = value;
+        }
+        hash = hash0 << 1;
+        break;
+    }
+    case EXT2_HASH_HALF_MD4:
+    case EXT2_HASH_HALF_MD4_UNSIGNED: {
+        u32 input[8];
+        for (; length > 0; length -= 32, characters += 32) {
+            directory_hash_fill_input(characters, length, input, 8, hash_version == EXT2_HASH_HALF_MD4_UNSIGNED);
+            directory_hash_half_md4_transform(buffer, input);
+        }
+        hash = buffer[1];
+        break;
+    }
+    case EXT2_HASH_TEA:
+    case EXT2_HASH_TEA_UNSIGNED: {
+        u32 input[4];
+        for (; length > 0; length -= 16, characters += 16) {
+            directory_hash_fill_input(characters, length, input, 4, hash_version == EXT2_HASH_TEA_UNSIGNED);
+            directory_hash_tea_transform(buffer, input);
+        }
+        hash = buffer[0];
+        break;
+    }
+    default:
+        ASSERT_NOT_REACHED();
+    }
+
+    // The lowest bit marks index entries that continue a run of colliding hashes.
+    hash &= ~1u;
+    if (hash == (0x7fffffffu << 1))
+        hash = (0x7fffffffu - 1) << 1;
+    return hash;
+}
+
+template<typename Callback>
+static bool for_each_entry_in_directory_block(u8* block, size_t block_size, Callback callback)
+{
+    ext2_dir_entry_2* previous_entry = nullptr;
+    for (size_t offset = 0; offset < block_size;) {
+        auto* entry = reinterpret_cast<ext2_dir_entry_2*>(block + offset);
+        if (entry->rec_len < 8 || (entry->rec_len % 4) || offset + entry->rec_len > block_size)
+            return false;
+        if (entry->inode && EXT2_DIR_REC_LEN(entry->name_len) > entry->rec_len)
+            return false;
+        if (callback(*entry, previous_entry) == IterationDecision::Break)
+            return true;
+        previous_entry = entry;
+        offset += entry->rec_len;
+    }
+    return true;
+}
+
+static ext2_dir_entry_2* find_entry_in_directory_block(u8* block, size_t block_size, const StringView& name, ext2_dir_entry_2** previous_entry = nullptr)
+{
+    ext2_dir_entry_2* found_entry = nullptr;
+    for_each_entry_in_directory_block(block, block_size, [&](auto& entry, auto* previous) {
+        if (!entry.inode || name != StringView(entry.name, entry.name_len))
+            return IterationDecision::Continue;
+        found_entry = &entry;
+        if (previous_entry)
+            *previous_entry = previous;
+        return IterationDecision::Break;
+    });
+    return found_entry;
+}
+
+static bool insert_entry_into_directory_block(u8* block, size_t block_size, const StringView& name, unsigned inode_index, u8 file_type)
+{
+    size_t needed_length = EXT2_DIR_REC_LEN(name.length());
+    bool inserted = false;
+    for_each_entry_in_directory_block(block, block_size, [&](auto& entry, auto*) {
+        size_t used_length = entry.inode ? EXT2_DIR_REC_LEN(entry.name_len) : 0;
+        if (entry.rec_len - used_length < needed_length)
+            return IterationDecision::Continue;
+        auto* new_entry = &entry;
+        if (used_length) {
+            new_entry = reinterpret_cast<ext2_dir_entry_2*>(reinterpret_cast<u8*>(&entry) + used_length);
+            new_entry->rec_len = entry.rec_len - used_length;
+            entry.rec_len = used_length;
+        }
+        new_entry->inode = inode_index;
+        new_entry->name_len = name.length();
+        new_entry->file_type = file_type;
+        memcpy(new_entry->name, name.characters_without_null_termination(), name.length());
+        inserted = true;
+        return IterationDecision::Break;
+    });
+    return inserted;
+}
+
+static void pack_entries_into_directory_block(u8* block, size_t block_size, const Vector<const ext2_dir_entry_2*>& entries)
+{
+    memset(block, 0, block_size);
+    size_t offset = 0;
+    ext2_dir_entry_2* last_entry = nullptr;
+    for (auto* entry : entries) {
+        size_t record_length = EXT2_DIR_REC_LEN(entry->name_len);
+        last_entry = reinterpret_cast<ext2_dir_entry_2*>(block + offset);
+        memcpy(last_entry, entry, record_length);
+        last_entry->rec_len = record_length;
+        offset += record_length;
+    }
+    if (last_entry)
+        last_entry->rec_len += block_size - offset;
+    else
+        reinterpret_cast<ext2_dir_entry_2*>(block)->rec_len = block_size;
+}
+
+static void initialize_directory_index_node(u8* block, size_t block_size)
+{
+    memset(block, 0, block_size);
+    reinterpret_cast<ext2_dir_entry_2*>(block)->rec_len = block_size;
+    auto& count_limit = *reinterpret_cast<ext2_dx_countlimit*>(block + directory_index_node_entries_offset);
+    count_limit.limit = (block_size - directory_index_node_entries_offset) / sizeof(ext2_dx_entry);
+}
+
 NonnullRefPtr<Ext2FS> Ext2FS::create(FileDescription& file_description)
 {
     return adopt(*new Ext2FS(file_description));
@@ -83,6 +326,7 @@ Ext2FS::Ext2FS(FileDescription& file_description)
 
 Ext2FS::~Ext2FS()
 {
+    PageCache::the().remove_fs(fsid());
 }
 
 bool Ext2FS::flush_super_block()
@@ -527,6 +771,8 @@ void Ext2FS::free_inode(Ext2FSInode& inode)
 {
     LOCKER(m_lock);
     ASSERT(inode.m_raw_inode.i_links_count == 0);
+    PageCache::the().remove_inode(inode.identifier());
+    release_preallocated_blocks(inode);
 #ifdef EXT2_DEBUG
     dbg() << "Ext2FS: Inode " << inode.identifier() << " has no more links, time to delete!";
 #endif
@@ -564,7 +810,7 @@ void Ext2FS::flush_block_group_descriptor_table()
     write_blocks(first_block_of_bgdt, blocks_to_write, buffer);
 }
 
-void Ext2FS::flush_writes()
+void Ext2FS::flush_metadata_to_cache()
 {
     LOCKER(m_lock);
     if (m_super_block_dirty) {
@@ -585,9 +831,27 @@ void Ext2FS::flush_writes()
 #endif
         }
     }
+}
 
+void Ext2FS::flush_writes()
+{
+    LOCKER(m_lock);
+    flush_metadata_to_cache();
     BlockBasedFS::flush_writes();
+    uncache_unused_inodes();
+}
 
+void Ext2FS::write_back()
+{
+    LOCKER(m_lock);
+    flush_metadata_to_cache();
+    BlockBasedFS::write_back();
+    uncache_unused_inodes();
+}
+
+void Ext2FS::uncache_unused_inodes()
+{
+    LOCKER(m_lock);
     // Uncache Inodes that are only kept alive by the index-to-inode lookup cache.
     // We don't uncache Inodes that are being watched by at least one InodeWatcher.
 
@@ -600,6 +864,7 @@ void Ext2FS::flush_writes()
             continue;
         if (it.value->has_watchers())
             continue;
+        release_preallocated_blocks(*it.value);
         unused_inodes.append(it.key);
     }
     for (auto index : unused_inodes)
@@ -716,7 +981,8 @@ ssize_t Ext2FSInode::read_bytes(off_t offset, ssize_t count, UserOrKernelBuffer&
         return -EIO;
     }
 
-    bool allow_cache = !description || !description->is_direct();
+    // File contents are cached by the PageCache, so keep them out of the DiskCache.
+    bool allow_cache = (!description || !description->is_direct()) && !is_regular_file(m_raw_inode.i_mode);
 
     const int block_size = fs().block_size();
 
@@ -740,6 +1006,25 @@ ssize_t Ext2FSInode::read_bytes(off_t offset, ssize_t count, UserOrKernelBuffer&
         size_t offset_into_block = (bi == first_block_logical_index) ? offset_into_first_block : 0;
         size_t num_bytes_to_copy = min(block_size - offset_into_block, remaining_count);
         auto buffer_offset = buffer.offset(nread);
+        if (!allow_cache && num_bytes_to_copy == static_cast<size_t>(block_size)) {
+            // Whole blocks that are contiguous on disk can be read with a single request.
+            size_t run_length = 1;
+            while (bi + run_length <= last_block_logical_index
+                && remaining_count >= (run_length + 1) * block_size
+                && m_block_list[bi + run_length] == block_index + run_length)
+                ++run_length;
+            if (run_length > 1) {
+                int err = fs().read_blocks(block_index, run_length, buffer_offset, false);
+                if (err < 0) {
+                    klog() << "ext2fs: read_bytes: read_blocks(" << block_index << ", " << run_length << ") failed (lbi: " << bi << ")";
+                    return err;
+                }
+                remaining_count -= run_length * block_size;
+                nread += run_length * block_size;
+                bi += run_length - 1;
+                continue;
+            }
+        }
         int err = fs().read_block(block_index, &buffer_offset, num_bytes_to_copy, offset_into_block, allow_cache);
         if (err < 0) {
             klog() << "ext2fs: read_bytes: read_block(" << block_index << ") failed (lbi: " << bi << ")";
@@ -780,9 +1065,41 @@ KResult Ext2FSInode::resize(u64 new_size)
         block_list = fs().block_list_for_inode(m_raw_inode);
 
     if (blocks_needed_after > blocks_needed_before) {
-        auto new_blocks = fs().allocate_blocks(fs().group_index_from_inode(index()), blocks_needed_after - blocks_needed_before);
-        block_list.append(move(new_blocks));
+        size_t blocks_to_add = blocks_needed_after - blocks_needed_before;
+        Ext2FS::BlockIndex goal = block_list.is_empty() || !block_list.last() ? 0 : block_list.last() + 1;
+
+        // Consume our preallocation window first, as long as it still continues the file.
+        if (m_preallocated_block_count && m_preallocated_first_block != goal)
+            fs().release_preallocated_blocks(*this);
+        while (blocks_to_add && m_preallocated_block_count) {
+            if (!fs().claim_reserved_block(m_preallocated_first_block)) {
+                // The file system took the reservation back to satisfy another allocation.
+                fs().release_preallocated_blocks(*this);
+                break;
+            }
+            block_list.append(m_preallocated_first_block++);
+            --m_preallocated_block_count;
+            --blocks_to_add;
+            goal = block_list.last() + 1;
+        }
+        if (!m_preallocated_block_count)
+            m_preallocated_first_block = 0;
+
+        if (blocks_to_add) {
+            auto new_blocks = fs().allocate_blocks(fs().group_index_from_inode(index()), blocks_to_add, goal);
+            block_list.append(move(new_blocks));
+
+            // Reserve a few blocks past the end of a growing file, unless the file system is getting full.
+            auto& super_block = fs().super_block();
+            if (is_regular_file(m_raw_inode.i_mode) && super_block.s_free_blocks_count > super_block.s_blocks_count / 20) {
+                m_preallocated_first_block = block_list.last() + 1;
+                m_preallocated_block_count = fs().reserve_contiguous_blocks(m_preallocated_first_block, Ext2FS::preallocation_window_blocks);
+                if (!m_preallocated_block_count)
+                    m_preallocated_first_block = 0;
+            }
+        }
     } else if (blocks_needed_after < blocks_needed_before) {
+        fs().release_preallocated_blocks(*this);
 #ifdef EXT2_DEBUG
         dbg() << "Ext2FS: Shrinking inode " << identifier() << ". Old block list is " << block_list.size() << " entries:";
         for (auto block_index : block_list) {
@@ -812,6 +1129,11 @@ ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const UserOrKernel
     ASSERT(offset >= 0);
     ASSERT(count >= 0);
 
+    // Only throttle writes on behalf of userspace, internal writes may already
+    // hold locks that the write-back task needs.
+    if (description)
+        fs().throttle_writer();
+
     Locker inode_locker(m_lock);
     Locker fs_locker(fs().m_lock);
 
@@ -869,6 +1191,25 @@ ssize_t Ext2FSInode::write_bytes(off_t offset, ssize_t count, const UserOrKernel
     for (size_t bi = first_block_logical_index; remaining_count && bi <= last_block_logical_index; ++bi) {
         size_t offset_into_block = (bi == first_block_logical_index) ? offset_into_first_block : 0;
         size_t num_bytes_to_copy = min(block_size - offset_into_block, remaining_count);
+
+        if (offset_into_block == 0 && num_bytes_to_copy == block_size && m_block_list[bi]) {
+            // Hand runs of whole blocks that are contiguous on disk to the file system in one go.
+            size_t run_length = 1;
+            while (bi + run_length <= last_block_logical_index
+                && remaining_count >= (run_length + 1) * block_size
+                && m_block_list[bi + run_length] == m_block_list[bi] + run_length)
+                ++run_length;
+            if (run_length > 1) {
+                int err = fs().write_blocks(m_block_list[bi], run_length, data.offset(nwritten), allow_cache);
+                if (err < 0)
+                    return err;
+                remaining_count -= run_length * block_size;
+                nwritten += run_length * block_size;
+                bi += run_length - 1;
+                continue;
+            }
+        }
+
 #ifdef EXT2_VERY_DEBUG
         dbg() << "Ext2FS: Writing block " << m_block_list[bi] << " (offset_into_block: " << offset_into_block << ")";
 #endif
@@ -1019,32 +1360,34 @@ KResult Ext2FSInode::add_child(Inode& child, const StringView& name, mode_t mode
     dbg() << "Ext2FSInode::add_child(): Adding inode " << child.index() << " with name '" << name << "' and mode " << mode << " to directory " << index();
 #endif
 
-    Vector<Ext2FSDirectoryEntry> entries;
     bool name_already_exists = false;
-    KResult result = traverse_as_directory([&](auto& entry) {
-        if (name == entry.name) {
-            name_already_exists = true;
-            return false;
-        }
-        entries.append({ entry.name, entry.inode, entry.file_type });
-        return true;
-    });
-
-    if (result.is_error())
-        return result;
+    if (!m_lookup_cache.is_empty()) {
+        name_already_exists = m_lookup_cache.contains(name);
+    } else {
+        size_t block_index = 0;
+        unsigned inode_index = 0;
+        auto result = find_directory_entry(name, block_index, inode_index);
+        if (result.is_error() && result.error() != -ENOENT)
+            return result;
+        name_already_exists = !result.is_error();
+    }
 
     if (name_already_exists) {
         dbg() << "Ext2FSInode::add_child(): Name '" << name << "' already exists in inode " << index();
         return KResult(-EEXIST);
     }
 
-    result = child.increment_link_count();
+    auto result = child.increment_link_count();
     if (result.is_error())
         return result;
 
-    entries.empend(name, child.identifier(), to_ext2_file_type(mode));
-    bool success = write_directory(entries);
-    if (success)
+    result = add_directory_entry(name, child.index(), to_ext2_file_type(mode));
+    if (result.is_error()) {
+        [[maybe_unused]] auto rc = child.decrement_link_count();
+        return result;
+    }
+
+    if (!m_lookup_cache.is_empty())
         m_lookup_cache.set(name, child.index());
 
     did_add_child(child.identifier());
@@ -1059,10 +1402,11 @@ KResult Ext2FSInode::remove_child(const StringView& name)
 #endif
     ASSERT(is_directory());
 
-    auto it = m_lookup_cache.find(name);
-    if (it == m_lookup_cache.end())
-        return KResult(-ENOENT);
-    auto child_inode_index = (*it).value;
+    size_t block_index = 0;
+    unsigned child_inode_index = 0;
+    auto result = find_directory_entry(name, block_index, child_inode_index);
+    if (result.is_error())
+        return result;
 
     InodeIdentifier child_id { fsid(), child_inode_index };
 
@@ -1070,20 +1414,24 @@ KResult Ext2FSInode::remove_child(const StringView& name)
     dbg() << "Ext2FSInode::remove_child(): Removing '" << name << "' in directory " << index();
 #endif
 
-    Vector<Ext2FSDirectoryEntry> entries;
-    KResult result = traverse_as_directory([&](auto& entry) {
-        if (name != entry.name)
-            entries.append({ entry.name, entry.inode, entry.file_type });
-        return true;
-    });
+    // Only the block holding the entry changes: it's merged into the entry before it,
+    // or just marked unused if it's the first one in its block.
+    auto block_size = fs().block_size();
+    auto block = ByteBuffer::create_uninitialized(block_size);
+    result = read_directory_block(block_index, block.data());
     if (result.is_error())
         return result;
-
-    bool success = write_directory(entries);
-    if (!success) {
-        // FIXME: Plumb error from write_directory().
+    ext2_dir_entry_2* previous_entry = nullptr;
+    auto* entry = find_entry_in_directory_block(block.data(), block_size, name, &previous_entry);
+    if (!entry)
         return KResult(-EIO);
-    }
+    if (previous_entry)
+        previous_entry->rec_len += entry->rec_len;
+    else
+        entry->inode = 0;
+    result = write_directory_block(block_index, block.data());
+    if (result.is_error())
+        return result;
 
     m_lookup_cache.remove(name);
 
@@ -1096,6 +1444,427 @@ KResult Ext2FSInode::remove_child(const StringView& name)
     return KSuccess;
 }
 
+KResult Ext2FSInode::read_directory_block(size_t block_index, u8* buffer) const
+{
+    if (m_block_list.is_empty())
+        m_block_list = fs().block_list_for_inode(m_raw_inode);
+    if (block_index >= m_block_list.size() || !m_block_list[block_index])
+        return KResult(-EIO);
+    auto out = UserOrKernelBuffer::for_kernel_buffer(buffer);
+    int err = fs().read_block(m_block_list[block_index], &out, fs().block_size());
+    if (err < 0)
+        return KResult(err);
+    return KSuccess;
+}
+
+KResult Ext2FSInode::write_directory_block(size_t block_index, const u8* buffer)
+{
+    if (m_block_list.is_empty())
+        m_block_list = fs().block_list_for_inode(m_raw_inode);
+    if (block_index >= m_block_list.size() || !m_block_list[block_index])
+        return KResult(-EIO);
+    auto in = UserOrKernelBuffer::for_kernel_buffer(const_cast<u8*>(buffer));
+    int err = fs().write_block(m_block_list[block_index], in, fs().block_size());
+    if (err < 0)
+        return KResult(err);
+    return KSuccess;
+}
+
+KResultOr<size_t> Ext2FSInode::append_directory_block()
+{
+    Locker fs_locker(fs().m_lock);
+    auto block_size = fs().block_size();
+    size_t block_index = size() / block_size;
+    auto result = resize(size() + block_size);
+    if (result.is_error())
+        return result;
+    return block_index;
+}
+
+bool Ext2FSInode::has_directory_index() const
+{
+    return (m_raw_inode.i_flags & EXT2_INDEX_FL) && (fs().super_block().s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX);
+}
+
+KResult Ext2FSInode::find_directory_index_leaf(const StringView& name, DirectoryIndexLookup& lookup) const
+{
+    auto block_size = fs().block_size();
+    auto buffer = ByteBuffer::create_uninitialized(block_size);
+    auto result = read_directory_block(0, buffer.data());
+    if (result.is_error())
+        return result;
+
+    // NOTE: We return EINVAL for any index we don't understand, callers then treat the directory as unindexed.
+    auto& root_info = *reinterpret_cast<const ext2_dx_root_info*>(buffer.data() + directory_index_root_info_offset);
+    if (root_info.reserved_zero || root_info.info_length != 8 || root_info.indirect_levels > 1 || root_info.hash_version > EXT2_HASH_TEA)
+        return KResult(-EINVAL);
+    size_t indirect_levels = root_info.indirect_levels;
+
+    lookup.hash_version = root_info.hash_version;
+    if (fs().super_block().s_flags & EXT2_FLAGS_UNSIGNED_HASH)
+        lookup.hash_version += EXT2_HASH_LEGACY_UNSIGNED;
+    lookup.hash = directory_hash(name, lookup.hash_version, fs().super_block().s_hash_seed);
+    lookup.frames.clear();
+    lookup.leaf_blocks.clear();
+
+    size_t block_index = 0;
+    size_t entries_offset = directory_index_root_entries_offset;
+    for (size_t level = 0;; ++level) {
+        auto* entries = reinterpret_cast<const ext2_dx_entry*>(buffer.data() + entries_offset);
+        auto& count_limit = *reinterpret_cast<const ext2_dx_countlimit*>(entries);
+        if (!count_limit.count || count_limit.count > count_limit.limit || count_limit.limit != (block_size - entries_offset) / sizeof(ext2_dx_entry))
+            return KResult(-EINVAL);
+
+        // Find the last entry whose hash isn't larger than ours. The first entry has no hash,
+        // it covers everything below the hash of the second one.
+        size_t low = 1;
+        size_t high = count_limit.count;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (entries[middle].hash > lookup.hash)
+                high = middle;
+            else
+                low = middle + 1;
+        }
+        size_t entry_index = low - 1;
+        lookup.frames.append({ block_index, entries_offset, entry_index });
+
+        if (level == indirect_levels) {
+            lookup.leaf_blocks.append(entries[entry_index].block);
+            for (size_t i = entry_index + 1; i < count_limit.count && entries[i].hash == (lookup.hash | 1); ++i)
+                lookup.leaf_blocks.append(entries[i].block);
+            return KSuccess;
+        }
+
+        block_index = entries[entry_index].block;
+        result = read_directory_block(block_index, buffer.data());
+        if (result.is_error())
+            return result;
+        entries_offset = directory_index_node_entries_offset;
+    }
+}
+
+KResult Ext2FSInode::find_directory_entry(const StringView& name, size_t& block_index, unsigned& inode_index) const
+{
+    auto block_size = fs().block_size();
+    auto buffer = ByteBuffer::create_uninitialized(block_size);
+
+    auto find_in_block = [&](size_t index) -> KResultOr<bool> {
+        auto result = read_directory_block(index, buffer.data());
+        if (result.is_error())
+            return result;
+        auto* entry = find_entry_in_directory_block(buffer.data(), block_size, name);
+        if (!entry)
+            return false;
+        block_index = index;
+        inode_index = entry->inode;
+        return true;
+    };
+
+    if (has_directory_index()) {
+        DirectoryIndexLookup lookup;
+        auto result = find_directory_index_leaf(name, lookup);
+        if (!result.is_error()) {
+            for (auto leaf_block : lookup.leaf_blocks) {
+                auto found_or = find_in_block(leaf_block);
+                if (found_or.is_error())
+                    return found_or.error();
+                if (found_or.value())
+                    return KSuccess;
+            }
+            return KResult(-ENOENT);
+        }
+        if (result.error() != -EINVAL)
+            return result;
+    }
+
+    size_t block_count = size() / block_size;
+    for (size_t i = 0; i < block_count; ++i) {
+        auto found_or = find_in_block(i);
+        if (found_or.is_error())
+            return found_or.error();
+        if (found_or.value())
+            return KSuccess;
+    }
+    return KResult(-ENOENT);
+}
+
+KResult Ext2FSInode::add_directory_entry(const StringView& name, unsigned inode_index, u8 file_type)
+{
+    if (has_directory_index()) {
+        auto added_or = add_directory_entry_to_index(name, inode_index, file_type);
+        if (added_or.is_error())
+            return added_or.error();
+        if (added_or.value())
+            return KSuccess;
+    }
+
+    if (m_raw_inode.i_flags & EXT2_INDEX_FL) {
+        // We can't keep this index up to date, so drop it. The directory stays valid without it.
+        dbg() << "Ext2FS: Dropping directory index of inode " << identifier();
+        m_raw_inode.i_flags &= ~EXT2_INDEX_FL;
+        set_metadata_dirty(true);
+    }
+
+    auto block_size = fs().block_size();
+    auto buffer = ByteBuffer::create_uninitialized(block_size);
+    size_t block_count = size() / block_size;
+    for (size_t i = 0; i < block_count; ++i) {
+        auto result = read_directory_block(i, buffer.data());
+        if (result.is_error())
+            return result;
+        if (insert_entry_into_directory_block(buffer.data(), block_size, name, inode_index, file_type))
+            return write_directory_block(i, buffer.data());
+    }
+
+    // Index directories once they outgrow their first block.
+    if (block_count == 1 && (fs().super_block().s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)) {
+        auto result = convert_to_indexed_directory();
+        if (!result.is_error())
+            return add_directory_entry(name, inode_index, file_type);
+        if (result.error() != -EINVAL)
+            return result;
+    }
+
+    auto block_index_or = append_directory_block();
+    if (block_index_or.is_error())
+        return block_index_or.error();
+    pack_entries_into_directory_block(buffer.data(), block_size, {});
+    bool inserted = insert_entry_into_directory_block(buffer.data(), block_size, name, inode_index, file_type);
+    ASSERT(inserted);
+    return write_directory_block(block_index_or.value(), buffer.data());
+}
+
+KResult Ext2FSInode::convert_to_indexed_directory()
+{
+    auto block_size = fs().block_size();
+    auto root = ByteBuffer::create_uninitialized(block_size);
+    auto result = read_directory_block(0, root.data());
+    if (result.is_error())
+        return result;
+
+    // The index root lives behind "." and "..", so they have to come first.
+    auto* dot = reinterpret_cast<ext2_dir_entry_2*>(root.data());
+    auto* dot_dot = reinterpret_cast<ext2_dir_entry_2*>(root.data() + EXT2_DIR_REC_LEN(1));
+    if (dot->rec_len != EXT2_DIR_REC_LEN(1) || StringView(dot->name, dot->name_len) != ".")
+        return KResult(-EINVAL);
+    if (dot_dot->rec_len < EXT2_DIR_REC_LEN(2) || StringView(dot_dot->name, dot_dot->name_len) != "..")
+        return KResult(-EINVAL);
+
+    Vector<const ext2_dir_entry_2*> entries;
+    bool is_valid = for_each_entry_in_directory_block(root.data(), block_size, [&](auto& entry, auto*) {
+        if (&entry != dot && &entry != dot_dot && entry.inode)
+            entries.append(&entry);
+        return IterationDecision::Continue;
+    });
+    if (!is_valid)
+        return KResult(-EINVAL);
+
+    auto leaf_index_or = append_directory_block();
+    if (leaf_index_or.is_error())
+        return leaf_index_or.error();
+    auto leaf = ByteBuffer::create_uninitialized(block_size);
+    pack_entries_into_directory_block(leaf.data(), block_size, entries);
+    result = write_directory_block(leaf_index_or.value(), leaf.data());
+    if (result.is_error())
+        return result;
+
+    dot_dot->rec_len = block_size - EXT2_DIR_REC_LEN(1);
+    memset(root.data() + directory_index_root_info_offset, 0, block_size - directory_index_root_info_offset);
+    auto& root_info = *reinterpret_cast<ext2_dx_root_info*>(root.data() + directory_index_root_info_offset);
+    u8 default_hash_version = fs().super_block().s_def_hash_version;
+    root_info.hash_version = default_hash_version <= EXT2_HASH_TEA ? default_hash_version : EXT2_HASH_HALF_MD4;
+    root_info.info_length = 8;
+    auto* dx_entries = reinterpret_cast<ext2_dx_entry*>(root.data() + directory_index_root_entries_offset);
+    auto& count_limit = *reinterpret_cast<ext2_dx_countlimit*>(dx_entries);
+    count_limit.limit = (block_size - directory_index_root_entries_offset) / sizeof(ext2_dx_entry);
+    count_limit.count = 1;
+    dx_entries[0].block = leaf_index_or.value();
+    result = write_directory_block(0, root.data());
+    if (result.is_error())
+        return result;
+
+    m_raw_inode.i_flags |= EXT2_INDEX_FL;
+    set_metadata_dirty(true);
+    return KSuccess;
+}
+
+KResultOr<bool> Ext2FSInode::add_directory_entry_to_index(const StringView& name, unsigned inode_index, u8 file_type)
+{
+    auto block_size = fs().block_size();
+    auto leaf = ByteBuffer::create_uninitialized(block_size);
+    auto node = ByteBuffer::create_uninitialized(block_size);
+    auto new_leaf = ByteBuffer::create_uninitialized(block_size);
+
+    // Every split halves the leaf the name belongs in, so this settles quickly.
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        DirectoryIndexLookup lookup;
+        auto result = find_directory_index_leaf(name, lookup);
+        if (result.is_error()) {
+            if (result.error() == -EINVAL)
+                return false;
+            return result;
+        }
+
+        size_t leaf_index = lookup.leaf_blocks.first();
+        result = read_directory_block(leaf_index, leaf.data());
+        if (result.is_error())
+            return result;
+        if (insert_entry_into_directory_block(leaf.data(), block_size, name, inode_index, file_type)) {
+            result = write_directory_block(leaf_index, leaf.data());
+            if (result.is_error())
+                return result;
+            return true;
+        }
+
+        // The leaf is full and has to be split, which needs room for another entry in its index node.
+        auto& frame = lookup.frames.last();
+        result = read_directory_block(frame.block_index, node.data());
+        if (result.is_error())
+            return result;
+        auto* node_entries = reinterpret_cast<ext2_dx_entry*>(node.data() + frame.entries_offset);
+        auto& count_limit = *reinterpret_cast<ext2_dx_countlimit*>(node_entries);
+        if (count_limit.count == count_limit.limit) {
+            auto grown_or = grow_directory_index(lookup);
+            if (grown_or.is_error())
+                return grown_or.error();
+            if (!grown_or.value())
+                return false;
+            continue;
+        }
+
+        struct HashedEntry {
+            u32 hash;
+            const ext2_dir_entry_2* entry;
+        };
+        auto source = ByteBuffer::copy(leaf.data(), block_size);
+        Vector<HashedEntry> hashed_entries;
+        bool is_valid = for_each_entry_in_directory_block(source.data(), block_size, [&](auto& entry, auto*) {
+            if (entry.inode)
+                hashed_entries.append({ directory_hash({ entry.name, entry.name_len }, lookup.hash_version, fs().super_block().s_hash_seed), &entry });
+            return IterationDecision::Continue;
+        });
+        if (!is_valid || hashed_entries.size() < 2)
+            return false;
+        quick_sort(hashed_entries, [](auto& a, auto& b) { return a.hash < b.hash; });
+
+        size_t split_index = hashed_entries.size() / 2;
+        u32 split_hash = hashed_entries[split_index].hash;
+        // Names with the same hash can end up in both halves, mark the new leaf as continuing the old one.
+        if (hashed_entries[split_index - 1].hash == split_hash)
+            split_hash |= 1;
+
+        Vector<const ext2_dir_entry_2*> lower_entries;
+        Vector<const ext2_dir_entry_2*> upper_entries;
+        for (size_t i = 0; i < hashed_entries.size(); ++i)
+            (i < split_index ? lower_entries : upper_entries).append(hashed_entries[i].entry);
+
+        auto new_leaf_index_or = append_directory_block();
+        if (new_leaf_index_or.is_error())
+            return new_leaf_index_or.error();
+        pack_entries_into_directory_block(leaf.data(), block_size, lower_entries);
+        pack_entries_into_directory_block(new_leaf.data(), block_size, upper_entries);
+        result = write_directory_block(new_leaf_index_or.value(), new_leaf.data());
+        if (result.is_error())
+            return result;
+        result = write_directory_block(leaf_index, leaf.data());
+        if (result.is_error())
+            return result;
+
+        size_t insert_index = frame.entry_index + 1;
+        memmove(&node_entries[insert_index + 1], &node_entries[insert_index], (count_limit.count - insert_index) * sizeof(ext2_dx_entry));
+        node_entries[insert_index].hash = split_hash;
+        node_entries[insert_index].block = new_leaf_index_or.value();
+        ++count_limit.count;
+        result = write_directory_block(frame.block_index, node.data());
+        if (result.is_error())
+            return result;
+    }
+    return false;
+}
+
+KResultOr<bool> Ext2FSInode::grow_directory_index(const DirectoryIndexLookup& lookup)
+{
+    auto block_size = fs().block_size();
+    auto root = ByteBuffer::create_uninitialized(block_size);
+    auto node = ByteBuffer::create_uninitialized(block_size);
+    auto result = read_directory_block(0, root.data());
+    if (result.is_error())
+        return result;
+    auto& root_info = *reinterpret_cast<ext2_dx_root_info*>(root.data() + directory_index_root_info_offset);
+    auto* root_entries = reinterpret_cast<ext2_dx_entry*>(root.data() + directory_index_root_entries_offset);
+    auto& root_count_limit = *reinterpret_cast<ext2_dx_countlimit*>(root_entries);
+
+    if (lookup.frames.size() == 1) {
+        // Add a level by moving all entries of the root into a new index node.
+        auto node_index_or = append_directory_block();
+        if (node_index_or.is_error())
+            return node_index_or.error();
+        initialize_directory_index_node(node.data(), block_size);
+        auto* node_entries = reinterpret_cast<ext2_dx_entry*>(node.data() + directory_index_node_entries_offset);
+        auto& node_count_limit = *reinterpret_cast<ext2_dx_countlimit*>(node_entries);
+        u16 node_limit = node_count_limit.limit;
+        memcpy(node_entries, root_entries, root_count_limit.count * sizeof(ext2_dx_entry));
+        node_count_limit.limit = node_limit;
+        result = write_directory_block(node_index_or.value(), node.data());
+        if (result.is_error())
+            return result;
+
+        root_count_limit.count = 1;
+        root_entries[0].block = node_index_or.value();
+        root_info.indirect_levels = 1;
+        result = write_directory_block(0, root.data());
+        if (result.is_error())
+            return result;
+        return true;
+    }
+
+    // Split the full index node in two, which needs room for another entry in the root.
+    if (root_count_limit.count == root_count_limit.limit)
+        return false;
+
+    auto& frame = lookup.frames.last();
+    result = read_directory_block(frame.block_index, node.data());
+    if (result.is_error())
+        return result;
+    auto* node_entries = reinterpret_cast<ext2_dx_entry*>(node.data() + directory_index_node_entries_offset);
+    auto& node_count_limit = *reinterpret_cast<ext2_dx_countlimit*>(node_entries);
+    size_t split_index = node_count_limit.count / 2;
+    u32 split_hash = node_entries[split_index].hash;
+
+    auto new_node = ByteBuffer::create_uninitialized(block_size);
+    initialize_directory_index_node(new_node.data(), block_size);
+    auto* new_node_entries = reinterpret_cast<ext2_dx_entry*>(new_node.data() + directory_index_node_entries_offset);
+    auto& new_node_count_limit = *reinterpret_cast<ext2_dx_countlimit*>(new_node_entries);
+    size_t moved_count = node_count_limit.count - split_index;
+    for (size_t i = 0; i < moved_count; ++i)
+        new_node_entries[i].block = node_entries[split_index + i].block;
+    for (size_t i = 1; i < moved_count; ++i)
+        new_node_entries[i].hash = node_entries[split_index + i].hash;
+    new_node_count_limit.count = moved_count;
+    node_count_limit.count = split_index;
+
+    auto new_node_index_or = append_directory_block();
+    if (new_node_index_or.is_error())
+        return new_node_index_or.error();
+    result = write_directory_block(new_node_index_or.value(), new_node.data());
+    if (result.is_error())
+        return result;
+    result = write_directory_block(frame.block_index, node.data());
+    if (result.is_error())
+        return result;
+
+    size_t insert_index = lookup.frames.first().entry_index + 1;
+    memmove(&root_entries[insert_index + 1], &root_entries[insert_index], (root_count_limit.count - insert_index) * sizeof(ext2_dx_entry));
+    root_entries[insert_index].hash = split_hash;
+    root_entries[insert_index].block = new_node_index_or.value();
+    ++root_count_limit.count;
+    result = write_directory_block(0, root.data());
+    if (result.is_error())
+        return result;
+    return true;
+}
+
 unsigned Ext2FS::inodes_per_block() const
 {
     return EXT2_INODES_PER_BLOCK(&super_block());
@@ -1126,11 +1895,11 @@ bool Ext2FS::write_ext2_inode(unsigned inode, const ext2_inode& e2inode)
     return write_block(block_index, buffer, inode_size(), offset) >= 0;
 }
 
-Vector<Ext2FS::BlockIndex> Ext2FS::allocate_blocks(GroupIndex preferred_group_index, size_t count)
+Vector<Ext2FS::BlockIndex> Ext2FS::allocate_blocks(GroupIndex preferred_group_index, size_t count, BlockIndex goal)
 {
     LOCKER(m_lock);
 #ifdef EXT2_DEBUG
-    dbg() << "Ext2FS: allocate_blocks(preferred group: " << preferred_group_index << ", count: " << count << ")";
+    dbg() << "Ext2FS: allocate_blocks(preferred group: " << preferred_group_index << ", count: " << count << ", goal: " << goal << ")";
 #endif
     if (count == 0)
         return {};
@@ -1141,44 +1910,70 @@ Vector<Ext2FS::BlockIndex> Ext2FS::allocate_blocks(GroupIndex preferred_group_in
 #endif
     blocks.ensure_capacity(count);
 
-    GroupIndex group_index = preferred_group_index;
-
-    if (!group_descriptor(preferred_group_index).bg_free_blocks_count) {
-        group_index = 1;
+    // Try to continue right where the caller left off, so that a growing file stays contiguous on disk.
+    if (goal) {
+        size_t allocated_at_goal = allocate_contiguous_blocks(goal, count);
+        for (size_t i = 0; i < allocated_at_goal; ++i)
+            blocks.unchecked_append(goal + i);
+        if (blocks.size() == count)
+            return blocks;
     }
 
-    while (blocks.size() < count) {
+    // Other inodes' preallocation windows are left alone for as long as there are free blocks
+    // outside of them. Only once every free block is reserved do real allocations take them.
+    auto find_group = [&](bool include_reserved) -> GroupIndex {
+        auto has_room = [&](GroupIndex group_index) {
+            size_t free_blocks = group_descriptor(group_index).bg_free_blocks_count;
+            return include_reserved ? free_blocks > 0 : free_blocks > reserved_block_count(group_index);
+        };
+        if (has_room(preferred_group_index))
+            return preferred_group_index;
+        for (GroupIndex group_index = 1; group_index <= m_block_group_count; ++group_index) {
+            if (has_room(group_index))
+                return group_index;
+        }
+        return 0;
+    };
 
-        bool found_a_group = false;
-        if (group_descriptor(group_index).bg_free_blocks_count) {
-            found_a_group = true;
-        } else {
-            if (group_index == preferred_group_index)
-                group_index = 1;
-            for (; group_index <= m_block_group_count; ++group_index) {
-                if (group_descriptor(group_index).bg_free_blocks_count) {
-                    found_a_group = true;
-                    break;
-                }
-            }
+    while (blocks.size() < count) {
+        bool take_reserved = false;
+        GroupIndex group_index = find_group(false);
+        if (!group_index) {
+            group_index = find_group(true);
+            take_reserved = true;
         }
+        ASSERT(group_index);
 
-        ASSERT(found_a_group);
         auto& bgd = group_descriptor(group_index);
         auto& cached_bitmap = get_bitmap_block(bgd.bg_block_bitmap);
 
         int blocks_in_group = min(blocks_per_group(), super_block().s_blocks_count);
         auto block_bitmap = Bitmap::wrap(cached_bitmap.buffer.data(), blocks_in_group);
-
         BlockIndex first_block_in_group = (group_index - 1) * blocks_per_group() + first_block_index();
+
+        // Search a copy of the bitmap that has the reserved blocks marked as used, so the
+        // range we find can't run into somebody's window.
+        ByteBuffer search_buffer;
+        if (!take_reserved && reserved_block_count(group_index)) {
+            search_buffer = ByteBuffer::copy(cached_bitmap.buffer.data(), ceil_div(blocks_in_group, 8));
+            block_bitmap = Bitmap::wrap(search_buffer.data(), blocks_in_group);
+            for (auto block_index : m_reserved_blocks) {
+                if (group_index_from_block_index(block_index) == group_index)
+                    block_bitmap.set(block_index - first_block_in_group, true);
+            }
+        }
+
         size_t free_region_size = 0;
         auto first_unset_bit_index = block_bitmap.find_longest_range_of_unset_bits(count - blocks.size(), free_region_size);
         ASSERT(first_unset_bit_index.has_value());
 #ifdef EXT2_DEBUG
-        dbg() << "Ext2FS: allocating free region of size: " << free_region_size << "[" << group_index << "]";
+        dbg() << "Ext2FS: allocating free region of size: " << free_region_size << "[" << group_index << "]" << (take_reserved ? " from preallocation windows" : "");
 #endif
         for (size_t i = 0; i < free_region_size; ++i) {
             BlockIndex block_index = (first_unset_bit_index.value() + i) + first_block_in_group;
+            // The owners of a window we take from notice when claim_reserved_block() fails.
+            if (take_reserved)
+                unreserve_block(block_index);
             set_block_allocation_state(block_index, true);
             blocks.unchecked_append(block_index);
 #ifdef EXT2_DEBUG
@@ -1191,6 +1986,91 @@ Vector<Ext2FS::BlockIndex> Ext2FS::allocate_blocks(GroupIndex preferred_group_in
     return blocks;
 }
 
+size_t Ext2FS::allocate_contiguous_blocks(BlockIndex first_block, size_t max_count)
+{
+    LOCKER(m_lock);
+    size_t count = reserve_contiguous_blocks(first_block, max_count);
+    for (size_t i = 0; i < count; ++i) {
+        unreserve_block(first_block + i);
+        set_block_allocation_state(first_block + i, true);
+    }
+    return count;
+}
+
+size_t Ext2FS::reserve_contiguous_blocks(BlockIndex first_block, size_t max_count)
+{
+    LOCKER(m_lock);
+    if (first_block < first_block_index() || first_block >= super_block().s_blocks_count)
+        return 0;
+
+    GroupIndex group_index = group_index_from_block_index(first_block);
+    auto& bgd = group_descriptor(group_index);
+    if (!bgd.bg_free_blocks_count)
+        return 0;
+
+    auto& cached_bitmap = get_bitmap_block(bgd.bg_block_bitmap);
+    auto block_bitmap = cached_bitmap.bitmap(blocks_per_group());
+    BlockIndex first_block_in_group = (group_index - 1) * blocks_per_group() + first_block_index();
+
+    size_t count = 0;
+    while (count < max_count) {
+        BlockIndex block_index = first_block + count;
+        if (block_index >= super_block().s_blocks_count)
+            break;
+        unsigned bit_index = block_index - first_block_in_group;
+        if (bit_index >= blocks_per_group() || block_bitmap.get(bit_index) || m_reserved_blocks.contains(block_index))
+            break;
+        ++count;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        reserve_block(first_block + i);
+    return count;
+}
+
+void Ext2FS::reserve_block(BlockIndex block_index)
+{
+    ASSERT(m_lock.is_locked());
+    if (m_reserved_blocks.set(block_index) == AK::HashSetResult::InsertedNewEntry)
+        m_reserved_block_counts.ensure(group_index_from_block_index(block_index))++;
+}
+
+void Ext2FS::unreserve_block(BlockIndex block_index)
+{
+    ASSERT(m_lock.is_locked());
+    if (!m_reserved_blocks.remove(block_index))
+        return;
+    auto group_index = group_index_from_block_index(block_index);
+    auto it = m_reserved_block_counts.find(group_index);
+    ASSERT(it != m_reserved_block_counts.end() && it->value);
+    if (!--it->value)
+        m_reserved_block_counts.remove(it);
+}
+
+size_t Ext2FS::reserved_block_count(GroupIndex group_index) const
+{
+    return m_reserved_block_counts.get(group_index).value_or(0);
+}
+
+bool Ext2FS::claim_reserved_block(BlockIndex block_index)
+{
+    LOCKER(m_lock);
+    if (!m_reserved_blocks.contains(block_index))
+        return false;
+    unreserve_block(block_index);
+    set_block_allocation_state(block_index, true);
+    return true;
+}
+
+void Ext2FS::release_preallocated_blocks(Ext2FSInode& inode)
+{
+    LOCKER(m_lock);
+    for (unsigned i = 0; i < inode.m_preallocated_block_count; ++i)
+        unreserve_block(inode.m_preallocated_first_block + i);
+    inode.m_preallocated_first_block = 0;
+    inode.m_preallocated_block_count = 0;
+}
+
 unsigned Ext2FS::find_a_free_inode(GroupIndex preferred_group, off_t expected_size)
 {
     ASSERT(expected_size >= 0);
@@ -1560,9 +2440,17 @@ bool Ext2FSInode::populate_lookup_cache() const
 RefPtr<Inode> Ext2FSInode::lookup(StringView name)
 {
     ASSERT(is_directory());
+    LOCKER(m_lock);
+    if (m_lookup_cache.is_empty() && has_directory_index()) {
+        // Go through the index instead of reading the entire directory into the lookup cache.
+        size_t block_index = 0;
+        unsigned inode_index = 0;
+        if (find_directory_entry(name, block_index, inode_index).is_error())
+            return {};
+        return fs().get_inode({ fsid(), inode_index });
+    }
     if (!populate_lookup_cache())
         return {};
-    LOCKER(m_lock);
     auto it = m_lookup_cache.find(name.hash(), [&](auto& entry) { return entry.key == name; });
     if (it != m_lookup_cache.end())
         return fs().get_inode({ fsid(), (*it).value });
@@ -1669,9 +2557,11 @@ KResult Ext2FSInode::truncate(u64 size)
     LOCKER(m_lock);
     if (static_cast<u64>(m_raw_inode.i_size) == size)
         return KSuccess;
+    size_t old_size = m_raw_inode.i_size;
     auto result = resize(size);
     if (result.is_error())
         return result;
+    inode_size_changed(old_size, size);
     set_metadata_dirty(true);
     return KSuccess;
 }
@@ -1709,6 +2599,8 @@ KResult Ext2FS::prepare_to_unmount() const
             return KResult(-EBUSY);
     }
 
+    for (auto& it : m_inode_cache)
+        const_cast<Ext2FS&>(*this).release_preallocated_blocks(*it.value);
     m_inode_cache.clear();
     return KSuccess;
 }
@@ -28,6 +28,7 @@
 
 #include <AK/Bitmap.h>
 #include <AK/HashMap.h>
+#include <AK/HashTable.h>
 #include <Kernel/FileSystem/BlockBasedFileSystem.h>
 #include <Kernel/FileSystem/Inode.h>
 #include <Kernel/FileSystem/ext2_fs.h>
@@ -81,6 +82,32 @@ private:
     bool populate_lookup_cache() const;
     KResult resize(u64);
 
+    // Directories are updated one block at a time. Large directories are indexed by
+    // name hash (the "htree" layout), which lets lookups and updates go straight to
+    // the leaf block that holds a name.
+    struct DirectoryIndexFrame {
+        size_t block_index { 0 };
+        size_t entries_offset { 0 };
+        size_t entry_index { 0 };
+    };
+    struct DirectoryIndexLookup {
+        u32 hash { 0 };
+        u8 hash_version { 0 };
+        Vector<DirectoryIndexFrame, 2> frames;
+        // The leaf the hash belongs in, followed by leaves continuing a run of colliding hashes.
+        Vector<size_t, 1> leaf_blocks;
+    };
+    bool has_directory_index() const;
+    KResult find_directory_index_leaf(const StringView& name, DirectoryIndexLookup&) const;
+    KResult find_directory_entry(const StringView& name, size_t& block_index, unsigned& inode_index) const;
+    KResult add_directory_entry(const StringView& name, unsigned inode_index, u8 file_type);
+    KResultOr<bool> add_directory_entry_to_index(const StringView& name, unsigned inode_index, u8 file_type);
+    KResultOr<bool> grow_directory_index(const DirectoryIndexLookup&);
+    KResult convert_to_indexed_directory();
+    KResult read_directory_block(size_t block_index, u8* buffer) const;
+    KResult write_directory_block(size_t block_index, const u8* buffer);
+    KResultOr<size_t> append_directory_block();
+
     static u8 file_type_for_directory_entry(const ext2_dir_entry_2&);
 
     Ext2FS& fs();
@@ -90,6 +117,12 @@ private:
     mutable Vector<unsigned> m_block_list;
     mutable HashMap<String, unsigned> m_lookup_cache;
     ext2_inode m_raw_inode;
+
+    // Blocks directly following m_block_list that are reserved for this inode
+    // so that the next append stays contiguous on disk. The reservation only
+    // lives in memory; the blocks stay free on disk until they are appended.
+    unsigned m_preallocated_first_block { 0 };
+    unsigned m_preallocated_block_count { 0 };
 };
 
 class Ext2FS final : public BlockBasedFS {
@@ -109,6 +142,7 @@ public:
     virtual KResult prepare_to_unmount() const override;
 
     virtual bool supports_watchers() const override { return true; }
+    virtual bool supports_page_cache() const override { return true; }
 
     virtual u8 internal_file_type_to_directory_entry_type(const DirectoryEntryView& entry) const override;
 
@@ -118,6 +152,8 @@ private:
     typedef unsigned InodeIndex;
     explicit Ext2FS(FileDescription&);
 
+    static constexpr size_t preallocation_window_blocks = 8;
+
     const ext2_super_block& super_block() const { return m_super_block; }
     const ext2_group_desc& group_descriptor(GroupIndex) const;
     ext2_group_desc* block_group_descriptors() { return (ext2_group_desc*)m_cached_group_descriptor_table->data(); }
@@ -139,10 +175,20 @@ private:
     KResultOr<NonnullRefPtr<Inode>> create_inode(InodeIdentifier parent_id, const String& name, mode_t, off_t size, dev_t, uid_t, gid_t);
     KResult create_directory(InodeIdentifier parent_inode, const String& name, mode_t, uid_t, gid_t);
     virtual void flush_writes() override;
+    virtual void write_back() override;
+    void flush_metadata_to_cache();
+    void uncache_unused_inodes();
 
     BlockIndex first_block_index() const;
     InodeIndex find_a_free_inode(GroupIndex preferred_group, off_t expected_size);
-    Vector<BlockIndex> allocate_blocks(GroupIndex preferred_group_index, size_t count);
+    Vector<BlockIndex> allocate_blocks(GroupIndex preferred_group_index, size_t count, BlockIndex goal = 0);
+    size_t allocate_contiguous_blocks(BlockIndex first_block, size_t max_count);
+    size_t reserve_contiguous_blocks(BlockIndex first_block, size_t max_count);
+    bool claim_reserved_block(BlockIndex);
+    void reserve_block(BlockIndex);
+    void unreserve_block(BlockIndex);
+    size_t reserved_block_count(GroupIndex) const;
+    void release_preallocated_blocks(Ext2FSInode&);
     GroupIndex group_index_from_inode(InodeIndex) const;
     GroupIndex group_index_from_block_index(BlockIndex) const;
 
@@ -192,6 +238,10 @@ private:
     CachedBitmap& get_bitmap_block(BlockIndex);
 
     Vector<OwnPtr<CachedBitmap>> m_cached_bitmaps;
+
+    // Free blocks set aside for inode preallocation windows. The allocators skip them.
+    HashTable<BlockIndex> m_reserved_blocks;
+    HashMap<GroupIndex, size_t> m_reserved_block_counts;
 };
 
 inline Ext2FS& Ext2FSInode::fs()
@@ -55,6 +55,9 @@ public:
     void attach(Direction);
     void detach(Direction);
 
+    bool has_readers() const { return m_readers; }
+    bool has_writers() const { return m_writers; }
+
 private:
     // ^File
     virtual KResultOr<size_t> write(FileDescription&, size_t, const UserOrKernelBuffer&, size_t) override;
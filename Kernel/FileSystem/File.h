@@ -132,6 +132,11 @@ public:
     virtual bool is_block_device() const { return false; }
     virtual bool is_character_device() const { return false; }
     virtual bool is_socket() const { return false; }
+    virtual bool is_event_queue() const { return false; }
+
+    // Files that unblock their waiters themselves whenever they become readable or writable
+    // can spare FileDescription from evaluating the block conditions after every read and write.
+    virtual bool signals_own_block_conditions() const { return false; }
 
     virtual FileBlockCondition& block_condition() { return m_block_condition; }
 
@@ -38,6 +38,7 @@
 #include <Kernel/TTY/TTY.h>
 #include <Kernel/UnixTypes.h>
 #include <Kernel/VM/MemoryManager.h>
+#include <Kernel/VM/PageCache.h>
 #include <LibC/errno_numbers.h>
 
 namespace Kernel {
@@ -66,6 +67,7 @@ FileDescription::FileDescription(File& file)
 
 FileDescription::~FileDescription()
 {
+    EventQueue::detach_watches(m_event_queue_watches);
     if (is_socket())
         socket()->detach(*this);
     if (is_fifo())
@@ -153,6 +155,48 @@ KResultOr<size_t> FileDescription::read(UserOrKernelBuffer& buffer, size_t count
     return nread_or_error;
 }
 
+KResultOr<size_t> FileDescription::read(UserOrKernelBuffer& buffer, off_t offset, size_t count)
+{
+    if (positional_io_needs_lock()) {
+        LOCKER(m_lock);
+        return read_at(buffer, offset, count);
+    }
+    // Threads sharing the description can run these concurrently.
+    return read_at(buffer, offset, count);
+}
+
+KResultOr<size_t> FileDescription::read_at(UserOrKernelBuffer& buffer, off_t offset, size_t count)
+{
+    if (!m_file->is_seekable())
+        return -ESPIPE;
+    if (offset < 0)
+        return -EINVAL;
+    Checked<size_t> end_offset = offset;
+    end_offset += count;
+    if (end_offset.has_overflow())
+        return -EOVERFLOW;
+    auto nread_or_error = m_file->read(*this, offset, buffer, count);
+    if (!nread_or_error.is_error())
+        evaluate_block_conditions();
+    return nread_or_error;
+}
+
+size_t FileDescription::update_readahead_window(off_t offset, size_t nread)
+{
+    ASSERT(m_readahead_lock.is_locked());
+    if (offset != m_readahead_expected_offset) {
+        // Not a sequential read, stop reading ahead until the reader settles down again.
+        m_readahead_window = 0;
+        m_readahead_issued_until = 0;
+    } else if (!m_readahead_window) {
+        m_readahead_window = PageCache::readahead_initial_window_pages;
+    } else {
+        m_readahead_window = min(m_readahead_window * 2, PageCache::readahead_max_window_pages);
+    }
+    m_readahead_expected_offset = offset + nread;
+    return m_readahead_window;
+}
+
 KResultOr<size_t> FileDescription::write(const UserOrKernelBuffer& data, size_t size)
 {
     LOCKER(m_lock);
@@ -169,6 +213,31 @@ KResultOr<size_t> FileDescription::write(const UserOrKernelBuffer& data, size_t
     return nwritten_or_error;
 }
 
+KResultOr<size_t> FileDescription::write(const UserOrKernelBuffer& data, off_t offset, size_t size)
+{
+    if (positional_io_needs_lock()) {
+        LOCKER(m_lock);
+        return write_at(data, offset, size);
+    }
+    return write_at(data, offset, size);
+}
+
+KResultOr<size_t> FileDescription::write_at(const UserOrKernelBuffer& data, off_t offset, size_t size)
+{
+    if (!m_file->is_seekable())
+        return -ESPIPE;
+    if (offset < 0)
+        return -EINVAL;
+    Checked<size_t> end_offset = offset;
+    end_offset += size;
+    if (end_offset.has_overflow())
+        return -EOVERFLOW;
+    auto nwritten_or_error = m_file->write(*this, offset, data, size);
+    if (!nwritten_or_error.is_error())
+        evaluate_block_conditions();
+    return nwritten_or_error;
+}
+
 bool FileDescription::can_write() const
 {
     return m_file->can_write(*this, offset());
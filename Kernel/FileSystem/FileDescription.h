@@ -29,6 +29,8 @@
 #include <AK/Badge.h>
 #include <AK/ByteBuffer.h>
 #include <AK/RefCounted.h>
+#include <AK/Weakable.h>
+#include <Kernel/FileSystem/EventQueue.h>
 #include <Kernel/FileSystem/FIFO.h>
 #include <Kernel/FileSystem/Inode.h>
 #include <Kernel/FileSystem/InodeMetadata.h>
@@ -38,7 +40,9 @@
 
 namespace Kernel {
 
-class FileDescription : public RefCounted<FileDescription> {
+class FileDescription
+    : public RefCounted<FileDescription>
+    , public Weakable<FileDescription> {
     MAKE_SLAB_ALLOCATED(FileDescription)
 public:
     static NonnullRefPtr<FileDescription> create(Custody&);
@@ -63,7 +67,9 @@ public:
 
     off_t seek(off_t, int whence);
     KResultOr<size_t> read(UserOrKernelBuffer&, size_t);
+    KResultOr<size_t> read(UserOrKernelBuffer&, off_t, size_t);
     KResultOr<size_t> write(const UserOrKernelBuffer& data, size_t);
+    KResultOr<size_t> write(const UserOrKernelBuffer& data, off_t, size_t);
     KResult stat(::stat&);
 
     KResult chmod(mode_t);
@@ -79,6 +85,13 @@ public:
 
     bool is_direct() const { return m_direct; }
 
+    // Sequential access detection for readahead. Positional reads don't hold m_lock,
+    // so this state is guarded by its own lock instead.
+    SpinLock<u8>& readahead_lock() { return m_readahead_lock; }
+    size_t update_readahead_window(off_t offset, size_t nread);
+    size_t readahead_issued_until() const { return m_readahead_issued_until; }
+    void set_readahead_issued_until(size_t page_index) { m_readahead_issued_until = page_index; }
+
     bool is_directory() const { return m_is_directory; }
 
     File& file() { return *m_file; }
@@ -122,6 +135,8 @@ public:
     FIFO::Direction fifo_direction() { return m_fifo_direction; }
     void set_fifo_direction(Badge<FIFO>, FIFO::Direction direction) { m_fifo_direction = direction; }
 
+    EventQueue::WatchList& event_queue_watches(Badge<EventQueue::Watch>) { return m_event_queue_watches; }
+
     OwnPtr<KBuffer>& generator_cache() { return m_generator_cache; }
 
     void set_original_inode(Badge<VFS>, NonnullRefPtr<Inode>&& inode) { m_inode = move(inode); }
@@ -139,8 +154,16 @@ private:
     explicit FileDescription(File&);
     FileDescription(FIFO&, FIFO::Direction);
 
+    // Positional I/O leaves the current offset alone, but some files (like ProcFS with its generator
+    // cache) keep other state in the description. Only files on a disk-backed filesystem do without m_lock.
+    bool positional_io_needs_lock() const { return !m_inode || !m_inode->fs().is_file_backed(); }
+    KResultOr<size_t> read_at(UserOrKernelBuffer&, off_t, size_t);
+    KResultOr<size_t> write_at(const UserOrKernelBuffer&, off_t, size_t);
+
     void evaluate_block_conditions()
     {
+        if (m_file->signals_own_block_conditions())
+            return;
         block_condition().unblock();
     }
 
@@ -150,6 +173,11 @@ private:
 
     off_t m_current_offset { 0 };
 
+    off_t m_readahead_expected_offset { 0 };
+    size_t m_readahead_window { 0 };
+    size_t m_readahead_issued_until { 0 };
+    SpinLock<u8> m_readahead_lock;
+
     OwnPtr<KBuffer> m_generator_cache;
 
     u32 m_file_flags { 0 };
@@ -162,6 +190,8 @@ private:
     bool m_direct : 1 { false };
     FIFO::Direction m_fifo_direction { FIFO::Direction::Neither };
 
+    EventQueue::WatchList m_event_queue_watches;
+
     Lock m_lock { "FileDescription" };
 };
 
@@ -35,6 +35,7 @@
 #include <Kernel/FileSystem/VirtualFileSystem.h>
 #include <Kernel/KBufferBuilder.h>
 #include <Kernel/Net/LocalSocket.h>
+#include <Kernel/VM/PageCache.h>
 #include <Kernel/VM/SharedInodeVMObject.h>
 
 namespace Kernel {
@@ -140,6 +141,11 @@ void Inode::will_be_destroyed()
 void Inode::inode_contents_changed(off_t offset, ssize_t size, const UserOrKernelBuffer& data)
 {
     LOCKER(m_lock);
+    if (fs().supports_page_cache() && size > 0) {
+        size_t first_page_index = offset / PAGE_SIZE;
+        size_t last_page_index = (offset + size - 1) / PAGE_SIZE;
+        PageCache::the().invalidate(identifier(), first_page_index, last_page_index - first_page_index + 1);
+    }
     if (auto shared_vmobject = this->shared_vmobject())
         shared_vmobject->inode_contents_changed({}, offset, size, data);
 }
@@ -147,6 +153,8 @@ void Inode::inode_contents_changed(off_t offset, ssize_t size, const UserOrKerne
 void Inode::inode_size_changed(size_t old_size, size_t new_size)
 {
     LOCKER(m_lock);
+    if (fs().supports_page_cache())
+        PageCache::the().invalidate(identifier(), min(old_size, new_size) / PAGE_SIZE);
     if (auto shared_vmobject = this->shared_vmobject())
         shared_vmobject->inode_size_changed({}, old_size, new_size);
 }
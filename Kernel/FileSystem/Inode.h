@@ -47,6 +47,7 @@ class Inode : public RefCounted<Inode>
     , public InlineLinkedListNode<Inode> {
     friend class VFS;
     friend class FS;
+    friend class PageCache;
 
 public:
     virtual ~Inode();
@@ -58,6 +58,7 @@
 #include <Kernel/TTY/TTY.h>
 #include <Kernel/VM/AnonymousVMObject.h>
 #include <Kernel/VM/MemoryManager.h>
+#include <Kernel/VM/PageCache.h>
 #include <LibC/errno_numbers.h>
 
 //#define PROCFS_DEBUG
@@ -86,10 +87,12 @@ enum ProcFileType {
     FI_Root_df,
     FI_Root_all,
     FI_Root_memstat,
+    FI_Root_kmalloc,
     FI_Root_cpuinfo,
     FI_Root_inodes,
     FI_Root_dmesg,
     FI_Root_interrupts,
+    FI_Root_big_lock,
     FI_Root_keymap,
     FI_Root_pci,
     FI_Root_devices,
@@ -320,32 +323,32 @@ static OwnPtr<KBuffer> procfs$pid_vm(InodeIdentifier identifier)
     {
         ScopedSpinLock lock(process->get_lock());
         for (auto& region : process->regions()) {
-            if (!region.is_user_accessible() && !Process::current()->is_superuser())
+            if (!region->is_user_accessible() && !Process::current()->is_superuser())
                 continue;
             auto region_object = array.add_object();
-            region_object.add("readable", region.is_readable());
-            region_object.add("writable", region.is_writable());
-            region_object.add("executable", region.is_executable());
-            region_object.add("stack", region.is_stack());
-            region_object.add("shared", region.is_shared());
-            region_object.add("user_accessible", region.is_user_accessible());
-            region_object.add("purgeable", region.vmobject().is_anonymous());
-            if (region.vmobject().is_anonymous()) {
-                region_object.add("volatile", static_cast<const AnonymousVMObject&>(region.vmobject()).is_any_volatile());
+            region_object.add("readable", region->is_readable());
+            region_object.add("writable", region->is_writable());
+            region_object.add("executable", region->is_executable());
+            region_object.add("stack", region->is_stack());
+            region_object.add("shared", region->is_shared());
+            region_object.add("user_accessible", region->is_user_accessible());
+            region_object.add("purgeable", region->vmobject().is_anonymous());
+            if (region->vmobject().is_anonymous()) {
+                region_object.add("volatile", static_cast<const AnonymousVMObject&>(region->vmobject()).is_any_volatile());
             }
-            region_object.add("cacheable", region.is_cacheable());
-            region_object.add("kernel", region.is_kernel());
-            region_object.add("address", region.vaddr().get());
-            region_object.add("size", region.size());
-            region_object.add("amount_resident", region.amount_resident());
-            region_object.add("amount_dirty", region.amount_dirty());
-            region_object.add("cow_pages", region.cow_pages());
-            region_object.add("name", region.name());
-            region_object.add("vmobject", region.vmobject().class_name());
+            region_object.add("cacheable", region->is_cacheable());
+            region_object.add("kernel", region->is_kernel());
+            region_object.add("address", region->vaddr().get());
+            region_object.add("size", region->size());
+            region_object.add("amount_resident", region->amount_resident());
+            region_object.add("amount_dirty", region->amount_dirty());
+            region_object.add("cow_pages", region->cow_pages());
+            region_object.add("name", region->name());
+            region_object.add("vmobject", region->vmobject().class_name());
 
             StringBuilder pagemap_builder;
-            for (size_t i = 0; i < region.page_count(); ++i) {
-                auto* page = region.physical_page(i);
+            for (size_t i = 0; i < region->page_count(); ++i) {
+                auto* page = region->physical_page(i);
                 if (!page)
                     pagemap_builder.append('N');
                 else if (page->is_shared_zero_page() || page->is_lazy_committed_page())
@@ -399,6 +402,26 @@ static OwnPtr<KBuffer> procfs$interrupts(InodeIdentifier)
     return builder.build();
 }
 
+static OwnPtr<KBuffer> procfs$big_lock(InodeIdentifier)
+{
+    KBufferBuilder builder;
+    JsonArraySerializer array { builder };
+    for (u32 i = 0; i < Syscall::Function::__Count; ++i) {
+        auto function = static_cast<Syscall::Function>(i);
+        auto statistics = Syscall::big_lock_statistics(function);
+        if (!statistics.call_count)
+            continue;
+        auto obj = array.add_object();
+        obj.add("syscall", Syscall::to_string(function));
+        obj.add("needs_big_lock", Syscall::needs_big_process_lock(function));
+        obj.add("call_count", statistics.call_count);
+        obj.add("locked_call_count", statistics.locked_call_count);
+        obj.add("cycles_held", statistics.cycles_held);
+    }
+    array.finish();
+    return builder.build();
+}
+
 static OwnPtr<KBuffer> procfs$keymap(InodeIdentifier)
 {
     KBufferBuilder builder;
@@ -602,19 +625,19 @@ static OwnPtr<KBuffer> procfs$pid_vmobjects(InodeIdentifier identifier)
         ScopedSpinLock lock(process->get_lock());
         for (auto& region : process->regions()) {
             builder.appendf("%x -- %x    %x    %s\n",
-                region.vaddr().get(),
-                region.vaddr().offset(region.size() - 1).get(),
-                region.size(),
-                region.name().characters());
+                region->vaddr().get(),
+                region->vaddr().offset(region->size() - 1).get(),
+                region->size(),
+                region->name().characters());
             builder.appendf("VMO: %s @ %x(%u)\n",
-                region.vmobject().is_anonymous() ? "anonymous" : "file-backed",
-                &region.vmobject(),
-                region.vmobject().ref_count());
-            for (size_t i = 0; i < region.vmobject().page_count(); ++i) {
-                auto& physical_page = region.vmobject().physical_pages()[i];
+                region->vmobject().is_anonymous() ? "anonymous" : "file-backed",
+                &region->vmobject(),
+                region->vmobject().ref_count());
+            for (size_t i = 0; i < region->vmobject().page_count(); ++i) {
+                auto& physical_page = region->vmobject().physical_pages()[i];
                 bool should_cow = false;
-                if (i >= region.first_page_index() && i <= region.last_page_index())
-                    should_cow = region.should_cow(i - region.first_page_index());
+                if (i >= region->first_page_index() && i <= region->last_page_index())
+                    should_cow = region->should_cow(i - region->first_page_index());
                 builder.appendf("P%x%s(%u) ",
                     physical_page ? physical_page->paddr().get() : 0,
                     should_cow ? "!" : "",
@@ -813,19 +836,41 @@ OwnPtr<KBuffer> procfs$memstat(InodeIdentifier)
     json.add("kmalloc_eternal_allocated", stats.bytes_eternal);
     json.add("user_physical_allocated", MM.user_physical_pages_used());
     json.add("user_physical_available", MM.user_physical_pages() - MM.user_physical_pages_used());
+    json.add("page_cache_pages", PageCache::the().page_count());
     json.add("super_physical_allocated", MM.super_physical_pages_used());
     json.add("super_physical_available", MM.super_physical_pages() - MM.super_physical_pages_used());
+    json.add("large_page_mappings", MM.large_page_mappings());
+    json.add("large_page_splits", MM.large_page_splits());
+    json.add("tlb_shootdowns", Processor::tlb_shootdown_count());
     json.add("kmalloc_call_count", stats.kmalloc_call_count);
     json.add("kfree_call_count", stats.kfree_call_count);
-    slab_alloc_stats([&json](size_t slab_size, size_t num_allocated, size_t num_free) {
-        auto prefix = String::format("slab_%zu", slab_size);
-        json.add(String::format("%s_num_allocated", prefix.characters()), num_allocated);
-        json.add(String::format("%s_num_free", prefix.characters()), num_free);
+    slab_alloc_stats([&json](auto& slab_stats) {
+        auto prefix = String::format("slab_%zu", slab_stats.object_size);
+        json.add(String::format("%s_num_allocated", prefix.characters()), slab_stats.allocated);
+        json.add(String::format("%s_num_free", prefix.characters()), slab_stats.free + slab_stats.cached);
     });
     json.finish();
     return builder.build();
 }
 
+static OwnPtr<KBuffer> procfs$kmalloc(InodeIdentifier)
+{
+    KBufferBuilder builder;
+    JsonArraySerializer array { builder };
+    slab_alloc_stats([&array](auto& slab_stats) {
+        auto obj = array.add_object();
+        obj.add("size", slab_stats.object_size);
+        obj.add("objects", slab_stats.object_count);
+        obj.add("allocated", slab_stats.allocated);
+        obj.add("free", slab_stats.free);
+        obj.add("cached", slab_stats.cached);
+        obj.add("alloc_count", slab_stats.alloc_count);
+        obj.add("free_count", slab_stats.free_count);
+    });
+    array.finish();
+    return builder.build();
+}
+
 static OwnPtr<KBuffer> procfs$all(InodeIdentifier)
 {
     KBufferBuilder builder;
@@ -1688,12 +1733,14 @@ ProcFS::ProcFS()
     m_entries[FI_Root_df] = { "df", FI_Root_df, false, procfs$df };
     m_entries[FI_Root_all] = { "all", FI_Root_all, false, procfs$all };
     m_entries[FI_Root_memstat] = { "memstat", FI_Root_memstat, false, procfs$memstat };
+    m_entries[FI_Root_kmalloc] = { "kmalloc", FI_Root_kmalloc, false, procfs$kmalloc };
     m_entries[FI_Root_cpuinfo] = { "cpuinfo", FI_Root_cpuinfo, false, procfs$cpuinfo };
     m_entries[FI_Root_inodes] = { "inodes", FI_Root_inodes, true, procfs$inodes };
     m_entries[FI_Root_dmesg] = { "dmesg", FI_Root_dmesg, true, procfs$dmesg };
     m_entries[FI_Root_self] = { "self", FI_Root_self, false, procfs$self };
     m_entries[FI_Root_pci] = { "pci", FI_Root_pci, false, procfs$pci };
     m_entries[FI_Root_interrupts] = { "interrupts", FI_Root_interrupts, false, procfs$interrupts };
+    m_entries[FI_Root_big_lock] = { "big_lock", FI_Root_big_lock, false, procfs$big_lock };
     m_entries[FI_Root_keymap] = { "keymap", FI_Root_keymap, false, procfs$keymap };
     m_entries[FI_Root_devices] = { "devices", FI_Root_devices, false, procfs$devices };
     m_entries[FI_Root_uptime] = { "uptime", FI_Root_uptime, false, procfs$uptime };
@@ -35,6 +35,7 @@ class Custody;
 class Device;
 class DiskCache;
 class DoubleBuffer;
+class EventQueue;
 class File;
 class FileDescription;
 class IPv4Socket;
@@ -58,6 +59,7 @@ class ThreadTracer;
 class Range;
 class RangeAllocator;
 class Region;
+class RingBuffer;
 class Scheduler;
 class SchedulerPerProcessorData;
 class SharedBuffer;
@@ -26,162 +26,280 @@
 
 #include <AK/Assertions.h>
 #include <AK/Memory.h>
+#include <Kernel/Arch/i386/CPU.h>
 #include <Kernel/Heap/SlabAllocator.h>
 #include <Kernel/Heap/kmalloc.h>
 #include <Kernel/SpinLock.h>
-#include <Kernel/VM/Region.h>
 
 #define SANITIZE_SLABS
 
 namespace Kernel {
 
-template<size_t templated_slab_size>
-class SlabAllocator {
-public:
-    SlabAllocator() { }
+// Every slab object is preceded by a tag word that occupies the same slot as the
+// kmalloc heap's AllocationHeader, which lets kfree() tell the two apart. Heap
+// chunk counts never get anywhere near the tag range.
+static constexpr size_t slab_tag = 0x5ab00000;
+static constexpr size_t slab_tag_mask = ~(size_t)0xff;
+static constexpr size_t slab_block_size = 16 * KiB;
+static constexpr size_t slab_magazine_capacity = 32;
+static constexpr size_t slab_reserve_block_count = 4;
 
-    void init(size_t size)
-    {
-        m_base = kmalloc_eternal(size);
-        m_end = (u8*)m_base + size;
-        FreeSlab* slabs = (FreeSlab*)m_base;
-        m_slab_count = size / templated_slab_size;
-        for (size_t i = 1; i < m_slab_count; ++i) {
-            slabs[i].next = &slabs[i - 1];
+static_assert(slab_max_object_size <= slab_block_size);
+
+struct FreeSlabObject {
+    FreeSlabObject* next;
+};
+
+// Expanding the kmalloc heap allocates Regions and PhysicalPages, which may need to
+// grow their size class while the heap can't hand out any memory. Those growths are
+// served from a few blocks that we keep in reserve, and top up whenever we can.
+static SpinLock<u8> s_reserve_lock;
+static u8* s_reserve_blocks[slab_reserve_block_count];
+static size_t s_reserve_block_count;
+
+static void refill_slab_reserve()
+{
+    for (;;) {
+        {
+            ScopedSpinLock lock(s_reserve_lock);
+            if (s_reserve_block_count == slab_reserve_block_count)
+                return;
         }
-        slabs[0].next = nullptr;
-        m_freelist = &slabs[m_slab_count - 1];
-        m_num_allocated.store(0, AK::MemoryOrder::memory_order_release);
+        u8* block = (u8*)kmalloc_impl(slab_block_size);
+        ScopedSpinLock lock(s_reserve_lock);
+        if (s_reserve_block_count == slab_reserve_block_count) {
+            // Someone else beat us to it.
+            lock.unlock();
+            kfree(block);
+            return;
+        }
+        s_reserve_blocks[s_reserve_block_count++] = block;
     }
+}
 
-    constexpr size_t slab_size() const { return templated_slab_size; }
-    size_t slab_count() const { return m_slab_count; }
+static u8* allocate_slab_block()
+{
+    if (kmalloc_is_expanding_heap()) {
+        ScopedSpinLock lock(s_reserve_lock);
+        ASSERT(s_reserve_block_count > 0);
+        return s_reserve_blocks[--s_reserve_block_count];
+    }
+    refill_slab_reserve();
+    return (u8*)kmalloc_impl(slab_block_size);
+}
 
-    void* alloc()
+class SlabSizeClass {
+public:
+    void init(size_t index)
     {
-        FreeSlab* free_slab;
-        {
-            // We want to avoid being swapped out in the middle of this
-            ScopedCritical critical;
-            FreeSlab* next_free;
-            free_slab = m_freelist.load(AK::memory_order_consume);
-            do {
-                if (!free_slab)
-                    return kmalloc(slab_size());
-                // It's possible another processor is doing the same thing at
-                // the same time, so next_free *can* be a bogus pointer. However,
-                // in that case compare_exchange_strong would fail and we would
-                // try again.
-                next_free = free_slab->next;
-            } while (!m_freelist.compare_exchange_strong(free_slab, next_free, AK::memory_order_acq_rel));
-
-            m_num_allocated.fetch_add(1, AK::MemoryOrder::memory_order_acq_rel);
-        }
+        m_index = index;
+        m_object_size = slab_min_object_size << index;
+    }
 
-#ifdef SANITIZE_SLABS
-        memset(free_slab, SLAB_ALLOC_SCRUB_BYTE, slab_size());
-#endif
-        return free_slab;
+    size_t object_size() const { return m_object_size; }
+    size_t object_count() const { return m_object_count; }
+    size_t free_count() const { return m_free_count; }
+
+    size_t take(void** objects, size_t count)
+    {
+        for (;;) {
+            {
+                ScopedSpinLock lock(m_lock);
+                if (m_free_list) {
+                    size_t taken = 0;
+                    while (taken < count && m_free_list) {
+                        objects[taken++] = m_free_list;
+                        m_free_list = m_free_list->next;
+                    }
+                    m_free_count -= taken;
+                    return taken;
+                }
+            }
+            grow();
+        }
     }
 
-    void dealloc(void* ptr)
+    void give(void** objects, size_t count)
     {
-        ASSERT(ptr);
-        if (ptr < m_base || ptr >= m_end) {
-            kfree(ptr);
-            return;
+        ScopedSpinLock lock(m_lock);
+        for (size_t i = 0; i < count; ++i) {
+            auto* object = (FreeSlabObject*)objects[i];
+            object->next = m_free_list;
+            m_free_list = object;
         }
-        FreeSlab* free_slab = (FreeSlab*)ptr;
-#ifdef SANITIZE_SLABS
-        if (slab_size() > sizeof(FreeSlab*))
-            memset(free_slab->padding, SLAB_DEALLOC_SCRUB_BYTE, sizeof(FreeSlab::padding));
-#endif
+        m_free_count += count;
+    }
 
-        // We want to avoid being swapped out in the middle of this
-        ScopedCritical critical;
-        FreeSlab* next_free = m_freelist.load(AK::memory_order_consume);
-        do {
-            free_slab->next = next_free;
-        } while (!m_freelist.compare_exchange_strong(next_free, free_slab, AK::memory_order_acq_rel));
+private:
+    void grow()
+    {
+        // NOTE: This must not happen while holding m_lock, because expanding the
+        //       kmalloc heap may need to allocate objects from this very class.
+        u8* block = allocate_slab_block();
+        size_t count = slab_block_size / m_object_size;
+        FreeSlabObject* first = nullptr;
+        FreeSlabObject* last = nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            u8* slot = block + i * m_object_size;
+            *(size_t*)slot = slab_tag | m_index;
+            auto* object = (FreeSlabObject*)(slot + sizeof(size_t));
+            object->next = nullptr;
+            if (last)
+                last->next = object;
+            else
+                first = object;
+            last = object;
+        }
 
-        m_num_allocated.fetch_sub(1, AK::MemoryOrder::memory_order_acq_rel);
+        ScopedSpinLock lock(m_lock);
+        last->next = m_free_list;
+        m_free_list = first;
+        m_free_count += count;
+        m_object_count += count;
     }
 
-    size_t num_allocated() const { return m_num_allocated.load(AK::MemoryOrder::memory_order_consume); }
-    size_t num_free() const { return m_slab_count - m_num_allocated.load(AK::MemoryOrder::memory_order_consume); }
+    SpinLock<u8> m_lock;
+    FreeSlabObject* m_free_list { nullptr };
+    size_t m_free_count { 0 };
+    size_t m_object_count { 0 };
+    size_t m_object_size { 0 };
+    size_t m_index { 0 };
+};
 
-private:
-    struct FreeSlab {
-        FreeSlab* next;
-        char padding[templated_slab_size - sizeof(FreeSlab*)];
-    };
-
-    Atomic<FreeSlab*> m_freelist { nullptr };
-    Atomic<ssize_t> m_num_allocated;
-    size_t m_slab_count;
-    void* m_base { nullptr };
-    void* m_end { nullptr };
-
-    static_assert(sizeof(FreeSlab) == templated_slab_size);
+struct SlabMagazine {
+    size_t count { 0 };
+    void* objects[slab_magazine_capacity];
+    size_t alloc_count { 0 };
+    size_t free_count { 0 };
+};
+
+struct SlabPerProcessorData {
+    SlabMagazine magazines[slab_size_class_count];
 };
 
-static SlabAllocator<16> s_slab_allocator_16;
-static SlabAllocator<32> s_slab_allocator_32;
-static SlabAllocator<64> s_slab_allocator_64;
-static SlabAllocator<128> s_slab_allocator_128;
+static SlabSizeClass s_size_classes[slab_size_class_count];
 
-static_assert(sizeof(Region) <= s_slab_allocator_128.slab_size());
+static size_t size_class_index_for(size_t size)
+{
+    size += sizeof(size_t);
+    size_t index = 0;
+    while ((slab_min_object_size << index) < size)
+        ++index;
+    ASSERT(index < slab_size_class_count);
+    return index;
+}
 
-template<typename Callback>
-void for_each_allocator(Callback callback)
+static size_t size_class_index_of(const void* ptr)
 {
-    callback(s_slab_allocator_16);
-    callback(s_slab_allocator_32);
-    callback(s_slab_allocator_64);
-    callback(s_slab_allocator_128);
+    return ((const size_t*)ptr)[-1] & ~slab_tag_mask;
+}
+
+static SlabPerProcessorData& slab_data_for_current_processor()
+{
+    auto& processor = Processor::current();
+    auto* slab_data = processor.get_slab_data();
+    if (!slab_data) {
+        slab_data = new (kmalloc_eternal(sizeof(SlabPerProcessorData))) SlabPerProcessorData;
+        processor.set_slab_data(*slab_data);
+    }
+    return *slab_data;
 }
 
 void slab_alloc_init()
 {
-    s_slab_allocator_16.init(128 * KiB);
-    s_slab_allocator_32.init(128 * KiB);
-    s_slab_allocator_64.init(512 * KiB);
-    s_slab_allocator_128.init(512 * KiB);
+    for (size_t i = 0; i < slab_size_class_count; ++i)
+        s_size_classes[i].init(i);
+    refill_slab_reserve();
 }
 
-void* slab_alloc(size_t slab_size)
+bool slab_owns(const void* ptr)
 {
-    if (slab_size <= 16)
-        return s_slab_allocator_16.alloc();
-    if (slab_size <= 32)
-        return s_slab_allocator_32.alloc();
-    if (slab_size <= 64)
-        return s_slab_allocator_64.alloc();
-    if (slab_size <= 128)
-        return s_slab_allocator_128.alloc();
-    ASSERT_NOT_REACHED();
+    size_t tag = ((const size_t*)ptr)[-1];
+    return (tag & slab_tag_mask) == slab_tag && (tag & ~slab_tag_mask) < slab_size_class_count;
 }
 
-void slab_dealloc(void* ptr, size_t slab_size)
+size_t slab_allocation_size(const void* ptr)
 {
-    if (slab_size <= 16)
-        return s_slab_allocator_16.dealloc(ptr);
-    if (slab_size <= 32)
-        return s_slab_allocator_32.dealloc(ptr);
-    if (slab_size <= 64)
-        return s_slab_allocator_64.dealloc(ptr);
-    if (slab_size <= 128)
-        return s_slab_allocator_128.dealloc(ptr);
-    ASSERT_NOT_REACHED();
+    return s_size_classes[size_class_index_of(ptr)].object_size() - sizeof(size_t);
 }
 
-void slab_alloc_stats(Function<void(size_t slab_size, size_t allocated, size_t free)> callback)
+void* slab_alloc(size_t size)
 {
-    for_each_allocator([&](auto& allocator) {
-        auto num_allocated = allocator.num_allocated();
-        auto num_free = allocator.slab_count() - num_allocated;
-        callback(allocator.slab_size(), num_allocated, num_free);
-    });
+    size_t index = size_class_index_for(size);
+    auto& size_class = s_size_classes[index];
+    void* ptr;
+    {
+        InterruptDisabler disabler;
+        auto* magazine = &slab_data_for_current_processor().magazines[index];
+        if (magazine->count == 0) {
+            void* batch[slab_magazine_capacity / 2];
+            size_t taken = size_class.take(batch, slab_magazine_capacity / 2);
+            // Growing the size class may have allocated from this magazine, so
+            // only now look at it again.
+            ptr = batch[--taken];
+            size_t i = 0;
+            while (i < taken && magazine->count < slab_magazine_capacity)
+                magazine->objects[magazine->count++] = batch[i++];
+            if (i < taken)
+                size_class.give(&batch[i], taken - i);
+        } else {
+            ptr = magazine->objects[--magazine->count];
+        }
+        ++magazine->alloc_count;
+    }
+
+#ifdef SANITIZE_SLABS
+    memset(ptr, SLAB_ALLOC_SCRUB_BYTE, size_class.object_size() - sizeof(size_t));
+#endif
+    return ptr;
+}
+
+void slab_dealloc(void* ptr)
+{
+    ASSERT(ptr);
+    ASSERT(slab_owns(ptr));
+    size_t index = size_class_index_of(ptr);
+    auto& size_class = s_size_classes[index];
+
+#ifdef SANITIZE_SLABS
+    if (size_class.object_size() - sizeof(size_t) > sizeof(FreeSlabObject))
+        memset((u8*)ptr + sizeof(FreeSlabObject), SLAB_DEALLOC_SCRUB_BYTE, size_class.object_size() - sizeof(size_t) - sizeof(FreeSlabObject));
+#endif
+
+    InterruptDisabler disabler;
+    auto& magazine = slab_data_for_current_processor().magazines[index];
+    if (magazine.count == slab_magazine_capacity) {
+        size_t half = slab_magazine_capacity / 2;
+        magazine.count -= half;
+        size_class.give(&magazine.objects[magazine.count], half);
+    }
+    magazine.objects[magazine.count++] = ptr;
+    ++magazine.free_count;
+}
+
+void slab_alloc_stats(Function<void(const SlabSizeClassStatistics&)> callback)
+{
+    for (size_t i = 0; i < slab_size_class_count; ++i) {
+        auto& size_class = s_size_classes[i];
+        SlabSizeClassStatistics stats;
+        stats.object_size = size_class.object_size();
+        stats.object_count = size_class.object_count();
+        stats.free = size_class.free_count();
+        Processor::for_each([&](Processor& processor) {
+            auto* slab_data = processor.get_slab_data();
+            if (!slab_data)
+                return IterationDecision::Continue;
+            auto& magazine = slab_data->magazines[i];
+            stats.cached += magazine.count;
+            stats.alloc_count += magazine.alloc_count;
+            stats.free_count += magazine.free_count;
+            return IterationDecision::Continue;
+        });
+        // The counters are read without stopping the other processors, so don't
+        // let a racing update make these go negative.
+        stats.allocated = stats.object_count - min(stats.object_count, stats.free + stats.cached);
+        callback(stats);
+    }
 }
 
 }
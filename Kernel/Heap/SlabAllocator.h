@@ -34,16 +34,39 @@ namespace Kernel {
 #define SLAB_ALLOC_SCRUB_BYTE 0xab
 #define SLAB_DEALLOC_SCRUB_BYTE 0xbc
 
-void* slab_alloc(size_t slab_size);
-void slab_dealloc(void*, size_t slab_size);
+// Small allocations are served from power-of-two size classes. Each processor keeps a
+// magazine of free objects per size class, so most of them don't take any shared lock.
+static constexpr size_t slab_size_class_count = 8;
+static constexpr size_t slab_min_object_size = 16;
+static constexpr size_t slab_max_object_size = slab_min_object_size << (slab_size_class_count - 1);
+static constexpr size_t slab_max_allocation_size = slab_max_object_size - sizeof(size_t);
+
+struct SlabSizeClassStatistics {
+    size_t object_size { 0 };
+    size_t object_count { 0 };
+    size_t allocated { 0 };
+    size_t free { 0 };
+    size_t cached { 0 };
+    size_t alloc_count { 0 };
+    size_t free_count { 0 };
+};
+
+void* slab_alloc(size_t);
+void slab_dealloc(void*);
+bool slab_owns(const void*);
+size_t slab_allocation_size(const void*);
 void slab_alloc_init();
-void slab_alloc_stats(Function<void(size_t slab_size, size_t allocated, size_t free)>);
+void slab_alloc_stats(Function<void(const SlabSizeClassStatistics&)>);
 
-#define MAKE_SLAB_ALLOCATED(type)                                        \
-public:                                                                  \
-    void* operator new(size_t) { return slab_alloc(sizeof(type)); }      \
-    void operator delete(void* ptr) { slab_dealloc(ptr, sizeof(type)); } \
-                                                                         \
+#define MAKE_SLAB_ALLOCATED(type)                                       \
+public:                                                                 \
+    void* operator new(size_t)                                          \
+    {                                                                   \
+        static_assert(sizeof(type) <= slab_max_allocation_size);        \
+        return slab_alloc(sizeof(type));                                \
+    }                                                                   \
+    void operator delete(void* ptr) { slab_dealloc(ptr); }              \
+                                                                        \
 private:
 
 }
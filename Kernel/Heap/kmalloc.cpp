@@ -36,6 +36,7 @@
 #include <AK/Types.h>
 #include <Kernel/Arch/i386/CPU.h>
 #include <Kernel/Heap/Heap.h>
+#include <Kernel/Heap/SlabAllocator.h>
 #include <Kernel/Heap/kmalloc.h>
 #include <Kernel/KSyms.h>
 #include <Kernel/Process.h>
@@ -63,15 +64,14 @@ struct KmallocGlobalHeap {
         {
         }
 
-        bool m_adding { false };
         bool add_memory(size_t allocation_request)
         {
             if (!MemoryManager::is_initialized()) {
                 klog() << "kmalloc(): Cannot expand heap before MM is initialized!";
                 return false;
             }
-            ASSERT(!m_adding);
-            TemporaryChange change(m_adding, true);
+            ASSERT(!m_global_heap.m_adding);
+            TemporaryChange change(m_global_heap.m_adding, true);
             // At this point we have very little memory left. Any attempt to
             // kmalloc() could fail, so use our backup memory first, so we
             // can't really reliably allocate even a new region of memory.
@@ -165,6 +165,7 @@ struct KmallocGlobalHeap {
     typedef ExpandableHeap<CHUNK_SIZE, KMALLOC_SCRUB_BYTE, KFREE_SCRUB_BYTE, ExpandGlobalHeap> HeapType;
 
     HeapType m_heap;
+    bool m_adding { false };
     NonnullOwnPtrVector<Region> m_subheap_memory;
     OwnPtr<Region> m_backup_memory;
 
@@ -224,6 +225,12 @@ void kmalloc_init()
     s_end_of_eternal_range = s_next_eternal_ptr + ETERNAL_RANGE_SIZE;
 }
 
+bool kmalloc_is_expanding_heap()
+{
+    // Only the processor that is expanding the heap holds the lock while doing so.
+    return s_lock.own_lock() && g_kmalloc_global->m_adding;
+}
+
 void* kmalloc_eternal(size_t size)
 {
     size = round_up_to_power_of_two(size, sizeof(void*));
@@ -238,14 +245,18 @@ void* kmalloc_eternal(size_t size)
 
 void* kmalloc_impl(size_t size)
 {
-    ScopedSpinLock lock(s_lock);
-    ++g_kmalloc_call_count;
-
     if (g_dump_kmalloc_stacks && Kernel::g_kernel_symbols_available) {
+        ScopedSpinLock lock(s_lock);
         dbg() << "kmalloc(" << size << ")";
         Kernel::dump_backtrace();
     }
 
+    if (size <= Kernel::slab_max_allocation_size)
+        return Kernel::slab_alloc(size);
+
+    ScopedSpinLock lock(s_lock);
+    ++g_kmalloc_call_count;
+
     void* ptr = g_kmalloc_global->m_heap.allocate(size);
     if (!ptr) {
         klog() << "kmalloc(): PANIC! Out of memory (no suitable block for size " << size << ")";
@@ -261,6 +272,11 @@ void kfree(void* ptr)
     if (!ptr)
         return;
 
+    if (Kernel::slab_owns(ptr)) {
+        Kernel::slab_dealloc(ptr);
+        return;
+    }
+
     ScopedSpinLock lock(s_lock);
     ++g_kfree_call_count;
 
@@ -269,6 +285,16 @@ void kfree(void* ptr)
 
 void* krealloc(void* ptr, size_t new_size)
 {
+    if (ptr && Kernel::slab_owns(ptr)) {
+        size_t old_size = Kernel::slab_allocation_size(ptr);
+        if (new_size <= old_size)
+            return ptr;
+        void* new_ptr = kmalloc_impl(new_size);
+        __builtin_memcpy(new_ptr, ptr, old_size);
+        Kernel::slab_dealloc(ptr);
+        return new_ptr;
+    }
+
     ScopedSpinLock lock(s_lock);
     return g_kmalloc_global->m_heap.reallocate(ptr, new_size);
 }
@@ -285,10 +311,17 @@ void* operator new[](size_t size)
 
 void get_kmalloc_stats(kmalloc_stats& stats)
 {
+    size_t slab_alloc_count = 0;
+    size_t slab_free_count = 0;
+    Kernel::slab_alloc_stats([&](auto& slab_stats) {
+        slab_alloc_count += slab_stats.alloc_count;
+        slab_free_count += slab_stats.free_count;
+    });
+
     ScopedSpinLock lock(s_lock);
     stats.bytes_allocated = g_kmalloc_global->m_heap.allocated_bytes();
     stats.bytes_free = g_kmalloc_global->m_heap.free_bytes() + g_kmalloc_global->backup_memory_bytes();
     stats.bytes_eternal = g_kmalloc_bytes_eternal;
-    stats.kmalloc_call_count = g_kmalloc_call_count;
-    stats.kfree_call_count = g_kfree_call_count;
+    stats.kmalloc_call_count = g_kmalloc_call_count + slab_alloc_count;
+    stats.kfree_call_count = g_kfree_call_count + slab_free_count;
 }
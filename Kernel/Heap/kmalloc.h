@@ -82,6 +82,7 @@ inline void kfree_aligned(void* ptr)
 }
 
 void kmalloc_enable_expand();
+bool kmalloc_is_expanding_heap();
 
 extern u8* const kmalloc_start;
 extern u8* const kmalloc_end;
@@ -115,6 +115,9 @@ namespace Kernel {
 #define TSTA_LC (1 << 2) // Late Collision
 #define LSTA_TU (1 << 3) // Transmit Underrun
 
+#define RSTA_DD (1 << 0)  // Descriptor Done
+#define RSTA_EOP (1 << 1) // End of Packet
+
 // STATUS Register
 
 #define STATUS_FD 0x01
@@ -140,8 +143,16 @@ namespace Kernel {
 #define INTERRUPT_PHYINT (1 << 12)
 #define INTERRUPT_TXD_LOW (1 << 15)
 #define INTERRUPT_SRPD (1 << 16)
+
+#define INTERRUPT_RX (INTERRUPT_RXT0 | INTERRUPT_RXO | INTERRUPT_RXDMT0)
+#define INTERRUPT_TX (INTERRUPT_TXDW | INTERRUPT_TXQE)
 // clang-format on
 
+// Upper bound on the number of interrupts per second the card will raise.
+// Received frames and completed transmissions accumulate in the rings in between,
+// so every interrupt gets to process a whole batch of them.
+static constexpr u32 interrupt_throttle_rate = 8000;
+
 // https://www.intel.com/content/dam/doc/manual/pci-pci-x-family-gbe-controllers-software-dev-manual.pdf Section 5.2
 static bool is_valid_device_id(u16 device_id)
 {
@@ -224,13 +235,15 @@ E1000NetworkAdapter::E1000NetworkAdapter(PCI::Address address, u8 irq)
     u32 flags = in32(REG_CTRL);
     out32(REG_CTRL, flags | ECTRL_SLU);
 
-    out32(REG_INTERRUPT_RATE, 6000); // Interrupt rate of 1.536 milliseconds
+    // The ITR register counts the minimum interval between interrupts in 256ns units.
+    out32(REG_INTERRUPT_RATE, 1'000'000'000 / (interrupt_throttle_rate * 256));
+    out32(REG_RDTR, 0);
+    out32(REG_RADV, 0);
 
     initialize_rx_descriptors();
     initialize_tx_descriptors();
 
-    out32(REG_INTERRUPT_MASK_SET, 0x1f6dc);
-    out32(REG_INTERRUPT_MASK_SET, INTERRUPT_LSC | INTERRUPT_RXT0);
+    out32(REG_INTERRUPT_MASK_SET, INTERRUPT_LSC | INTERRUPT_RX | INTERRUPT_TX);
     in32(REG_INTERRUPT_CAUSE_READ);
 
     enable_irq();
@@ -248,20 +261,22 @@ void E1000NetworkAdapter::handle_irq(const RegisterState&)
 
     m_entropy_source.add_random_event(status);
 
-    if (status & 4) {
+    if (status & INTERRUPT_LSC) {
         u32 flags = in32(REG_CTRL);
         out32(REG_CTRL, flags | ECTRL_SLU);
     }
-    if (status & 0x80) {
+    if (status & INTERRUPT_RX) {
         receive();
     }
-    if (status & 0x10) {
-        // Threshold OK?
+    if (status & INTERRUPT_TX) {
+        ScopedSpinLock lock(m_tx_lock);
+        reclaim_tx_descriptors();
+        // Hand everything that was queued up while the card was busy over in one go.
+        flush_tx_descriptors();
+        m_wait_queue.wake_all();
     }
 
-    m_wait_queue.wake_all();
-
-    out32(REG_INTERRUPT_MASK_SET, INTERRUPT_LSC | INTERRUPT_RXT0 | INTERRUPT_RXO);
+    out32(REG_INTERRUPT_MASK_SET, INTERRUPT_LSC | INTERRUPT_RX | INTERRUPT_TX);
 }
 
 void E1000NetworkAdapter::detect_eeprom()
@@ -320,15 +335,17 @@ bool E1000NetworkAdapter::link_up()
 
 void E1000NetworkAdapter::initialize_rx_descriptors()
 {
-    auto* rx_descriptors = (e1000_tx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
+    m_rx_buffers_region = MM.allocate_contiguous_kernel_region(number_of_rx_descriptors * rx_buffer_size, "E1000 RX buffers", Region::Access::Read | Region::Access::Write);
+    ASSERT(m_rx_buffers_region);
+    auto rx_buffers_paddr = m_rx_buffers_region->physical_page(0)->paddr();
+
+    auto* rx_descriptors = (e1000_rx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
     for (size_t i = 0; i < number_of_rx_descriptors; ++i) {
         auto& descriptor = rx_descriptors[i];
-        auto region = MM.allocate_contiguous_kernel_region(8192, "E1000 RX buffer", Region::Access::Read | Region::Access::Write);
-        ASSERT(region);
-        m_rx_buffers_regions.append(region.release_nonnull());
-        descriptor.addr = m_rx_buffers_regions[i].physical_page(0)->paddr().get();
+        descriptor.addr = rx_buffers_paddr.offset(i * rx_buffer_size).get();
         descriptor.status = 0;
     }
+    m_rx_current = 0;
 
     out32(REG_RXDESCLO, m_rx_descriptors_region->physical_page(0)->paddr().get());
     out32(REG_RXDESCHI, 0);
@@ -336,20 +353,28 @@ void E1000NetworkAdapter::initialize_rx_descriptors()
     out32(REG_RXDESCHEAD, 0);
     out32(REG_RXDESCTAIL, number_of_rx_descriptors - 1);
 
-    out32(REG_RCTRL, RCTL_EN | RCTL_SBP | RCTL_UPE | RCTL_MPE | RCTL_LBM_NONE | RTCL_RDMTS_HALF | RCTL_BAM | RCTL_SECRC | RCTL_BSIZE_8192);
+    out32(REG_RCTRL, RCTL_EN | RCTL_SBP | RCTL_UPE | RCTL_MPE | RCTL_LBM_NONE | RTCL_RDMTS_HALF | RCTL_BAM | RCTL_SECRC | RCTL_BSIZE_2048);
 }
 
 void E1000NetworkAdapter::initialize_tx_descriptors()
 {
+    m_tx_buffers_region = MM.allocate_contiguous_kernel_region(number_of_tx_buffers * tx_buffer_size, "E1000 TX buffers", Region::Access::Read | Region::Access::Write);
+    ASSERT(m_tx_buffers_region);
+    for (size_t i = 0; i < number_of_tx_buffers; ++i)
+        m_free_tx_buffers[i] = i;
+    m_free_tx_buffer_count = number_of_tx_buffers;
+
+    // Descriptors get pointed at a TX buffer whenever something is sent with them.
     auto* tx_descriptors = (e1000_tx_desc*)m_tx_descriptors_region->vaddr().as_ptr();
     for (size_t i = 0; i < number_of_tx_descriptors; ++i) {
         auto& descriptor = tx_descriptors[i];
-        auto region = MM.allocate_contiguous_kernel_region(8192, "E1000 TX buffer", Region::Access::Read | Region::Access::Write);
-        ASSERT(region);
-        m_tx_buffers_regions.append(region.release_nonnull());
-        descriptor.addr = m_tx_buffers_regions[i].physical_page(0)->paddr().get();
+        descriptor.addr = 0;
         descriptor.cmd = 0;
+        descriptor.status = 0;
     }
+    m_tx_clean = 0;
+    m_tx_tail = 0;
+    m_tx_current = 0;
 
     out32(REG_TXDESCLO, m_tx_descriptors_region->physical_page(0)->paddr().get());
     out32(REG_TXDESCHI, 0);
@@ -430,61 +455,141 @@ u32 E1000NetworkAdapter::in32(u16 address)
     return m_io_base.offset(address).in<u32>();
 }
 
+size_t E1000NetworkAdapter::tx_descriptors_in_use() const
+{
+    return (m_tx_current + number_of_tx_descriptors - m_tx_clean) % number_of_tx_descriptors;
+}
+
+void E1000NetworkAdapter::reclaim_tx_descriptors()
+{
+    ASSERT(m_tx_lock.is_locked());
+    auto* tx_descriptors = (e1000_tx_desc*)m_tx_descriptors_region->vaddr().as_ptr();
+    while (m_tx_clean != m_tx_tail && (tx_descriptors[m_tx_clean].status & TSTA_DD)) {
+        m_free_tx_buffers[m_free_tx_buffer_count++] = m_tx_descriptor_buffers[m_tx_clean];
+        m_tx_clean = (m_tx_clean + 1) % number_of_tx_descriptors;
+    }
+}
+
+void E1000NetworkAdapter::flush_tx_descriptors()
+{
+    ASSERT(m_tx_lock.is_locked());
+    if (m_tx_tail == m_tx_current)
+        return;
+    m_tx_tail = m_tx_current;
+    out32(REG_TXDESCTAIL, m_tx_tail);
+}
+
+Optional<size_t> E1000NetworkAdapter::try_take_tx_buffer()
+{
+    ScopedSpinLock lock(m_tx_lock);
+    if (!m_free_tx_buffer_count) {
+        reclaim_tx_descriptors();
+        if (!m_free_tx_buffer_count)
+            return {};
+    }
+    return m_free_tx_buffers[--m_free_tx_buffer_count];
+}
+
+size_t E1000NetworkAdapter::take_tx_buffer()
+{
+    for (;;) {
+        if (auto index = try_take_tx_buffer(); index.has_value())
+            return index.value();
+        m_wait_queue.wait_on(nullptr, "E1000NetworkAdapter");
+    }
+}
+
+PacketBuffer E1000NetworkAdapter::allocate_packet(size_t size)
+{
+    // Packets that don't fit get fragmented, which copies them anyway.
+    if (PacketBuffer::default_headroom + size > tx_buffer_size)
+        return NetworkAdapter::allocate_packet(size);
+    // Rather than wait for a TX buffer, fall back to ordinary memory and copy when sending.
+    auto index = try_take_tx_buffer();
+    if (!index.has_value())
+        return NetworkAdapter::allocate_packet(size);
+    return wrap_transmit_buffer(index.value(), { tx_buffer(index.value()), tx_buffer_size }, size);
+}
+
+void E1000NetworkAdapter::release_transmit_buffer(size_t index)
+{
+    ScopedSpinLock lock(m_tx_lock);
+    m_free_tx_buffers[m_free_tx_buffer_count++] = index;
+    m_wait_queue.wake_all();
+}
+
 void E1000NetworkAdapter::send_raw(ReadonlyBytes payload)
 {
-    disable_irq();
-    size_t tx_current = in32(REG_TXDESCTAIL) % number_of_tx_descriptors;
+    ASSERT(payload.size() <= tx_buffer_size);
+    auto index = take_tx_buffer();
+    memcpy(tx_buffer(index), payload.data(), payload.size());
+    transmit_buffer(index, { tx_buffer(index), payload.size() });
+}
+
+void E1000NetworkAdapter::transmit_buffer(size_t index, ReadonlyBytes frame)
+{
 #ifdef E1000_DEBUG
-    klog() << "E1000: Sending packet (" << payload.size() << " bytes)";
+    klog() << "E1000: Sending packet (" << frame.size() << " bytes)";
 #endif
-    auto* tx_descriptors = (e1000_tx_desc*)m_tx_descriptors_region->vaddr().as_ptr();
-    auto& descriptor = tx_descriptors[tx_current];
-    ASSERT(payload.size() <= 8192);
-    auto* vptr = (void*)m_tx_buffers_regions[tx_current].vaddr().as_ptr();
-    memcpy(vptr, payload.data(), payload.size());
-    descriptor.length = payload.size();
-    descriptor.status = 0;
-    descriptor.cmd = CMD_EOP | CMD_IFCS | CMD_RS;
+    ASSERT(frame.data() >= tx_buffer(index) && frame.data() + frame.size() <= tx_buffer(index) + tx_buffer_size);
+    auto frame_paddr = m_tx_buffers_region->physical_page(0)->paddr().offset(frame.data() - tx_buffer(0));
+    for (;;) {
+        {
+            ScopedSpinLock lock(m_tx_lock);
+            reclaim_tx_descriptors();
+            // Keep one descriptor unused so that a full ring can't be mistaken for an empty one.
+            if (tx_descriptors_in_use() < number_of_tx_descriptors - 1) {
+                auto* tx_descriptors = (e1000_tx_desc*)m_tx_descriptors_region->vaddr().as_ptr();
+                auto& descriptor = tx_descriptors[m_tx_current];
+                m_tx_descriptor_buffers[m_tx_current] = index;
+                descriptor.addr = frame_paddr.get();
+                descriptor.length = frame.size();
+                descriptor.status = 0;
+                descriptor.cmd = CMD_EOP | CMD_IFCS | CMD_RS;
 #ifdef E1000_DEBUG
-    klog() << "E1000: Using tx descriptor " << tx_current << " (head is at " << in32(REG_TXDESCHEAD) << ")";
+                klog() << "E1000: Using tx descriptor " << m_tx_current << " (" << tx_descriptors_in_use() << " in use)";
 #endif
-    tx_current = (tx_current + 1) % number_of_tx_descriptors;
-    cli();
-    enable_irq();
-    out32(REG_TXDESCTAIL, tx_current);
-    for (;;) {
-        if (descriptor.status) {
-            sti();
-            break;
+                m_tx_current = (m_tx_current + 1) % number_of_tx_descriptors;
+
+                // Writing the tail register is expensive (especially when virtualized), so only
+                // do it here if the card has nothing left to send. Otherwise this descriptor goes
+                // out with the rest of the batch once the TX interrupt comes in.
+                if (m_tx_clean == m_tx_tail)
+                    flush_tx_descriptors();
+                return;
+            }
         }
         m_wait_queue.wait_on(nullptr, "E1000NetworkAdapter");
     }
-#ifdef E1000_DEBUG
-    dbgln("E1000: Sent packet, status is now {:#02x}!", (u8)descriptor.status);
-#endif
 }
 
 void E1000NetworkAdapter::receive()
 {
-    auto* rx_descriptors = (e1000_tx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
-    u32 rx_current;
-    for (;;) {
-        rx_current = in32(REG_RXDESCTAIL) % number_of_rx_descriptors;
-        if (rx_current == (in32(REG_RXDESCHEAD) % number_of_rx_descriptors))
-            return;
-        rx_current = (rx_current + 1) % number_of_rx_descriptors;
-        if (!(rx_descriptors[rx_current].status & 1))
+    auto* rx_descriptors = (e1000_rx_desc*)m_rx_descriptors_region->vaddr().as_ptr();
+    size_t received = 0;
+    // Every descriptor can only come back once per pass, so this can't starve the rest of the system.
+    while (received < number_of_rx_descriptors) {
+        auto& descriptor = rx_descriptors[m_rx_current];
+        if (!(descriptor.status & RSTA_DD))
             break;
-        auto* buffer = m_rx_buffers_regions[rx_current].vaddr().as_ptr();
-        u16 length = rx_descriptors[rx_current].length;
-        ASSERT(length <= 8192);
+        auto* buffer = m_rx_buffers_region->vaddr().offset(m_rx_current * rx_buffer_size).as_ptr();
+        u16 length = descriptor.length;
+        ASSERT(length <= rx_buffer_size);
 #ifdef E1000_DEBUG
         klog() << "E1000: Received 1 packet @ " << buffer << " (" << length << ") bytes!";
 #endif
-        did_receive({ buffer, length });
-        rx_descriptors[rx_current].status = 0;
-        out32(REG_RXDESCTAIL, rx_current);
+        queue_packet({ buffer, length });
+        descriptor.status = 0;
+        m_rx_current = (m_rx_current + 1) % number_of_rx_descriptors;
+        ++received;
     }
+    if (!received)
+        return;
+
+    // Give all the buffers we just emptied back to the card at once.
+    // The descriptor before m_rx_current stays unused, which keeps the ring from looking empty.
+    out32(REG_RXDESCTAIL, (m_rx_current + number_of_rx_descriptors - 1) % number_of_rx_descriptors);
+    did_queue_packets();
 }
 
 }
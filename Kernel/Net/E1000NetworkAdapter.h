@@ -26,7 +26,8 @@
 
 #pragma once
 
-#include <AK/NonnullOwnPtrVector.h>
+#include <AK/Array.h>
+#include <AK/Optional.h>
 #include <AK/OwnPtr.h>
 #include <Kernel/IO.h>
 #include <Kernel/Interrupts/IRQHandler.h>
@@ -34,6 +35,7 @@
 #include <Kernel/PCI/Access.h>
 #include <Kernel/PCI/Device.h>
 #include <Kernel/Random.h>
+#include <Kernel/SpinLock.h>
 
 namespace Kernel {
 
@@ -46,6 +48,7 @@ public:
     virtual ~E1000NetworkAdapter() override;
 
     virtual void send_raw(ReadonlyBytes) override;
+    virtual PacketBuffer allocate_packet(size_t) override;
     virtual bool link_up() override;
 
     virtual const char* purpose() const override { return class_name(); }
@@ -53,6 +56,8 @@ public:
 private:
     virtual void handle_irq(const RegisterState&) override;
     virtual const char* class_name() const override { return "E1000NetworkAdapter"; }
+    virtual void transmit_buffer(size_t, ReadonlyBytes) override;
+    virtual void release_transmit_buffer(size_t) override;
 
     struct [[gnu::packed]] e1000_rx_desc {
         volatile uint64_t addr { 0 };
@@ -91,21 +96,48 @@ private:
     u32 in32(u16 address);
 
     void receive();
+    void reclaim_tx_descriptors();
+    size_t tx_descriptors_in_use() const;
+    void flush_tx_descriptors();
+    Optional<size_t> try_take_tx_buffer();
+    size_t take_tx_buffer();
+    u8* tx_buffer(size_t index) { return m_tx_buffers_region->vaddr().offset(index * tx_buffer_size).as_ptr(); }
 
     IOAddress m_io_base;
     VirtualAddress m_mmio_base;
     OwnPtr<Region> m_rx_descriptors_region;
     OwnPtr<Region> m_tx_descriptors_region;
-    NonnullOwnPtrVector<Region> m_rx_buffers_regions;
-    NonnullOwnPtrVector<Region> m_tx_buffers_regions;
+    OwnPtr<Region> m_rx_buffers_region;
+    OwnPtr<Region> m_tx_buffers_region;
     OwnPtr<Region> m_mmio_region;
     u8 m_interrupt_line { 0 };
     bool m_has_eeprom { false };
     bool m_use_mmio { false };
     EntropySource m_entropy_source;
 
-    static const size_t number_of_rx_descriptors = 32;
-    static const size_t number_of_tx_descriptors = 8;
+    static const size_t number_of_rx_descriptors = 128;
+    static const size_t number_of_tx_descriptors = 64;
+    static const size_t rx_buffer_size = 2048;
+    static const size_t tx_buffer_size = 2048;
+
+    // Packets are built right in the TX buffers, so there are more of them than descriptors:
+    // some are being filled in while others are waiting to be sent.
+    static const size_t number_of_tx_buffers = number_of_tx_descriptors * 2;
+
+    // Next RX descriptor the card will hand back to us.
+    size_t m_rx_current { 0 };
+
+    // TX ring state. Descriptors in [m_tx_clean, m_tx_tail) belong to the card,
+    // descriptors in [m_tx_tail, m_tx_current) are filled in but not yet announced.
+    SpinLock<u8> m_tx_lock;
+    size_t m_tx_clean { 0 };
+    size_t m_tx_tail { 0 };
+    size_t m_tx_current { 0 };
+
+    // TX buffers that nobody is using, and the buffer each descriptor sends from.
+    Array<u16, number_of_tx_buffers> m_free_tx_buffers;
+    size_t m_free_tx_buffer_count { 0 };
+    Array<u16, number_of_tx_descriptors> m_tx_descriptor_buffers;
 
     WaitQueue m_wait_queue;
 };
@@ -192,6 +192,13 @@ bool IPv4Socket::can_write(const FileDescription&, size_t) const
     return is_connected();
 }
 
+bool IPv4Socket::has_hung_up(const FileDescription& description) const
+{
+    if (m_role != Role::Listener && protocol_is_disconnected())
+        return true;
+    return Socket::has_hung_up(description);
+}
+
 int IPv4Socket::allocate_local_port_if_needed()
 {
     if (m_local_port)
@@ -240,7 +247,16 @@ KResultOr<size_t> IPv4Socket::sendto(FileDescription&, const UserOrKernelBuffer&
 #endif
 
     if (type() == SOCK_RAW) {
-        int err = routing_decision.adapter->send_ipv4(routing_decision.next_hop, m_peer_address, (IPv4Protocol)protocol(), data, data_length, m_ttl);
+        auto& adapter = *routing_decision.adapter;
+        int err;
+        if (sizeof(IPv4Packet) + data_length > adapter.mtu()) {
+            err = adapter.send_ipv4_fragmented(routing_decision.next_hop, m_peer_address, (IPv4Protocol)protocol(), data, data_length, m_ttl);
+        } else {
+            auto packet = adapter.allocate_packet(data_length);
+            if (!data.read(packet.data(), data_length))
+                return KResult(-EFAULT);
+            err = adapter.send_ipv4(routing_decision.next_hop, m_peer_address, (IPv4Protocol)protocol(), move(packet), m_ttl);
+        }
         if (err < 0)
             return KResult(err);
         return data_length;
@@ -281,6 +297,8 @@ KResultOr<size_t> IPv4Socket::receive_byte_buffered(FileDescription& description
         Thread::current()->did_ipv4_socket_read((size_t)nreceived);
 
     set_can_read(!m_receive_buffer.is_empty());
+    if (nreceived > 0)
+        protocol_did_read_from_receive_buffer();
     return nreceived;
 }
 
@@ -390,7 +408,7 @@ KResultOr<size_t> IPv4Socket::recvfrom(FileDescription& description, UserOrKerne
     return nreceived;
 }
 
-bool IPv4Socket::did_receive(const IPv4Address& source_address, u16 source_port, KBuffer&& packet, const timeval& packet_timestamp)
+bool IPv4Socket::did_receive(const IPv4Address& source_address, u16 source_port, ReadonlyBytes packet, const timeval& packet_timestamp)
 {
     LOCKER(lock());
 
@@ -407,7 +425,7 @@ bool IPv4Socket::did_receive(const IPv4Address& source_address, u16 source_port,
             return false;
         }
         auto scratch_buffer = UserOrKernelBuffer::for_kernel_buffer(m_scratch_buffer.value().data());
-        auto nreceived_or_error = protocol_receive(ReadonlyBytes { packet.data(), packet.size() }, scratch_buffer, m_scratch_buffer.value().size(), 0);
+        auto nreceived_or_error = protocol_receive(packet, scratch_buffer, m_scratch_buffer.value().size(), 0);
         if (nreceived_or_error.is_error())
             return false;
         ssize_t nwritten = m_receive_buffer.write(scratch_buffer, nreceived_or_error.value());
@@ -419,7 +437,8 @@ bool IPv4Socket::did_receive(const IPv4Address& source_address, u16 source_port,
             dbg() << "IPv4Socket(" << this << "): did_receive refusing packet since queue is full.";
             return false;
         }
-        m_receive_queue.append({ source_address, source_port, packet_timestamp, move(packet) });
+        // Only datagrams are kept around as whole packets; byte streams go straight into the receive buffer above.
+        m_receive_queue.append({ source_address, source_port, packet_timestamp, KBuffer::copy(packet.data(), packet.size()) });
         set_can_read(true);
     }
     m_bytes_received += packet_size;
@@ -464,10 +483,10 @@ String IPv4Socket::absolute_path(const FileDescription&) const
     return builder.to_string();
 }
 
-KResult IPv4Socket::setsockopt(int level, int option, Userspace<const void*> user_value, socklen_t user_value_size)
+KResult IPv4Socket::setsockopt(FileDescription& description, int level, int option, Userspace<const void*> user_value, socklen_t user_value_size)
 {
     if (level != IPPROTO_IP)
-        return Socket::setsockopt(level, option, user_value, user_value_size);
+        return Socket::setsockopt(description, level, option, user_value, user_value_size);
 
     switch (option) {
     case IP_TTL: {
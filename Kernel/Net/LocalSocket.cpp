@@ -272,6 +272,14 @@ bool LocalSocket::has_attached_peer(const FileDescription& description) const
     ASSERT_NOT_REACHED();
 }
 
+bool LocalSocket::has_hung_up(const FileDescription& description) const
+{
+    auto role = this->role(description);
+    if (role == Role::Accepted || role == Role::Connected)
+        return !has_attached_peer(description);
+    return Socket::has_hung_up(description);
+}
+
 bool LocalSocket::can_write(const FileDescription& description, size_t) const
 {
     auto role = this->role(description);
@@ -295,7 +303,7 @@ KResultOr<size_t> LocalSocket::sendto(FileDescription& description, const UserOr
     return nwritten;
 }
 
-DoubleBuffer* LocalSocket::receive_buffer_for(FileDescription& description)
+RingBuffer* LocalSocket::receive_buffer_for(FileDescription& description)
 {
     auto role = this->role(description);
     if (role == Role::Accepted)
@@ -305,7 +313,7 @@ DoubleBuffer* LocalSocket::receive_buffer_for(FileDescription& description)
     return nullptr;
 }
 
-DoubleBuffer* LocalSocket::send_buffer_for(FileDescription& description)
+RingBuffer* LocalSocket::send_buffer_for(FileDescription& description)
 {
     auto role = this->role(description);
     if (role == Role::Connected)
@@ -315,6 +323,17 @@ DoubleBuffer* LocalSocket::send_buffer_for(FileDescription& description)
     return nullptr;
 }
 
+RingBuffer* LocalSocket::buffer_for_option(FileDescription& description, int option)
+{
+    // Until the connection is accepted, a connecting socket's buffers are the client side's.
+    bool is_server_side = role(description) == Role::Accepted;
+    if (role(description) == Role::Listener)
+        return nullptr;
+    if (option == SO_SNDBUF)
+        return is_server_side ? &m_for_client : &m_for_server;
+    return is_server_side ? &m_for_server : &m_for_client;
+}
+
 KResultOr<size_t> LocalSocket::recvfrom(FileDescription& description, UserOrKernelBuffer& buffer, size_t buffer_size, int, Userspace<sockaddr*>, Userspace<socklen_t*>, timeval&)
 {
     auto* socket_buffer = receive_buffer_for(description);
@@ -372,6 +391,31 @@ String LocalSocket::absolute_path(const FileDescription& description) const
     return builder.to_string();
 }
 
+KResult LocalSocket::setsockopt(FileDescription& description, int level, int option, Userspace<const void*> user_value, socklen_t user_value_size)
+{
+    if (level != SOL_SOCKET || (option != SO_SNDBUF && option != SO_RCVBUF))
+        return Socket::setsockopt(description, level, option, user_value, user_value_size);
+
+    if (user_value_size != sizeof(int))
+        return KResult(-EINVAL);
+    int requested_capacity;
+    if (!copy_from_user(&requested_capacity, static_ptr_cast<const int*>(user_value)))
+        return KResult(-EFAULT);
+    if (requested_capacity < 0)
+        return KResult(-EINVAL);
+    auto* socket_buffer = buffer_for_option(description, option);
+    if (!socket_buffer)
+        return KResult(-EINVAL);
+
+    // RingBuffer needs a power of two, so round up within the limits.
+    size_t capacity = minimum_buffer_capacity;
+    while (capacity < (size_t)requested_capacity && capacity < maximum_buffer_capacity)
+        capacity *= 2;
+    if (capacity == socket_buffer->capacity())
+        return KSuccess;
+    return socket_buffer->set_capacity(capacity);
+}
+
 KResult LocalSocket::getsockopt(FileDescription& description, int level, int option, Userspace<void*> value, Userspace<socklen_t*> value_size)
 {
     if (level != SOL_SOCKET)
@@ -407,6 +451,21 @@ KResult LocalSocket::getsockopt(FileDescription& description, int level, int opt
         }
         break;
     }
+    case SO_SNDBUF:
+    case SO_RCVBUF: {
+        if (size < sizeof(int))
+            return KResult(-EINVAL);
+        auto* socket_buffer = buffer_for_option(description, option);
+        if (!socket_buffer)
+            return KResult(-EINVAL);
+        int capacity = socket_buffer->capacity();
+        if (!copy_to_user(static_ptr_cast<int*>(value), &capacity))
+            return KResult(-EFAULT);
+        size = sizeof(int);
+        if (!copy_to_user(value_size, &size))
+            return KResult(-EFAULT);
+        return KSuccess;
+    }
     default:
         return Socket::getsockopt(description, level, option, value, value_size);
     }
@@ -27,7 +27,7 @@
 #pragma once
 
 #include <AK/InlineLinkedList.h>
-#include <Kernel/DoubleBuffer.h>
+#include <Kernel/RingBuffer.h>
 #include <Kernel/Net/Socket.h>
 
 namespace Kernel {
@@ -60,8 +60,10 @@ public:
     virtual void detach(FileDescription&) override;
     virtual bool can_read(const FileDescription&, size_t) const override;
     virtual bool can_write(const FileDescription&, size_t) const override;
+    virtual bool has_hung_up(const FileDescription&) const override;
     virtual KResultOr<size_t> sendto(FileDescription&, const UserOrKernelBuffer&, size_t, int, Userspace<const sockaddr*>, socklen_t) override;
     virtual KResultOr<size_t> recvfrom(FileDescription&, UserOrKernelBuffer&, size_t, int flags, Userspace<sockaddr*>, Userspace<socklen_t*>, timeval&) override;
+    virtual KResult setsockopt(FileDescription&, int level, int option, Userspace<const void*>, socklen_t) override;
     virtual KResult getsockopt(FileDescription&, int level, int option, Userspace<void*>, Userspace<socklen_t*>) override;
     virtual KResult chown(FileDescription&, uid_t, gid_t) override;
     virtual KResult chmod(FileDescription&, mode_t) override;
@@ -70,10 +72,13 @@ private:
     explicit LocalSocket(int type);
     virtual const char* class_name() const override { return "LocalSocket"; }
     virtual bool is_local() const override { return true; }
+    // The ring buffers tell us when they go from empty or full to anything else.
+    virtual bool signals_own_block_conditions() const override { return true; }
     bool has_attached_peer(const FileDescription&) const;
     static Lockable<InlineLinkedList<LocalSocket>>& all_sockets();
-    DoubleBuffer* receive_buffer_for(FileDescription&);
-    DoubleBuffer* send_buffer_for(FileDescription&);
+    RingBuffer* receive_buffer_for(FileDescription&);
+    RingBuffer* send_buffer_for(FileDescription&);
+    RingBuffer* buffer_for_option(FileDescription&, int option);
     NonnullRefPtrVector<FileDescription>& sendfd_queue_for(const FileDescription&);
     NonnullRefPtrVector<FileDescription>& recvfd_queue_for(const FileDescription&);
 
@@ -110,8 +115,14 @@ private:
     bool m_accept_side_fd_open { false };
     sockaddr_un m_address { 0, { 0 } };
 
-    DoubleBuffer m_for_client;
-    DoubleBuffer m_for_server;
+    // Large enough that a busy IPC client rarely has to wait for the other side.
+    // Either side can change the size of its buffers with SO_SNDBUF and SO_RCVBUF.
+    static constexpr size_t buffer_capacity = 128 * KiB;
+    static constexpr size_t minimum_buffer_capacity = 4 * KiB;
+    static constexpr size_t maximum_buffer_capacity = 1 * MiB;
+
+    RingBuffer m_for_client { buffer_capacity };
+    RingBuffer m_for_server { buffer_capacity };
 
     NonnullRefPtrVector<FileDescription> m_fds_for_client;
     NonnullRefPtrVector<FileDescription> m_fds_for_server;
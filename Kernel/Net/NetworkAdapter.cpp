@@ -77,6 +77,15 @@ RefPtr<NetworkAdapter> NetworkAdapter::lookup_by_name(const StringView& name)
 
 NetworkAdapter::NetworkAdapter()
 {
+    // Receiving happens in IRQ context, so set up some packet buffers ahead of time.
+    for (size_t i = 0; i < preallocated_packet_count; ++i) {
+        auto buffer = KBuffer::try_create_with_size(PAGE_SIZE, Region::Access::Read | Region::Access::Write, "Packet buffer", AllocationStrategy::AllocateNow);
+        if (!buffer)
+            break;
+        m_unused_packets.append(*new PacketWithTimestamp(*buffer, {}));
+        ++m_unused_packet_count;
+    }
+
     // FIXME: I wanna lock :(
     all_adapters().resource().set(this);
 }
@@ -85,6 +94,11 @@ NetworkAdapter::~NetworkAdapter()
 {
     // FIXME: I wanna lock :(
     all_adapters().resource().remove(this);
+
+    while (auto* packet = m_packet_queue.take_first())
+        delete packet;
+    while (auto* packet = m_unused_packets.take_first())
+        delete packet;
 }
 
 void NetworkAdapter::send(const MACAddress& destination, const ARPPacket& packet)
@@ -101,19 +115,15 @@ void NetworkAdapter::send(const MACAddress& destination, const ARPPacket& packet
     send_raw({ (const u8*)eth, size_in_bytes });
 }
 
-int NetworkAdapter::send_ipv4(const MACAddress& destination_mac, const IPv4Address& destination_ipv4, IPv4Protocol protocol, const UserOrKernelBuffer& payload, size_t payload_size, u8 ttl)
+int NetworkAdapter::send_ipv4(const MACAddress& destination_mac, const IPv4Address& destination_ipv4, IPv4Protocol protocol, PacketBuffer&& packet, u8 ttl)
 {
-    size_t ipv4_packet_size = sizeof(IPv4Packet) + payload_size;
-    if (ipv4_packet_size > mtu())
+    size_t payload_size = packet.size();
+    if (sizeof(IPv4Packet) + payload_size > mtu()) {
+        auto payload = UserOrKernelBuffer::for_kernel_buffer(packet.data());
         return send_ipv4_fragmented(destination_mac, destination_ipv4, protocol, payload, payload_size, ttl);
+    }
 
-    size_t ethernet_frame_size = sizeof(EthernetFrameHeader) + sizeof(IPv4Packet) + payload_size;
-    auto buffer = ByteBuffer::create_zeroed(ethernet_frame_size);
-    auto& eth = *(EthernetFrameHeader*)buffer.data();
-    eth.set_source(mac_address());
-    eth.set_destination(destination_mac);
-    eth.set_ether_type(EtherType::IPv4);
-    auto& ipv4 = *(IPv4Packet*)eth.payload();
+    auto& ipv4 = packet.prepend<IPv4Packet>();
     ipv4.set_version(4);
     ipv4.set_internet_header_length(5);
     ipv4.set_source(ipv4_address());
@@ -123,15 +133,33 @@ int NetworkAdapter::send_ipv4(const MACAddress& destination_mac, const IPv4Addre
     ipv4.set_ident(1);
     ipv4.set_ttl(ttl);
     ipv4.set_checksum(ipv4.compute_checksum());
-    m_packets_out++;
-    m_bytes_out += ethernet_frame_size;
 
-    if (!payload.read(ipv4.payload(), payload_size))
-        return -EFAULT;
-    send_raw({ (const u8*)&eth, ethernet_frame_size });
+    auto& eth = packet.prepend<EthernetFrameHeader>();
+    eth.set_source(mac_address());
+    eth.set_destination(destination_mac);
+    eth.set_ether_type(EtherType::IPv4);
+
+    m_packets_out++;
+    m_bytes_out += packet.size();
+    send_packet(move(packet));
     return 0;
 }
 
+PacketBuffer NetworkAdapter::wrap_transmit_buffer(size_t index, Bytes storage, size_t size)
+{
+    return PacketBuffer(*this, index, storage, size, PacketBuffer::default_headroom);
+}
+
+void NetworkAdapter::send_packet(PacketBuffer&& packet)
+{
+    if (!packet.is_transmit_buffer_of(*this)) {
+        send_raw(packet.bytes());
+        return;
+    }
+    packet.did_transmit();
+    transmit_buffer(packet.transmit_buffer_index(), packet.bytes());
+}
+
 int NetworkAdapter::send_ipv4_fragmented(const MACAddress& destination_mac, const IPv4Address& destination_ipv4, IPv4Protocol protocol, const UserOrKernelBuffer& payload, size_t payload_size, u8 ttl)
 {
     // packets must be split on the 64-bit boundary
@@ -173,28 +201,34 @@ int NetworkAdapter::send_ipv4_fragmented(const MACAddress& destination_mac, cons
 }
 
 void NetworkAdapter::did_receive(ReadonlyBytes payload)
+{
+    InterruptDisabler disabler;
+    queue_packet(payload);
+    did_queue_packets();
+}
+
+void NetworkAdapter::queue_packet(ReadonlyBytes payload)
 {
     InterruptDisabler disabler;
     m_packets_in++;
     m_bytes_in += payload.size();
 
-    Optional<KBuffer> buffer;
-
-    if (m_unused_packet_buffers.is_empty()) {
-        buffer = KBuffer::copy(payload.data(), payload.size());
+    PacketWithTimestamp* packet = m_unused_packets.first();
+    if (packet && payload.size() <= packet->packet.capacity()) {
+        m_unused_packets.remove(*packet);
+        --m_unused_packet_count;
+        memcpy(packet->packet.data(), payload.data(), payload.size());
+        packet->packet.set_size(payload.size());
+        packet->timestamp = kgettimeofday();
     } else {
-        buffer = m_unused_packet_buffers.take_first();
-        --m_unused_packet_buffers_count;
-        if (payload.size() <= buffer.value().size()) {
-            memcpy(buffer.value().data(), payload.data(), payload.size());
-            buffer.value().set_size(payload.size());
-        } else {
-            buffer = KBuffer::copy(payload.data(), payload.size());
-        }
+        packet = new PacketWithTimestamp(KBuffer::copy(payload.data(), payload.size()), kgettimeofday());
     }
 
-    m_packet_queue.append({ buffer.value(), kgettimeofday() });
+    m_packet_queue.append(*packet);
+}
 
+void NetworkAdapter::did_queue_packets()
+{
     if (on_receive)
         on_receive();
 }
@@ -202,17 +236,18 @@ void NetworkAdapter::did_receive(ReadonlyBytes payload)
 size_t NetworkAdapter::dequeue_packet(u8* buffer, size_t buffer_size, timeval& packet_timestamp)
 {
     InterruptDisabler disabler;
-    if (m_packet_queue.is_empty())
+    auto* packet = m_packet_queue.take_first();
+    if (!packet)
         return 0;
-    auto packet_with_timestamp = m_packet_queue.take_first();
-    packet_timestamp = packet_with_timestamp.timestamp;
-    auto packet = move(packet_with_timestamp.packet);
-    size_t packet_size = packet.size();
+    packet_timestamp = packet->timestamp;
+    size_t packet_size = packet->packet.size();
     ASSERT(packet_size <= buffer_size);
-    memcpy(buffer, packet.data(), packet_size);
-    if (m_unused_packet_buffers_count < 100) {
-        m_unused_packet_buffers.append(packet);
-        ++m_unused_packet_buffers_count;
+    memcpy(buffer, packet->packet.data(), packet_size);
+    if (m_unused_packet_count < max_unused_packet_count) {
+        m_unused_packets.append(*packet);
+        ++m_unused_packet_count;
+    } else {
+        delete packet;
     }
     return packet_size;
 }
@@ -28,8 +28,8 @@
 
 #include <AK/ByteBuffer.h>
 #include <AK/Function.h>
+#include <AK/IntrusiveList.h>
 #include <AK/MACAddress.h>
-#include <AK/SinglyLinkedList.h>
 #include <AK/Types.h>
 #include <AK/WeakPtr.h>
 #include <AK/Weakable.h>
@@ -37,6 +37,7 @@
 #include <Kernel/Net/ARP.h>
 #include <Kernel/Net/ICMP.h>
 #include <Kernel/Net/IPv4.h>
+#include <Kernel/Net/PacketBuffer.h>
 #include <Kernel/UserOrKernelBuffer.h>
 
 namespace Kernel {
@@ -64,7 +65,7 @@ public:
     void set_ipv4_gateway(const IPv4Address&);
 
     void send(const MACAddress&, const ARPPacket&);
-    int send_ipv4(const MACAddress&, const IPv4Address&, IPv4Protocol, const UserOrKernelBuffer& payload, size_t payload_size, u8 ttl);
+    int send_ipv4(const MACAddress&, const IPv4Address&, IPv4Protocol, PacketBuffer&& payload, u8 ttl);
     int send_ipv4_fragmented(const MACAddress&, const IPv4Address&, IPv4Protocol, const UserOrKernelBuffer& payload, size_t payload_size, u8 ttl);
 
     size_t dequeue_packet(u8* buffer, size_t buffer_size, timeval& packet_timestamp);
@@ -79,6 +80,11 @@ public:
     u32 packets_out() const { return m_packets_out; }
     u32 bytes_out() const { return m_bytes_out; }
 
+    // Returns an outgoing packet of the given size, with room for the Ethernet and IPv4 headers
+    // in front. Adapters that can transmit straight from their own memory override this and
+    // hand out one of their transmit buffers, so the packet isn't copied again when it's sent.
+    virtual PacketBuffer allocate_packet(size_t size) { return PacketBuffer::create(size); }
+
     Function<void()> on_receive;
 
 protected:
@@ -88,20 +94,48 @@ protected:
     virtual void send_raw(ReadonlyBytes) = 0;
     void did_receive(ReadonlyBytes);
 
+    // For adapters that override allocate_packet(): wrap_transmit_buffer() turns one of their transmit
+    // buffers into a packet. It comes back through transmit_buffer() to be sent, or through
+    // release_transmit_buffer() if the packet is dropped before that.
+    PacketBuffer wrap_transmit_buffer(size_t index, Bytes storage, size_t size);
+    virtual void transmit_buffer(size_t, ReadonlyBytes) { ASSERT_NOT_REACHED(); }
+    virtual void release_transmit_buffer(size_t) { ASSERT_NOT_REACHED(); }
+
+    // For adapters that drain several packets per interrupt: queue each of them with
+    // queue_packet() and then call did_queue_packets() once for the whole batch.
+    void queue_packet(ReadonlyBytes);
+    void did_queue_packets();
+
 private:
+    friend class PacketBuffer;
+
+    void send_packet(PacketBuffer&&);
+
     MACAddress m_mac_address;
     IPv4Address m_ipv4_address;
     IPv4Address m_ipv4_netmask;
     IPv4Address m_ipv4_gateway;
 
     struct PacketWithTimestamp {
+        PacketWithTimestamp(KBuffer buffer, timeval timestamp)
+            : packet(move(buffer))
+            , timestamp(timestamp)
+        {
+        }
+
         KBuffer packet;
         timeval timestamp;
+        IntrusiveListNode packet_list_node;
     };
 
-    SinglyLinkedList<PacketWithTimestamp> m_packet_queue;
-    SinglyLinkedList<KBuffer> m_unused_packet_buffers;
-    size_t m_unused_packet_buffers_count { 0 };
+    using PacketList = IntrusiveList<PacketWithTimestamp, &PacketWithTimestamp::packet_list_node>;
+
+    static constexpr size_t preallocated_packet_count = 32;
+    static constexpr size_t max_unused_packet_count = 100;
+
+    PacketList m_packet_queue;
+    PacketList m_unused_packets;
+    size_t m_unused_packet_count { 0 };
     String m_name;
     u32 m_packets_in { 0 };
     u32 m_bytes_in { 0 };
@@ -69,7 +69,7 @@ void NetworkTask_main(void*)
 {
     WaitQueue packet_wait_queue;
     u8 octet = 15;
-    int pending_packets = 0;
+    bool has_pending_packets = false;
     NetworkAdapter::for_each([&](auto& adapter) {
         if (String(adapter.class_name()) == "LoopbackAdapter") {
             adapter.set_ipv4_address({ 127, 0, 0, 1 });
@@ -84,20 +84,24 @@ void NetworkTask_main(void*)
         klog() << "NetworkTask: " << adapter.class_name() << " network adapter found: hw=" << adapter.mac_address().to_string().characters() << " address=" << adapter.ipv4_address().to_string().characters() << " netmask=" << adapter.ipv4_netmask().to_string().characters() << " gateway=" << adapter.ipv4_gateway().to_string().characters();
 
         adapter.on_receive = [&]() {
-            pending_packets++;
+            has_pending_packets = true;
             packet_wait_queue.wake_all();
         };
     });
 
-    auto dequeue_packet = [&pending_packets](u8* buffer, size_t buffer_size, timeval& packet_timestamp) -> size_t {
-        if (pending_packets == 0)
+    auto dequeue_packet = [&has_pending_packets](u8* buffer, size_t buffer_size, timeval& packet_timestamp) -> size_t {
+        if (!has_pending_packets)
             return 0;
+        // Adapters notify us once per batch of packets, so keep coming back until all the queues are empty.
+        // The flag is cleared up front so that a packet arriving while we look through the adapters isn't missed.
+        has_pending_packets = false;
         size_t packet_size = 0;
         NetworkAdapter::for_each([&](auto& adapter) {
             if (packet_size || !adapter.has_queued_packets())
                 return;
             packet_size = adapter.dequeue_packet(buffer, buffer_size, packet_timestamp);
-            pending_packets--;
+            if (packet_size)
+                has_pending_packets = true;
 #ifdef NETWORK_TASK_DEBUG
             klog() << "NetworkTask: Dequeued packet from " << adapter.name().characters() << " (" << packet_size << " bytes)";
 #endif
@@ -110,11 +114,24 @@ void NetworkTask_main(void*)
     auto buffer = (u8*)buffer_region->vaddr().get();
     timeval packet_timestamp;
 
+    timeval tcp_timer_interval { 0, TCPSocket::timer_interval_ms * 1000 };
+    timeval next_tcp_timer_run;
+    timeval_add(kgettimeofday(), tcp_timer_interval, next_tcp_timer_run);
+
     klog() << "NetworkTask: Enter main loop.";
     for (;;) {
+        auto now = kgettimeofday();
+        timeval time_until_tcp_timers;
+        timeval_sub(next_tcp_timer_run, now, time_until_tcp_timers);
+        if (time_until_tcp_timers.tv_sec < 0) {
+            TCPSocket::run_timers();
+            timeval_add(now, tcp_timer_interval, next_tcp_timer_run);
+            time_until_tcp_timers = tcp_timer_interval;
+        }
+
         size_t packet_size = dequeue_packet(buffer, buffer_size, packet_timestamp);
         if (!packet_size) {
-            packet_wait_queue.wait_on(nullptr, "NetworkTask");
+            packet_wait_queue.wait_on(Thread::BlockTimeout(false, &time_until_tcp_timers), "NetworkTask");
             continue;
         }
         if (packet_size < sizeof(EthernetFrameHeader)) {
@@ -263,7 +280,7 @@ void handle_icmp(const EthernetFrameHeader& eth, const IPv4Packet& ipv4_packet,
             LOCKER(socket->lock());
             if (socket->protocol() != (unsigned)IPv4Protocol::ICMP)
                 continue;
-            socket->did_receive(ipv4_packet.source(), 0, KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size()), packet_timestamp);
+            socket->did_receive(ipv4_packet.source(), 0, ReadonlyBytes { &ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size() }, packet_timestamp);
         }
     }
 
@@ -279,8 +296,8 @@ void handle_icmp(const EthernetFrameHeader& eth, const IPv4Packet& ipv4_packet,
             klog() << "handle_icmp: EchoRequest packet is too small, ignoring.";
             return;
         }
-        auto buffer = ByteBuffer::create_zeroed(icmp_packet_size);
-        auto& response = *(ICMPEchoPacket*)buffer.data();
+        auto packet = adapter->allocate_packet(icmp_packet_size);
+        auto& response = *new (packet.data()) ICMPEchoPacket;
         response.header.set_type(ICMPType::EchoReply);
         response.header.set_code(0);
         response.identifier = request.identifier;
@@ -289,8 +306,7 @@ void handle_icmp(const EthernetFrameHeader& eth, const IPv4Packet& ipv4_packet,
             memcpy(response.payload(), request.payload(), icmp_payload_size);
         response.header.set_checksum(internet_checksum(&response, icmp_packet_size));
         // FIXME: What is the right TTL value here? Is 64 ok? Should we use the same TTL as the echo request?
-        auto response_buffer = UserOrKernelBuffer::for_kernel_buffer((u8*)&response);
-        adapter->send_ipv4(eth.source(), ipv4_packet.source(), IPv4Protocol::ICMP, response_buffer, buffer.size(), 64);
+        adapter->send_ipv4(eth.source(), ipv4_packet.source(), IPv4Protocol::ICMP, move(packet), 64);
     }
 }
 
@@ -320,7 +336,7 @@ void handle_udp(const IPv4Packet& ipv4_packet, const timeval& packet_timestamp)
 
     ASSERT(socket->type() == SOCK_DGRAM);
     ASSERT(socket->local_port() == udp_packet.destination_port());
-    socket->did_receive(ipv4_packet.source(), udp_packet.source_port(), KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size()), packet_timestamp);
+    socket->did_receive(ipv4_packet.source(), udp_packet.source_port(), ReadonlyBytes { &ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size() }, packet_timestamp);
 }
 
 void handle_tcp(const IPv4Packet& ipv4_packet, const timeval& packet_timestamp)
@@ -580,12 +596,30 @@ void handle_tcp(const IPv4Packet& ipv4_packet, const timeval& packet_timestamp)
             return;
         }
     case TCPSocket::State::Established:
-        if (tcp_packet.has_fin()) {
-            if (payload_size != 0)
-                socket->did_receive(ipv4_packet.source(), tcp_packet.source_port(), KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size()), packet_timestamp);
+        if (!payload_size && !tcp_packet.has_fin())
+            return;
+
+        if (tcp_packet.sequence_number() != socket->ack_number()) {
+            // Out of order or duplicate. We don't queue these, but an immediate duplicate
+            // ACK lets the peer's fast retransmit fill the hole.
+#ifdef TCP_DEBUG
+            klog() << "handle_tcp: out of order segment with seq_no=" << tcp_packet.sequence_number() << ", expected " << socket->ack_number();
+#endif
+            unused_rc = socket->send_ack(TCPSocket::AckMode::Immediate);
+            return;
+        }
 
+        if (payload_size) {
+            if (!socket->did_receive(ipv4_packet.source(), tcp_packet.source_port(), ReadonlyBytes { &ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size() }, packet_timestamp)) {
+                // No room for it; tell the peer what our window really is.
+                unused_rc = socket->send_ack(TCPSocket::AckMode::Immediate);
+                return;
+            }
+        }
+
+        if (tcp_packet.has_fin()) {
             socket->set_ack_number(tcp_packet.sequence_number() + payload_size + 1);
-            unused_rc = socket->send_tcp_packet(TCPFlags::ACK);
+            unused_rc = socket->send_ack(TCPSocket::AckMode::Immediate);
             socket->set_state(TCPSocket::State::CloseWait);
             socket->set_connected(false);
             return;
@@ -597,10 +631,7 @@ void handle_tcp(const IPv4Packet& ipv4_packet, const timeval& packet_timestamp)
         klog() << "Got packet with ack_no=" << tcp_packet.ack_number() << ", seq_no=" << tcp_packet.sequence_number() << ", payload_size=" << payload_size << ", acking it with new ack_no=" << socket->ack_number() << ", seq_no=" << socket->sequence_number();
 #endif
 
-        if (payload_size) {
-            if (socket->did_receive(ipv4_packet.source(), tcp_packet.source_port(), KBuffer::copy(&ipv4_packet, sizeof(IPv4Packet) + ipv4_packet.payload_size()), packet_timestamp))
-                unused_rc = socket->send_tcp_packet(TCPFlags::ACK);
-        }
+        unused_rc = socket->send_ack(TCPSocket::AckMode::Delayed);
     }
 }
 
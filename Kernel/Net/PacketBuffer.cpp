@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/StdLibExtras.h>
+#include <Kernel/Net/NetworkAdapter.h>
+#include <Kernel/Net/PacketBuffer.h>
+
+namespace Kernel {
+
+PacketBuffer PacketBuffer::create(size_t size, size_t headroom)
+{
+    return PacketBuffer(ByteBuffer::create_uninitialized(headroom + size), headroom);
+}
+
+PacketBuffer::PacketBuffer(ByteBuffer&& buffer, size_t headroom)
+    : m_buffer(move(buffer))
+    , m_storage(m_buffer.data())
+    , m_offset(headroom)
+    , m_end(m_buffer.size())
+{
+}
+
+PacketBuffer::PacketBuffer(NetworkAdapter& adapter, size_t transmit_buffer_index, Bytes storage, size_t size, size_t headroom)
+    : m_adapter(adapter)
+    , m_transmit_buffer_index(transmit_buffer_index)
+    , m_storage(storage.data())
+    , m_offset(headroom)
+    , m_end(headroom + size)
+{
+    ASSERT(m_end <= storage.size());
+}
+
+PacketBuffer::PacketBuffer(PacketBuffer&& other)
+    : m_buffer(move(other.m_buffer))
+    , m_adapter(move(other.m_adapter))
+    , m_transmit_buffer_index(other.m_transmit_buffer_index)
+    , m_storage(exchange(other.m_storage, nullptr))
+    , m_offset(exchange(other.m_offset, 0))
+    , m_end(exchange(other.m_end, 0))
+{
+}
+
+PacketBuffer& PacketBuffer::operator=(PacketBuffer&& other)
+{
+    if (this != &other) {
+        release();
+        m_buffer = move(other.m_buffer);
+        m_adapter = move(other.m_adapter);
+        m_transmit_buffer_index = other.m_transmit_buffer_index;
+        m_storage = exchange(other.m_storage, nullptr);
+        m_offset = exchange(other.m_offset, 0);
+        m_end = exchange(other.m_end, 0);
+    }
+    return *this;
+}
+
+PacketBuffer::~PacketBuffer()
+{
+    release();
+}
+
+PacketBuffer PacketBuffer::copy() const
+{
+    auto packet = create(size(), headroom());
+    memcpy(packet.data(), data(), size());
+    return packet;
+}
+
+void PacketBuffer::did_transmit()
+{
+    m_adapter = nullptr;
+}
+
+void PacketBuffer::release()
+{
+    // A packet that was never sent gives its transmit buffer back to the adapter.
+    if (auto adapter = move(m_adapter))
+        adapter->release_transmit_buffer(m_transmit_buffer_index);
+}
+
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/ByteBuffer.h>
+#include <AK/Noncopyable.h>
+#include <AK/RefPtr.h>
+#include <AK/Span.h>
+#include <Kernel/Net/EthernetFrameHeader.h>
+#include <Kernel/Net/IPv4.h>
+
+namespace Kernel {
+
+class NetworkAdapter;
+
+// An outgoing packet with some unused space (headroom) in front of it.
+// Each layer on the way down prepends its header into the headroom, so the
+// payload is written exactly once, by whoever creates the packet.
+//
+// Packets from NetworkAdapter::allocate_packet() usually live in one of the
+// adapter's transmit buffers, which the card sends from directly. Such a packet
+// holds on to its transmit buffer until it is sent or destroyed.
+class PacketBuffer {
+    AK_MAKE_NONCOPYABLE(PacketBuffer);
+
+public:
+    // Enough room for everything NetworkAdapter::send_ipv4() puts in front of a packet.
+    static constexpr size_t default_headroom = sizeof(EthernetFrameHeader) + sizeof(IPv4Packet);
+
+    // Creates a packet in ordinary kernel memory, for when no adapter is involved yet.
+    static PacketBuffer create(size_t size, size_t headroom = default_headroom);
+
+    PacketBuffer(PacketBuffer&&);
+    PacketBuffer& operator=(PacketBuffer&&);
+    ~PacketBuffer();
+
+    // Copies the packet (but not its headroom contents) into ordinary kernel memory.
+    PacketBuffer copy() const;
+
+    u8* data() { return m_storage + m_offset; }
+    const u8* data() const { return m_storage + m_offset; }
+    size_t size() const { return m_end - m_offset; }
+    size_t headroom() const { return m_offset; }
+
+    ReadonlyBytes bytes() const { return { data(), size() }; }
+
+    // Claims sizeof(T) bytes of headroom and constructs a T there, which becomes the new start of the packet.
+    template<typename T>
+    T& prepend()
+    {
+        ASSERT(m_offset >= sizeof(T));
+        m_offset -= sizeof(T);
+        return *new (data()) T();
+    }
+
+    // Strips a header that was added with prepend(), turning it back into headroom.
+    void pull(size_t size)
+    {
+        ASSERT(size <= this->size());
+        m_offset += size;
+    }
+
+private:
+    friend class NetworkAdapter;
+
+    PacketBuffer(ByteBuffer&&, size_t headroom);
+    PacketBuffer(NetworkAdapter&, size_t transmit_buffer_index, Bytes storage, size_t size, size_t headroom);
+
+    bool is_transmit_buffer_of(const NetworkAdapter& adapter) const { return m_adapter.ptr() == &adapter; }
+    size_t transmit_buffer_index() const { return m_transmit_buffer_index; }
+    void did_transmit();
+    void release();
+
+    ByteBuffer m_buffer;
+    RefPtr<NetworkAdapter> m_adapter;
+    size_t m_transmit_buffer_index { 0 };
+    u8* m_storage { nullptr };
+    size_t m_offset { 0 };
+    size_t m_end { 0 };
+};
+
+}
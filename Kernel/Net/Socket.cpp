@@ -105,7 +105,7 @@ KResult Socket::queue_connection_from(NonnullRefPtr<Socket> peer)
     return KSuccess;
 }
 
-KResult Socket::setsockopt(int level, int option, Userspace<const void*> user_value, socklen_t user_value_size)
+KResult Socket::setsockopt(FileDescription&, int level, int option, Userspace<const void*> user_value, socklen_t user_value_size)
 {
     ASSERT(level == SOL_SOCKET);
     switch (option) {
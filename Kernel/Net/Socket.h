@@ -93,6 +93,9 @@ public:
     bool is_connected() const { return m_connected; }
     void set_connected(bool);
 
+    // Whether the connection is gone for good, i.e. neither direction will ever see new data.
+    virtual bool has_hung_up(const FileDescription&) const { return is_shut_down_for_reading() && is_shut_down_for_writing(); }
+
     bool can_accept() const { return !m_pending.is_empty(); }
     RefPtr<Socket> accept();
 
@@ -110,7 +113,7 @@ public:
     virtual KResultOr<size_t> sendto(FileDescription&, const UserOrKernelBuffer&, size_t, int flags, Userspace<const sockaddr*>, socklen_t) = 0;
     virtual KResultOr<size_t> recvfrom(FileDescription&, UserOrKernelBuffer&, size_t, int flags, Userspace<sockaddr*>, Userspace<socklen_t*>, timeval&) = 0;
 
-    virtual KResult setsockopt(int level, int option, Userspace<const void*>, socklen_t);
+    virtual KResult setsockopt(FileDescription&, int level, int option, Userspace<const void*>, socklen_t);
     virtual KResult getsockopt(FileDescription&, int level, int option, Userspace<void*>, Userspace<socklen_t*>);
 
     pid_t origin_pid() const { return m_origin.pid; }
@@ -39,6 +39,53 @@
 
 namespace Kernel {
 
+static constexpr size_t send_buffer_size = 256 * KiB;
+static constexpr size_t maximum_segment_size_limit = 8 * KiB;
+static constexpr u16 default_maximum_segment_size = 536;
+static constexpr size_t initial_congestion_window_segments = 4;
+static constexpr u32 minimum_retransmission_timeout = 200;
+static constexpr u32 maximum_retransmission_timeout = 60000;
+static constexpr size_t tcp_ipv4_overhead = sizeof(IPv4Packet) + sizeof(TCPPacket);
+// The IPv4 IHL and the TCP data offset are 4-bit counts of 32-bit words, so with options each header can grow to 60 bytes.
+static constexpr size_t tcp_ipv4_max_overhead = 2 * 15 * sizeof(u32);
+
+// Sequence numbers wrap around, so they are compared modulo 2^32.
+static inline bool sequence_less_than(u32 a, u32 b) { return (i32)(a - b) < 0; }
+static inline bool sequence_less_than_or_equal(u32 a, u32 b) { return (i32)(a - b) <= 0; }
+
+static u32 milliseconds_between(const timeval& earlier, const timeval& later)
+{
+    timeval diff;
+    timeval_sub(later, earlier, diff);
+    if (diff.tv_sec < 0)
+        return 0;
+    return diff.tv_sec * 1000 + diff.tv_usec / 1000;
+}
+
+static u16 parse_maximum_segment_size_option(const TCPPacket& packet)
+{
+    auto* options = (const u8*)&packet + sizeof(TCPPacket);
+    size_t options_size = packet.header_size() - sizeof(TCPPacket);
+    for (size_t i = 0; i < options_size;) {
+        u8 kind = options[i];
+        if (kind == 0)
+            break;
+        if (kind == 1) {
+            ++i;
+            continue;
+        }
+        if (i + 1 >= options_size)
+            break;
+        u8 length = options[i + 1];
+        if (length < 2 || i + length > options_size)
+            break;
+        if (kind == 2 && length == 4)
+            return (options[i + 2] << 8) | options[i + 3];
+        i += length;
+    }
+    return 0;
+}
+
 void TCPSocket::for_each(Function<void(const TCPSocket&)> callback)
 {
     LOCKER(sockets_by_tuple().lock(), Lock::Mode::Shared);
@@ -183,22 +230,101 @@ KResultOr<size_t> TCPSocket::protocol_receive(ReadonlyBytes raw_ipv4_packet, Use
 
 KResultOr<size_t> TCPSocket::protocol_send(const UserOrKernelBuffer& data, size_t data_length)
 {
-    int err = send_tcp_packet(TCPFlags::PUSH | TCPFlags::ACK, &data, data_length);
-    if (err < 0)
-        return KResult(err);
-    return data_length;
+    size_t segment_size = maximum_segment_size();
+    size_t queued_bytes = m_sequence_number - m_send_unacknowledged;
+    size_t space = queued_bytes < send_buffer_size ? send_buffer_size - queued_bytes : 0;
+    // Always accept at least one segment, since sendto() doesn't wait for can_write().
+    size_t bytes_to_send = min(data_length, max(space, segment_size));
+
+    for (size_t offset = 0; offset < bytes_to_send;) {
+        size_t segment_length = min(segment_size, bytes_to_send - offset);
+        u16 flags = TCPFlags::ACK;
+        if (offset + segment_length == bytes_to_send)
+            flags |= TCPFlags::PUSH;
+        auto segment = data.offset(offset);
+        int err = send_tcp_packet(flags, &segment, segment_length);
+        if (err < 0) {
+            if (offset)
+                return offset;
+            return KResult(err);
+        }
+        offset += segment_length;
+    }
+    return bytes_to_send;
+}
+
+bool TCPSocket::can_write(const FileDescription& description, size_t size) const
+{
+    if (!IPv4Socket::can_write(description, size))
+        return false;
+    return m_sequence_number - m_send_unacknowledged < send_buffer_size;
+}
+
+size_t TCPSocket::maximum_segment_size() const
+{
+    size_t segment_size = default_maximum_segment_size;
+    auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
+    if (!routing_decision.is_zero())
+        segment_size = min<size_t>(routing_decision.adapter->mtu() - tcp_ipv4_overhead, maximum_segment_size_limit);
+    if (m_peer_maximum_segment_size)
+        segment_size = min<size_t>(segment_size, m_peer_maximum_segment_size);
+    return segment_size;
+}
+
+u16 TCPSocket::receive_window() const
+{
+    // IPv4Socket::did_receive() needs room for the headers as well, and the peer may send options.
+    size_t space = receive_buffer_space();
+    if (space <= tcp_ipv4_max_overhead)
+        return 0;
+    return min<size_t>(space - tcp_ipv4_max_overhead, 0xffff);
+}
+
+size_t TCPSocket::send_window() const
+{
+    return min<size_t>(m_congestion_window, m_peer_window);
+}
+
+void TCPSocket::protocol_did_read_from_receive_buffer()
+{
+    // Tell the peer about the space we just made, but only once it's worth a segment
+    // or half the buffer, to avoid silly window syndrome (RFC 1122, 4.2.3.3).
+    if (state() != State::Established && state() != State::FinWait1 && state() != State::FinWait2)
+        return;
+    u16 window = receive_window();
+    if (window <= m_last_advertised_window)
+        return;
+    size_t threshold = min<size_t>(maximum_segment_size(), (window + tcp_ipv4_max_overhead) / 2);
+    if ((size_t)(window - m_last_advertised_window) < threshold)
+        return;
+    [[maybe_unused]] auto rc = send_tcp_packet(TCPFlags::ACK);
+}
+
+int TCPSocket::send_ack(AckMode mode)
+{
+    if (mode == AckMode::Delayed && ++m_unacknowledged_segments_received < 2)
+        return 0;
+    return send_tcp_packet(TCPFlags::ACK);
+}
+
+void TCPSocket::flush_delayed_ack()
+{
+    if (!m_unacknowledged_segments_received)
+        return;
+    [[maybe_unused]] auto rc = send_tcp_packet(TCPFlags::ACK);
 }
 
 int TCPSocket::send_tcp_packet(u16 flags, const UserOrKernelBuffer* payload, size_t payload_size)
 {
-    const size_t buffer_size = sizeof(TCPPacket) + payload_size;
-    alignas(TCPPacket) u8 buffer[buffer_size];
-    new (buffer) TCPPacket;
-    auto& tcp_packet = *(TCPPacket*)(buffer);
+    // Build the segment right in the buffer the adapter is going to send it from.
+    auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
+    size_t packet_size = sizeof(TCPPacket) + payload_size;
+    auto packet = routing_decision.is_zero() ? PacketBuffer::create(packet_size) : routing_decision.adapter->allocate_packet(packet_size);
+    auto& tcp_packet = *new (packet.data()) TCPPacket;
     ASSERT(local_port());
     tcp_packet.set_source_port(local_port());
     tcp_packet.set_destination_port(peer_port());
-    tcp_packet.set_window_size(1024);
+    tcp_packet.set_window_size(receive_window());
     tcp_packet.set_sequence_number(m_sequence_number);
     tcp_packet.set_data_offset(sizeof(TCPPacket) / sizeof(u32));
     tcp_packet.set_flags(flags);
@@ -209,99 +335,284 @@ int TCPSocket::send_tcp_packet(u16 flags, const UserOrKernelBuffer* payload, siz
     if (payload && !payload->read(tcp_packet.payload(), payload_size))
         return -EFAULT;
 
+    u32 sequence_number = m_sequence_number;
     if (flags & TCPFlags::SYN) {
         ++m_sequence_number;
     } else {
         m_sequence_number += payload_size;
     }
 
-    tcp_packet.set_checksum(compute_tcp_checksum(local_address(), peer_address(), tcp_packet, payload_size));
-
     if (tcp_packet.has_syn() || payload_size > 0) {
         LOCKER(m_not_acked_lock);
-        m_not_acked.append({ m_sequence_number, ByteBuffer::copy(buffer, buffer_size) });
-        send_outgoing_packets();
+        if (m_not_acked.is_empty())
+            m_retransmission_timer_start = kgettimeofday();
+        // Keep our own copy until the segment is acknowledged. The packet itself
+        // goes out right away if the window allows, and is dropped otherwise.
+        m_not_acked.append({ sequence_number, m_sequence_number, packet.copy() });
+        transmit_packets_within_window(&packet);
         return 0;
     }
 
-    auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
+    tcp_packet.set_checksum(compute_tcp_checksum(local_address(), peer_address(), tcp_packet, payload_size));
+
     ASSERT(!routing_decision.is_zero());
 
-    auto packet_buffer = UserOrKernelBuffer::for_kernel_buffer(buffer);
+    // The packet belongs to the adapter once it's sent, so don't look at it afterwards.
+    u16 window_size = tcp_packet.window_size();
     int err = routing_decision.adapter->send_ipv4(
         routing_decision.next_hop, peer_address(), IPv4Protocol::TCP,
-        packet_buffer, buffer_size, ttl());
+        move(packet), ttl());
     if (err < 0)
         return err;
 
+    if (flags & TCPFlags::ACK) {
+        m_unacknowledged_segments_received = 0;
+        m_last_advertised_window = window_size;
+    }
     m_packets_out++;
-    m_bytes_out += buffer_size;
+    m_bytes_out += packet_size;
     return 0;
 }
 
 void TCPSocket::send_outgoing_packets()
 {
-    auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
-    ASSERT(!routing_decision.is_zero());
+    LOCKER(m_not_acked_lock);
+    transmit_packets_within_window();
+}
 
-    auto now = kgettimeofday();
+void TCPSocket::transmit_packets_within_window(PacketBuffer* new_packet)
+{
+    ASSERT(m_not_acked_lock.is_locked());
+    if (!m_congestion_window)
+        m_congestion_window = initial_congestion_window_segments * maximum_segment_size();
 
-    LOCKER(m_not_acked_lock, Lock::Mode::Shared);
+    u32 window_end = m_send_unacknowledged + send_window();
     for (auto& packet : m_not_acked) {
-        timeval diff;
-        timeval_sub(packet.tx_time, now, diff);
-        if (diff.tv_sec == 0 && diff.tv_usec <= 500000)
+        if (sequence_less_than(packet.sequence_number, m_send_next))
             continue;
-        packet.tx_time = now;
-        packet.tx_counter++;
+        if (sequence_less_than(window_end, packet.ack_number))
+            break;
+        bool is_new_packet = new_packet && &packet == &m_not_acked.last();
+        if (!transmit_packet(packet, is_new_packet ? new_packet : nullptr))
+            break;
+        m_send_next = packet.ack_number;
+        if (sequence_less_than(m_send_max, m_send_next))
+            m_send_max = m_send_next;
+    }
+}
+
+bool TCPSocket::transmit_packet(OutgoingPacket& packet, PacketBuffer* prepared_packet)
+{
+    auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
+    if (routing_decision.is_zero())
+        return false;
+
+    // The acknowledgment and window may have moved on since the packet was queued.
+    auto& tcp_packet = *(TCPPacket*)(packet.buffer.data());
+    if (tcp_packet.has_ack())
+        tcp_packet.set_ack_number(m_ack_number);
+    tcp_packet.set_window_size(receive_window());
+    tcp_packet.set_checksum(0);
+    tcp_packet.set_checksum(compute_tcp_checksum(local_address(), peer_address(), tcp_packet, packet.buffer.size() - sizeof(TCPPacket)));
+
+    // Sending a segment for the first time uses the buffer it was built in, which only needs
+    // the updated header. Anything else is copied from our copy into a new buffer.
+    size_t size_to_copy = prepared_packet ? sizeof(TCPPacket) : packet.buffer.size();
+    auto outgoing_packet = prepared_packet ? move(*prepared_packet) : routing_decision.adapter->allocate_packet(packet.buffer.size());
+    memcpy(outgoing_packet.data(), packet.buffer.data(), size_to_copy);
+
+    packet.tx_time = kgettimeofday();
+    packet.tx_counter++;
 
 #ifdef TCP_SOCKET_DEBUG
-        auto& tcp_packet = *(TCPPacket*)(packet.buffer.data());
-        klog() << "sending tcp packet from " << local_address().to_string().characters() << ":" << local_port() << " to " << peer_address().to_string().characters() << ":" << peer_port() << " with (" << (tcp_packet.has_syn() ? "SYN " : "") << (tcp_packet.has_ack() ? "ACK " : "") << (tcp_packet.has_fin() ? "FIN " : "") << (tcp_packet.has_rst() ? "RST " : "") << ") seq_no=" << tcp_packet.sequence_number() << ", ack_no=" << tcp_packet.ack_number() << ", tx_counter=" << packet.tx_counter;
+    klog() << "sending tcp packet from " << local_address().to_string().characters() << ":" << local_port() << " to " << peer_address().to_string().characters() << ":" << peer_port() << " with (" << (tcp_packet.has_syn() ? "SYN " : "") << (tcp_packet.has_ack() ? "ACK " : "") << (tcp_packet.has_fin() ? "FIN " : "") << (tcp_packet.has_rst() ? "RST " : "") << ") seq_no=" << tcp_packet.sequence_number() << ", ack_no=" << tcp_packet.ack_number() << ", tx_counter=" << packet.tx_counter;
 #endif
-        auto packet_buffer = UserOrKernelBuffer::for_kernel_buffer(packet.buffer.data());
-        int err = routing_decision.adapter->send_ipv4(
-            routing_decision.next_hop, peer_address(), IPv4Protocol::TCP,
-            packet_buffer, packet.buffer.size(), ttl());
-        if (err < 0) {
-            auto& tcp_packet = *(TCPPacket*)(packet.buffer.data());
-            klog() << "Error (" << err << ") sending tcp packet from " << local_address().to_string().characters() << ":" << local_port() << " to " << peer_address().to_string().characters() << ":" << peer_port() << " with (" << (tcp_packet.has_syn() ? "SYN " : "") << (tcp_packet.has_ack() ? "ACK " : "") << (tcp_packet.has_fin() ? "FIN " : "") << (tcp_packet.has_rst() ? "RST " : "") << ") seq_no=" << tcp_packet.sequence_number() << ", ack_no=" << tcp_packet.ack_number() << ", tx_counter=" << packet.tx_counter;
-        } else {
-            m_packets_out++;
-            m_bytes_out += packet.buffer.size();
+    int err = routing_decision.adapter->send_ipv4(
+        routing_decision.next_hop, peer_address(), IPv4Protocol::TCP,
+        move(outgoing_packet), ttl());
+    if (err < 0) {
+        klog() << "Error (" << err << ") sending tcp packet from " << local_address().to_string().characters() << ":" << local_port() << " to " << peer_address().to_string().characters() << ":" << peer_port() << " with (" << (tcp_packet.has_syn() ? "SYN " : "") << (tcp_packet.has_ack() ? "ACK " : "") << (tcp_packet.has_fin() ? "FIN " : "") << (tcp_packet.has_rst() ? "RST " : "") << ") seq_no=" << tcp_packet.sequence_number() << ", ack_no=" << tcp_packet.ack_number() << ", tx_counter=" << packet.tx_counter;
+        return false;
+    }
+
+    if (tcp_packet.has_ack()) {
+        m_unacknowledged_segments_received = 0;
+        m_last_advertised_window = tcp_packet.window_size();
+    }
+    m_packets_out++;
+    m_bytes_out += packet.buffer.size();
+    return true;
+}
+
+void TCPSocket::update_round_trip_time(u32 sample)
+{
+    // RFC 6298, section 2, with alpha = 1/8 and beta = 1/4.
+    if (!m_smoothed_rtt) {
+        m_smoothed_rtt = max(sample, 1u);
+        m_rtt_variance = sample / 2;
+    } else {
+        u32 delta = sample > m_smoothed_rtt ? sample - m_smoothed_rtt : m_smoothed_rtt - sample;
+        m_rtt_variance = (3 * m_rtt_variance + delta) / 4;
+        m_smoothed_rtt = max((7 * m_smoothed_rtt + sample) / 8, 1u);
+    }
+    m_retransmission_timeout = clamp(m_smoothed_rtt + max(4 * m_rtt_variance, timer_interval_ms), minimum_retransmission_timeout, maximum_retransmission_timeout);
+}
+
+void TCPSocket::handle_retransmission_timer()
+{
+    LOCKER(m_not_acked_lock);
+    if (m_not_acked.is_empty())
+        return;
+
+    auto now = kgettimeofday();
+    if (milliseconds_between(m_retransmission_timer_start, now) < m_retransmission_timeout) {
+        // The peer may have opened its window without telling us about it yet.
+        transmit_packets_within_window();
+        return;
+    }
+
+    size_t segment_size = maximum_segment_size();
+    auto& packet = m_not_acked.first();
+    bool is_window_probe = packet.tx_counter == 0;
+
+#ifdef TCP_SOCKET_DEBUG
+    dbg() << "TCPSocket: retransmission timeout (" << m_retransmission_timeout << " ms), " << (is_window_probe ? "probing window" : "retransmitting");
+#endif
+
+    if (!is_window_probe) {
+        // RFC 5681, section 3.1, equation (4), and RFC 6582, section 3.2, step 4.
+        m_slow_start_threshold = max(bytes_in_flight() / 2, 2 * segment_size);
+        m_congestion_window = segment_size;
+        m_in_fast_recovery = false;
+        m_duplicate_ack_count = 0;
+        m_recover = m_send_max;
+        // Everything in flight is presumed lost; resend it as the window opens again.
+        m_send_next = m_send_unacknowledged;
+    }
+
+    if (transmit_packet(packet)) {
+        if (sequence_less_than(m_send_next, packet.ack_number))
+            m_send_next = packet.ack_number;
+        if (sequence_less_than(m_send_max, m_send_next))
+            m_send_max = m_send_next;
+    }
+
+    m_retransmission_timeout = min(m_retransmission_timeout * 2, maximum_retransmission_timeout);
+    m_retransmission_timer_start = now;
+}
+
+void TCPSocket::run_timers()
+{
+    Vector<NonnullRefPtr<TCPSocket>, 16> sockets;
+    {
+        LOCKER(sockets_by_tuple().lock(), Lock::Mode::Shared);
+        for (auto& it : sockets_by_tuple().resource()) {
+            auto& socket = *it.value;
+            if (socket.state() == State::Closed || socket.state() == State::Listen)
+                continue;
+            sockets.append(socket);
         }
     }
+
+    for (auto& socket : sockets) {
+        socket->flush_delayed_ack();
+        socket->handle_retransmission_timer();
+    }
 }
 
 void TCPSocket::receive_tcp_packet(const TCPPacket& packet, u16 size)
 {
+    if (packet.has_syn()) {
+        if (auto segment_size = parse_maximum_segment_size_option(packet))
+            m_peer_maximum_segment_size = segment_size;
+    }
+
     if (packet.has_ack()) {
         u32 ack_number = packet.ack_number();
+        size_t payload_size = size - packet.header_size();
+        bool did_acknowledge_data = false;
 
 #ifdef TCP_SOCKET_DEBUG
         dbg() << "TCPSocket: receive_tcp_packet: " << ack_number;
 #endif
 
-        int removed = 0;
         LOCKER(m_not_acked_lock);
-        while (!m_not_acked.is_empty()) {
-            auto& packet = m_not_acked.first();
+        u16 previous_peer_window = m_peer_window;
+        size_t segment_size = maximum_segment_size();
+
+        if (sequence_less_than(m_send_unacknowledged, ack_number) && sequence_less_than_or_equal(ack_number, m_send_max)) {
+            size_t newly_acknowledged = ack_number - m_send_unacknowledged;
+            auto now = kgettimeofday();
+
+            int removed = 0;
+            while (!m_not_acked.is_empty()) {
+                auto& packet = m_not_acked.first();
 
 #ifdef TCP_SOCKET_DEBUG
-            dbg() << "TCPSocket: iterate: " << packet.ack_number;
+                dbg() << "TCPSocket: iterate: " << packet.ack_number;
 #endif
 
-            if (packet.ack_number <= ack_number) {
+                if (!sequence_less_than_or_equal(packet.ack_number, ack_number))
+                    break;
+                // Karn's algorithm: never take samples from retransmitted packets.
+                if (packet.tx_counter == 1)
+                    update_round_trip_time(milliseconds_between(packet.tx_time, now));
                 m_not_acked.take_first();
                 removed++;
-            } else {
-                break;
             }
-        }
 
 #ifdef TCP_SOCKET_DEBUG
-        dbg() << "TCPSocket: receive_tcp_packet acknowledged " << removed << " packets";
+            dbg() << "TCPSocket: receive_tcp_packet acknowledged " << removed << " packets";
 #endif
+
+            m_send_unacknowledged = ack_number;
+            if (sequence_less_than(m_send_next, ack_number))
+                m_send_next = ack_number;
+
+            if (m_in_fast_recovery) {
+                if (sequence_less_than_or_equal(m_recover, ack_number)) {
+                    // Full acknowledgment (RFC 6582, section 3.2, step 3).
+                    m_congestion_window = min(m_slow_start_threshold, max(bytes_in_flight(), segment_size) + segment_size);
+                    m_in_fast_recovery = false;
+                } else {
+                    // Partial acknowledgment: the next hole is lost as well.
+                    if (!m_not_acked.is_empty())
+                        transmit_packet(m_not_acked.first());
+                    m_congestion_window -= min(m_congestion_window - segment_size, newly_acknowledged);
+                    m_congestion_window += segment_size;
+                }
+            } else if (m_congestion_window < m_slow_start_threshold) {
+                m_congestion_window += min(newly_acknowledged, segment_size);
+            } else {
+                m_congestion_window += max<size_t>(segment_size * segment_size / m_congestion_window, 1);
+            }
+
+            m_duplicate_ack_count = 0;
+            m_retransmission_timer_start = now;
+            did_acknowledge_data = true;
+        } else if (ack_number == m_send_unacknowledged && !payload_size && !packet.has_syn() && !packet.has_fin()
+            && packet.window_size() == previous_peer_window && bytes_in_flight()) {
+            ++m_duplicate_ack_count;
+            if (m_in_fast_recovery) {
+                m_congestion_window += segment_size;
+            } else if (m_duplicate_ack_count == 3 && sequence_less_than(m_recover, ack_number)) {
+                // Fast retransmit (RFC 5681, section 3.2, and RFC 6582, section 3.2, step 2).
+                m_slow_start_threshold = max(bytes_in_flight() / 2, 2 * segment_size);
+                m_recover = m_send_max;
+                m_in_fast_recovery = true;
+                if (!m_not_acked.is_empty())
+                    transmit_packet(m_not_acked.first());
+                m_congestion_window = m_slow_start_threshold + 3 * segment_size;
+            }
+        }
+
+        m_peer_window = packet.window_size();
+        transmit_packets_within_window();
+
+        if (did_acknowledge_data) {
+            locker.unlock();
+            evaluate_block_conditions();
+        }
     }
 
     m_packets_in++;
@@ -384,7 +695,7 @@ KResult TCPSocket::protocol_connect(FileDescription& description, ShouldBlock sh
 
     allocate_local_port_if_needed();
 
-    m_sequence_number = get_good_random<u32>();
+    set_sequence_number(get_good_random<u32>());
     m_ack_number = 0;
 
     set_setup_state(SetupState::InProgress);
@@ -31,6 +31,7 @@
 #include <AK/SinglyLinkedList.h>
 #include <AK/WeakPtr.h>
 #include <Kernel/Net/IPv4Socket.h>
+#include <Kernel/Net/PacketBuffer.h>
 
 namespace Kernel {
 
@@ -140,7 +141,14 @@ public:
     void set_error(Error error) { m_error = error; }
 
     void set_ack_number(u32 n) { m_ack_number = n; }
-    void set_sequence_number(u32 n) { m_sequence_number = n; }
+    void set_sequence_number(u32 n)
+    {
+        m_sequence_number = n;
+        m_send_unacknowledged = n;
+        m_send_next = n;
+        m_send_max = n;
+        m_recover = n;
+    }
     u32 ack_number() const { return m_ack_number; }
     u32 sequence_number() const { return m_sequence_number; }
     u32 packets_in() const { return m_packets_in; }
@@ -152,6 +160,18 @@ public:
     void send_outgoing_packets();
     void receive_tcp_packet(const TCPPacket&, u16 size);
 
+    // Acknowledges a received data segment. Unless told otherwise, only every second
+    // segment is acknowledged right away; the rest are picked up by the delayed ACK timer.
+    enum class AckMode {
+        Immediate,
+        Delayed,
+    };
+    [[nodiscard]] int send_ack(AckMode);
+
+    // Runs the retransmission and delayed ACK timers of every socket. Called periodically by the NetworkTask.
+    static void run_timers();
+    static constexpr u32 timer_interval_ms = 100;
+
     static Lockable<HashMap<IPv4SocketTuple, TCPSocket*>>& sockets_by_tuple();
     static RefPtr<TCPSocket> from_tuple(const IPv4SocketTuple& tuple);
     static RefPtr<TCPSocket> from_endpoints(const IPv4Address& local_address, u16 local_port, const IPv4Address& peer_address, u16 peer_port);
@@ -176,6 +196,7 @@ private:
     static NetworkOrdered<u16> compute_tcp_checksum(const IPv4Address& source, const IPv4Address& destination, const TCPPacket&, u16 payload_size);
 
     virtual void shut_down_for_writing() override;
+    virtual bool can_write(const FileDescription&, size_t) const override;
 
     virtual KResultOr<size_t> protocol_receive(ReadonlyBytes raw_ipv4_packet, UserOrKernelBuffer& buffer, size_t buffer_size, int flags) override;
     virtual KResultOr<size_t> protocol_send(const UserOrKernelBuffer&, size_t) override;
@@ -184,6 +205,19 @@ private:
     virtual bool protocol_is_disconnected() const override;
     virtual KResult protocol_bind() override;
     virtual KResult protocol_listen() override;
+    virtual void protocol_did_read_from_receive_buffer() override;
+
+    struct OutgoingPacket;
+
+    size_t maximum_segment_size() const;
+    u16 receive_window() const;
+    size_t send_window() const;
+    size_t bytes_in_flight() const { return m_send_next - m_send_unacknowledged; }
+    void flush_delayed_ack();
+    void handle_retransmission_timer();
+    void transmit_packets_within_window(PacketBuffer* new_packet = nullptr);
+    bool transmit_packet(OutgoingPacket&, PacketBuffer* prepared_packet = nullptr);
+    void update_round_trip_time(u32 sample_ms);
 
     WeakPtr<TCPSocket> m_originator;
     HashMap<IPv4SocketTuple, NonnullRefPtr<TCPSocket>> m_pending_release_for_accept;
@@ -199,14 +233,41 @@ private:
     u32 m_bytes_out { 0 };
 
     struct OutgoingPacket {
+        u32 sequence_number { 0 };
         u32 ack_number { 0 };
-        ByteBuffer buffer;
+        PacketBuffer buffer;
         int tx_counter { 0 };
         timeval tx_time { 0, 0 };
     };
 
+    // Everything below is protected by m_not_acked_lock.
     Lock m_not_acked_lock { "TCPSocket unacked packets" };
     SinglyLinkedList<OutgoingPacket> m_not_acked;
+
+    // Send sequence space, as in RFC 793: everything before m_send_unacknowledged has been
+    // acknowledged and everything before m_send_next has been (re)transmitted in this round.
+    // m_send_max is the highest sequence number ever transmitted.
+    u32 m_send_unacknowledged { 0 };
+    u32 m_send_next { 0 };
+    u32 m_send_max { 0 };
+    u16 m_peer_window { 0xffff };
+    u16 m_peer_maximum_segment_size { 0 };
+
+    // NewReno congestion control (RFC 5681, RFC 6582).
+    size_t m_congestion_window { 0 };
+    size_t m_slow_start_threshold { 0xffff };
+    u32 m_duplicate_ack_count { 0 };
+    bool m_in_fast_recovery { false };
+    u32 m_recover { 0 };
+
+    // Retransmission timeout estimation (RFC 6298), in milliseconds.
+    u32 m_smoothed_rtt { 0 };
+    u32 m_rtt_variance { 0 };
+    u32 m_retransmission_timeout { 1000 };
+    timeval m_retransmission_timer_start { 0, 0 };
+
+    u16 m_last_advertised_window { 0 };
+    u32 m_unacknowledged_segments_received { 0 };
 };
 
 }
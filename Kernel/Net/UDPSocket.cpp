@@ -95,19 +95,15 @@ KResultOr<size_t> UDPSocket::protocol_send(const UserOrKernelBuffer& data, size_
     auto routing_decision = route_to(peer_address(), local_address(), bound_interface());
     if (routing_decision.is_zero())
         return KResult(-EHOSTUNREACH);
-    const size_t buffer_size = sizeof(UDPPacket) + data_length;
-
-    alignas(UDPPacket) u8 buffer[buffer_size];
-    new (buffer) UDPPacket;
-
-    auto& udp_packet = *reinterpret_cast<UDPPacket*>(buffer);
+    auto packet = routing_decision.adapter->allocate_packet(sizeof(UDPPacket) + data_length);
+    auto& udp_packet = *new (packet.data()) UDPPacket;
     udp_packet.set_source_port(local_port());
     udp_packet.set_destination_port(peer_port());
-    udp_packet.set_length(buffer_size);
+    udp_packet.set_length(packet.size());
     if (!data.read(udp_packet.payload(), data_length))
         return KResult(-EFAULT);
 
-    routing_decision.adapter->send_ipv4(routing_decision.next_hop, peer_address(), IPv4Protocol::UDP, UserOrKernelBuffer::for_kernel_buffer(buffer), buffer_size, ttl());
+    routing_decision.adapter->send_ipv4(routing_decision.next_hop, peer_address(), IPv4Protocol::UDP, move(packet), ttl());
     return data_length;
 }
 
@@ -25,7 +25,6 @@
  */
 
 #include <AK/Demangle.h>
-#include <AK/QuickSort.h>
 #include <AK/StdLibExtras.h>
 #include <AK/StringBuilder.h>
 #include <AK/Time.h>
@@ -132,6 +131,7 @@ Range Process::allocate_range(VirtualAddress vaddr, size_t size, size_t alignmen
 
 Region& Process::allocate_split_region(const Region& source_region, const Range& range, size_t offset_in_vmobject)
 {
+    LOCKER(m_address_space_lock);
     auto& region = add_region(Region::create_user_accessible(this, range, source_region.vmobject(), offset_in_vmobject, source_region.name(), source_region.access()));
     region.set_mmap(source_region.is_mmap());
     region.set_stack(source_region.is_stack());
@@ -146,6 +146,7 @@ Region& Process::allocate_split_region(const Region& source_region, const Range&
 Region* Process::allocate_region(const Range& range, const String& name, int prot, AllocationStrategy strategy)
 {
     ASSERT(range.is_valid());
+    LOCKER(m_address_space_lock);
     auto vmobject = AnonymousVMObject::create_with_size(range.size(), strategy);
     if (!vmobject)
         return nullptr;
@@ -157,6 +158,7 @@ Region* Process::allocate_region(const Range& range, const String& name, int pro
 
 Region* Process::allocate_region(VirtualAddress vaddr, size_t size, const String& name, int prot, AllocationStrategy strategy)
 {
+    LOCKER(m_address_space_lock);
     auto range = allocate_range(vaddr, size);
     if (!range.is_valid())
         return nullptr;
@@ -166,6 +168,7 @@ Region* Process::allocate_region(VirtualAddress vaddr, size_t size, const String
 Region* Process::allocate_region_with_vmobject(const Range& range, NonnullRefPtr<VMObject> vmobject, size_t offset_in_vmobject, const String& name, int prot, bool shared)
 {
     ASSERT(range.is_valid());
+    LOCKER(m_address_space_lock);
     size_t end_in_vmobject = offset_in_vmobject + range.size();
     if (end_in_vmobject <= offset_in_vmobject) {
         dbg() << "allocate_region_with_vmobject: Overflow (offset + size)";
@@ -188,26 +191,43 @@ Region* Process::allocate_region_with_vmobject(const Range& range, NonnullRefPtr
 
 Region* Process::allocate_region_with_vmobject(VirtualAddress vaddr, size_t size, NonnullRefPtr<VMObject> vmobject, size_t offset_in_vmobject, const String& name, int prot, bool shared)
 {
+    LOCKER(m_address_space_lock);
     auto range = allocate_range(vaddr, size);
     if (!range.is_valid())
         return nullptr;
     return allocate_region_with_vmobject(range, move(vmobject), offset_in_vmobject, name, prot, shared);
 }
 
+void Process::set_priority_boost(u32 boost)
+{
+    ScopedSpinLock lock(g_scheduler_lock);
+    m_priority_boost = boost;
+    // This changes the effective priority of all our threads.
+    for_each_thread([](Thread& thread) {
+        Scheduler::requeue_runnable_thread(thread);
+        return IterationDecision::Continue;
+    });
+}
+
 bool Process::deallocate_region(Region& region)
 {
-    OwnPtr<Region> region_protector;
+    LOCKER(m_address_space_lock);
+    // The region is destroyed after take_region() has dropped m_lock.
+    auto region_protector = take_region(region);
+    return region_protector;
+}
+
+OwnPtr<Region> Process::take_region(Region& region)
+{
+    LOCKER(m_address_space_lock);
     ScopedSpinLock lock(m_lock);
 
     if (m_region_lookup_cache.region.unsafe_ptr() == &region)
         m_region_lookup_cache.region = nullptr;
-    for (size_t i = 0; i < m_regions.size(); ++i) {
-        if (&m_regions[i] == &region) {
-            region_protector = m_regions.unstable_take(i);
-            return true;
-        }
-    }
-    return false;
+    auto* stored_region = m_regions.find(region.vaddr().get());
+    if (!stored_region || stored_region->ptr() != &region)
+        return {};
+    return m_regions.take(region.vaddr().get()).release_value();
 }
 
 Region* Process::find_region_from_range(const Range& range)
@@ -217,24 +237,21 @@ Region* Process::find_region_from_range(const Range& range)
         return m_region_lookup_cache.region.unsafe_ptr();
 
     size_t size = PAGE_ROUND_UP(range.size());
-    for (auto& region : m_regions) {
-        if (region.vaddr() == range.base() && region.size() == size) {
-            m_region_lookup_cache.range = range;
-            m_region_lookup_cache.region = region;
-            return &region;
-        }
-    }
-    return nullptr;
+    auto* region = m_regions.find(range.base().get());
+    if (!region || (*region)->size() != size)
+        return nullptr;
+    m_region_lookup_cache.range = range;
+    m_region_lookup_cache.region = **region;
+    return region->ptr();
 }
 
 Region* Process::find_region_containing(const Range& range)
 {
     ScopedSpinLock lock(m_lock);
-    for (auto& region : m_regions) {
-        if (region.contains(range))
-            return &region;
-    }
-    return nullptr;
+    auto* region = m_regions.find_largest_not_above(range.base().get());
+    if (!region || !(*region)->contains(range))
+        return nullptr;
+    return region->ptr();
 }
 
 void Process::kill_threads_except_self()
@@ -397,16 +414,8 @@ void Process::dump_regions()
 
     ScopedSpinLock lock(m_lock);
 
-    Vector<Region*> sorted_regions;
-    sorted_regions.ensure_capacity(m_regions.size());
-    for (auto& region : m_regions)
-        sorted_regions.append(&region);
-    quick_sort(sorted_regions, [](auto& a, auto& b) {
-        return a->vaddr() < b->vaddr();
-    });
-
-    for (auto& sorted_region : sorted_regions) {
-        auto& region = *sorted_region;
+    for (auto& region_ptr : m_regions) {
+        auto& region = *region_ptr;
         klog() << String::format("%08x", region.vaddr().get()) << " -- " << String::format("%08x", region.vaddr().offset(region.size() - 1).get()) << "    " << String::format("%08x", region.size()) << "    " << (region.is_readable() ? 'R' : ' ') << (region.is_writable() ? 'W' : ' ') << (region.is_executable() ? 'X' : ' ') << (region.is_shared() ? 'S' : ' ') << (region.is_stack() ? 'T' : ' ') << (region.vmobject().is_anonymous() ? 'A' : ' ') << "    " << region.name().characters();
     }
     MM.dump_kernel_regions();
@@ -505,6 +514,7 @@ RefPtr<FileDescription> Process::file_description(int fd) const
 {
     if (fd < 0)
         return nullptr;
+    ScopedSpinLock lock(m_fds_lock);
     if (static_cast<size_t>(fd) < m_fds.size())
         return m_fds[fd].description();
     return nullptr;
@@ -514,6 +524,7 @@ int Process::fd_flags(int fd) const
 {
     if (fd < 0)
         return -1;
+    ScopedSpinLock lock(m_fds_lock);
     if (static_cast<size_t>(fd) < m_fds.size())
         return m_fds[fd].flags();
     return -1;
@@ -522,6 +533,7 @@ int Process::fd_flags(int fd) const
 int Process::number_of_open_file_descriptors() const
 {
     int count = 0;
+    ScopedSpinLock lock(m_fds_lock);
     for (auto& description : m_fds) {
         if (description)
             ++count;
@@ -568,6 +580,7 @@ siginfo_t Process::wait_info()
 
 Custody& Process::current_directory()
 {
+    ScopedSpinLock lock(m_lock);
     if (!m_cwd)
         m_cwd = VFS::the().root_custody();
     return *m_cwd;
@@ -640,7 +653,14 @@ void Process::finalize()
 
     if (m_alarm_timer)
         TimerQueue::the().cancel_timer(m_alarm_timer.release_nonnull());
-    m_fds.clear();
+    {
+        // Drop the descriptions outside of m_fds_lock, closing them may block.
+        Vector<FileDescriptionAndFlags> fds;
+        {
+            ScopedSpinLock lock(m_fds_lock);
+            fds = move(m_fds);
+        }
+    }
     m_tty = nullptr;
     m_executable = nullptr;
     m_cwd = nullptr;
@@ -713,8 +733,8 @@ size_t Process::amount_dirty_private() const
     size_t amount = 0;
     ScopedSpinLock lock(m_lock);
     for (auto& region : m_regions) {
-        if (!region.is_shared())
-            amount += region.amount_dirty();
+        if (!region->is_shared())
+            amount += region->amount_dirty();
     }
     return amount;
 }
@@ -725,8 +745,8 @@ size_t Process::amount_clean_inode() const
     {
         ScopedSpinLock lock(m_lock);
         for (auto& region : m_regions) {
-            if (region.vmobject().is_inode())
-                vmobjects.set(&static_cast<const InodeVMObject&>(region.vmobject()));
+            if (region->vmobject().is_inode())
+                vmobjects.set(&static_cast<const InodeVMObject&>(region->vmobject()));
         }
     }
     size_t amount = 0;
@@ -740,7 +760,7 @@ size_t Process::amount_virtual() const
     size_t amount = 0;
     ScopedSpinLock lock(m_lock);
     for (auto& region : m_regions) {
-        amount += region.size();
+        amount += region->size();
     }
     return amount;
 }
@@ -751,7 +771,7 @@ size_t Process::amount_resident() const
     size_t amount = 0;
     ScopedSpinLock lock(m_lock);
     for (auto& region : m_regions) {
-        amount += region.amount_resident();
+        amount += region->amount_resident();
     }
     return amount;
 }
@@ -765,7 +785,7 @@ size_t Process::amount_shared() const
     size_t amount = 0;
     ScopedSpinLock lock(m_lock);
     for (auto& region : m_regions) {
-        amount += region.amount_shared();
+        amount += region->amount_shared();
     }
     return amount;
 }
@@ -775,8 +795,8 @@ size_t Process::amount_purgeable_volatile() const
     size_t amount = 0;
     ScopedSpinLock lock(m_lock);
     for (auto& region : m_regions) {
-        if (region.vmobject().is_anonymous() && static_cast<const AnonymousVMObject&>(region.vmobject()).is_any_volatile())
-            amount += region.amount_resident();
+        if (region->vmobject().is_anonymous() && static_cast<const AnonymousVMObject&>(region->vmobject()).is_any_volatile())
+            amount += region->amount_resident();
     }
     return amount;
 }
@@ -786,8 +806,8 @@ size_t Process::amount_purgeable_nonvolatile() const
     size_t amount = 0;
     ScopedSpinLock lock(m_lock);
     for (auto& region : m_regions) {
-        if (region.vmobject().is_anonymous() && !static_cast<const AnonymousVMObject&>(region.vmobject()).is_any_volatile())
-            amount += region.amount_resident();
+        if (region->vmobject().is_anonymous() && !static_cast<const AnonymousVMObject&>(region->vmobject()).is_any_volatile())
+            amount += region->amount_resident();
     }
     return amount;
 }
@@ -875,6 +895,7 @@ OwnPtr<KBuffer> Process::backtrace() const
 
 Custody& Process::root_directory()
 {
+    ScopedSpinLock lock(m_lock);
     if (!m_root_directory)
         m_root_directory = VFS::the().root_custody();
     return *m_root_directory;
@@ -889,6 +910,7 @@ Custody& Process::root_directory_relative_to_global_root()
 
 void Process::set_root_directory(const Custody& root)
 {
+    LOCKER(m_path_resolution_lock);
     m_root_directory = root;
 }
 
@@ -896,7 +918,7 @@ Region& Process::add_region(NonnullOwnPtr<Region> region)
 {
     auto* ptr = region.ptr();
     ScopedSpinLock lock(m_lock);
-    m_regions.append(move(region));
+    m_regions.insert(ptr->vaddr().get(), move(region));
     return *ptr;
 }
 
@@ -31,6 +31,7 @@
 #include <AK/InlineLinkedList.h>
 #include <AK/NonnullOwnPtrVector.h>
 #include <AK/NonnullRefPtrVector.h>
+#include <AK/RedBlackTree.h>
 #include <AK/String.h>
 #include <AK/Userspace.h>
 #include <AK/WeakPtr.h>
@@ -218,6 +219,9 @@ public:
     int sys$beep();
     int sys$get_process_name(Userspace<char*> buffer, size_t buffer_size);
     int sys$set_process_name(Userspace<const char*> user_name, size_t user_name_length);
+    int sys$epoll_create1(int flags);
+    int sys$epoll_ctl(Userspace<const Syscall::SC_epoll_ctl_params*>);
+    int sys$epoll_wait(Userspace<const Syscall::SC_epoll_wait_params*>);
     int sys$watch_file(Userspace<const char*> path, size_t path_length);
     int sys$dbgputch(u8);
     int sys$dbgputstr(Userspace<const u8*>, int length);
@@ -242,8 +246,12 @@ public:
     int sys$open(Userspace<const Syscall::SC_open_params*>);
     int sys$close(int fd);
     ssize_t sys$read(int fd, Userspace<u8*>, ssize_t);
+    ssize_t sys$readv(int fd, Userspace<const struct iovec*> iov, int iov_count);
+    ssize_t sys$preadv(Userspace<const Syscall::SC_preadv_params*>);
     ssize_t sys$write(int fd, const u8*, ssize_t);
     ssize_t sys$writev(int fd, Userspace<const struct iovec*> iov, int iov_count);
+    ssize_t sys$pwritev(Userspace<const Syscall::SC_pwritev_params*>);
+    ssize_t sys$sendfile(Userspace<const Syscall::SC_sendfile_params*>);
     int sys$fstat(int fd, Userspace<stat*>);
     int sys$stat(Userspace<const Syscall::SC_stat_params*>);
     int sys$lseek(int fd, off_t, int whence);
@@ -325,6 +333,8 @@ public:
     int sys$getpeername(Userspace<const Syscall::SC_getpeername_params*>);
     int sys$sched_setparam(pid_t pid, Userspace<const struct sched_param*>);
     int sys$sched_getparam(pid_t pid, Userspace<struct sched_param*>);
+    int sys$sched_setaffinity(pid_t tid, size_t cpusetsize, Userspace<const cpu_set_t*>);
+    int sys$sched_getaffinity(pid_t tid, size_t cpusetsize, Userspace<cpu_set_t*>);
     int sys$create_thread(void* (*)(void*), Userspace<const Syscall::SC_create_thread_params*>);
     void sys$exit_thread(Userspace<void*>);
     int sys$join_thread(pid_t tid, Userspace<void**> exit_value);
@@ -379,7 +389,7 @@ public:
     void set_tty(TTY*);
 
     size_t region_count() const { return m_regions.size(); }
-    const NonnullOwnPtrVector<Region>& regions() const
+    const RedBlackTree<FlatPtr, NonnullOwnPtr<Region>>& regions() const
     {
         ASSERT(m_lock.is_locked());
         return m_regions;
@@ -442,6 +452,7 @@ public:
     Region* allocate_region_with_vmobject(const Range&, NonnullRefPtr<VMObject>, size_t offset_in_vmobject, const String& name, int prot, bool shared);
     Region* allocate_region(const Range&, const String& name, int prot = PROT_READ | PROT_WRITE, AllocationStrategy strategy = AllocationStrategy::Reserve);
     bool deallocate_region(Region& region);
+    OwnPtr<Region> take_region(Region& region);
 
     Region& allocate_split_region(const Region& source_region, const Range&, size_t offset_in_vmobject);
     Vector<Region*, 2> split_region_around_range(const Region& source_region, const Range&);
@@ -463,6 +474,7 @@ public:
     {
         return m_priority_boost;
     }
+    void set_priority_boost(u32);
 
     Custody& root_directory();
     Custody& root_directory_relative_to_global_root();
@@ -521,6 +533,7 @@ private:
 
     int do_exec(NonnullRefPtr<FileDescription> main_program_description, Vector<String> arguments, Vector<String> environment, RefPtr<FileDescription> interpreter_description, Thread*& new_main_thread, u32& prev_flags);
     ssize_t do_write(FileDescription&, const UserOrKernelBuffer&, size_t);
+    ssize_t copy_iovecs_from_user(Vector<struct iovec, 32>&, Userspace<const struct iovec*>, int iov_count);
 
     KResultOr<NonnullRefPtr<FileDescription>> find_elf_interpreter_for_executable(const String& path, char (&first_page)[PAGE_SIZE], int nread, size_t file_size);
 
@@ -584,7 +597,10 @@ private:
         RefPtr<FileDescription> m_description;
         u32 m_flags { 0 };
     };
+    // Slots in m_fds are only changed with the big lock *and* m_fds_lock held,
+    // so syscalls that merely look up a descriptor can run without the big lock.
     Vector<FileDescriptionAndFlags> m_fds;
+    mutable SpinLock<u8> m_fds_lock;
 
     u8 m_termination_status { 0 };
     u8 m_termination_signal { 0 };
@@ -597,6 +613,8 @@ private:
     bool m_should_dump_core { false };
 
     RefPtr<Custody> m_executable;
+    // m_cwd, m_root_directory and the veil are only changed with m_path_resolution_lock held exclusively,
+    // so path lookups that run without the big lock hold it shared for as long as they use them.
     RefPtr<Custody> m_cwd;
     RefPtr<Custody> m_root_directory;
     RefPtr<Custody> m_root_directory_relative_to_global_root;
@@ -606,7 +624,13 @@ private:
     Region* find_region_from_range(const Range&);
     Region* find_region_containing(const Range&);
 
-    NonnullOwnPtrVector<Region> m_regions;
+    // Held by everything that adds, removes or replaces regions, and by the mmap family
+    // of syscalls for as long as they use the regions they looked up. mmap, munmap and
+    // mprotect run without the big lock, so this is what keeps them apart from each other,
+    // from thread/TLS/shbuf region allocation and from exec swapping the address space.
+    Lock m_address_space_lock { "AddressSpace" };
+
+    RedBlackTree<FlatPtr, NonnullOwnPtr<Region>> m_regions;
     struct RegionLookupCache {
         Range range;
         WeakPtr<Region> region;
@@ -625,6 +649,7 @@ private:
     size_t m_master_tls_alignment { 0 };
 
     Lock m_big_lock { "Process" };
+    Lock m_path_resolution_lock { "PathResolution" };
     mutable SpinLock<u32> m_lock;
 
     RefPtr<Timer> m_alarm_timer;
@@ -639,6 +664,7 @@ private:
 
     WaitQueue& futex_queue(Userspace<const i32*>);
     HashMap<u32, OwnPtr<WaitQueue>> m_futex_queues;
+    SpinLock<u8> m_futex_queues_lock;
 
     OwnPtr<PerformanceEventBuffer> m_perf_event_buffer;
 
@@ -752,7 +778,7 @@ inline const LogStream& operator<<(const LogStream& stream, const Process& proce
 
 inline u32 Thread::effective_priority() const
 {
-    return m_priority + m_process->priority_boost() + m_priority_boost + m_extra_priority;
+    return m_priority + m_process->priority_boost() + m_priority_boost;
 }
 
 #define REQUIRE_NO_PROMISES                        \
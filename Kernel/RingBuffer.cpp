@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Kernel/RingBuffer.h>
+
+namespace Kernel {
+
+RingBuffer::RingBuffer(size_t capacity)
+    : m_storage(KBuffer::create_with_size(capacity, Region::Access::Read | Region::Access::Write, "RingBuffer"))
+    , m_capacity(capacity)
+{
+    ASSERT(capacity && (capacity & (capacity - 1)) == 0);
+}
+
+KResult RingBuffer::set_capacity(size_t capacity)
+{
+    ASSERT(capacity && (capacity & (capacity - 1)) == 0);
+    // Readers and writers both have to stay out while the data moves. Nobody else takes both locks.
+    Locker write_locker(m_write_lock);
+    Locker read_locker(m_read_lock);
+    size_t head = m_head.load();
+    size_t tail = m_tail.load();
+    size_t used = tail - head;
+    if (used > capacity)
+        return KResult(-EBUSY);
+
+    auto storage = KBuffer::try_create_with_size(capacity, Region::Access::Read | Region::Access::Write, "RingBuffer");
+    if (!storage)
+        return KResult(-ENOMEM);
+    size_t offset = head & (m_capacity - 1);
+    size_t first_chunk_size = min(used, m_capacity - offset);
+    memcpy(storage->data(), m_storage.data() + offset, first_chunk_size);
+    memcpy(storage->data() + first_chunk_size, m_storage.data(), used - first_chunk_size);
+
+    bool was_full = used == m_capacity;
+    m_storage = move(*storage);
+    m_capacity = capacity;
+    m_head.store(0);
+    m_tail.store(used);
+
+    if (m_unblock_callback && was_full && used < capacity)
+        m_unblock_callback();
+    return KSuccess;
+}
+
+ssize_t RingBuffer::write(const UserOrKernelBuffer& data, size_t size)
+{
+    if (!size || m_storage.is_null())
+        return 0;
+    LOCKER(m_write_lock);
+    // Only writers move the tail, and we're the only writer right now.
+    size_t tail = m_tail.load(AK::memory_order_relaxed);
+    size_t head = m_head.load(AK::memory_order_acquire);
+    size_t bytes_to_write = min(size, m_capacity - (tail - head));
+    if (!bytes_to_write)
+        return 0;
+
+    size_t offset = tail & (m_capacity - 1);
+    size_t first_chunk_size = min(bytes_to_write, m_capacity - offset);
+    if (!data.read(m_storage.data() + offset, first_chunk_size))
+        return -EFAULT;
+    if (first_chunk_size < bytes_to_write && !data.read(m_storage.data(), first_chunk_size, bytes_to_write - first_chunk_size))
+        return -EFAULT;
+
+    m_tail.store(tail + bytes_to_write);
+
+    // If the reader had consumed everything up to where we started, it may be
+    // waiting for this data. Otherwise it will see the new tail by itself.
+    // Loading the head only after publishing the tail is what makes this safe.
+    if (m_unblock_callback && m_head.load() == tail)
+        m_unblock_callback();
+    return (ssize_t)bytes_to_write;
+}
+
+ssize_t RingBuffer::read(UserOrKernelBuffer& data, size_t size)
+{
+    if (!size || m_storage.is_null())
+        return 0;
+    LOCKER(m_read_lock);
+    // Only readers move the head, and we're the only reader right now.
+    size_t head = m_head.load(AK::memory_order_relaxed);
+    size_t tail = m_tail.load(AK::memory_order_acquire);
+    size_t nread = min(size, tail - head);
+    if (!nread)
+        return 0;
+
+    size_t offset = head & (m_capacity - 1);
+    size_t first_chunk_size = min(nread, m_capacity - offset);
+    if (!data.write(m_storage.data() + offset, first_chunk_size))
+        return -EFAULT;
+    if (first_chunk_size < nread && !data.write(m_storage.data(), first_chunk_size, nread - first_chunk_size))
+        return -EFAULT;
+
+    m_head.store(head + nread);
+
+    // Same as in write(): a writer only needs waking up if it found the buffer full.
+    if (m_unblock_callback && m_tail.load() - head >= m_capacity)
+        m_unblock_callback();
+    return (ssize_t)nread;
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/Atomic.h>
+#include <AK/Function.h>
+#include <AK/Types.h>
+#include <Kernel/KBuffer.h>
+#include <Kernel/KResult.h>
+#include <Kernel/Lock.h>
+#include <Kernel/UserOrKernelBuffer.h>
+
+namespace Kernel {
+
+// A byte stream buffer for one direction of a connection.
+// The reader and the writer only share the head and tail positions, so they
+// never have to wait for each other. If several threads write (or read) at
+// the same time, they are serialized by a lock that only their side takes.
+class RingBuffer {
+public:
+    // The capacity must be a power of two.
+    explicit RingBuffer(size_t capacity = 64 * KiB);
+
+    [[nodiscard]] ssize_t write(const UserOrKernelBuffer&, size_t);
+    [[nodiscard]] ssize_t write(const u8* data, size_t size)
+    {
+        return write(UserOrKernelBuffer::for_kernel_buffer(const_cast<u8*>(data)), size);
+    }
+    [[nodiscard]] ssize_t read(UserOrKernelBuffer&, size_t);
+    [[nodiscard]] ssize_t read(u8* data, size_t size)
+    {
+        auto buffer = UserOrKernelBuffer::for_kernel_buffer(data);
+        return read(buffer, size);
+    }
+
+    bool is_empty() const { return used_space() == 0; }
+    size_t space_for_writing() const { return m_capacity - used_space(); }
+    size_t capacity() const { return m_capacity; }
+    // Moves the buffered data into new storage of the given capacity, which must be a power of two.
+    KResult set_capacity(size_t);
+
+    // The callback only fires when the buffer goes from empty to non-empty,
+    // or from full to having space again, not for every read and write.
+    void set_unblock_callback(Function<void()> callback)
+    {
+        ASSERT(!m_unblock_callback);
+        m_unblock_callback = move(callback);
+    }
+
+private:
+    size_t used_space() const
+    {
+        // The tail never passes the head by more than m_capacity, but since we
+        // can't load both at once, a concurrent read may make it look like it did.
+        size_t head = m_head.load();
+        size_t tail = m_tail.load();
+        return min(tail - head, m_capacity);
+    }
+
+    KBuffer m_storage;
+    Function<void()> m_unblock_callback;
+    size_t m_capacity { 0 };
+
+    // The total number of bytes ever read from and written to the buffer.
+    // Only the low bits are used as an offset into m_storage, and the
+    // difference between the two is how much data is currently buffered.
+    Atomic<size_t> m_head { 0 };
+    Atomic<size_t> m_tail { 0 };
+
+    Lock m_read_lock { "RingBuffer read" };
+    Lock m_write_lock { "RingBuffer write" };
+};
+
+}
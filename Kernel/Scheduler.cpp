@@ -24,7 +24,6 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <AK/QuickSort.h>
 #include <AK/ScopeGuard.h>
 #include <AK/TemporaryChange.h>
 #include <AK/Time.h>
@@ -56,6 +55,52 @@ public:
 SchedulerData* g_scheduler_data;
 RecursiveSpinLock g_scheduler_lock;
 
+// Bitmask of the processors that pick threads from their ready queue.
+// Runnable threads are only ever queued on one of these.
+static Atomic<u32> s_scheduling_processors { 0 };
+
+u32 ThreadReadyQueue::bucket_for_priority(u32 priority)
+{
+    // Bucket 0 holds the highest priority threads. Priority boosts may push
+    // the effective priority past THREAD_PRIORITY_MAX, so clamp it first.
+    priority = min<u32>(max<u32>(priority, THREAD_PRIORITY_MIN), THREAD_PRIORITY_MAX);
+    constexpr u32 priority_range = THREAD_PRIORITY_MAX - THREAD_PRIORITY_MIN;
+    return ((THREAD_PRIORITY_MAX - priority) * (bucket_count - 1)) / priority_range;
+}
+
+void ThreadReadyQueue::enqueue(Thread& thread)
+{
+    ASSERT(m_lock.is_locked());
+    ASSERT(thread.m_ready_queue_bucket < 0);
+    u32 bucket = bucket_for_priority(thread.effective_priority());
+    m_buckets[bucket].append(thread);
+    m_bucket_mask |= 1u << bucket;
+    m_thread_count++;
+    thread.m_ready_queue_bucket = bucket;
+    thread.m_ready_since_ms = TimeManagement::the().uptime_ms();
+}
+
+void ThreadReadyQueue::requeue(Thread& thread)
+{
+    ASSERT(m_lock.is_locked());
+    if (dequeue(thread))
+        enqueue(thread);
+}
+
+bool ThreadReadyQueue::dequeue(Thread& thread)
+{
+    ASSERT(m_lock.is_locked());
+    if (thread.m_ready_queue_bucket < 0)
+        return false;
+    auto& list = m_buckets[thread.m_ready_queue_bucket];
+    list.remove(thread);
+    if (list.is_empty())
+        m_bucket_mask &= ~(1u << thread.m_ready_queue_bucket);
+    thread.m_ready_queue_bucket = -1;
+    m_thread_count--;
+    return true;
+}
+
 void Scheduler::init_thread(Thread& thread)
 {
     ASSERT(g_scheduler_data);
@@ -75,6 +120,138 @@ WaitQueue* g_finalizer_wait_queue;
 Atomic<bool> g_finalizer_has_work { false };
 static Process* s_colonel_process;
 
+static Processor& ready_queue_processor_for(Thread& thread)
+{
+    u32 candidates = thread.affinity() & s_scheduling_processors.load(AK::MemoryOrder::memory_order_consume);
+    if (candidates == 0) {
+        // Nobody this thread may run on is picking threads yet (we're
+        // still booting), so park it on the BSP.
+        return Processor::by_id(0);
+    }
+
+    // A thread's home is the processor it last ran on, as long as its
+    // affinity allows it. Idle processors will steal it if need be.
+    u32 cpu = thread.cpu();
+    if (cpu >= 32 || (candidates & (1u << cpu)) == 0)
+        cpu = __builtin_ctz(candidates);
+    return Processor::by_id(cpu);
+}
+
+void Scheduler::queue_runnable_thread(Thread& thread)
+{
+    ASSERT(g_scheduler_lock.own_lock());
+    ASSERT(thread.state() == Thread::Runnable);
+
+    auto& processor = ready_queue_processor_for(thread);
+    auto& ready_queue = processor.ready_queue();
+    ScopedSpinLock lock(ready_queue.lock());
+    thread.m_ready_queue_cpu = processor.id();
+    ready_queue.enqueue(thread);
+}
+
+void Scheduler::requeue_runnable_thread(Thread& thread)
+{
+    ASSERT(g_scheduler_lock.own_lock());
+    if (thread.m_ready_queue_bucket < 0)
+        return;
+
+    auto& ready_queue = Processor::by_id(thread.m_ready_queue_cpu).ready_queue();
+    ScopedSpinLock lock(ready_queue.lock());
+    ready_queue.requeue(thread);
+}
+
+bool Scheduler::dequeue_runnable_thread(Thread& thread)
+{
+    ASSERT(g_scheduler_lock.own_lock());
+    if (thread.m_ready_queue_bucket < 0)
+        return false;
+
+    auto& ready_queue = Processor::by_id(thread.m_ready_queue_cpu).ready_queue();
+    ScopedSpinLock lock(ready_queue.lock());
+    return ready_queue.dequeue(thread);
+}
+
+static bool can_run_on(Thread& thread, u32 cpu)
+{
+    if ((thread.affinity() & (1u << cpu)) == 0)
+        return false;
+    // While a process is in exec(), only the exec'ing thread may run.
+    if (thread.process().exec_tid() && thread.process().exec_tid() != thread.tid())
+        return false;
+    return true;
+}
+
+static Thread* steal_runnable_thread(u32 cpu)
+{
+    u32 siblings = s_scheduling_processors.load(AK::MemoryOrder::memory_order_consume) & ~(1u << cpu);
+
+    // Steal from whoever has the most threads waiting.
+    Processor* victim = nullptr;
+    u32 victim_load = 0;
+    while (siblings != 0) {
+        u32 sibling = __builtin_ctz(siblings);
+        siblings &= ~(1u << sibling);
+        auto& processor = Processor::by_id(sibling);
+        u32 load = processor.ready_queue().thread_count();
+        if (load > victim_load) {
+            victim = &processor;
+            victim_load = load;
+        }
+    }
+    if (!victim)
+        return nullptr;
+
+    auto now = TimeManagement::the().uptime_ms();
+    auto& ready_queue = victim->ready_queue();
+    ScopedSpinLock lock(ready_queue.lock());
+    auto* thread = ready_queue.take_first_matching(ThreadReadyQueue::bucket_count - 1, [&](Thread& thread) {
+        if (thread.is_active() || thread.is_cache_hot(now))
+            return false;
+        return can_run_on(thread, cpu);
+    });
+#ifdef SCHEDULER_DEBUG
+    if (thread)
+        dbg() << "Scheduler[" << cpu << "]: Stole " << *thread << " from CPU #" << victim->id();
+#endif
+    return thread;
+}
+
+static Thread& pull_next_runnable_thread(Thread& current_thread)
+{
+    auto& processor = Processor::current();
+    u32 cpu = processor.id();
+
+    // The current thread keeps running unless something of at least
+    // equal (aged) priority is waiting, in which case it goes to the back
+    // of its bucket once we switch away from it.
+    bool can_keep_current = current_thread.state() == Thread::Running
+        && &current_thread != processor.idle_thread()
+        && can_run_on(current_thread, cpu);
+    u32 max_bucket = ThreadReadyQueue::bucket_count - 1;
+    if (can_keep_current)
+        max_bucket = ThreadReadyQueue::bucket_for_priority(current_thread.effective_priority());
+
+    {
+        auto& ready_queue = processor.ready_queue();
+        ScopedSpinLock lock(ready_queue.lock());
+        auto* thread = ready_queue.take_next(TimeManagement::the().uptime_ms(), max_bucket, [&](Thread& thread) {
+            // A thread may still be switching out on another processor.
+            if (thread.is_active())
+                return false;
+            return can_run_on(thread, cpu);
+        });
+        if (thread)
+            return *thread;
+    }
+    if (can_keep_current)
+        return current_thread;
+
+    // We'd go idle otherwise, see if a sibling has work to spare.
+    if (auto* thread = steal_runnable_thread(cpu))
+        return *thread;
+    return *processor.idle_thread();
+}
+
 void Scheduler::start()
 {
     ASSERT_INTERRUPTS_DISABLED();
@@ -95,6 +272,9 @@ void Scheduler::start()
     processor.init_context(idle_thread, false);
     idle_thread.set_state(Thread::Running);
     ASSERT(idle_thread.affinity() == (1u << processor.id()));
+
+    s_scheduling_processors.fetch_or(1u << processor.id(), AK::MemoryOrder::memory_order_release);
+
     processor.initialize_context_switching(idle_thread);
     ASSERT_NOT_REACHED();
 }
@@ -154,24 +334,10 @@ bool Scheduler::pick_next()
     });
 #endif
 
-    Thread* thread_to_schedule = nullptr;
-
     auto pending_beneficiary = scheduler_data.m_pending_beneficiary.strong_ref();
-    Vector<Thread*, 128> sorted_runnables;
-    for_each_runnable([&](auto& thread) {
-        if ((thread.affinity() & (1u << Processor::current().id())) == 0)
-            return IterationDecision::Continue;
-        if (thread.state() == Thread::Running && &thread != current_thread)
-            return IterationDecision::Continue;
-        sorted_runnables.append(&thread);
-        if (&thread == pending_beneficiary) {
-            thread_to_schedule = &thread;
-            return IterationDecision::Break;
-        }
-        return IterationDecision::Continue;
-    });
-
-    if (thread_to_schedule) {
+    if (pending_beneficiary
+        && (pending_beneficiary->state() == Thread::Runnable || pending_beneficiary == current_thread)
+        && (pending_beneficiary->affinity() & (1u << Processor::current().id())) != 0) {
         // The thread we're supposed to donate to still exists
         const char* reason = scheduler_data.m_pending_donate_reason;
         scheduler_data.m_pending_beneficiary = nullptr;
@@ -182,9 +348,9 @@ bool Scheduler::pick_next()
         critical.leave();
 
 #ifdef SCHEDULER_DEBUG
-        dbg() << "Processing pending donate to " << *thread_to_schedule << " reason=" << reason;
+        dbg() << "Processing pending donate to " << *pending_beneficiary << " reason=" << reason;
 #endif
-        return donate_to_and_switch(thread_to_schedule, reason);
+        return donate_to_and_switch(pending_beneficiary.ptr(), reason);
     }
 
     // Either we're not donating or the beneficiary disappeared.
@@ -192,24 +358,7 @@ bool Scheduler::pick_next()
     scheduler_data.m_pending_beneficiary = nullptr;
     scheduler_data.m_pending_donate_reason = nullptr;
 
-    quick_sort(sorted_runnables, [](auto& a, auto& b) { return a->effective_priority() >= b->effective_priority(); });
-
-    for (auto* thread : sorted_runnables) {
-        if (thread->process().exec_tid() && thread->process().exec_tid() != thread->tid())
-            continue;
-
-        ASSERT(thread->state() == Thread::Runnable || thread->state() == Thread::Running);
-
-        if (!thread_to_schedule) {
-            thread->m_extra_priority = 0;
-            thread_to_schedule = thread;
-        } else {
-            thread->m_extra_priority++;
-        }
-    }
-
-    if (!thread_to_schedule)
-        thread_to_schedule = Processor::current().idle_thread();
+    auto* thread_to_schedule = &pull_next_runnable_thread(*current_thread);
 
 #ifdef SCHEDULER_DEBUG
     dbg() << "Scheduler[" << Processor::current().id() << "]: Switch to " << *thread_to_schedule << " @ " << String::format("%04x:%08x", thread_to_schedule->tss().cs, thread_to_schedule->tss().eip);
@@ -325,6 +474,8 @@ bool Scheduler::context_switch(Thread* thread)
         return false;
 
     if (from_thread) {
+        from_thread->set_last_ran_at(TimeManagement::the().uptime_ms());
+
         // If the last process hasn't blocked (still marked as running),
         // mark it as runnable for the next round.
         if (from_thread->state() == Thread::Running)
@@ -473,10 +624,10 @@ void Scheduler::timer_tick(const RegisterState& regs)
     if (!current_thread)
         return;
 
+    // FIXME: The profiling sample buffer isn't safe to use from multiple
+    //        processors at once, so only the BSP takes samples for now.
     bool is_bsp = Processor::current().id() == 0;
-    if (!is_bsp)
-        return; // TODO: This prevents scheduling on other CPUs!
-    if (current_thread->process().is_profiling()) {
+    if (is_bsp && current_thread->process().is_profiling()) {
         SmapDisabler disabler;
         auto backtrace = current_thread->raw_backtrace(regs.ebp, regs.eip);
         auto& sample = Profiling::next_sample_slot();
@@ -538,8 +689,9 @@ void Scheduler::idle_loop(void*)
     for (;;) {
         asm("hlt");
 
-        if (Processor::current().id() == 0)
-            yield();
+        // Even with nothing queued locally, the scheduler will look
+        // for threads to steal from the other processors.
+        yield();
     }
 }
 
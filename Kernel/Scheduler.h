@@ -56,6 +56,9 @@ public:
     static void timer_tick(const RegisterState&);
     [[noreturn]] static void start();
     static bool pick_next();
+    static void queue_runnable_thread(Thread&);
+    static bool dequeue_runnable_thread(Thread&);
+    static void requeue_runnable_thread(Thread&);
     static bool yield();
     static void yield_from_critical();
     static bool donate_to_and_switch(Thread*, const char* reason);
@@ -24,6 +24,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <AK/Atomic.h>
 #include <Kernel/API/Syscall.h>
 #include <Kernel/Arch/i386/CPU.h>
 #include <Kernel/Process.h>
@@ -84,6 +85,77 @@ static Handler s_syscall_table[] = {
 };
 #undef __ENUMERATE_SYSCALL
 
+bool needs_big_process_lock(Function function)
+{
+    // These only touch per-object state (file descriptions, sockets, futex queues)
+    // that has its own locking, so threads of the same process may run them in parallel.
+    // Path-based stat holds the path resolution lock shared, and mmap, munmap and mprotect
+    // serialize with everything else that changes regions on the address space lock.
+    switch (function) {
+    case SC_yield:
+    case SC_read:
+    case SC_readv:
+    case SC_preadv:
+    case SC_write:
+    case SC_writev:
+    case SC_pwritev:
+    case SC_sendfile:
+    case SC_lseek:
+    case SC_fstat:
+    case SC_stat:
+    case SC_mmap:
+    case SC_munmap:
+    case SC_mprotect:
+    case SC_futex:
+    case SC_epoll_ctl:
+    case SC_epoll_wait:
+    case SC_sendmsg:
+    case SC_recvmsg:
+    case SC_getsockname:
+    case SC_getpeername:
+    case SC_gettid:
+    case SC_getpid:
+    case SC_clock_gettime:
+    case SC_gettimeofday:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// These are bumped on every syscall, so they are plain relaxed counters rather than
+// something that would make all processors contend for one lock.
+struct BigLockStatisticsEntry {
+    Atomic<u32> call_count;
+    Atomic<u32> locked_call_count;
+    Atomic<u64> cycles_held;
+};
+
+static BigLockStatisticsEntry s_big_lock_statistics[Function::__Count];
+
+BigLockStatistics big_lock_statistics(Function function)
+{
+    ASSERT(function < Function::__Count);
+    auto& entry = s_big_lock_statistics[function];
+    BigLockStatistics statistics;
+    statistics.call_count = entry.call_count.load(AK::MemoryOrder::memory_order_relaxed);
+    statistics.locked_call_count = entry.locked_call_count.load(AK::MemoryOrder::memory_order_relaxed);
+    statistics.cycles_held = entry.cycles_held.load(AK::MemoryOrder::memory_order_relaxed);
+    return statistics;
+}
+
+static void account_syscall(u32 function, bool took_big_lock, u64 cycles_held)
+{
+    if (function >= Function::__Count)
+        return;
+    auto& entry = s_big_lock_statistics[function];
+    entry.call_count.fetch_add(1, AK::MemoryOrder::memory_order_relaxed);
+    if (took_big_lock) {
+        entry.locked_call_count.fetch_add(1, AK::MemoryOrder::memory_order_relaxed);
+        entry.cycles_held.fetch_add(cycles_held, AK::MemoryOrder::memory_order_relaxed);
+    }
+}
+
 int handle(RegisterState& regs, u32 function, u32 arg1, u32 arg2, u32 arg3)
 {
     ASSERT_INTERRUPTS_ENABLED();
@@ -188,14 +260,30 @@ void syscall_handler(TrapFrame* trap)
         ASSERT_NOT_REACHED();
     }
 
-    process.big_lock().lock();
     u32 function = regs.eax;
     u32 arg1 = regs.edx;
     u32 arg2 = regs.ecx;
     u32 arg3 = regs.ebx;
+
+    // Blocking inside the syscall temporarily gives up the big lock, so that time isn't counted as held.
+    bool needs_big_lock = function >= Syscall::Function::__Count || Syscall::needs_big_process_lock(static_cast<Syscall::Function>(function));
+    u64 lock_acquired_at = 0;
+    u64 cycles_without_lock_before = 0;
+    if (needs_big_lock) {
+        process.big_lock().lock();
+        lock_acquired_at = read_tsc();
+        cycles_without_lock_before = current_thread->cycles_without_big_lock();
+    }
+
     regs.eax = Syscall::handle(regs, function, arg1, arg2, arg3);
 
-    process.big_lock().unlock();
+    if (needs_big_lock) {
+        u64 cycles_without_lock = current_thread->cycles_without_big_lock() - cycles_without_lock_before;
+        Syscall::account_syscall(function, true, read_tsc() - lock_acquired_at - cycles_without_lock);
+        process.big_lock().unlock();
+    } else {
+        Syscall::account_syscall(function, false, 0);
+    }
 
     if (auto tracer = process.tracer(); tracer && tracer->is_tracing_syscalls()) {
         tracer->set_trace_syscalls(false);
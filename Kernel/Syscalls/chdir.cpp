@@ -40,6 +40,7 @@ int Process::sys$chdir(Userspace<const char*> user_path, size_t path_length)
     auto directory_or_error = VFS::the().open_directory(path.value(), current_directory());
     if (directory_or_error.is_error())
         return directory_or_error.error();
+    LOCKER(m_path_resolution_lock);
     m_cwd = *directory_or_error.value();
     return 0;
 }
@@ -57,6 +58,7 @@ int Process::sys$fchdir(int fd)
     if (!description->metadata().may_execute(*this))
         return -EACCES;
 
+    LOCKER(m_path_resolution_lock);
     m_cwd = description->custody();
     return 0;
 }
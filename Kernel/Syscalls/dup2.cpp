@@ -39,6 +39,9 @@ int Process::sys$dup2(int old_fd, int new_fd)
         return 0;
     if (new_fd < 0 || new_fd >= m_max_open_file_descriptors)
         return -EINVAL;
+    // Keep the description previously at new_fd alive until m_fds_lock is released.
+    RefPtr<FileDescription> replaced_description = file_description(new_fd);
+    ScopedSpinLock lock(m_fds_lock);
     m_fds[new_fd].set(*description);
     return new_fd;
 }
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Kernel/FileSystem/EventQueue.h>
+#include <Kernel/FileSystem/FileDescription.h>
+#include <Kernel/Process.h>
+
+namespace Kernel {
+
+int Process::sys$epoll_create1(int flags)
+{
+    REQUIRE_PROMISE(stdio);
+    if ((flags & EPOLL_CLOEXEC) != flags)
+        return -EINVAL;
+
+    int fd = alloc_fd();
+    if (fd < 0)
+        return fd;
+
+    auto description = FileDescription::create(EventQueue::create());
+    description->set_readable(true);
+    ScopedSpinLock lock(m_fds_lock);
+    m_fds[fd].set(move(description), (flags & EPOLL_CLOEXEC) ? FD_CLOEXEC : 0);
+    return fd;
+}
+
+static EventQueue* event_queue_for(FileDescription& description)
+{
+    if (!description.file().is_event_queue())
+        return nullptr;
+    return static_cast<EventQueue*>(&description.file());
+}
+
+int Process::sys$epoll_ctl(Userspace<const Syscall::SC_epoll_ctl_params*> user_params)
+{
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_epoll_ctl_params params;
+    if (!copy_from_user(&params, user_params))
+        return -EFAULT;
+
+    auto queue_description = file_description(params.epfd);
+    if (!queue_description)
+        return -EBADF;
+    auto* queue = event_queue_for(*queue_description);
+    if (!queue)
+        return -EINVAL;
+
+    // Like on other systems, removing a watch doesn't need the fd to still be open.
+    if (params.op == EPOLL_CTL_DEL)
+        return queue->remove(params.fd);
+
+    epoll_event event;
+    if (!copy_from_user(&event, params.event))
+        return -EFAULT;
+
+    switch (params.op) {
+    case EPOLL_CTL_ADD: {
+        auto description = file_description(params.fd);
+        if (!description)
+            return -EBADF;
+        return queue->add(params.fd, *description, event);
+    }
+    case EPOLL_CTL_MOD:
+        return queue->modify(params.fd, event);
+    default:
+        return -EINVAL;
+    }
+}
+
+int Process::sys$epoll_wait(Userspace<const Syscall::SC_epoll_wait_params*> user_params)
+{
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_epoll_wait_params params;
+    if (!copy_from_user(&params, user_params))
+        return -EFAULT;
+    if (params.max_events <= 0)
+        return -EINVAL;
+
+    auto queue_description = file_description(params.epfd);
+    if (!queue_description)
+        return -EBADF;
+    auto* queue = event_queue_for(*queue_description);
+    if (!queue)
+        return -EINVAL;
+
+    Thread::BlockTimeout timeout;
+    if (params.timeout >= 0) {
+        timespec timeout_spec { params.timeout / 1000, (params.timeout % 1000) * 1000000 };
+        // The deadline is fixed here, so waking up for a watch that isn't ready doesn't extend it.
+        timeout = Thread::BlockTimeout(false, &timeout_spec);
+    }
+
+    size_t max_events = min(static_cast<size_t>(params.max_events), EventQueue::max_events_per_wait);
+    Vector<epoll_event, 32> events;
+    events.resize(max_events);
+
+    size_t count = 0;
+    for (;;) {
+        count = queue->collect_ready_events(events.data(), max_events);
+        if (count || params.timeout == 0)
+            break;
+        auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+        auto result = Thread::current()->block<Thread::ReadBlocker>(timeout, *queue_description, unblock_flags);
+        if (result.was_interrupted())
+            return -EINTR;
+        if (result.timed_out()) {
+            count = queue->collect_ready_events(events.data(), max_events);
+            break;
+        }
+    }
+
+    if (count && !copy_n_to_user(params.events, events.data(), count))
+        return -EFAULT;
+    return count;
+}
+
+}
@@ -279,8 +279,9 @@ KResultOr<Process::LoadResult> Process::load_elf_object(FileDescription& object_
 KResultOr<Process::LoadResult> Process::load(NonnullRefPtr<FileDescription> main_program_description, RefPtr<FileDescription> interpreter_description)
 {
     RefPtr<PageDirectory> old_page_directory;
-    NonnullOwnPtrVector<Region> old_regions;
+    RedBlackTree<FlatPtr, NonnullOwnPtr<Region>> old_regions;
 
+    ASSERT(m_address_space_lock.is_locked());
     {
         auto page_directory = PageDirectory::create_for_userspace(*this);
         if (!page_directory)
@@ -393,6 +394,10 @@ int Process::do_exec(NonnullRefPtr<FileDescription> main_program_description, Ve
         }
     }
 
+    // Other threads may still be in mmap until they are killed below. Keep them away
+    // from the address space until the new one is complete, thread-specific region included.
+    LOCKER(m_address_space_lock);
+
     auto load_result_or_error = load(main_program_description, interpreter_description);
     if (load_result_or_error.is_error()) {
         dbgln("do_exec({}): Failed to load main program or interpreter", path);
@@ -430,8 +435,11 @@ int Process::do_exec(NonnullRefPtr<FileDescription> main_program_description, Ve
 
     for (size_t i = 0; i < m_fds.size(); ++i) {
         auto& description_and_flags = m_fds[i];
-        if (description_and_flags.description() && description_and_flags.flags() & FD_CLOEXEC)
+        if (description_and_flags.description() && description_and_flags.flags() & FD_CLOEXEC) {
+            RefPtr<FileDescription> closed_description = description_and_flags.description();
+            ScopedSpinLock lock(m_fds_lock);
             description_and_flags = {};
+        }
     }
 
     int main_program_fd = -1;
@@ -440,6 +448,7 @@ int Process::do_exec(NonnullRefPtr<FileDescription> main_program_description, Ve
         ASSERT(main_program_fd >= 0);
         main_program_description->seek(0, SEEK_SET);
         main_program_description->set_readable(true);
+        ScopedSpinLock lock(m_fds_lock);
         m_fds[main_program_fd].set(move(main_program_description), FD_CLOEXEC);
     }
 
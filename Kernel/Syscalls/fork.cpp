@@ -29,6 +29,7 @@
 #include <Kernel/Process.h>
 #include <Kernel/SharedBuffer.h>
 #include <Kernel/VM/Region.h>
+#include <Kernel/VM/TLBShootdownBatch.h>
 
 //#define FORK_DEBUG
 
@@ -83,12 +84,14 @@ pid_t Process::sys$fork(RegisterState& regs)
     SharedBuffer::share_all_shared_buffers(*this, *child);
 
     {
+        // Cloning turns our writable pages into CoW ones; tell the other processors once for all regions.
+        TLBShootdownBatch tlb_shootdown_batch;
         ScopedSpinLock lock(m_lock);
         for (auto& region : m_regions) {
 #ifdef FORK_DEBUG
-            dbg() << "fork: cloning Region{" << &region << "} '" << region.name() << "' @ " << region.vaddr();
+            dbg() << "fork: cloning Region{" << region.ptr() << "} '" << region->name() << "' @ " << region->vaddr();
 #endif
-            auto region_clone = region.clone(*child);
+            auto region_clone = region->clone(*child);
             if (!region_clone) {
                 dbg() << "fork: Cannot clone region, insufficient memory";
                 // TODO: tear down new process?
@@ -98,7 +101,7 @@ pid_t Process::sys$fork(RegisterState& regs)
             auto& child_region = child->add_region(region_clone.release_nonnull());
             child_region.map(child->page_directory());
 
-            if (&region == m_master_tls_region.unsafe_ptr())
+            if (region.ptr() == m_master_tls_region.unsafe_ptr())
                 child->m_master_tls_region = child_region;
         }
 
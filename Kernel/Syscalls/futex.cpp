@@ -31,6 +31,8 @@ namespace Kernel {
 
 WaitQueue& Process::futex_queue(Userspace<const i32*> userspace_address)
 {
+    // Queues are never removed, so the reference stays valid after we drop the lock.
+    ScopedSpinLock lock(m_futex_queues_lock);
     auto& queue = m_futex_queues.ensure(userspace_address.ptr());
     if (!queue)
         queue = make<WaitQueue>();
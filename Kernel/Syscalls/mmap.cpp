@@ -31,6 +31,7 @@
 #include <Kernel/VM/PrivateInodeVMObject.h>
 #include <Kernel/VM/Region.h>
 #include <Kernel/VM/SharedInodeVMObject.h>
+#include <Kernel/VM/TLBShootdownBatch.h>
 #include <LibC/limits.h>
 
 namespace Kernel {
@@ -132,10 +133,16 @@ void* Process::sys$mmap(Userspace<const Syscall::SC_mmap_params*> user_params)
     if (map_stack && (!map_private || !map_anonymous))
         return (void*)-EINVAL;
 
+    LOCKER(m_address_space_lock);
+
     Region* region = nullptr;
     Optional<Range> range;
     if (map_noreserve || map_anonymous) {
-        range = allocate_range(VirtualAddress(addr), size, alignment);
+        // Line big anonymous mappings up for large pages, if there's room for that.
+        if (map_anonymous && !addr && size >= LARGE_PAGE_SIZE && alignment < LARGE_PAGE_SIZE)
+            range = allocate_range({}, size, LARGE_PAGE_SIZE);
+        if (!range.has_value() || !range.value().is_valid())
+            range = allocate_range(VirtualAddress(addr), size, alignment);
         if (!range.value().is_valid())
             return (void*)-ENOMEM;
     }
@@ -202,6 +209,8 @@ int Process::sys$mprotect(void* addr, size_t size, int prot)
 
     Range range_to_mprotect = { VirtualAddress(addr), size };
 
+    LOCKER(m_address_space_lock);
+
     if (auto* whole_region = find_region_from_range(range_to_mprotect)) {
         if (!whole_region->is_mmap())
             return -EPERM;
@@ -233,6 +242,13 @@ int Process::sys$mprotect(void* addr, size_t size, int prot)
             return -EACCES;
         }
 
+        // The old region's pages stay alive in the split regions, so it's fine to shoot down the TLBs once at the end.
+        TLBShootdownBatch tlb_shootdown_batch;
+
+        // Take the old region out of our region tree first, since one of its replacements will start at the same address.
+        auto old_region_protector = take_region(*old_region);
+        ASSERT(old_region_protector);
+
         // This vector is the region(s) adjacent to our range.
         // We need to allocate a new region for the range we wanted to change permission bits on.
         auto adjacent_regions = split_region_around_range(*old_region, range_to_mprotect);
@@ -245,7 +261,7 @@ int Process::sys$mprotect(void* addr, size_t size, int prot)
 
         // Unmap the old region here, specifying that we *don't* want the VM deallocated.
         old_region->unmap(Region::ShouldDeallocateVirtualMemoryRange::No);
-        deallocate_region(*old_region);
+        old_region_protector = nullptr;
 
         // Map the new regions using our page directory (they were just allocated and don't have one).
         for (auto* adjacent_region : adjacent_regions) {
@@ -270,6 +286,7 @@ int Process::sys$madvise(void* address, size_t size, int advice)
     if (!is_user_range(VirtualAddress(address), size))
         return -EFAULT;
 
+    LOCKER(m_address_space_lock);
     auto* region = find_region_from_range({ VirtualAddress(address), size });
     if (!region)
         return -EINVAL;
@@ -307,6 +324,7 @@ int Process::sys$minherit(void* address, size_t size, int inherit)
 {
     REQUIRE_PROMISE(stdio);
 
+    LOCKER(m_address_space_lock);
     auto* region = find_region_from_range({ VirtualAddress(address), size });
     if (!region)
         return -EINVAL;
@@ -344,6 +362,7 @@ int Process::sys$set_mmap_name(Userspace<const Syscall::SC_set_mmap_name_params*
     if (name.is_null())
         return -EFAULT;
 
+    LOCKER(m_address_space_lock);
     auto* region = find_region_from_range({ VirtualAddress(params.addr), params.size });
     if (!region)
         return -EINVAL;
@@ -382,6 +401,8 @@ int Process::sys$munmap(void* addr, size_t size)
         return -EFAULT;
 
     Range range_to_unmap { VirtualAddress(addr), size };
+
+    LOCKER(m_address_space_lock);
     if (auto* whole_region = find_region_from_range(range_to_unmap)) {
         if (!whole_region->is_mmap())
             return -EPERM;
@@ -394,11 +415,17 @@ int Process::sys$munmap(void* addr, size_t size)
         if (!old_region->is_mmap())
             return -EPERM;
 
+        // The unmapped pages stay alive in the split regions' VMObject, so it's fine to shoot down the TLBs once at the end.
+        TLBShootdownBatch tlb_shootdown_batch;
+
+        // Take the old region out of our region tree first, since one of its replacements may start at the same address.
+        auto old_region_protector = take_region(*old_region);
+        ASSERT(old_region_protector);
         auto new_regions = split_region_around_range(*old_region, range_to_unmap);
 
         // We manually unmap the old region here, specifying that we *don't* want the VM deallocated.
         old_region->unmap(Region::ShouldDeallocateVirtualMemoryRange::No);
-        deallocate_region(*old_region);
+        old_region_protector = nullptr;
 
         // Instead we give back the unwanted VM manually.
         page_directory().range_allocator().deallocate(range_to_unmap);
@@ -423,6 +450,7 @@ void* Process::sys$mremap(Userspace<const Syscall::SC_mremap_params*> user_param
     if (!copy_from_user(&params, user_params))
         return (void*)-EFAULT;
 
+    LOCKER(m_address_space_lock);
     auto* old_region = find_region_from_range(Range { VirtualAddress(params.old_address), params.old_size });
     if (!old_region)
         return (void*)-EINVAL;
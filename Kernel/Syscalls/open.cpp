@@ -91,6 +91,7 @@ int Process::sys$open(Userspace<const Syscall::SC_open_params*> user_params)
         return -ENXIO;
 
     u32 fd_flags = (options & O_CLOEXEC) ? FD_CLOEXEC : 0;
+    ScopedSpinLock lock(m_fds_lock);
     m_fds[fd].set(move(description), fd_flags);
     return fd;
 }
@@ -105,7 +106,10 @@ int Process::sys$close(int fd)
     if (!description)
         return -EBADF;
     int rc = description->close();
-    m_fds[fd] = {};
+    {
+        ScopedSpinLock lock(m_fds_lock);
+        m_fds[fd] = {};
+    }
     return rc;
 }
 
@@ -42,15 +42,23 @@ int Process::sys$pipe(int pipefd[2], int flags)
     u32 fd_flags = (flags & O_CLOEXEC) ? FD_CLOEXEC : 0;
     auto fifo = FIFO::create(m_uid);
 
+    auto reader_description = fifo->open_direction(FIFO::Direction::Reader);
+    reader_description->set_readable(true);
     int reader_fd = alloc_fd();
-    m_fds[reader_fd].set(fifo->open_direction(FIFO::Direction::Reader), fd_flags);
-    m_fds[reader_fd].description()->set_readable(true);
+    {
+        ScopedSpinLock lock(m_fds_lock);
+        m_fds[reader_fd].set(move(reader_description), fd_flags);
+    }
     if (!copy_to_user(&pipefd[0], &reader_fd))
         return -EFAULT;
 
+    auto writer_description = fifo->open_direction(FIFO::Direction::Writer);
+    writer_description->set_writable(true);
     int writer_fd = alloc_fd();
-    m_fds[writer_fd].set(fifo->open_direction(FIFO::Direction::Writer), fd_flags);
-    m_fds[writer_fd].description()->set_writable(true);
+    {
+        ScopedSpinLock lock(m_fds_lock);
+        m_fds[writer_fd].set(move(writer_description), fd_flags);
+    }
     if (!copy_to_user(&pipefd[1], &writer_fd))
         return -EFAULT;
 
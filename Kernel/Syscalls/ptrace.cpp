@@ -73,6 +73,7 @@ KResultOr<u32> Process::peek_user_data(Userspace<const u32*> address)
 KResult Process::poke_user_data(Userspace<u32*> address, u32 data)
 {
     ProcessPagingScope scope(*this);
+    LOCKER(m_address_space_lock);
     Range range = { VirtualAddress(address), sizeof(u32) };
     auto* region = find_region_containing(range);
     if (!region)
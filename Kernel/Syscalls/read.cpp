@@ -31,6 +31,19 @@
 
 namespace Kernel {
 
+static int block_until_readable(FileDescription& description)
+{
+    if (!description.is_blocking() || description.can_read())
+        return 0;
+    auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+    if (Thread::current()->block<Thread::ReadBlocker>(nullptr, description, unblock_flags).was_interrupted())
+        return -EINTR;
+    if (!((u32)unblock_flags & (u32)Thread::FileBlocker::BlockFlags::Read))
+        return -EAGAIN;
+    // TODO: handle exceptions in unblock_flags
+    return 0;
+}
+
 ssize_t Process::sys$read(int fd, Userspace<u8*> buffer, ssize_t size)
 {
     REQUIRE_PROMISE(stdio);
@@ -48,16 +61,8 @@ ssize_t Process::sys$read(int fd, Userspace<u8*> buffer, ssize_t size)
         return -EBADF;
     if (description->is_directory())
         return -EISDIR;
-    if (description->is_blocking()) {
-        if (!description->can_read()) {
-            auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
-            if (Thread::current()->block<Thread::ReadBlocker>(nullptr, *description, unblock_flags).was_interrupted())
-                return -EINTR;
-            if (!((u32)unblock_flags & (u32)Thread::FileBlocker::BlockFlags::Read))
-                return -EAGAIN;
-            // TODO: handle exceptions in unblock_flags
-        }
-    }
+    if (int rc = block_until_readable(*description); rc < 0)
+        return rc;
     auto user_buffer = UserOrKernelBuffer::for_user_buffer(buffer, size);
     if (!user_buffer.has_value())
         return -EFAULT;
@@ -67,4 +72,85 @@ ssize_t Process::sys$read(int fd, Userspace<u8*> buffer, ssize_t size)
     return result.value();
 }
 
+ssize_t Process::sys$readv(int fd, Userspace<const struct iovec*> iov, int iov_count)
+{
+    REQUIRE_PROMISE(stdio);
+    Vector<iovec, 32> vecs;
+    ssize_t total_length = copy_iovecs_from_user(vecs, iov, iov_count);
+    if (total_length < 0)
+        return total_length;
+
+    auto description = file_description(fd);
+    if (!description)
+        return -EBADF;
+    if (!description->is_readable())
+        return -EBADF;
+    if (description->is_directory())
+        return -EISDIR;
+    if (total_length == 0)
+        return 0;
+    if (int rc = block_until_readable(*description); rc < 0)
+        return rc;
+
+    ssize_t nread = 0;
+    for (auto& vec : vecs) {
+        auto buffer = UserOrKernelBuffer::for_user_buffer((u8*)vec.iov_base, vec.iov_len);
+        if (!buffer.has_value())
+            return -EFAULT;
+        auto result = description->read(buffer.value(), vec.iov_len);
+        if (result.is_error()) {
+            if (nread == 0)
+                return result.error();
+            return nread;
+        }
+        nread += result.value();
+        // Like a single read(), stop at the first short read instead of blocking again.
+        if (result.value() < vec.iov_len)
+            break;
+    }
+
+    return nread;
+}
+
+ssize_t Process::sys$preadv(Userspace<const Syscall::SC_preadv_params*> user_params)
+{
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_preadv_params params;
+    if (!copy_from_user(&params, user_params))
+        return -EFAULT;
+    if (params.offset < 0)
+        return -EINVAL;
+
+    Vector<iovec, 32> vecs;
+    ssize_t total_length = copy_iovecs_from_user(vecs, (FlatPtr)params.iov, params.iov_count);
+    if (total_length < 0)
+        return total_length;
+
+    auto description = file_description(params.fd);
+    if (!description)
+        return -EBADF;
+    if (!description->is_readable())
+        return -EBADF;
+    if (description->is_directory())
+        return -EISDIR;
+
+    ssize_t nread = 0;
+    for (auto& vec : vecs) {
+        auto buffer = UserOrKernelBuffer::for_user_buffer((u8*)vec.iov_base, vec.iov_len);
+        if (!buffer.has_value())
+            return -EFAULT;
+        auto result = description->read(buffer.value(), params.offset + nread, vec.iov_len);
+        if (result.is_error()) {
+            if (nread == 0)
+                return result.error();
+            return nread;
+        }
+        nread += result.value();
+        if (result.value() < vec.iov_len)
+            break;
+    }
+
+    return nread;
+}
+
 }
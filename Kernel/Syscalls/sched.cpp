@@ -104,6 +104,69 @@ int Process::sys$sched_getparam(pid_t pid, Userspace<struct sched_param*> user_p
     return 0;
 }
 
+static u32 online_processors_mask()
+{
+    u32 count = Processor::count();
+    if (count >= CPU_SETSIZE)
+        return 0xffffffff;
+    return (1u << count) - 1;
+}
+
+int Process::sys$sched_setaffinity(pid_t tid, size_t cpusetsize, Userspace<const cpu_set_t*> user_mask)
+{
+    REQUIRE_PROMISE(proc);
+    if (cpusetsize < sizeof(cpu_set_t))
+        return -EINVAL;
+    cpu_set_t desired_mask;
+    if (!copy_from_user(&desired_mask, user_mask))
+        return -EFAULT;
+
+    u32 affinity = desired_mask.__bits[0] & online_processors_mask();
+    if (affinity == 0)
+        return -EINVAL;
+
+    ScopedSpinLock lock(g_scheduler_lock);
+    RefPtr<Thread> peer = Thread::current();
+    if (tid != 0)
+        peer = Thread::from_tid(tid);
+    if (!peer)
+        return -ESRCH;
+    if (peer->state() == Thread::State::Dead || peer->state() == Thread::State::Dying)
+        return -ESRCH;
+
+    if (!is_superuser() && m_euid != peer->process().m_uid && m_uid != peer->process().m_uid)
+        return -EPERM;
+
+    // Kernel threads (including the per-processor idle threads) stay where the kernel put them.
+    if (peer->process().is_kernel_process())
+        return -EINVAL;
+
+    peer->set_affinity(affinity);
+    return 0;
+}
+
+int Process::sys$sched_getaffinity(pid_t tid, size_t cpusetsize, Userspace<cpu_set_t*> user_mask)
+{
+    REQUIRE_PROMISE(proc);
+    if (cpusetsize < sizeof(cpu_set_t))
+        return -EINVAL;
+
+    RefPtr<Thread> peer = Thread::current();
+    if (tid != 0)
+        peer = Thread::from_tid(tid);
+    if (!peer)
+        return -ESRCH;
+
+    if (!is_superuser() && m_euid != peer->process().m_uid && m_uid != peer->process().m_uid)
+        return -EPERM;
+
+    cpu_set_t mask {};
+    mask.__bits[0] = peer->affinity() & online_processors_mask();
+    if (!copy_to_user(user_mask, &mask))
+        return -EFAULT;
+    return 0;
+}
+
 int Process::sys$set_thread_boost(pid_t tid, int amount)
 {
     REQUIRE_PROMISE(proc);
@@ -126,13 +189,12 @@ int Process::sys$set_process_boost(pid_t pid, int amount)
     REQUIRE_PROMISE(proc);
     if (amount < 0 || amount > 20)
         return -EINVAL;
-    ScopedSpinLock lock(g_processes_lock);
     auto process = Process::from_pid(pid);
     if (!process || process->is_dead())
         return -ESRCH;
     if (!is_superuser() && process->uid() != euid())
         return -EPERM;
-    process->m_priority_boost = amount;
+    process->set_priority_boost(amount);
     return 0;
 }
 
@@ -74,6 +74,7 @@ int Process::sys$recvfd(int sockfd)
     if (received_descriptor_or_error.is_error())
         return received_descriptor_or_error.error();
 
+    ScopedSpinLock lock(m_fds_lock);
     m_fds[new_fd].set(*received_descriptor_or_error.value(), 0);
     return new_fd;
 }
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/NumericLimits.h>
+#include <Kernel/FileSystem/FileDescription.h>
+#include <Kernel/KBuffer.h>
+#include <Kernel/Process.h>
+
+namespace Kernel {
+
+// Data is copied from the in_fd's file (and so from the page cache) into a kernel
+// buffer, and from there by the out_fd's write path. This saves the round trip
+// through userspace, but it is not zero-copy.
+static constexpr size_t sendfile_buffer_size = 64 * KiB;
+
+ssize_t Process::sys$sendfile(Userspace<const Syscall::SC_sendfile_params*> user_params)
+{
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_sendfile_params params;
+    if (!copy_from_user(&params, user_params))
+        return -EFAULT;
+
+    auto in_description = file_description(params.in_fd);
+    if (!in_description)
+        return -EBADF;
+    if (!in_description->is_readable())
+        return -EBADF;
+    // Reading at an offset only makes sense for regular files; everything else goes through read().
+    if (!in_description->inode() || !in_description->metadata().is_regular_file())
+        return -EINVAL;
+
+    auto out_description = file_description(params.out_fd);
+    if (!out_description)
+        return -EBADF;
+    if (!out_description->is_writable())
+        return -EBADF;
+
+    off_t offset;
+    if (params.offset) {
+        if (!copy_from_user(&offset, params.offset))
+            return -EFAULT;
+        if (offset < 0)
+            return -EINVAL;
+    } else {
+        offset = in_description->offset();
+    }
+
+    size_t count = min(params.count, static_cast<size_t>(NumericLimits<off_t>::max() - offset));
+    if (count == 0)
+        return 0;
+
+    // The buffer is committed up front, so filling it never takes a page fault.
+    auto buffer = KBuffer::try_create_with_size(min(count, sendfile_buffer_size), Region::Access::Read | Region::Access::Write, "sendfile", AllocationStrategy::AllocateNow);
+    if (!buffer)
+        return -ENOMEM;
+
+    ssize_t total_nwritten = 0;
+    int error = 0;
+    while ((size_t)total_nwritten < count) {
+        size_t chunk_size = min(count - total_nwritten, buffer->capacity());
+        auto data = UserOrKernelBuffer::for_kernel_buffer(buffer->data());
+        auto nread_or_error = in_description->read(data, offset + total_nwritten, chunk_size);
+        if (nread_or_error.is_error()) {
+            error = nread_or_error.error();
+            break;
+        }
+        size_t nread = nread_or_error.value();
+        if (nread == 0)
+            break;
+
+        ssize_t nwritten = do_write(*out_description, data, nread);
+        if (nwritten < 0) {
+            error = nwritten;
+            break;
+        }
+        total_nwritten += nwritten;
+        if ((size_t)nwritten < nread)
+            break;
+    }
+
+    if (total_nwritten == 0 && error)
+        return error;
+
+    if (params.offset) {
+        offset += total_nwritten;
+        if (!copy_to_user(params.offset, &offset))
+            return -EFAULT;
+    } else {
+        in_description->seek(offset + total_nwritten, SEEK_SET);
+    }
+    return total_nwritten;
+}
+
+}
@@ -60,6 +60,7 @@ int Process::sys$socket(int domain, int type, int protocol)
         flags |= FD_CLOEXEC;
     if (type & SOCK_NONBLOCK)
         description->set_blocking(false);
+    ScopedSpinLock lock(m_fds_lock);
     m_fds[fd].set(move(description), flags);
     return fd;
 }
@@ -138,7 +139,10 @@ int Process::sys$accept(int accepting_socket_fd, Userspace<sockaddr*> user_addre
     // NOTE: The accepted socket inherits fd flags from the accepting socket.
     //       I'm not sure if this matches other systems but it makes sense to me.
     accepted_socket_description->set_blocking(accepting_socket_description->is_blocking());
-    m_fds[accepted_socket_fd].set(move(accepted_socket_description), m_fds[accepting_socket_fd].flags());
+    {
+        ScopedSpinLock lock(m_fds_lock);
+        m_fds[accepted_socket_fd].set(move(accepted_socket_description), m_fds[accepting_socket_fd].flags());
+    }
 
     // NOTE: Moving this state to Completed is what causes connect() to unblock on the client side.
     accepted_socket->set_setup_state(Socket::SetupState::Completed);
@@ -381,7 +385,7 @@ int Process::sys$setsockopt(Userspace<const Syscall::SC_setsockopt_params*> user
         return -ENOTSOCK;
     auto& socket = *description->socket();
     REQUIRE_PROMISE_FOR_SOCKET_DOMAIN(socket.domain());
-    return socket.setsockopt(params.level, params.option, user_value, params.value_size);
+    return socket.setsockopt(*description, params.level, params.option, user_value, params.value_size);
 }
 
 }
@@ -53,6 +53,8 @@ int Process::sys$stat(Userspace<const Syscall::SC_stat_params*> user_params)
     auto path = get_syscall_path_argument(params.path);
     if (path.is_error())
         return path.error();
+    // This runs without the big lock, so keep chdir(), chroot() and unveil() out while we resolve the path.
+    LOCKER(m_path_resolution_lock, Lock::Mode::Shared);
     auto metadata_or_error = VFS::the().lookup_metadata(path.value(), current_directory(), params.follow_symlinks ? 0 : O_NOFOLLOW_NOERROR);
     if (metadata_or_error.is_error())
         return metadata_or_error.error();
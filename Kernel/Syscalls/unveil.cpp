@@ -38,6 +38,7 @@ int Process::sys$unveil(Userspace<const Syscall::SC_unveil_params*> user_params)
     if (!copy_from_user(&params, user_params))
         return -EFAULT;
 
+    LOCKER(m_path_resolution_lock);
     if (!params.path.characters && !params.permissions.characters) {
         m_veil_state = VeilState::Locked;
         return 0;
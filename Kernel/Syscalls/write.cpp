@@ -30,9 +30,8 @@
 
 namespace Kernel {
 
-ssize_t Process::sys$writev(int fd, Userspace<const struct iovec*> iov, int iov_count)
+ssize_t Process::copy_iovecs_from_user(Vector<iovec, 32>& vecs, Userspace<const struct iovec*> iov, int iov_count)
 {
-    REQUIRE_PROMISE(stdio);
     if (iov_count < 0)
         return -EINVAL;
 
@@ -44,7 +43,6 @@ ssize_t Process::sys$writev(int fd, Userspace<const struct iovec*> iov, int iov_
     }
 
     u64 total_length = 0;
-    Vector<iovec, 32> vecs;
     vecs.resize(iov_count);
     if (!copy_n_from_user(vecs.data(), iov, iov_count))
         return -EFAULT;
@@ -53,6 +51,16 @@ ssize_t Process::sys$writev(int fd, Userspace<const struct iovec*> iov, int iov_
         if (total_length > NumericLimits<i32>::max())
             return -EINVAL;
     }
+    return total_length;
+}
+
+ssize_t Process::sys$writev(int fd, Userspace<const struct iovec*> iov, int iov_count)
+{
+    REQUIRE_PROMISE(stdio);
+    Vector<iovec, 32> vecs;
+    ssize_t total_length = copy_iovecs_from_user(vecs, iov, iov_count);
+    if (total_length < 0)
+        return total_length;
 
     auto description = file_description(fd);
     if (!description)
@@ -78,6 +86,47 @@ ssize_t Process::sys$writev(int fd, Userspace<const struct iovec*> iov, int iov_
     return nwritten;
 }
 
+ssize_t Process::sys$pwritev(Userspace<const Syscall::SC_pwritev_params*> user_params)
+{
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_pwritev_params params;
+    if (!copy_from_user(&params, user_params))
+        return -EFAULT;
+    if (params.offset < 0)
+        return -EINVAL;
+
+    Vector<iovec, 32> vecs;
+    ssize_t total_length = copy_iovecs_from_user(vecs, (FlatPtr)params.iov, params.iov_count);
+    if (total_length < 0)
+        return total_length;
+
+    auto description = file_description(params.fd);
+    if (!description)
+        return -EBADF;
+    if (!description->is_writable())
+        return -EBADF;
+    if (description->is_directory())
+        return -EISDIR;
+
+    ssize_t nwritten = 0;
+    for (auto& vec : vecs) {
+        auto buffer = UserOrKernelBuffer::for_user_buffer((u8*)vec.iov_base, vec.iov_len);
+        if (!buffer.has_value())
+            return -EFAULT;
+        auto result = description->write(buffer.value(), params.offset + nwritten, vec.iov_len);
+        if (result.is_error()) {
+            if (nwritten == 0)
+                return result.error();
+            return nwritten;
+        }
+        nwritten += result.value();
+        if (result.value() < vec.iov_len)
+            break;
+    }
+
+    return nwritten;
+}
+
 ssize_t Process::do_write(FileDescription& description, const UserOrKernelBuffer& data, size_t data_size)
 {
     ssize_t total_nwritten = 0;
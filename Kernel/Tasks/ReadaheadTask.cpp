@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/NonnullRefPtr.h>
+#include <AK/Vector.h>
+#include <Kernel/FileSystem/Inode.h>
+#include <Kernel/Process.h>
+#include <Kernel/SpinLock.h>
+#include <Kernel/Tasks/ReadaheadTask.h>
+#include <Kernel/VM/PageCache.h>
+#include <Kernel/WaitQueue.h>
+
+namespace Kernel {
+
+struct ReadaheadRequest {
+    NonnullRefPtr<Inode> inode;
+    size_t first_page_index { 0 };
+    size_t page_count { 0 };
+};
+
+// If the task falls this far behind, readers are better off reading on their own.
+static constexpr size_t max_pending_requests = 64;
+
+static SpinLock<u8> s_lock;
+static Vector<ReadaheadRequest>* s_requests;
+static WaitQueue* s_wait_queue;
+
+void ReadaheadTask::spawn()
+{
+    s_requests = new Vector<ReadaheadRequest>;
+    s_wait_queue = new WaitQueue;
+
+    RefPtr<Thread> readahead_thread;
+    Process::create_kernel_process(readahead_thread, "ReadaheadTask", [] {
+        for (;;) {
+            s_wait_queue->wait_on(nullptr, "ReadaheadTask");
+            for (;;) {
+                Vector<ReadaheadRequest> requests;
+                {
+                    ScopedSpinLock lock(s_lock);
+                    requests = move(*s_requests);
+                }
+                if (requests.is_empty())
+                    break;
+                for (auto& request : requests)
+                    PageCache::the().fill_range(request.inode, request.first_page_index, request.page_count);
+            }
+        }
+    });
+}
+
+void ReadaheadTask::queue(Inode& inode, size_t first_page_index, size_t page_count)
+{
+    if (!s_requests)
+        return;
+    {
+        ScopedSpinLock lock(s_lock);
+        if (s_requests->size() >= max_pending_requests)
+            return;
+        s_requests->append({ inode, first_page_index, page_count });
+    }
+    s_wait_queue->wake_one();
+}
+
+}
@@ -24,23 +24,38 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <Kernel/FileSystem/VirtualFileSystem.h>
+#include <Kernel/FileSystem/FileSystem.h>
 #include <Kernel/Process.h>
 #include <Kernel/Tasks/SyncTask.h>
 #include <Kernel/Time/TimeManagement.h>
+#include <Kernel/WaitQueue.h>
 
 namespace Kernel {
 
+static WaitQueue* s_wait_queue;
+
 void SyncTask::spawn()
 {
+    s_wait_queue = new WaitQueue;
+
     RefPtr<Thread> syncd_thread;
     Process::create_kernel_process(syncd_thread, "SyncTask", [] {
         dbg() << "SyncTask is running";
         for (;;) {
-            VFS::the().sync();
-            Thread::current()->sleep({ 1, 0 });
+            // Write back old dirty blocks once a second, or right away when
+            // a file system is over its dirty threshold.
+            FS::write_back_all();
+            timespec interval { 1, 0 };
+            Thread::BlockTimeout timeout(false, &interval);
+            [[maybe_unused]] auto result = s_wait_queue->wait_on(timeout, "SyncTask");
         }
     });
 }
 
+void SyncTask::wake_write_back()
+{
+    if (s_wait_queue)
+        s_wait_queue->wake_one();
+}
+
 }
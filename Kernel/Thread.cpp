@@ -134,6 +134,7 @@ Thread::~Thread()
         // the middle of being destroyed.
         ScopedSpinLock lock(g_scheduler_lock);
         g_scheduler_data->thread_list_for_state(m_state).remove(*this);
+        ASSERT(m_ready_queue_bucket < 0);
     }
 }
 
@@ -290,7 +291,10 @@ void Thread::donate_without_holding_big_lock(RefPtr<Thread>& thread, const char*
 
 LockMode Thread::unlock_process_if_locked(u32& lock_count_to_restore)
 {
-    return process().big_lock().force_unlock_if_locked(lock_count_to_restore);
+    auto previous_locked = process().big_lock().force_unlock_if_locked(lock_count_to_restore);
+    if (previous_locked != LockMode::Unlocked)
+        m_big_lock_released_at = read_tsc();
+    return previous_locked;
 }
 
 void Thread::relock_process(LockMode previous_locked, u32 lock_count_to_restore)
@@ -310,6 +314,7 @@ void Thread::relock_process(LockMode previous_locked, u32 lock_count_to_restore)
     if (previous_locked != LockMode::Unlocked) {
         // We've unblocked, relock the process if needed and carry on.
         RESTORE_LOCK(process().big_lock(), previous_locked, lock_count_to_restore);
+        m_cycles_without_big_lock += read_tsc() - m_big_lock_released_at;
     }
 }
 
@@ -956,6 +961,49 @@ void Thread::set_state(State new_state, u8 stop_signal)
     }
 }
 
+void Thread::set_priority(u32 priority)
+{
+    ScopedSpinLock lock(g_scheduler_lock);
+    m_priority = priority;
+    Scheduler::requeue_runnable_thread(*this);
+}
+
+void Thread::set_priority_boost(u32 boost)
+{
+    ScopedSpinLock lock(g_scheduler_lock);
+    m_priority_boost = boost;
+    Scheduler::requeue_runnable_thread(*this);
+}
+
+static void reschedule_processor(u32 cpu)
+{
+    if (cpu == Processor::current().id()) {
+        Processor::current().invoke_scheduler_async();
+        return;
+    }
+    Processor::smp_unicast(
+        cpu, [] { Processor::current().invoke_scheduler_async(); }, true);
+}
+
+void Thread::set_affinity(u32 affinity)
+{
+    ASSERT(affinity != 0);
+    ScopedSpinLock lock(g_scheduler_lock);
+    m_cpu_affinity = affinity;
+
+    // If we're waiting on a processor we may no longer run on, move over,
+    // and make sure our new processor notices us even if it is idle.
+    if (m_ready_queue_bucket >= 0 && (affinity & (1u << m_ready_queue_cpu)) == 0) {
+        Scheduler::dequeue_runnable_thread(*this);
+        Scheduler::queue_runnable_thread(*this);
+        reschedule_processor(m_ready_queue_cpu);
+    }
+
+    // If we're running on such a processor, get off it as soon as possible.
+    if (m_state == Running && (affinity & (1u << cpu())) == 0)
+        reschedule_processor(cpu());
+}
+
 void Thread::update_state_for_thread(Thread::State previous_state)
 {
     ASSERT_INTERRUPTS_DISABLED();
@@ -968,6 +1016,11 @@ void Thread::update_state_for_thread(Thread::State previous_state)
         previous_list.remove(*this);
     }
 
+    if (previous_state == Runnable)
+        Scheduler::dequeue_runnable_thread(*this);
+    else if (state() == Runnable)
+        Scheduler::queue_runnable_thread(*this);
+
     if (list.contains(*this))
         return;
 
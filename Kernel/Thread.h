@@ -50,6 +50,8 @@
 
 namespace Kernel {
 
+class TLBShootdownBatch;
+
 enum class DispatchSignalResult {
     Deferred = 0,
     Yield,
@@ -99,10 +101,10 @@ public:
     ThreadID tid() const { return m_tid; }
     ProcessID pid() const;
 
-    void set_priority(u32 p) { m_priority = p; }
+    void set_priority(u32);
     u32 priority() const { return m_priority; }
 
-    void set_priority_boost(u32 boost) { m_priority_boost = boost; }
+    void set_priority_boost(u32);
     u32 priority_boost() const { return m_priority_boost; }
 
     u32 effective_priority() const;
@@ -705,7 +707,13 @@ public:
     u32 cpu() const { return m_cpu.load(AK::MemoryOrder::memory_order_consume); }
     void set_cpu(u32 cpu) { m_cpu.store(cpu, AK::MemoryOrder::memory_order_release); }
     u32 affinity() const { return m_cpu_affinity; }
-    void set_affinity(u32 affinity) { m_cpu_affinity = affinity; }
+    void set_affinity(u32 affinity);
+
+    // A thread that ran very recently probably still has a warm cache on
+    // the processor it ran on, so idle processors won't steal it.
+    static constexpr u64 cache_hot_time_ms = 4;
+    void set_last_ran_at(u64 uptime_ms) { m_last_ran_at_ms = uptime_ms; }
+    bool is_cache_hot(u64 now_ms) const { return now_ms - m_last_ran_at_ms < cache_hot_time_ms; }
 
     u32 stack_ptr() const { return m_tss.esp; }
 
@@ -713,6 +721,9 @@ public:
 
     TSS32& tss() { return m_tss; }
     const TSS32& tss() const { return m_tss; }
+
+    TLBShootdownBatch* tlb_shootdown_batch() { return m_tlb_shootdown_batch; }
+    void set_tlb_shootdown_batch(TLBShootdownBatch* batch) { m_tlb_shootdown_batch = batch; }
     State state() const { return m_state; }
     const char* state_string() const;
 
@@ -939,6 +950,9 @@ public:
 
     unsigned syscall_count() const { return m_syscall_count; }
     void did_syscall() { ++m_syscall_count; }
+
+    // Time spent with the big lock given up while blocking or yielding inside a syscall.
+    u64 cycles_without_big_lock() const { return m_cycles_without_big_lock; }
     unsigned inode_faults() const { return m_inode_faults; }
     void did_inode_fault() { ++m_inode_faults; }
     unsigned zero_faults() const { return m_zero_faults; }
@@ -1081,9 +1095,11 @@ public:
 
 private:
     IntrusiveListNode m_runnable_list_node;
+    IntrusiveListNode m_ready_queue_node;
 
 private:
     friend struct SchedulerData;
+    friend class ThreadReadyQueue;
     friend class WaitQueue;
 
     class JoinBlockCondition : public BlockCondition {
@@ -1166,6 +1182,7 @@ private:
     VirtualAddress m_thread_specific_data;
     SignalActionData m_signal_action_data[32];
     Blocker* m_blocker { nullptr };
+    TLBShootdownBatch* m_tlb_shootdown_batch { nullptr };
 
 #ifdef LOCK_DEBUG
     struct HoldingLockInfo {
@@ -1201,8 +1218,13 @@ private:
     State m_state { Invalid };
     String m_name;
     u32 m_priority { THREAD_PRIORITY_NORMAL };
-    u32 m_extra_priority { 0 };
     u32 m_priority_boost { 0 };
+    int m_ready_queue_bucket { -1 };
+    u32 m_ready_queue_cpu { 0 };
+    u64 m_ready_since_ms { 0 };
+    u64 m_last_ran_at_ms { 0 };
+    u64 m_big_lock_released_at { 0 };
+    u64 m_cycles_without_big_lock { 0 };
 
     State m_stop_state { Invalid };
 
@@ -1277,6 +1299,113 @@ struct SchedulerData {
     }
 };
 
+// Threads in the Runnable state are queued on exactly one processor's ready
+// queue. Priorities are mapped onto a fixed number of buckets, and a bit is
+// set in m_bucket_mask for every bucket that isn't empty, so the next thread
+// to run can be found without looking at any of the others.
+// Waiting threads age: every aging_interval_ms spent in the queue counts as
+// one bucket higher, so that busy threads can't starve lower priority ones.
+// Since buckets are FIFO, only the first eligible thread of each bucket has
+// to be looked at to find the thread with the best aged priority.
+class ThreadReadyQueue {
+    AK_MAKE_NONCOPYABLE(ThreadReadyQueue);
+    AK_MAKE_NONMOVABLE(ThreadReadyQueue);
+
+public:
+    static constexpr u32 bucket_count = sizeof(u32) * 8;
+    static constexpr u64 aging_interval_ms = 20;
+
+    ThreadReadyQueue() = default;
+
+    static u32 bucket_for_priority(u32 priority);
+
+    SpinLock<u8>& lock() { return m_lock; }
+
+    bool is_empty() const { return m_bucket_mask == 0; }
+
+    // NOTE: This may be read without holding the lock, e.g. by another
+    //       processor looking for work to steal.
+    u32 thread_count() const { return m_thread_count.load(AK::MemoryOrder::memory_order_relaxed); }
+
+    void enqueue(Thread&);
+    bool dequeue(Thread&);
+    // Moves a queued thread to the bucket for its current effective priority.
+    // It starts aging afresh there, which keeps every bucket ordered by age.
+    void requeue(Thread&);
+
+    // Removes and returns the eligible thread with the best aged priority,
+    // as long as that is at least as good as max_bucket.
+    template<typename Callback>
+    Thread* take_next(u64 now_ms, u32 max_bucket, Callback);
+
+    // Removes and returns the first thread for which the callback returns
+    // true, looking only at buckets up to and including max_bucket.
+    template<typename Callback>
+    Thread* take_first_matching(u32 max_bucket, Callback);
+
+private:
+    typedef IntrusiveList<Thread, &Thread::m_ready_queue_node> ThreadList;
+
+    SpinLock<u8> m_lock;
+    u32 m_bucket_mask { 0 };
+    Atomic<u32> m_thread_count { 0 };
+    ThreadList m_buckets[bucket_count];
+};
+
+template<typename Callback>
+inline Thread* ThreadReadyQueue::take_next(u64 now_ms, u32 max_bucket, Callback callback)
+{
+    ASSERT(m_lock.is_locked());
+    Thread* best_thread = nullptr;
+    u32 best_aged_bucket = max_bucket;
+    u32 mask = m_bucket_mask;
+    while (mask != 0) {
+        u32 bucket = __builtin_ctz(mask);
+        mask &= ~(1u << bucket);
+        for (auto& thread : m_buckets[bucket]) {
+            if (!callback(thread))
+                continue;
+            u64 waited_intervals = (now_ms - thread.m_ready_since_ms) / aging_interval_ms;
+            u32 aged_bucket = bucket - (u32)min<u64>(bucket, waited_intervals);
+            // On a tie, the thread with the better real priority wins.
+            if (aged_bucket < best_aged_bucket || (!best_thread && aged_bucket == best_aged_bucket)) {
+                best_thread = &thread;
+                best_aged_bucket = aged_bucket;
+            }
+            break;
+        }
+    }
+    if (best_thread)
+        dequeue(*best_thread);
+    return best_thread;
+}
+
+template<typename Callback>
+inline Thread* ThreadReadyQueue::take_first_matching(u32 max_bucket, Callback callback)
+{
+    ASSERT(m_lock.is_locked());
+    u32 mask = m_bucket_mask;
+    if (max_bucket < bucket_count - 1)
+        mask &= (2u << max_bucket) - 1;
+    while (mask != 0) {
+        u32 bucket = __builtin_ctz(mask);
+        auto& list = m_buckets[bucket];
+        for (auto& thread : list) {
+            ASSERT(thread.m_ready_queue_bucket == (int)bucket);
+            if (!callback(thread))
+                continue;
+            list.remove(thread);
+            thread.m_ready_queue_bucket = -1;
+            if (list.is_empty())
+                m_bucket_mask &= ~(1u << bucket);
+            m_thread_count--;
+            return &thread;
+        }
+        mask &= ~(1u << bucket);
+    }
+    return nullptr;
+}
+
 template<typename Callback>
 inline IterationDecision Scheduler::for_each_runnable(Callback callback)
 {
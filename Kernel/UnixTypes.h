@@ -441,6 +441,31 @@ struct pollfd {
     short revents;
 };
 
+#define EPOLLIN POLLIN
+#define EPOLLPRI POLLPRI
+#define EPOLLOUT POLLOUT
+#define EPOLLERR POLLERR
+#define EPOLLHUP POLLHUP
+#define EPOLLET (1u << 31)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLL_CLOEXEC O_CLOEXEC
+
+typedef union epoll_data {
+    void* ptr;
+    int fd;
+    uint32_t u32;
+    uint64_t u64;
+} epoll_data_t;
+
+struct epoll_event {
+    uint32_t events;
+    epoll_data_t data;
+};
+
 #define AF_MASK 0xff
 #define AF_UNSPEC 0
 #define AF_LOCAL 1
@@ -476,6 +501,9 @@ enum {
     SO_BINDTODEVICE,
     SO_KEEPALIVE,
     SO_TIMESTAMP,
+    SO_BROADCAST,
+    SO_SNDBUF,
+    SO_RCVBUF,
 };
 
 enum {
@@ -588,6 +616,12 @@ struct sched_param {
     int sched_priority;
 };
 
+#define CPU_SETSIZE 32
+
+typedef struct {
+    u32 __bits[CPU_SETSIZE / 32];
+} cpu_set_t;
+
 struct ifreq {
 #define IFNAMSIZ 16
     char ifr_name[IFNAMSIZ];
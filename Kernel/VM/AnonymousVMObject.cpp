@@ -394,6 +394,31 @@ RefPtr<PhysicalPage> AnonymousVMObject::allocate_committed_page(size_t page_inde
     return MM.allocate_committed_user_physical_page(MemoryManager::ShouldZeroFill::Yes);
 }
 
+bool AnonymousVMObject::allocate_committed_contiguous_pages(size_t first_page_index, size_t page_count)
+{
+    {
+        ScopedSpinLock lock(m_lock);
+        if (m_unused_committed_pages < page_count)
+            return false;
+        for (size_t i = 0; i < page_count; ++i) {
+            auto& page = physical_pages()[first_page_index + i];
+            if (!page || !page->is_lazy_committed_page())
+                return false;
+        }
+        m_unused_committed_pages -= page_count;
+    }
+
+    auto pages = MM.allocate_committed_contiguous_user_physical_pages(page_count);
+    if (pages.is_empty()) {
+        ScopedSpinLock lock(m_lock);
+        m_unused_committed_pages += page_count;
+        return false;
+    }
+    for (size_t i = 0; i < page_count; ++i)
+        physical_pages()[first_page_index + i] = pages[i];
+    return true;
+}
+
 Bitmap& AnonymousVMObject::ensure_cow_map()
 {
     if (!m_cow_map)
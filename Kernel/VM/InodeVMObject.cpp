@@ -25,8 +25,10 @@
  */
 
 #include <Kernel/FileSystem/Inode.h>
+#include <Kernel/Tasks/ReadaheadTask.h>
 #include <Kernel/VM/InodeVMObject.h>
 #include <Kernel/VM/MemoryManager.h>
+#include <Kernel/VM/PageCache.h>
 #include <Kernel/VM/Region.h>
 
 namespace Kernel {
@@ -35,6 +37,7 @@ InodeVMObject::InodeVMObject(Inode& inode, size_t size)
     : VMObject(size)
     , m_inode(inode)
     , m_dirty_pages(page_count(), false)
+    , m_shared_with_page_cache(page_count(), false)
 {
 }
 
@@ -42,9 +45,12 @@ InodeVMObject::InodeVMObject(const InodeVMObject& other)
     : VMObject(other)
     , m_inode(other.m_inode)
     , m_dirty_pages(page_count(), false)
+    , m_shared_with_page_cache(page_count(), false)
 {
-    for (size_t i = 0; i < page_count(); ++i)
+    for (size_t i = 0; i < page_count(); ++i) {
         m_dirty_pages.set(i, other.m_dirty_pages.get(i));
+        m_shared_with_page_cache.set(i, other.m_shared_with_page_cache.get(i));
+    }
 }
 
 InodeVMObject::~InodeVMObject()
@@ -82,6 +88,7 @@ void InodeVMObject::inode_size_changed(Badge<Inode>, size_t old_size, size_t new
     m_physical_pages.resize(new_page_count);
 
     m_dirty_pages.grow(new_page_count, false);
+    m_shared_with_page_cache.grow(new_page_count, false);
 
     // FIXME: Consolidate with inode_contents_changed() so we only do a single walk.
     for_each_region([](auto& region) {
@@ -180,4 +187,30 @@ u32 InodeVMObject::executable_mappings() const
     return count;
 }
 
+void InodeVMObject::start_fault_readahead(size_t page_index)
+{
+    // Each fault maps in up to Region::fault_around_pages cached neighbors,
+    // so a sequential reader's next fault lands at most that far ahead.
+    bool is_sequential = page_index > m_last_fault_page_index && page_index - m_last_fault_page_index <= Region::fault_around_pages;
+    m_last_fault_page_index = page_index;
+    if (!is_sequential) {
+        m_readahead_issued_until = 0;
+        return;
+    }
+    if (!PageCache::is_enabled_for(*m_inode))
+        return;
+
+    size_t next_page_index = page_index + 1;
+    size_t issued_until = max(m_readahead_issued_until, next_page_index);
+    // Like PageCache::start_readahead(), wait until the faults are halfway
+    // through what has already been issued before issuing more.
+    if (issued_until >= next_page_index + PageCache::readahead_max_window_pages / 2)
+        return;
+    size_t end_page_index = min(next_page_index + PageCache::readahead_max_window_pages, page_count());
+    if (end_page_index <= issued_until)
+        return;
+    m_readahead_issued_until = end_page_index;
+    ReadaheadTask::queue(*m_inode, issued_until, end_page_index - issued_until);
+}
+
 }
@@ -50,6 +50,15 @@ public:
     u32 writable_mappings() const;
     u32 executable_mappings() const;
 
+    // Private mappings map clean pages straight from the page cache, read-only,
+    // and only make a copy of their own when they are written to.
+    bool is_shared_with_page_cache(size_t page_index) const { return m_shared_with_page_cache.get(page_index); }
+    void set_shared_with_page_cache(size_t page_index, bool shared) { m_shared_with_page_cache.set(page_index, shared); }
+
+    // Called for every inode fault with the paging lock held. Queues readahead
+    // of the pages after it if the faults look sequential.
+    void start_fault_readahead(size_t page_index);
+
 protected:
     explicit InodeVMObject(Inode&, size_t);
     explicit InodeVMObject(const InodeVMObject&);
@@ -64,6 +73,9 @@ protected:
 
     NonnullRefPtr<Inode> m_inode;
     Bitmap m_dirty_pages;
+    Bitmap m_shared_with_page_cache;
+    size_t m_last_fault_page_index { 0 };
+    size_t m_readahead_issued_until { 0 };
 };
 
 }
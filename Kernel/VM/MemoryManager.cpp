@@ -34,12 +34,15 @@
 #include <Kernel/Multiboot.h>
 #include <Kernel/Process.h>
 #include <Kernel/StdLib.h>
+#include <Kernel/Tasks/PageZeroingTask.h>
 #include <Kernel/VM/AnonymousVMObject.h>
 #include <Kernel/VM/ContiguousVMObject.h>
 #include <Kernel/VM/MemoryManager.h>
+#include <Kernel/VM/PageCache.h>
 #include <Kernel/VM/PageDirectory.h>
 #include <Kernel/VM/PhysicalRegion.h>
 #include <Kernel/VM/SharedInodeVMObject.h>
+#include <Kernel/VM/TLBShootdownBatch.h>
 
 //#define MM_DEBUG
 //#define PAGE_FAULT_DEBUG
@@ -77,6 +80,8 @@ MemoryManager::MemoryManager()
     write_cr3(kernel_page_directory().cr3());
     protect_kernel_image();
 
+    m_zeroed_user_physical_pages.ensure_capacity(zeroed_user_physical_page_pool_size);
+
     // We're temporarily "committing" to two pages that we need to allocate below
     if (!commit_user_physical_pages(2))
         ASSERT_NOT_REACHED();
@@ -219,7 +224,7 @@ PageTableEntry* MemoryManager::pte(PageDirectory& page_directory, VirtualAddress
 
     auto* pd = quickmap_pd(const_cast<PageDirectory&>(page_directory), page_directory_table_index);
     const PageDirectoryEntry& pde = pd[page_directory_index];
-    if (!pde.is_present())
+    if (!pde.is_present() || pde.is_huge())
         return nullptr;
 
     return &quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()))[page_table_index];
@@ -235,6 +240,11 @@ PageTableEntry* MemoryManager::ensure_pte(PageDirectory& page_directory, Virtual
     u32 page_table_index = (vaddr.get() >> 12) & 0x1ff;
 
     auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+    if (pd[page_directory_index].is_present() && pd[page_directory_index].is_huge()) {
+        if (!split_large_pde(page_directory, vaddr))
+            return nullptr;
+        pd = quickmap_pd(page_directory, page_directory_table_index);
+    }
     PageDirectoryEntry& pde = pd[page_directory_index];
     if (!pde.is_present()) {
 #ifdef MM_DEBUG
@@ -283,6 +293,12 @@ void MemoryManager::release_pte(PageDirectory& page_directory, VirtualAddress va
 
     auto* pd = quickmap_pd(page_directory, page_directory_table_index);
     PageDirectoryEntry& pde = pd[page_directory_index];
+    if (pde.is_present() && pde.is_huge()) {
+        // A large page never straddles regions, so it goes away with the first of its pages.
+        pde.clear();
+        --m_large_page_mappings;
+        return;
+    }
     if (pde.is_present()) {
         auto* page_table = quickmap_pt(PhysicalAddress((FlatPtr)pde.page_table_base()));
         auto& pte = page_table[page_table_index];
@@ -300,9 +316,7 @@ void MemoryManager::release_pte(PageDirectory& page_directory, VirtualAddress va
             }
             if (all_clear) {
                 pde.clear();
-
-                auto result = page_directory.m_page_tables.remove(vaddr.get() & ~0x1fffff);
-                ASSERT(result);
+                release_page_table(page_directory, vaddr.get() & ~0x1fffff);
 #ifdef MM_DEBUG
                 dbg() << "MM: Released page table for " << VirtualAddress(vaddr.get() & ~0x1fffff);
 #endif
@@ -311,6 +325,101 @@ void MemoryManager::release_pte(PageDirectory& page_directory, VirtualAddress va
     }
 }
 
+void MemoryManager::release_page_table(PageDirectory& page_directory, FlatPtr base)
+{
+    auto it = page_directory.m_page_tables.find(base);
+    ASSERT(it != page_directory.m_page_tables.end());
+    NonnullRefPtr<PhysicalPage> page_table = *it->value;
+    page_directory.m_page_tables.remove(it);
+
+    // Other processors may still walk the old page table until their TLB entries for
+    // it are shot down, so a batch that defers that has to keep the page table alive.
+    auto* current_thread = Thread::current();
+    if (current_thread && current_thread->tlb_shootdown_batch() && !Processor::current().in_irq()
+        && Processor::may_cache_page_directory(page_directory))
+        current_thread->tlb_shootdown_batch()->defer_release(page_directory, move(page_table));
+}
+
+PageDirectoryEntry& MemoryManager::ensure_large_pde(PageDirectory& page_directory, VirtualAddress vaddr)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    ASSERT(s_mm_lock.own_lock());
+    ASSERT(page_directory.get_lock().own_lock());
+    ASSERT(!(vaddr.get() & (LARGE_PAGE_SIZE - 1)));
+    u32 page_directory_table_index = (vaddr.get() >> 30) & 0x3;
+    u32 page_directory_index = (vaddr.get() >> 21) & 0x1ff;
+
+    auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+    PageDirectoryEntry& pde = pd[page_directory_index];
+    if (pde.is_present() && pde.is_huge()) {
+        pde.clear();
+        return pde;
+    }
+    if (pde.is_present()) {
+        // The caller is mapping all 2 MiB of this page table, so anything
+        // still in it belongs to the same region and can simply go.
+        pde.clear();
+        release_page_table(page_directory, vaddr.get());
+    }
+    ++m_large_page_mappings;
+    return pde;
+}
+
+bool MemoryManager::split_large_pde(PageDirectory& page_directory, VirtualAddress vaddr)
+{
+    ASSERT_INTERRUPTS_DISABLED();
+    ASSERT(s_mm_lock.own_lock());
+    ASSERT(page_directory.get_lock().own_lock());
+    u32 page_directory_table_index = (vaddr.get() >> 30) & 0x3;
+    u32 page_directory_index = (vaddr.get() >> 21) & 0x1ff;
+
+    bool did_purge = false;
+    auto page_table = allocate_user_physical_page(ShouldZeroFill::No, &did_purge);
+    if (!page_table) {
+        dbg() << "MM: Unable to allocate page table to split large page at " << vaddr;
+        return false;
+    }
+
+    auto* pd = quickmap_pd(page_directory, page_directory_table_index);
+    PageDirectoryEntry& pde = pd[page_directory_index];
+    if (!pde.is_present() || !pde.is_huge()) {
+        // Purging to get the page table may have split this one already.
+        ASSERT(did_purge);
+        return true;
+    }
+
+    // Map the same 2 MiB with the same attributes, 4 KiB at a time. The caller
+    // flushes the address it's about to change, which also drops the large TLB entry.
+    auto base = (FlatPtr)pde.page_table_base();
+    auto* pt = quickmap_pt(page_table->paddr());
+    for (u32 i = 0; i <= 0x1ff; i++) {
+        auto& pte = pt[i];
+        pte.clear();
+        pte.set_physical_page_base(base + i * PAGE_SIZE);
+        pte.set_writable(pde.is_writable());
+        pte.set_user_allowed(pde.is_user_allowed());
+        pte.set_cache_disabled(pde.is_cache_disabled());
+        pte.set_execute_disabled(pde.is_execute_disabled());
+        pte.set_present(true);
+    }
+
+    pde.clear();
+    pde.set_page_table_base(page_table->paddr().get());
+    pde.set_user_allowed(true);
+    pde.set_present(true);
+    pde.set_writable(true);
+    pde.set_global(&page_directory == m_kernel_page_directory.ptr());
+    auto result = page_directory.m_page_tables.set(vaddr.get() & ~0x1fffff, move(page_table));
+    ASSERT(result == AK::HashSetResult::InsertedNewEntry);
+
+    --m_large_page_mappings;
+    ++m_large_page_splits;
+#ifdef MM_DEBUG
+    dbg() << "MM: Split large page at " << VirtualAddress(vaddr.get() & ~0x1fffff);
+#endif
+    return true;
+}
+
 void MemoryManager::initialize(u32 cpu)
 {
     auto mm_data = new MemoryManagerData;
@@ -338,11 +447,9 @@ Region* MemoryManager::kernel_region_from_vaddr(VirtualAddress vaddr)
 Region* MemoryManager::user_region_from_vaddr(Process& process, VirtualAddress vaddr)
 {
     ScopedSpinLock lock(s_mm_lock);
-    // FIXME: Use a binary search tree (maybe red/black?) or some other more appropriate data structure!
-    for (auto& region : process.m_regions) {
-        if (region.contains(vaddr))
-            return &region;
-    }
+    auto* region = process.m_regions.find_largest_not_above(vaddr.get());
+    if (region && (*region)->contains(vaddr))
+        return region->ptr();
 #ifdef MM_DEBUG
     dbg() << process << " Couldn't find user region for " << vaddr;
 #endif
@@ -402,7 +509,8 @@ OwnPtr<Region> MemoryManager::allocate_contiguous_kernel_region(size_t size, con
 {
     ASSERT(!(size % PAGE_SIZE));
     ScopedSpinLock lock(s_mm_lock);
-    auto range = kernel_page_directory().range_allocator().allocate_anywhere(size);
+    // Big enough to be worth mapping with large pages, which needs the virtual and physical addresses to line up.
+    auto range = kernel_page_directory().range_allocator().allocate_anywhere(size, size >= LARGE_PAGE_SIZE ? LARGE_PAGE_SIZE : PAGE_SIZE);
     if (!range.is_valid())
         return nullptr;
     auto vmobject = ContiguousVMObject::create_with_size(size);
@@ -426,7 +534,8 @@ OwnPtr<Region> MemoryManager::allocate_kernel_region(PhysicalAddress paddr, size
 {
     ASSERT(!(size % PAGE_SIZE));
     ScopedSpinLock lock(s_mm_lock);
-    auto range = kernel_page_directory().range_allocator().allocate_anywhere(size);
+    bool can_use_large_pages = size >= LARGE_PAGE_SIZE && !(paddr.get() & (LARGE_PAGE_SIZE - 1));
+    auto range = kernel_page_directory().range_allocator().allocate_anywhere(size, can_use_large_pages ? LARGE_PAGE_SIZE : PAGE_SIZE);
     if (!range.is_valid())
         return nullptr;
     auto vmobject = AnonymousVMObject::create_for_physical_range(paddr, size);
@@ -521,7 +630,44 @@ void MemoryManager::deallocate_user_physical_page(const PhysicalPage& page)
     ASSERT_NOT_REACHED();
 }
 
-RefPtr<PhysicalPage> MemoryManager::find_free_user_physical_page(bool committed)
+RefPtr<PhysicalPage> MemoryManager::take_free_user_physical_page_from_regions()
+{
+    ASSERT(s_mm_lock.is_locked());
+    for (auto& region : m_user_physical_regions) {
+        auto page = region.take_free_page(false);
+        if (!page.is_null())
+            return page;
+    }
+    return {};
+}
+
+RefPtr<PhysicalPage> MemoryManager::take_zeroed_user_physical_page()
+{
+    ASSERT(s_mm_lock.is_locked());
+    if (m_zeroed_user_physical_pages.is_empty())
+        return {};
+    auto page = m_zeroed_user_physical_pages.take_last();
+    if (m_zeroed_user_physical_pages.size() < zeroed_user_physical_page_pool_size / 2)
+        PageZeroingTask::wake();
+    return page;
+}
+
+bool MemoryManager::zero_one_free_user_physical_page()
+{
+    ScopedSpinLock lock(s_mm_lock);
+    if (m_zeroed_user_physical_pages.size() >= zeroed_user_physical_page_pool_size)
+        return false;
+    auto page = take_free_user_physical_page_from_regions();
+    if (!page)
+        return false;
+    auto* ptr = quickmap_page(*page);
+    memset(ptr, 0, PAGE_SIZE);
+    unquickmap_page();
+    m_zeroed_user_physical_pages.append(page.release_nonnull());
+    return true;
+}
+
+RefPtr<PhysicalPage> MemoryManager::find_free_user_physical_page(bool committed, ShouldZeroFill should_zero_fill)
 {
     ASSERT(s_mm_lock.is_locked());
     RefPtr<PhysicalPage> page;
@@ -535,33 +681,64 @@ RefPtr<PhysicalPage> MemoryManager::find_free_user_physical_page(bool committed)
             return {};
         m_user_physical_pages_uncommitted--;
     }
-    for (auto& region : m_user_physical_regions) {
-        page = region.take_free_page(false);
-        if (!page.is_null()) {
-            ++m_user_physical_pages_used;
-            break;
-        }
+    bool page_is_zeroed = false;
+    if (should_zero_fill == ShouldZeroFill::Yes) {
+        page = take_zeroed_user_physical_page();
+        page_is_zeroed = !page.is_null();
+    }
+    if (!page)
+        page = take_free_user_physical_page_from_regions();
+    if (!page) {
+        // The zeroed pool is made of free pages too, so it's our last resort.
+        page = take_zeroed_user_physical_page();
     }
     ASSERT(!committed || !page.is_null());
+    if (!page)
+        return {};
+
+    ++m_user_physical_pages_used;
+    if (should_zero_fill == ShouldZeroFill::Yes && !page_is_zeroed) {
+        auto* ptr = quickmap_page(*page);
+        memset(ptr, 0, PAGE_SIZE);
+        unquickmap_page();
+    }
     return page;
 }
 
 NonnullRefPtr<PhysicalPage> MemoryManager::allocate_committed_user_physical_page(ShouldZeroFill should_zero_fill)
 {
     ScopedSpinLock lock(s_mm_lock);
-    auto page = find_free_user_physical_page(true);
-    if (should_zero_fill == ShouldZeroFill::Yes) {
-        auto* ptr = quickmap_page(*page);
+    auto page = find_free_user_physical_page(true, should_zero_fill);
+    return page.release_nonnull();
+}
+
+NonnullRefPtrVector<PhysicalPage> MemoryManager::allocate_committed_contiguous_user_physical_pages(size_t count)
+{
+    ScopedSpinLock lock(s_mm_lock);
+    ASSERT(m_user_physical_pages_committed >= count);
+    NonnullRefPtrVector<PhysicalPage> physical_pages;
+    for (auto& region : m_user_physical_regions) {
+        physical_pages = region.take_contiguous_free_pages(count, false);
+        if (!physical_pages.is_empty())
+            break;
+    }
+    if (physical_pages.is_empty())
+        return {};
+
+    m_user_physical_pages_committed -= count;
+    m_user_physical_pages_used += count;
+    for (auto& page : physical_pages) {
+        auto* ptr = quickmap_page(page);
         memset(ptr, 0, PAGE_SIZE);
         unquickmap_page();
     }
-    return page.release_nonnull();
+    return physical_pages;
 }
 
 RefPtr<PhysicalPage> MemoryManager::allocate_user_physical_page(ShouldZeroFill should_zero_fill, bool* did_purge)
 {
     ScopedSpinLock lock(s_mm_lock);
-    auto page = find_free_user_physical_page(false);
+    auto page = find_free_user_physical_page(false, should_zero_fill);
     bool purged_pages = false;
 
     if (!page) {
@@ -573,7 +750,7 @@ RefPtr<PhysicalPage> MemoryManager::allocate_user_physical_page(ShouldZeroFill s
             int purged_page_count = static_cast<AnonymousVMObject&>(vmobject).purge_with_interrupts_disabled({});
             if (purged_page_count) {
                 klog() << "MM: Purge saved the day! Purged " << purged_page_count << " pages from AnonymousVMObject{" << &vmobject << "}";
-                page = find_free_user_physical_page(false);
+                page = find_free_user_physical_page(false, should_zero_fill);
                 purged_pages = true;
                 ASSERT(page);
                 return IterationDecision::Break;
@@ -581,6 +758,12 @@ RefPtr<PhysicalPage> MemoryManager::allocate_user_physical_page(ShouldZeroFill s
             return IterationDecision::Continue;
         });
 
+        if (!page) {
+            // Next, shrink the page cache. Evict a batch so the next few allocations don't end up here again.
+            if (PageCache::the().evict(32))
+                page = find_free_user_physical_page(false, should_zero_fill);
+        }
+
         if (!page) {
             klog() << "MM: no user physical pages available";
             return {};
@@ -591,12 +774,6 @@ RefPtr<PhysicalPage> MemoryManager::allocate_user_physical_page(ShouldZeroFill s
     dbg() << "MM: allocate_user_physical_page vending " << page->paddr();
 #endif
 
-    if (should_zero_fill == ShouldZeroFill::Yes) {
-        auto* ptr = quickmap_page(*page);
-        memset(ptr, 0, PAGE_SIZE);
-        unquickmap_page();
-    }
-
     if (did_purge)
         *did_purge = purged_pages;
     return page;
@@ -686,7 +863,7 @@ void MemoryManager::enter_process_paging_scope(Process& process)
     ScopedSpinLock lock(s_mm_lock);
 
     current_thread->tss().cr3 = process.page_directory().cr3();
-    write_cr3(process.page_directory().cr3());
+    Processor::current().load_page_directory(process.page_directory().cr3(), &process.page_directory());
 }
 
 void MemoryManager::flush_tlb_local(VirtualAddress vaddr, size_t page_count)
@@ -702,6 +879,11 @@ void MemoryManager::flush_tlb(const PageDirectory* page_directory, VirtualAddres
 #ifdef MM_DEBUG
     dbg() << "MM: Flush " << page_count << " pages at " << vaddr;
 #endif
+    auto* current_thread = Thread::current();
+    if (current_thread && current_thread->tlb_shootdown_batch() && !Processor::current().in_irq()) {
+        current_thread->tlb_shootdown_batch()->add(page_directory, vaddr, page_count);
+        return;
+    }
     Processor::flush_tlb(page_directory, vaddr, page_count);
 }
 
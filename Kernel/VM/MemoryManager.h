@@ -81,6 +81,7 @@ extern RecursiveSpinLock s_mm_lock;
 
 class MemoryManager {
     AK_MAKE_ETERNAL
+    friend class PageCache;
     friend class PageDirectory;
     friend class PhysicalPage;
     friend class PhysicalRegion;
@@ -115,12 +116,17 @@ public:
     bool commit_user_physical_pages(size_t);
     void uncommit_user_physical_pages(size_t);
     NonnullRefPtr<PhysicalPage> allocate_committed_user_physical_page(ShouldZeroFill = ShouldZeroFill::Yes);
+    NonnullRefPtrVector<PhysicalPage> allocate_committed_contiguous_user_physical_pages(size_t count);
     RefPtr<PhysicalPage> allocate_user_physical_page(ShouldZeroFill = ShouldZeroFill::Yes, bool* did_purge = nullptr);
     RefPtr<PhysicalPage> allocate_supervisor_physical_page();
     NonnullRefPtrVector<PhysicalPage> allocate_contiguous_supervisor_physical_pages(size_t size);
     void deallocate_user_physical_page(const PhysicalPage&);
     void deallocate_supervisor_physical_page(const PhysicalPage&);
 
+    // Moves one free user page into the pool of pre-zeroed pages.
+    // Returns false once the pool is full or there are no free pages left.
+    bool zero_one_free_user_physical_page();
+
     OwnPtr<Region> allocate_contiguous_kernel_region(size_t, const StringView& name, u8 access, bool user_accessible = false, bool cacheable = true);
     OwnPtr<Region> allocate_kernel_region(size_t, const StringView& name, u8 access, bool user_accessible = false, AllocationStrategy strategy = AllocationStrategy::Reserve, bool cacheable = true);
     OwnPtr<Region> allocate_kernel_region(PhysicalAddress, size_t, const StringView& name, u8 access, bool user_accessible = false, bool cacheable = true);
@@ -133,6 +139,8 @@ public:
     unsigned user_physical_pages_used() const { return m_user_physical_pages_used; }
     unsigned super_physical_pages() const { return m_super_physical_pages; }
     unsigned super_physical_pages_used() const { return m_super_physical_pages_used; }
+    unsigned large_page_mappings() const { return m_large_page_mappings; }
+    unsigned large_page_splits() const { return m_large_page_splits; }
 
     template<typename Callback>
     static void for_each_vmobject(Callback callback)
@@ -191,7 +199,9 @@ private:
 
     static Region* find_region_from_vaddr(VirtualAddress);
 
-    RefPtr<PhysicalPage> find_free_user_physical_page(bool);
+    RefPtr<PhysicalPage> find_free_user_physical_page(bool, ShouldZeroFill);
+    RefPtr<PhysicalPage> take_free_user_physical_page_from_regions();
+    RefPtr<PhysicalPage> take_zeroed_user_physical_page();
     u8* quickmap_page(PhysicalPage&);
     void unquickmap_page();
 
@@ -201,6 +211,9 @@ private:
     PageTableEntry* pte(PageDirectory&, VirtualAddress);
     PageTableEntry* ensure_pte(PageDirectory&, VirtualAddress);
     void release_pte(PageDirectory&, VirtualAddress, bool);
+    void release_page_table(PageDirectory&, FlatPtr base);
+    PageDirectoryEntry& ensure_large_pde(PageDirectory&, VirtualAddress);
+    bool split_large_pde(PageDirectory&, VirtualAddress);
 
     RefPtr<PageDirectory> m_kernel_page_directory;
     RefPtr<PhysicalPage> m_low_page_table;
@@ -214,6 +227,13 @@ private:
     unsigned m_user_physical_pages_uncommitted { 0 };
     unsigned m_super_physical_pages { 0 };
     unsigned m_super_physical_pages_used { 0 };
+    unsigned m_large_page_mappings { 0 };
+    unsigned m_large_page_splits { 0 };
+
+    // Free pages that have already been zeroed, so that the page fault path
+    // usually doesn't have to. They still count as free (and uncommitted).
+    static constexpr size_t zeroed_user_physical_page_pool_size = 256;
+    NonnullRefPtrVector<PhysicalPage> m_zeroed_user_physical_pages;
 
     NonnullRefPtrVector<PhysicalRegion> m_user_physical_regions;
     NonnullRefPtrVector<PhysicalRegion> m_super_physical_regions;
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Singleton.h>
+#include <Kernel/FileSystem/FileDescription.h>
+#include <Kernel/FileSystem/Inode.h>
+#include <Kernel/KBuffer.h>
+#include <Kernel/Tasks/ReadaheadTask.h>
+#include <Kernel/Thread.h>
+#include <Kernel/VM/MemoryManager.h>
+#include <Kernel/VM/PageCache.h>
+
+//#define PAGE_CACHE_DEBUG
+
+namespace Kernel {
+
+static AK::Singleton<PageCache> s_the;
+
+PageCache& PageCache::the()
+{
+    return *s_the;
+}
+
+PageCache::PageCache()
+{
+}
+
+bool PageCache::is_enabled_for(const Inode& inode)
+{
+    return inode.fs().supports_page_cache() && inode.metadata().is_regular_file();
+}
+
+RefPtr<PhysicalPage> PageCache::find(InodeIdentifier inode, size_t page_index)
+{
+    ScopedSpinLock lock(m_lock);
+    auto it = m_inodes.find(inode);
+    if (it == m_inodes.end())
+        return nullptr;
+    auto page_it = it->value->find(page_index);
+    if (page_it == it->value->end())
+        return nullptr;
+    auto& entry = *page_it->value;
+    m_lru_list.prepend(entry);
+    return entry.page;
+}
+
+bool PageCache::contains(InodeIdentifier inode, size_t page_index)
+{
+    ScopedSpinLock lock(m_lock);
+    auto it = m_inodes.find(inode);
+    return it != m_inodes.end() && it->value->contains(page_index);
+}
+
+NonnullRefPtr<PhysicalPage> PageCache::add(InodeIdentifier inode, size_t page_index, NonnullRefPtr<PhysicalPage>&& page)
+{
+    ScopedSpinLock lock(m_lock);
+    auto& pages = m_inodes.ensure(inode);
+    if (!pages)
+        pages = make<InodePages>();
+    if (auto it = pages->find(page_index); it != pages->end()) {
+        // Someone else filled this page while we were reading it, use theirs.
+        // Our page is released by the caller after we drop m_lock.
+        return it->value->page;
+    }
+    auto entry = make<Entry>(Entry { {}, inode, page_index, move(page) });
+    m_lru_list.prepend(*entry);
+    auto result = entry->page;
+    pages->set(page_index, move(entry));
+    ++m_page_count;
+    return result;
+}
+
+KResultOr<NonnullRefPtr<PhysicalPage>> PageCache::get_or_fill(Inode& inode, size_t page_index, FileDescription* description)
+{
+    if (auto page = find(inode.identifier(), page_index))
+        return page.release_nonnull();
+
+    // Hold the inode lock while filling so a concurrent write can't invalidate
+    // the range between us reading the old contents and adding them to the cache.
+    LOCKER(inode.m_lock);
+    if (auto page = find(inode.identifier(), page_index))
+        return page.release_nonnull();
+
+    u8 page_buffer[PAGE_SIZE];
+    auto buffer = UserOrKernelBuffer::for_kernel_buffer(page_buffer);
+    auto nread = inode.read_bytes(page_index * PAGE_SIZE, PAGE_SIZE, buffer, description);
+    if (nread < 0)
+        return KResult(nread);
+    if (nread < PAGE_SIZE) {
+        // If we read less than a page, zero out the rest to avoid leaking uninitialized data.
+        memset(page_buffer + nread, 0, PAGE_SIZE - nread);
+    }
+    return add_from_buffer(inode.identifier(), page_index, page_buffer);
+}
+
+KResultOr<NonnullRefPtr<PhysicalPage>> PageCache::add_from_buffer(InodeIdentifier inode, size_t page_index, const u8* data)
+{
+    auto page = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+    if (!page)
+        return KResult(-ENOMEM);
+    {
+        InterruptDisabler disabler;
+        u8* dest_ptr = MM.quickmap_page(*page);
+        memcpy(dest_ptr, data, PAGE_SIZE);
+        MM.unquickmap_page();
+    }
+
+#ifdef PAGE_CACHE_DEBUG
+    dbg() << "PageCache: Filled page " << page_index << " of inode " << inode << " into " << page->paddr();
+#endif
+    return add(inode, page_index, page.release_nonnull());
+}
+
+void PageCache::fill_range(Inode& inode, size_t first_page_index, size_t page_count)
+{
+    size_t file_page_count = ceil_div(inode.size(), static_cast<size_t>(PAGE_SIZE));
+    if (first_page_index >= file_page_count)
+        return;
+    size_t end_page_index = min(first_page_index + page_count, file_page_count);
+
+    // Read chunks of uncached pages with one read_bytes() call each, so the file system
+    // can coalesce contiguous blocks. The inode lock is dropped between chunks so a reader
+    // that catches up only has to wait for the chunk containing its page.
+    constexpr size_t max_chunk_pages = 8;
+    auto chunk_buffer = KBuffer::try_create_with_size(max_chunk_pages * PAGE_SIZE, Region::Access::Read | Region::Access::Write, "PageCache readahead");
+    if (!chunk_buffer)
+        return;
+
+    size_t page_index = first_page_index;
+    while (page_index < end_page_index) {
+        LOCKER(inode.m_lock);
+        while (page_index < end_page_index && contains(inode.identifier(), page_index))
+            ++page_index;
+        size_t chunk_pages = 0;
+        while (page_index + chunk_pages < end_page_index && chunk_pages < max_chunk_pages && !contains(inode.identifier(), page_index + chunk_pages))
+            ++chunk_pages;
+        if (!chunk_pages)
+            break;
+
+        auto buffer = UserOrKernelBuffer::for_kernel_buffer(chunk_buffer->data());
+        auto nread = inode.read_bytes(page_index * PAGE_SIZE, chunk_pages * PAGE_SIZE, buffer, nullptr);
+        if (nread <= 0)
+            return;
+        if (static_cast<size_t>(nread) < chunk_pages * PAGE_SIZE)
+            memset(chunk_buffer->data() + nread, 0, chunk_pages * PAGE_SIZE - nread);
+        for (size_t i = 0; i < chunk_pages; ++i) {
+            if (add_from_buffer(inode.identifier(), page_index + i, chunk_buffer->data() + i * PAGE_SIZE).is_error())
+                return;
+        }
+        page_index += chunk_pages;
+    }
+}
+
+void PageCache::start_readahead(Inode& inode, FileDescription& description, off_t offset, size_t nread)
+{
+    size_t file_page_count = ceil_div(inode.size(), static_cast<size_t>(PAGE_SIZE));
+    size_t issued_until;
+    size_t end_page_index;
+    {
+        ScopedSpinLock lock(description.readahead_lock());
+        size_t window = description.update_readahead_window(offset, nread);
+        if (!window)
+            return;
+
+        // Only issue more once the reader has used up half of what's already been
+        // issued, so the readahead task works on sizable chunks ahead of the reader.
+        size_t next_page_index = (offset + nread) / PAGE_SIZE;
+        issued_until = max(description.readahead_issued_until(), next_page_index);
+        if (issued_until >= next_page_index + window / 2)
+            return;
+
+        end_page_index = min(next_page_index + window, file_page_count);
+        if (end_page_index <= issued_until)
+            return;
+        description.set_readahead_issued_until(end_page_index);
+    }
+
+#ifdef PAGE_CACHE_DEBUG
+    dbg() << "PageCache: Readahead of pages " << issued_until << "-" << end_page_index << " of inode " << inode.identifier();
+#endif
+    ReadaheadTask::queue(inode, issued_until, end_page_index - issued_until);
+}
+
+ssize_t PageCache::read(Inode& inode, off_t offset, ssize_t count, UserOrKernelBuffer& buffer, FileDescription* description)
+{
+    ASSERT(offset >= 0);
+    ASSERT(count >= 0);
+    size_t size = inode.size();
+    if (static_cast<size_t>(offset) >= size)
+        return 0;
+    size_t remaining = min(static_cast<size_t>(count), size - offset);
+
+    u8 page_buffer[PAGE_SIZE];
+    ssize_t nread = 0;
+    while (remaining) {
+        size_t page_index = (offset + nread) / PAGE_SIZE;
+        size_t offset_in_page = (offset + nread) % PAGE_SIZE;
+        size_t chunk_size = min(PAGE_SIZE - offset_in_page, remaining);
+
+        auto page_or_error = get_or_fill(inode, page_index, description);
+        if (page_or_error.is_error()) {
+            if (nread)
+                return nread;
+            return page_or_error.error();
+        }
+
+        // Copy through a bounce buffer, the destination may be user memory that faults.
+        {
+            InterruptDisabler disabler;
+            u8* src_ptr = MM.quickmap_page(page_or_error.value());
+            memcpy(page_buffer, src_ptr + offset_in_page, chunk_size);
+            MM.unquickmap_page();
+        }
+        if (!buffer.write(page_buffer, nread, chunk_size))
+            return -EFAULT;
+
+        nread += chunk_size;
+        remaining -= chunk_size;
+    }
+
+    if (description)
+        start_readahead(inode, *description, offset, nread);
+    return nread;
+}
+
+void PageCache::invalidate(InodeIdentifier inode, size_t first_page_index, size_t page_count)
+{
+    // Pages are released after m_lock is dropped, since releasing a page takes the MM lock.
+    Vector<NonnullOwnPtr<Entry>, 16> invalidated_entries;
+    {
+        ScopedSpinLock lock(m_lock);
+        auto it = m_inodes.find(inode);
+        if (it == m_inodes.end())
+            return;
+        auto& pages = *it->value;
+        Vector<size_t, 16> page_indices;
+        for (auto& page_it : pages) {
+            if (page_it.key >= first_page_index && page_it.key - first_page_index < page_count)
+                page_indices.append(page_it.key);
+        }
+        for (auto page_index : page_indices) {
+            auto page_it = pages.find(page_index);
+            m_lru_list.remove(*page_it->value);
+            invalidated_entries.append(move(page_it->value));
+            pages.remove(page_it);
+        }
+        m_page_count -= invalidated_entries.size();
+        if (pages.is_empty())
+            m_inodes.remove(it);
+    }
+#ifdef PAGE_CACHE_DEBUG
+    if (!invalidated_entries.is_empty())
+        dbg() << "PageCache: Invalidated " << invalidated_entries.size() << " pages of inode " << inode;
+#endif
+}
+
+void PageCache::remove_inode(InodeIdentifier inode)
+{
+    invalidate(inode);
+}
+
+void PageCache::remove_fs(u32 fsid)
+{
+    Vector<InodeIdentifier> inodes;
+    {
+        ScopedSpinLock lock(m_lock);
+        for (auto& it : m_inodes) {
+            if (it.key.fsid() == fsid)
+                inodes.append(it.key);
+        }
+    }
+    for (auto inode : inodes)
+        invalidate(inode);
+}
+
+size_t PageCache::evict(size_t page_count)
+{
+    Vector<NonnullOwnPtr<Entry>, 32> evicted_entries;
+    {
+        ScopedSpinLock lock(m_lock);
+        // Walk from the least recently used end. Pages that are still referenced
+        // elsewhere (e.g. mapped by an InodeVMObject) can't be freed, so they are
+        // moved to the front instead, giving each page at most one look per call.
+        for (size_t i = m_page_count; i && evicted_entries.size() < page_count; --i) {
+            auto* entry = m_lru_list.take_last();
+            if (entry->page->ref_count() != 1) {
+                m_lru_list.prepend(*entry);
+                continue;
+            }
+            auto it = m_inodes.find(entry->inode);
+            ASSERT(it != m_inodes.end());
+            auto& pages = *it->value;
+            auto page_it = pages.find(entry->page_index);
+            evicted_entries.append(move(page_it->value));
+            pages.remove(page_it);
+            if (pages.is_empty())
+                m_inodes.remove(it);
+        }
+        m_page_count -= evicted_entries.size();
+    }
+#ifdef PAGE_CACHE_DEBUG
+    dbg() << "PageCache: Evicted " << evicted_entries.size() << " pages";
+#endif
+    return evicted_entries.size();
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/HashMap.h>
+#include <AK/IntrusiveList.h>
+#include <AK/NumericLimits.h>
+#include <AK/OwnPtr.h>
+#include <Kernel/FileSystem/FileSystem.h>
+#include <Kernel/FileSystem/InodeIdentifier.h>
+#include <Kernel/SpinLock.h>
+#include <Kernel/VM/PhysicalPage.h>
+
+namespace Kernel {
+
+// The page cache holds file contents keyed by (inode, page index), for file systems
+// that opt in via FS::supports_page_cache(). Both read() and inode faults go through
+// it, so a file that is read and mmap()'d at the same time is only cached once.
+// Pages that nobody else references are kept in LRU order and evicted when
+// the MemoryManager runs out of user physical pages.
+class PageCache {
+    AK_MAKE_NONCOPYABLE(PageCache);
+    AK_MAKE_NONMOVABLE(PageCache);
+
+public:
+    static PageCache& the();
+
+    static constexpr size_t readahead_initial_window_pages = 4;
+    static constexpr size_t readahead_max_window_pages = 32;
+
+    PageCache();
+
+    static bool is_enabled_for(const Inode&);
+
+    ssize_t read(Inode&, off_t, ssize_t, UserOrKernelBuffer&, FileDescription*);
+    KResultOr<NonnullRefPtr<PhysicalPage>> get_or_fill(Inode&, size_t page_index, FileDescription*);
+    // Only looks, never reads: returns null if the page isn't cached.
+    RefPtr<PhysicalPage> find(InodeIdentifier, size_t page_index);
+    void fill_range(Inode&, size_t first_page_index, size_t page_count);
+
+    void invalidate(InodeIdentifier, size_t first_page_index = 0, size_t page_count = NumericLimits<size_t>::max());
+    void remove_inode(InodeIdentifier);
+    void remove_fs(u32 fsid);
+
+    size_t evict(size_t page_count);
+
+    size_t page_count() const { return m_page_count; }
+
+private:
+    struct Entry {
+        IntrusiveListNode lru_list_node;
+        InodeIdentifier inode;
+        size_t page_index { 0 };
+        NonnullRefPtr<PhysicalPage> page;
+    };
+    using InodePages = HashMap<size_t, NonnullOwnPtr<Entry>>;
+
+    NonnullRefPtr<PhysicalPage> add(InodeIdentifier, size_t page_index, NonnullRefPtr<PhysicalPage>&&);
+    bool contains(InodeIdentifier, size_t page_index);
+    KResultOr<NonnullRefPtr<PhysicalPage>> add_from_buffer(InodeIdentifier, size_t page_index, const u8* data);
+    void start_readahead(Inode&, FileDescription&, off_t offset, size_t nread);
+
+    SpinLock<u8> m_lock;
+    HashMap<InodeIdentifier, OwnPtr<InodePages>> m_inodes;
+    IntrusiveList<Entry, &Entry::lru_list_node> m_lru_list;
+    size_t m_page_count { 0 };
+};
+
+}
@@ -26,6 +26,7 @@
 
 #pragma once
 
+#include <AK/Atomic.h>
 #include <AK/HashMap.h>
 #include <AK/RefCounted.h>
 #include <AK/RefPtr.h>
@@ -38,6 +39,7 @@ class Process;
 
 class PageDirectory : public RefCounted<PageDirectory> {
     friend class MemoryManager;
+    friend class Processor;
 
 public:
     static RefPtr<PageDirectory> create_for_userspace(Process& process, const RangeAllocator* parent_range_allocator = nullptr)
@@ -62,6 +64,9 @@ public:
 
     RecursiveSpinLock& get_lock() { return m_lock; }
 
+    // Bitmask of the processors that currently have this page directory loaded.
+    u32 active_processors() const { return m_active_processors.load(); }
+
 private:
     PageDirectory(Process&, const RangeAllocator* parent_range_allocator);
     PageDirectory();
@@ -73,6 +78,7 @@ private:
     RefPtr<PhysicalPage> m_directory_pages[4];
     HashMap<u32, RefPtr<PhysicalPage>> m_page_tables;
     RecursiveSpinLock m_lock;
+    Atomic<u32> m_active_processors { 0 };
 };
 
 }
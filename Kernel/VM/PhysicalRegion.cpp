@@ -43,7 +43,6 @@ NonnullRefPtr<PhysicalRegion> PhysicalRegion::create(PhysicalAddress lower, Phys
 PhysicalRegion::PhysicalRegion(PhysicalAddress lower, PhysicalAddress upper)
     : m_lower(lower)
     , m_upper(upper)
-    , m_bitmap(Bitmap::create())
 {
 }
 
@@ -60,39 +59,112 @@ unsigned PhysicalRegion::finalize_capacity()
     ASSERT(!m_pages);
 
     m_pages = (m_upper.get() - m_lower.get()) / PAGE_SIZE;
-    m_bitmap.grow(m_pages, false);
+    m_first_pfn = m_lower.get() / PAGE_SIZE;
+    m_end_pfn = m_first_pfn + m_pages;
+
+    for (size_t order = 0; order <= max_order; ++order) {
+        size_t block_count = m_pages ? block_index(m_end_pfn - 1, order) + 1 : 1;
+        // Bitmap only scans whole words, so keep the bits past the end around (and unset).
+        m_free_blocks.append(Bitmap::create(round_up_to_power_of_two(block_count, 32), false));
+    }
+    free_range(m_first_pfn, m_pages);
 
     return size();
 }
 
-NonnullRefPtrVector<PhysicalPage> PhysicalRegion::take_contiguous_free_pages(size_t count, bool supervisor)
+bool PhysicalRegion::is_free_block(size_t pfn, size_t order) const
 {
-    ASSERT(m_pages);
-    ASSERT(m_used != m_pages);
+    return m_free_blocks[order].get(block_index(pfn, order));
+}
 
-    NonnullRefPtrVector<PhysicalPage> physical_pages;
-    physical_pages.ensure_capacity(count);
+void PhysicalRegion::set_free_block(size_t pfn, size_t order, bool free)
+{
+    ASSERT(is_free_block(pfn, order) != free);
+    m_free_blocks[order].set(block_index(pfn, order), free);
+    if (free) {
+        ++m_free_block_count[order];
+        m_free_block_hint[order] = block_index(pfn, order);
+    } else {
+        --m_free_block_count[order];
+    }
+}
 
-    auto first_contiguous_page = find_contiguous_free_pages(count);
+Optional<size_t> PhysicalRegion::take_block(size_t order)
+{
+    for (size_t available_order = order; available_order <= max_order; ++available_order) {
+        if (!m_free_block_count[available_order])
+            continue;
+        auto index = m_free_blocks[available_order].find_one_anywhere_set(m_free_block_hint[available_order]);
+        ASSERT(index.has_value());
+        size_t pfn = (index.value() + (m_first_pfn >> available_order)) << available_order;
+        set_free_block(pfn, available_order, false);
+
+        // Split the block, handing the upper halves back to the smaller orders.
+        while (available_order > order) {
+            --available_order;
+            set_free_block(pfn + (1u << available_order), available_order, true);
+        }
+        return pfn;
+    }
+    return {};
+}
 
-    for (size_t index = 0; index < count; index++)
-        physical_pages.append(PhysicalPage::create(m_lower.offset(PAGE_SIZE * (index + first_contiguous_page)), supervisor));
-    return physical_pages;
+void PhysicalRegion::free_block(size_t pfn, size_t order)
+{
+    for (; order < max_order; ++order) {
+        size_t buddy_pfn = pfn ^ (1u << order);
+        if (buddy_pfn < m_first_pfn || buddy_pfn + (1u << order) > m_end_pfn)
+            break;
+        if (!is_free_block(buddy_pfn, order))
+            break;
+        set_free_block(buddy_pfn, order, false);
+        pfn &= ~(1u << order);
+    }
+    set_free_block(pfn, order, true);
+}
+
+void PhysicalRegion::free_range(size_t pfn, size_t count)
+{
+    // Hand the range back as the largest naturally aligned blocks that fit.
+    while (count) {
+        size_t order = 0;
+        while (order < max_order && !(pfn & (1u << order)) && (2u << order) <= count)
+            ++order;
+        free_block(pfn, order);
+        pfn += 1u << order;
+        count -= 1u << order;
+    }
 }
 
-unsigned PhysicalRegion::find_contiguous_free_pages(size_t count)
+NonnullRefPtrVector<PhysicalPage> PhysicalRegion::take_contiguous_free_pages(size_t count, bool supervisor)
 {
+    ASSERT(m_pages);
     ASSERT(count != 0);
-    // search from the last page we allocated
-    auto range = find_and_allocate_contiguous_range(count);
-    ASSERT(range.has_value());
-    return range.value();
+
+    size_t order = 0;
+    while ((1u << order) < count)
+        ++order;
+    if (order > max_order || m_pages - m_used < count)
+        return {};
+
+    auto first_pfn = take_block(order);
+    if (!first_pfn.has_value())
+        return {};
+    // Give back whatever we rounded up to reach a power of two.
+    free_range(first_pfn.value() + count, (1u << order) - count);
+    m_used += count;
+
+    NonnullRefPtrVector<PhysicalPage> physical_pages;
+    physical_pages.ensure_capacity(count);
+    for (size_t index = 0; index < count; index++)
+        physical_pages.append(PhysicalPage::create(PhysicalAddress((first_pfn.value() + index) * PAGE_SIZE), supervisor));
+    return physical_pages;
 }
 
 Optional<unsigned> PhysicalRegion::find_one_free_page()
 {
     if (m_used == m_pages) {
-        // We know we don't have any free pages, no need to check the bitmap
+        // We know we don't have any free pages, no need to check the buddy allocator
         // Check if we can draw one from the return queue
         if (m_recently_returned.size() > 0) {
             u8 index = get_fast_random<u8>() % m_recently_returned.size();
@@ -105,37 +177,12 @@ Optional<unsigned> PhysicalRegion::find_one_free_page()
         }
         return {};
     }
-    auto free_index = m_bitmap.find_one_anywhere_unset(m_free_hint);
-    if (!free_index.has_value())
+    auto pfn = take_block(0);
+    if (!pfn.has_value())
         return {};
 
-    auto page_index = free_index.value();
-    m_bitmap.set(page_index, true);
     m_used++;
-    m_free_hint = free_index.value() + 1; // Just a guess
-    if (m_free_hint >= m_bitmap.size())
-        m_free_hint = 0;
-    return page_index;
-}
-
-Optional<unsigned> PhysicalRegion::find_and_allocate_contiguous_range(size_t count)
-{
-    ASSERT(count != 0);
-    size_t found_pages_count = 0;
-    auto first_index = m_bitmap.find_longest_range_of_unset_bits(count, found_pages_count);
-    if (!first_index.has_value())
-        return {};
-
-    auto page = first_index.value();
-    if (count == found_pages_count) {
-        m_bitmap.set_range<true>(page, count);
-        m_used += count;
-        m_free_hint = first_index.value() + count + 1; // Just a guess
-        if (m_free_hint >= m_bitmap.size())
-            m_free_hint = 0;
-        return page;
-    }
-    return {};
+    return pfn.value() - m_first_pfn;
 }
 
 RefPtr<PhysicalPage> PhysicalRegion::take_free_page(bool supervisor)
@@ -163,8 +210,7 @@ void PhysicalRegion::free_page_at(PhysicalAddress addr)
     ASSERT(local_offset.value() < (FlatPtr)(m_pages * PAGE_SIZE));
 
     auto page = local_offset.value() / PAGE_SIZE;
-    m_bitmap.set(page, false);
-    m_free_hint = page; // We know we can find one here for sure
+    free_block(m_first_pfn + page, 0);
     m_used--;
 }
 
@@ -34,10 +34,16 @@
 
 namespace Kernel {
 
+// Free pages are handed out by a binary buddy allocator: a free block of
+// 2^order pages always starts at a page frame number that is a multiple of
+// 2^order, and is merged with its equally sized neighbour (its "buddy") as
+// soon as both are free.
 class PhysicalRegion : public RefCounted<PhysicalRegion> {
     AK_MAKE_ETERNAL
 
 public:
+    static constexpr size_t max_order = 10;
+
     static NonnullRefPtr<PhysicalRegion> create(PhysicalAddress lower, PhysicalAddress upper);
     ~PhysicalRegion() { }
 
@@ -56,19 +62,27 @@ public:
     void return_page(const PhysicalPage& page);
 
 private:
-    unsigned find_contiguous_free_pages(size_t count);
-    Optional<unsigned> find_and_allocate_contiguous_range(size_t count);
     Optional<unsigned> find_one_free_page();
     void free_page_at(PhysicalAddress addr);
 
+    size_t block_index(size_t pfn, size_t order) const { return (pfn >> order) - (m_first_pfn >> order); }
+    bool is_free_block(size_t pfn, size_t order) const;
+    void set_free_block(size_t pfn, size_t order, bool);
+    Optional<size_t> take_block(size_t order);
+    void free_block(size_t pfn, size_t order);
+    void free_range(size_t pfn, size_t count);
+
     PhysicalRegion(PhysicalAddress lower, PhysicalAddress upper);
 
     PhysicalAddress m_lower;
     PhysicalAddress m_upper;
     unsigned m_pages { 0 };
     unsigned m_used { 0 };
-    Bitmap m_bitmap;
-    size_t m_free_hint { 0 };
+    size_t m_first_pfn { 0 };
+    size_t m_end_pfn { 0 };
+    Vector<Bitmap, max_order + 1> m_free_blocks;
+    size_t m_free_block_count[max_order + 1] {};
+    size_t m_free_block_hint[max_order + 1] {};
     Vector<PhysicalAddress, 256> m_recently_returned;
 };
 
@@ -32,7 +32,11 @@ namespace Kernel {
 ProcessPagingScope::ProcessPagingScope(Process& process)
 {
     ASSERT(Thread::current() != nullptr);
-    m_previous_cr3 = read_cr3();
+    {
+        InterruptDisabler disabler;
+        m_previous_cr3 = read_cr3();
+        m_previous_page_directory = Processor::current().active_page_directory();
+    }
     MM.enter_process_paging_scope(process);
 }
 
@@ -40,7 +44,7 @@ ProcessPagingScope::~ProcessPagingScope()
 {
     InterruptDisabler disabler;
     Thread::current()->tss().cr3 = m_previous_cr3;
-    write_cr3(m_previous_cr3);
+    Processor::current().load_page_directory(m_previous_cr3, m_previous_page_directory);
 }
 
 }
@@ -38,6 +38,7 @@ public:
 
 private:
     u32 m_previous_cr3 { 0 };
+    PageDirectory* m_previous_page_directory { nullptr };
 };
 
 }
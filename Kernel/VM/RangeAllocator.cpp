@@ -24,8 +24,6 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <AK/BinarySearch.h>
-#include <AK/QuickSort.h>
 #include <Kernel/Random.h>
 #include <Kernel/Thread.h>
 #include <Kernel/VM/RangeAllocator.h>
@@ -42,7 +40,7 @@ RangeAllocator::RangeAllocator()
 void RangeAllocator::initialize_with_range(VirtualAddress base, size_t size)
 {
     m_total_range = { base, size };
-    m_available_ranges.append({ base, size });
+    m_available_ranges.insert(base.get(), Range { base, size });
 #ifdef VRA_DEBUG
     ScopedSpinLock lock(m_lock);
     dump();
@@ -86,14 +84,14 @@ Vector<Range, 2> Range::carve(const Range& taken)
     return parts;
 }
 
-void RangeAllocator::carve_at_index(int index, const Range& range)
+void RangeAllocator::carve_from_range(Range from, const Range& range)
 {
     ASSERT(m_lock.is_locked());
-    auto remaining_parts = m_available_ranges[index].carve(range);
+    auto remaining_parts = from.carve(range);
     ASSERT(remaining_parts.size() >= 1);
-    m_available_ranges[index] = remaining_parts[0];
-    if (remaining_parts.size() == 2)
-        m_available_ranges.insert(index + 1, move(remaining_parts[1]));
+    m_available_ranges.remove(from.base().get());
+    for (auto& part : remaining_parts)
+        m_available_ranges.insert(part.base().get(), part);
 }
 
 Range RangeAllocator::allocate_anywhere(size_t size, size_t alignment)
@@ -111,8 +109,7 @@ Range RangeAllocator::allocate_anywhere(size_t size, size_t alignment)
 #endif
 
     ScopedSpinLock lock(m_lock);
-    for (size_t i = 0; i < m_available_ranges.size(); ++i) {
-        auto& available_range = m_available_ranges[i];
+    for (auto& available_range : m_available_ranges) {
         // FIXME: This check is probably excluding some valid candidates when using a large alignment.
         if (available_range.size() < (effective_size + alignment))
             continue;
@@ -125,10 +122,10 @@ Range RangeAllocator::allocate_anywhere(size_t size, size_t alignment)
 #ifdef VRA_DEBUG
             dbg() << "VRA: Allocated perfect-fit anywhere(" << String::format("%zu", size) << ", " << String::format("%zu", alignment) << "): " << String::format("%x", allocated_range.base().get());
 #endif
-            m_available_ranges.remove(i);
+            m_available_ranges.remove(available_range.base().get());
             return allocated_range;
         }
-        carve_at_index(i, allocated_range);
+        carve_from_range(available_range, allocated_range);
 #ifdef VRA_DEBUG
         dbg() << "VRA: Allocated anywhere(" << String::format("%zu", size) << ", " << String::format("%zu", alignment) << "): " << String::format("%x", allocated_range.base().get());
         dump();
@@ -146,23 +143,21 @@ Range RangeAllocator::allocate_specific(VirtualAddress base, size_t size)
 
     Range allocated_range(base, size);
     ScopedSpinLock lock(m_lock);
-    for (size_t i = 0; i < m_available_ranges.size(); ++i) {
-        auto& available_range = m_available_ranges[i];
-        if (!available_range.contains(base, size))
-            continue;
-        if (available_range == allocated_range) {
-            m_available_ranges.remove(i);
-            return allocated_range;
-        }
-        carve_at_index(i, allocated_range);
-#ifdef VRA_DEBUG
-        dbg() << "VRA: Allocated specific(" << size << "): " << String::format("%x", available_range.base().get());
-        dump();
-#endif
+    auto* available_range = m_available_ranges.find_largest_not_above(base.get());
+    if (!available_range || !available_range->contains(base, size)) {
+        dbg() << "VRA: Failed to allocate specific range: " << base << "(" << size << ")";
+        return {};
+    }
+    if (*available_range == allocated_range) {
+        m_available_ranges.remove(base.get());
         return allocated_range;
     }
-    dbg() << "VRA: Failed to allocate specific range: " << base << "(" << size << ")";
-    return {};
+    carve_from_range(*available_range, allocated_range);
+#ifdef VRA_DEBUG
+    dbg() << "VRA: Allocated specific(" << size << "): " << String::format("%x", allocated_range.base().get());
+    dump();
+#endif
+    return allocated_range;
 }
 
 void RangeAllocator::deallocate(Range range)
@@ -177,36 +172,16 @@ void RangeAllocator::deallocate(Range range)
     dump();
 #endif
 
-    ASSERT(!m_available_ranges.is_empty());
-
-    size_t nearby_index = 0;
-    auto* existing_range = binary_search(
-        m_available_ranges.span(),
-        range,
-        &nearby_index,
-        [](auto& a, auto& b) { return a.base().get() - b.end().get(); });
-
-    size_t inserted_index = 0;
-    if (existing_range) {
-        existing_range->m_size += range.size();
-        inserted_index = nearby_index;
-    } else {
-        m_available_ranges.insert_before_matching(
-            Range(range), [&](auto& entry) {
-                return entry.base() >= range.end();
-            },
-            nearby_index, &inserted_index);
-    }
+    Range* inserted_range = m_available_ranges.find_largest_not_above(range.base().get());
+    if (inserted_range && inserted_range->end() == range.base())
+        inserted_range->m_size += range.size();
+    else
+        inserted_range = &m_available_ranges.insert(range.base().get(), range);
 
-    if (inserted_index < (m_available_ranges.size() - 1)) {
-        // We already merged with previous. Try to merge with next.
-        auto& inserted_range = m_available_ranges[inserted_index];
-        auto& next_range = m_available_ranges[inserted_index + 1];
-        if (inserted_range.end() == next_range.base()) {
-            inserted_range.m_size += next_range.size();
-            m_available_ranges.remove(inserted_index + 1);
-            return;
-        }
+    // We already merged with previous. Try to merge with next.
+    if (auto* next_range = m_available_ranges.find(inserted_range->end().get())) {
+        inserted_range->m_size += next_range->size();
+        m_available_ranges.remove(next_range->base().get());
     }
 #ifdef VRA_DEBUG
     dbg() << "VRA: After deallocate";
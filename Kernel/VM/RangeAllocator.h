@@ -26,6 +26,7 @@
 
 #pragma once
 
+#include <AK/RedBlackTree.h>
 #include <AK/String.h>
 #include <AK/Traits.h>
 #include <AK/Vector.h>
@@ -98,9 +99,9 @@ public:
     }
 
 private:
-    void carve_at_index(int, const Range&);
+    void carve_from_range(Range, const Range&);
 
-    Vector<Range> m_available_ranges;
+    RedBlackTree<FlatPtr, Range> m_available_ranges;
     Range m_total_range;
     mutable SpinLock<u8> m_lock;
 };
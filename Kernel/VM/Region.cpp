@@ -31,6 +31,7 @@
 #include <Kernel/Thread.h>
 #include <Kernel/VM/AnonymousVMObject.h>
 #include <Kernel/VM/MemoryManager.h>
+#include <Kernel/VM/PageCache.h>
 #include <Kernel/VM/PageDirectory.h>
 #include <Kernel/VM/Region.h>
 #include <Kernel/VM/SharedInodeVMObject.h>
@@ -259,6 +260,8 @@ NonnullOwnPtr<Region> Region::create_kernel_only(const Range& range, NonnullRefP
 
 bool Region::should_cow(size_t page_index) const
 {
+    if (vmobject().is_private_inode())
+        return static_cast<const InodeVMObject&>(vmobject()).is_shared_with_page_cache(first_page_index() + page_index);
     if (!vmobject().is_anonymous())
         return false;
     return static_cast<const AnonymousVMObject&>(vmobject()).should_cow(first_page_index() + page_index, m_shared);
@@ -303,6 +306,62 @@ bool Region::map_individual_page_impl(size_t page_index)
     return true;
 }
 
+bool Region::can_map_large_page(size_t page_index) const
+{
+    constexpr size_t pages_per_large_page = LARGE_PAGE_SIZE / PAGE_SIZE;
+    if (vaddr_from_page_index(page_index).get() & (LARGE_PAGE_SIZE - 1))
+        return false;
+    if (page_index + pages_per_large_page > page_count())
+        return false;
+    if (!is_readable() && !is_writable())
+        return false;
+    auto* first_page = physical_page(page_index);
+    if (!first_page || (first_page->paddr().get() & (LARGE_PAGE_SIZE - 1)))
+        return false;
+    for (size_t i = 0; i < pages_per_large_page; ++i) {
+        auto* page = physical_page(page_index + i);
+        if (!page || page->paddr() != first_page->paddr().offset(i * PAGE_SIZE))
+            return false;
+        if (page->is_shared_zero_page() || page->is_lazy_committed_page() || should_cow(page_index + i))
+            return false;
+    }
+    return true;
+}
+
+void Region::map_large_page_impl(size_t page_index)
+{
+    ASSERT(m_page_directory->get_lock().own_lock());
+    auto& pde = MM.ensure_large_pde(*m_page_directory, vaddr_from_page_index(page_index));
+    pde.set_page_table_base(physical_page(page_index)->paddr().get());
+    pde.set_huge(true);
+    pde.set_cache_disabled(!m_cacheable);
+    pde.set_writable(is_writable());
+    if (Processor::current().has_feature(CPUFeature::NX))
+        pde.set_execute_disabled(!is_executable());
+    pde.set_user_allowed(is_user_accessible());
+    pde.set_present(true);
+#ifdef MM_DEBUG
+    dbg() << "MM: >> region map large page " << name() << " " << vaddr_from_page_index(page_index) << " => " << physical_page(page_index)->paddr();
+#endif
+}
+
+size_t Region::map_page_range_impl(size_t page_index, size_t page_count)
+{
+    constexpr size_t pages_per_large_page = LARGE_PAGE_SIZE / PAGE_SIZE;
+    size_t index = page_index;
+    while (index < page_index + page_count) {
+        if (index + pages_per_large_page <= page_index + page_count && can_map_large_page(index)) {
+            map_large_page_impl(index);
+            index += pages_per_large_page;
+            continue;
+        }
+        if (!map_individual_page_impl(index))
+            break;
+        index++;
+    }
+    return index - page_index;
+}
+
 bool Region::do_remap_vmobject_page_range(size_t page_index, size_t page_count)
 {
     bool success = true;
@@ -311,16 +370,11 @@ bool Region::do_remap_vmobject_page_range(size_t page_index, size_t page_count)
     if (!translate_vmobject_page_range(page_index, page_count))
         return success; // not an error, region doesn't map this page range
     ScopedSpinLock page_lock(m_page_directory->get_lock());
-    size_t index = page_index;
-    while (index < page_index + page_count) {
-        if (!map_individual_page_impl(index)) {
-            success = false;
-            break;
-        }
-        index++;
-    }
-    if (index > page_index)
-        MM.flush_tlb(m_page_directory, vaddr_from_page_index(page_index), index - page_index);
+    size_t mapped_page_count = map_page_range_impl(page_index, page_count);
+    if (mapped_page_count != page_count)
+        success = false;
+    if (mapped_page_count > 0)
+        MM.flush_tlb(m_page_directory, vaddr_from_page_index(page_index), mapped_page_count);
     return success;
 }
 
@@ -412,12 +466,7 @@ bool Region::map(PageDirectory& page_directory)
 #ifdef MM_DEBUG
     dbg() << "MM: Region::map() will map VMO pages " << first_page_index() << " - " << last_page_index() << " (VMO page count: " << vmobject().page_count() << ")";
 #endif
-    size_t page_index = 0;
-    while (page_index < page_count()) {
-        if (!map_individual_page_impl(page_index))
-            break;
-        ++page_index;
-    }
+    size_t page_index = map_page_range_impl(0, page_count());
     if (page_index > 0) {
         MM.flush_tlb(m_page_directory, vaddr(), page_index);
         return page_index == page_count();
@@ -475,6 +524,8 @@ PageFaultResponse Region::handle_fault(const PageFault& fault)
 #ifdef PAGE_FAULT_DEBUG
         dbg() << "PV(cow) fault in Region{" << this << "}[" << page_index_in_region << "] at " << fault.vaddr();
 #endif
+        if (vmobject().is_inode())
+            return handle_cow_fault(page_index_in_region);
         auto* phys_page = physical_page(page_index_in_region);
         if (phys_page->is_shared_zero_page() || phys_page->is_lazy_committed_page()) {
 #ifdef PAGE_FAULT_DEBUG
@@ -512,6 +563,14 @@ PageFaultResponse Region::handle_zero_fault(size_t page_index_in_region)
         current_thread->did_zero_fault();
 
     if (page_slot->is_lazy_committed_page()) {
+        size_t first_page_index_in_vmobject = 0;
+        if (allocate_committed_large_page(page_index_in_region, first_page_index_in_vmobject)) {
+            if (!remap_vmobject_page_range(first_page_index_in_vmobject, LARGE_PAGE_SIZE / PAGE_SIZE)) {
+                klog() << "MM: handle_zero_fault was unable to allocate a page table to map " << page_slot;
+                return PageFaultResponse::OutOfMemory;
+            }
+            return PageFaultResponse::Continue;
+        }
         page_slot = static_cast<AnonymousVMObject&>(*m_vmobject).allocate_committed_page(page_index_in_vmobject);
 #ifdef PAGE_FAULT_DEBUG
         dbg() << "      >> ALLOCATED COMMITTED " << page_slot->paddr();
@@ -534,6 +593,16 @@ PageFaultResponse Region::handle_zero_fault(size_t page_index_in_region)
     return PageFaultResponse::Continue;
 }
 
+bool Region::allocate_committed_large_page(size_t page_index_in_region, size_t& first_page_index_in_vmobject)
+{
+    // Fill in the whole 2 MiB around the faulting page at once, so it can be mapped as a large page.
+    auto first_vaddr = VirtualAddress(vaddr_from_page_index(page_index_in_region).get() & ~(LARGE_PAGE_SIZE - 1));
+    if (first_vaddr < vaddr() || first_vaddr.offset(LARGE_PAGE_SIZE) > m_range.end())
+        return false;
+    first_page_index_in_vmobject = translate_to_vmobject_page(page_index_from_address(first_vaddr));
+    return static_cast<AnonymousVMObject&>(*m_vmobject).allocate_committed_contiguous_pages(first_page_index_in_vmobject, LARGE_PAGE_SIZE / PAGE_SIZE);
+}
+
 PageFaultResponse Region::handle_cow_fault(size_t page_index_in_region)
 {
     ASSERT_INTERRUPTS_DISABLED();
@@ -541,6 +610,8 @@ PageFaultResponse Region::handle_cow_fault(size_t page_index_in_region)
     if (current_thread)
         current_thread->did_cow_fault();
 
+    if (vmobject().is_private_inode())
+        return handle_page_cache_cow_fault(page_index_in_region);
     if (!vmobject().is_anonymous())
         return PageFaultResponse::ShouldCrash;
 
@@ -551,6 +622,66 @@ PageFaultResponse Region::handle_cow_fault(size_t page_index_in_region)
     return response;
 }
 
+PageFaultResponse Region::handle_page_cache_cow_fault(size_t page_index_in_region)
+{
+    auto& inode_vmobject = static_cast<InodeVMObject&>(vmobject());
+    LOCKER(inode_vmobject.m_paging_lock);
+
+    auto page_index_in_vmobject = translate_to_vmobject_page(page_index_in_region);
+    auto& page_slot = inode_vmobject.physical_pages()[page_index_in_vmobject];
+    // The inode changed under us and dropped the page; page it back in and let the write fault again.
+    if (page_slot.is_null())
+        return handle_inode_fault(page_index_in_region);
+
+    // Someone else may have made the copy while we were waiting for the paging lock.
+    if (inode_vmobject.is_shared_with_page_cache(page_index_in_vmobject)) {
+        // Writes to private mappings must not leak into the cache, so give them a copy now.
+        auto page = MM.allocate_user_physical_page(MemoryManager::ShouldZeroFill::No);
+        if (!page) {
+            klog() << "MM: handle_page_cache_cow_fault was unable to allocate a physical page";
+            return PageFaultResponse::OutOfMemory;
+        }
+        u8 page_buffer[PAGE_SIZE];
+        memcpy(page_buffer, MM.quickmap_page(*page_slot), PAGE_SIZE);
+        MM.unquickmap_page();
+        memcpy(MM.quickmap_page(*page), page_buffer, PAGE_SIZE);
+        MM.unquickmap_page();
+        page_slot = move(page);
+        inode_vmobject.set_shared_with_page_cache(page_index_in_vmobject, false);
+    }
+
+    if (!remap_vmobject_page(page_index_in_vmobject))
+        return PageFaultResponse::OutOfMemory;
+    return PageFaultResponse::Continue;
+}
+
+bool Region::fault_around(size_t page_index_in_vmobject)
+{
+    ASSERT(vmobject().is_inode());
+    auto& inode_vmobject = static_cast<InodeVMObject&>(vmobject());
+    auto& inode = inode_vmobject.inode();
+    size_t window_start = page_index_in_vmobject - page_index_in_vmobject % fault_around_pages;
+    size_t first_index = max(window_start, first_page_index());
+    size_t end_index = min(window_start + fault_around_pages, min(first_page_index() + page_count(), inode_vmobject.page_count()));
+
+    // Only pick up pages that are already cached; anything else is left for
+    // its own fault (and usually for the readahead that is already queued).
+    // Private mappings map them read-only and copy them on their first write.
+    bool is_private = !inode_vmobject.is_shared_inode();
+    for (size_t index = first_index; index < end_index; ++index) {
+        auto& physical_page_entry = inode_vmobject.physical_pages()[index];
+        if (!physical_page_entry.is_null())
+            continue;
+        if (auto cached_page = PageCache::the().find(inode.identifier(), index)) {
+            physical_page_entry = move(cached_page);
+            if (is_private)
+                inode_vmobject.set_shared_with_page_cache(index, true);
+        }
+    }
+
+    return remap_vmobject_page_range(first_index, end_index - first_index);
+}
+
 PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
 {
     ASSERT_INTERRUPTS_DISABLED();
@@ -584,8 +715,25 @@ PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
     dbg() << "MM: page_in_from_inode ready to read from inode";
 #endif
 
-    u8 page_buffer[PAGE_SIZE];
     auto& inode = inode_vmobject.inode();
+    if (PageCache::is_enabled_for(inode)) {
+        auto page_or_error = PageCache::the().get_or_fill(inode, page_index_in_vmobject, nullptr);
+        if (page_or_error.is_error()) {
+            klog() << "MM: handle_inode_fault had error (" << page_or_error.error() << ") while reading!";
+            return page_or_error.error() == -ENOMEM ? PageFaultResponse::OutOfMemory : PageFaultResponse::ShouldCrash;
+        }
+        // Shared mappings use the cached page, so they stay coherent with read(). Private ones
+        // use it too, but map it read-only and only make their own copy when they write to it.
+        vmobject_physical_page_entry = page_or_error.release_value();
+        if (!inode_vmobject.is_shared_inode())
+            inode_vmobject.set_shared_with_page_cache(page_index_in_vmobject, true);
+        inode_vmobject.start_fault_readahead(page_index_in_vmobject);
+        if (!fault_around(page_index_in_vmobject))
+            return PageFaultResponse::OutOfMemory;
+        return PageFaultResponse::Continue;
+    }
+
+    u8 page_buffer[PAGE_SIZE];
     auto buffer = UserOrKernelBuffer::for_kernel_buffer(page_buffer);
     auto nread = inode.read_bytes(page_index_in_vmobject * PAGE_SIZE, PAGE_SIZE, buffer, nullptr);
     if (nread < 0) {
@@ -602,6 +750,7 @@ PageFaultResponse Region::handle_inode_fault(size_t page_index_in_region)
         klog() << "MM: handle_inode_fault was unable to allocate a physical page";
         return PageFaultResponse::OutOfMemory;
     }
+    inode_vmobject.set_shared_with_page_cache(page_index_in_vmobject, false);
 
     u8* dest_ptr = MM.quickmap_page(*vmobject_physical_page_entry);
     {
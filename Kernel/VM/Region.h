@@ -40,6 +40,7 @@
 namespace Kernel {
 
 class Inode;
+class InodeVMObject;
 class VMObject;
 
 class Region final
@@ -61,6 +62,10 @@ public:
         ZeroedOnFork,
     };
 
+    // An inode fault also maps any already-cached pages
+    // in the aligned window of this many pages around the faulting one.
+    static constexpr size_t fault_around_pages = 16;
+
     static NonnullOwnPtr<Region> create_user_accessible(Process*, const Range&, NonnullRefPtr<VMObject>, size_t offset_in_vmobject, const StringView& name, u8 access, bool cacheable = true, bool shared = false);
     static NonnullOwnPtr<Region> create_kernel_only(const Range&, NonnullRefPtr<VMObject>, size_t offset_in_vmobject, const StringView& name, u8 access, bool cacheable = true);
 
@@ -256,10 +261,16 @@ private:
     bool remap_vmobject_page(size_t index, bool with_flush = true);
 
     PageFaultResponse handle_cow_fault(size_t page_index);
+    PageFaultResponse handle_page_cache_cow_fault(size_t page_index);
     PageFaultResponse handle_inode_fault(size_t page_index);
+    bool fault_around(size_t page_index_in_vmobject);
     PageFaultResponse handle_zero_fault(size_t page_index);
 
     bool map_individual_page_impl(size_t page_index);
+    bool can_map_large_page(size_t page_index) const;
+    void map_large_page_impl(size_t page_index);
+    size_t map_page_range_impl(size_t page_index, size_t page_count);
+    bool allocate_committed_large_page(size_t page_index, size_t& first_page_index_in_vmobject);
 
     void register_purgeable_page_ranges();
     void unregister_purgeable_page_ranges();
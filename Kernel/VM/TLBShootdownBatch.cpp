@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/StdLibExtras.h>
+#include <Kernel/Thread.h>
+#include <Kernel/VM/MemoryManager.h>
+#include <Kernel/VM/PageDirectory.h>
+#include <Kernel/VM/PhysicalPage.h>
+#include <Kernel/VM/TLBShootdownBatch.h>
+
+namespace Kernel {
+
+TLBShootdownBatch::TLBShootdownBatch()
+{
+    // Nested batches simply leave everything to the outermost one.
+    auto* current_thread = Thread::current();
+    if (current_thread && !current_thread->tlb_shootdown_batch()) {
+        m_thread = current_thread;
+        m_thread->set_tlb_shootdown_batch(this);
+    }
+}
+
+TLBShootdownBatch::~TLBShootdownBatch()
+{
+    if (!m_thread)
+        return;
+    m_thread->set_tlb_shootdown_batch(nullptr);
+    flush();
+    m_deferred_releases.clear();
+}
+
+static VirtualAddress end_of(const TLBFlushRange& range)
+{
+    return range.vaddr.offset(range.page_count * PAGE_SIZE);
+}
+
+void TLBShootdownBatch::add(const PageDirectory* page_directory, VirtualAddress vaddr, size_t page_count)
+{
+    Processor::flush_tlb_local(vaddr, page_count);
+
+    if (page_directory && is_user_address(vaddr) && !Processor::may_cache_page_directory(*page_directory))
+        return;
+
+    if (m_range_count > 0 && m_page_directory != page_directory)
+        flush();
+    m_page_directory = page_directory;
+    m_page_count += page_count;
+
+    if (m_range_count > 0 && end_of(m_ranges[m_range_count - 1]) == vaddr) {
+        m_ranges[m_range_count - 1].page_count += page_count;
+    } else {
+        if (m_range_count == max_ranges)
+            collapse_ranges();
+        m_ranges[m_range_count++] = { vaddr, page_count };
+    }
+
+    if (m_range_count > 1 && m_page_count > Processor::flush_entire_tlb_threshold)
+        collapse_ranges();
+}
+
+void TLBShootdownBatch::collapse_ranges()
+{
+    // Replace all ranges by one that spans them. Once that is large enough,
+    // the other processors will just flush their entire TLB.
+    auto start = m_ranges[0].vaddr;
+    auto end = end_of(m_ranges[0]);
+    for (size_t i = 1; i < m_range_count; ++i) {
+        start = min(start, m_ranges[i].vaddr);
+        end = max(end, end_of(m_ranges[i]));
+    }
+    m_ranges[0] = { start, (end - start).get() / PAGE_SIZE };
+    m_range_count = 1;
+}
+
+void TLBShootdownBatch::flush()
+{
+    // The thread may have been moved to another processor since add() flushed the ranges
+    // locally, so flush them here once more. Staying in a critical section makes sure that
+    // the processor we flush is the one that flush_tlb_remote() leaves out.
+    ScopedCritical critical;
+    for (size_t i = 0; i < m_range_count; ++i)
+        Processor::flush_tlb_local(m_ranges[i].vaddr, m_ranges[i].page_count);
+    Processor::flush_tlb_remote(m_page_directory, m_ranges, m_range_count);
+    m_range_count = 0;
+    m_page_count = 0;
+
+    // Page tables of a page directory whose ranges come later have to wait for those.
+    m_deferred_releases.remove_all_matching([&](auto& release) {
+        return release.page_directory == m_page_directory;
+    });
+}
+
+void TLBShootdownBatch::defer_release(const PageDirectory& page_directory, NonnullRefPtr<PhysicalPage> page)
+{
+    m_deferred_releases.append({ &page_directory, move(page) });
+}
+
+}
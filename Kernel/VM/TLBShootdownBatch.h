@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2020, Andreas Kling <kling@serenityos.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/Noncopyable.h>
+#include <AK/NonnullRefPtr.h>
+#include <AK/RefPtr.h>
+#include <AK/Vector.h>
+#include <Kernel/Arch/i386/CPU.h>
+#include <Kernel/Forward.h>
+
+namespace Kernel {
+
+// While a batch is alive, MemoryManager::flush_tlb() calls made by the current
+// thread still flush this processor's TLB right away, but the shootdown of the
+// other processors is deferred and sent as a single round when the batch goes
+// out of scope. The thread may migrate in between, so that round flushes the
+// processor it ends up on as well. Nothing that the deferred ranges still map
+// may be freed before that happens, since the other processors can still reach
+// it through their TLBs; page tables that get emptied meanwhile are handed to
+// defer_release() and only freed once the ranges of their page directory are flushed.
+//
+// Page directories that no processor has loaded (like a child's during fork) can't
+// be cached anywhere, so changes to them are neither deferred nor split the batch.
+class TLBShootdownBatch {
+    AK_MAKE_NONCOPYABLE(TLBShootdownBatch);
+    AK_MAKE_NONMOVABLE(TLBShootdownBatch);
+
+public:
+    TLBShootdownBatch();
+    ~TLBShootdownBatch();
+
+    void add(const PageDirectory*, VirtualAddress, size_t page_count);
+    void defer_release(const PageDirectory&, NonnullRefPtr<PhysicalPage>);
+    void flush();
+
+private:
+    static constexpr size_t max_ranges = 8;
+
+    void collapse_ranges();
+
+    Thread* m_thread { nullptr };
+    const PageDirectory* m_page_directory { nullptr };
+    TLBFlushRange m_ranges[max_ranges];
+    size_t m_range_count { 0 };
+    size_t m_page_count { 0 };
+
+    struct DeferredRelease {
+        const PageDirectory* page_directory { nullptr };
+        RefPtr<PhysicalPage> page;
+    };
+    Vector<DeferredRelease, 4> m_deferred_releases;
+};
+
+}
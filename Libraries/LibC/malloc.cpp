@@ -24,6 +24,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <AK/Atomic.h>
 #include <AK/InlineLinkedList.h>
 #include <AK/LogStream.h>
 #include <AK/ScopedValueRollback.h>
@@ -38,8 +39,6 @@
 #include <sys/internals.h>
 #include <sys/mman.h>
 
-// FIXME: Thread safety.
-
 //#define MALLOC_DEBUG
 #define RECYCLE_BIG_ALLOCATIONS
 
@@ -74,6 +73,13 @@ static bool s_scrub_malloc = true;
 static bool s_scrub_free = true;
 static bool s_profiling = false;
 
+// Every thread keeps a small cache of free chunks per size class, so most calls to
+// malloc() and free() don't have to take the malloc lock. Chunks sitting in a thread
+// cache (or in a remote free queue) count as used as far as their ChunkedBlock is
+// concerned; only the lock holder touches block freelists.
+constexpr size_t thread_cache_bytes_per_size_class = 16 * KiB;
+constexpr size_t max_thread_cache_chunks_per_size_class = 64;
+
 struct MallocStats {
     size_t number_of_malloc_calls;
 
@@ -86,6 +92,12 @@ struct MallocStats {
     size_t number_of_block_allocs;
     size_t number_of_blocks_full;
 
+    size_t number_of_thread_cache_hits;
+    size_t number_of_thread_cache_refills;
+    size_t number_of_thread_cache_flushes;
+    size_t number_of_remote_frees;
+    size_t number_of_remote_free_drains;
+
     size_t number_of_free_calls;
 
     size_t number_of_big_allocator_keeps;
@@ -104,12 +116,41 @@ struct Allocator {
     ChunkedBlock* empty_blocks[number_of_chunked_blocks_to_keep_around_per_size_class] { nullptr };
     InlineLinkedList<ChunkedBlock> usable_blocks;
     InlineLinkedList<ChunkedBlock> full_blocks;
+
+    // Chunks that were freed by a thread whose own cache was already full. In the
+    // common producer/consumer case these were allocated by another thread, which
+    // picks them up on its next refill without touching any block. Pushing onto
+    // this list doesn't need the malloc lock; taking from it does.
+    Atomic<FreelistEntry*> remote_frees { nullptr };
+    Atomic<ssize_t> remote_free_count { 0 };
 };
 
 struct BigAllocator {
     Vector<BigAllocationBlock*, number_of_big_blocks_to_keep_around_per_size_class> blocks;
 };
 
+struct ThreadCacheBin {
+    FreelistEntry* chunks;
+    size_t count;
+};
+
+struct ThreadCache {
+    ThreadCacheBin bins[num_size_classes];
+
+    // Counted locally and folded into g_malloc_stats whenever we hold the malloc lock.
+    size_t number_of_malloc_calls;
+    size_t number_of_free_calls;
+    size_t number_of_thread_cache_hits;
+    size_t number_of_thread_cache_flushes;
+    size_t number_of_remote_frees;
+};
+
+#ifdef NO_TLS
+static ThreadCache s_thread_cache;
+#else
+static __thread ThreadCache s_thread_cache;
+#endif
+
 // Allocators will be initialized in __malloc_init.
 // We can not rely on global constructors to initialize them,
 // because they must be initialized before other global constructors
@@ -141,6 +182,16 @@ static Allocator* allocator_for_size(size_t size, size_t& good_size)
     return nullptr;
 }
 
+static ThreadCacheBin& thread_cache_bin_for(const Allocator& allocator)
+{
+    return s_thread_cache.bins[&allocator - allocators()];
+}
+
+static size_t thread_cache_capacity(const Allocator& allocator)
+{
+    return max((size_t)2, min(thread_cache_bytes_per_size_class / allocator.size, max_thread_cache_chunks_per_size_class));
+}
+
 #ifdef RECYCLE_BIG_ALLOCATIONS
 static BigAllocator* big_allocator_for_size(size_t size)
 {
@@ -165,22 +216,218 @@ static void os_free(void* ptr, size_t size)
     assert(rc == 0);
 }
 
-static void* malloc_impl(size_t size)
+// Must be called with the malloc lock held.
+static void fold_thread_cache_stats()
+{
+    auto& cache = s_thread_cache;
+    g_malloc_stats.number_of_malloc_calls += exchange(cache.number_of_malloc_calls, 0);
+    g_malloc_stats.number_of_free_calls += exchange(cache.number_of_free_calls, 0);
+    g_malloc_stats.number_of_thread_cache_hits += exchange(cache.number_of_thread_cache_hits, 0);
+    g_malloc_stats.number_of_thread_cache_flushes += exchange(cache.number_of_thread_cache_flushes, 0);
+    g_malloc_stats.number_of_remote_frees += exchange(cache.number_of_remote_frees, 0);
+}
+
+// Must be called with the malloc lock held.
+static void* take_chunk_from_blocks(Allocator& allocator)
+{
+    ChunkedBlock* block = nullptr;
+
+    for (block = allocator.usable_blocks.head(); block; block = block->next()) {
+        if (block->free_chunks())
+            break;
+    }
+
+    if (!block && allocator.empty_block_count) {
+        g_malloc_stats.number_of_empty_block_hits++;
+        block = allocator.empty_blocks[--allocator.empty_block_count];
+        int rc = madvise(block, ChunkedBlock::block_size, MADV_SET_NONVOLATILE);
+        bool this_block_was_purged = rc == 1;
+        if (rc < 0) {
+            perror("madvise");
+            ASSERT_NOT_REACHED();
+        }
+        rc = mprotect(block, ChunkedBlock::block_size, PROT_READ | PROT_WRITE);
+        if (rc < 0) {
+            perror("mprotect");
+            ASSERT_NOT_REACHED();
+        }
+        if (this_block_was_purged) {
+            g_malloc_stats.number_of_empty_block_purge_hits++;
+            new (block) ChunkedBlock(allocator.size);
+        }
+        allocator.usable_blocks.append(block);
+    }
+
+    if (!block) {
+        g_malloc_stats.number_of_block_allocs++;
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "malloc: ChunkedBlock(%zu)", allocator.size);
+        block = (ChunkedBlock*)os_alloc(ChunkedBlock::block_size, buffer);
+        new (block) ChunkedBlock(allocator.size);
+        allocator.usable_blocks.append(block);
+        ++allocator.block_count;
+    }
+
+    --block->m_free_chunks;
+    void* ptr = block->m_freelist;
+    ASSERT(ptr);
+    block->m_freelist = block->m_freelist->next;
+    if (block->is_full()) {
+        g_malloc_stats.number_of_blocks_full++;
+#ifdef MALLOC_DEBUG
+        dbgprintf("Block %p is now full in size class %zu\n", block, allocator.size);
+#endif
+        allocator.usable_blocks.remove(block);
+        allocator.full_blocks.append(block);
+    }
+#ifdef MALLOC_DEBUG
+    dbgprintf("LibC: allocated %p (chunk in block %p, size %zu)\n", ptr, block, block->bytes_per_chunk());
+#endif
+    return ptr;
+}
+
+// Must be called with the malloc lock held.
+static void return_chunk_to_block(Allocator& allocator, void* ptr)
+{
+    auto* block = (ChunkedBlock*)((FlatPtr)ptr & ChunkedBlock::block_mask);
+    ASSERT(block->m_magic == MAGIC_PAGE_HEADER);
+
+#ifdef MALLOC_DEBUG
+    dbgprintf("LibC: freeing %p in allocator %p (size=%zu, used=%zu)\n", ptr, block, block->bytes_per_chunk(), block->used_chunks());
+#endif
+
+    auto* entry = (FreelistEntry*)ptr;
+    entry->next = block->m_freelist;
+    block->m_freelist = entry;
+
+    if (block->is_full()) {
+#ifdef MALLOC_DEBUG
+        dbgprintf("Block %p no longer full in size class %zu\n", block, allocator.size);
+#endif
+        g_malloc_stats.number_of_freed_full_blocks++;
+        allocator.full_blocks.remove(block);
+        allocator.usable_blocks.prepend(block);
+    }
+
+    ++block->m_free_chunks;
+
+    if (!block->used_chunks()) {
+        if (allocator.block_count < number_of_chunked_blocks_to_keep_around_per_size_class) {
+#ifdef MALLOC_DEBUG
+            dbgprintf("Keeping block %p around for size class %zu\n", block, allocator.size);
+#endif
+            g_malloc_stats.number_of_keeps++;
+            allocator.usable_blocks.remove(block);
+            allocator.empty_blocks[allocator.empty_block_count++] = block;
+            mprotect(block, ChunkedBlock::block_size, PROT_NONE);
+            madvise(block, ChunkedBlock::block_size, MADV_SET_VOLATILE);
+            return;
+        }
+#ifdef MALLOC_DEBUG
+        dbgprintf("Releasing block %p for size class %zu\n", block, allocator.size);
+#endif
+        g_malloc_stats.number_of_frees++;
+        allocator.usable_blocks.remove(block);
+        --allocator.block_count;
+        os_free(block, ChunkedBlock::block_size);
+    }
+}
+
+// Must be called with the malloc lock held.
+static FreelistEntry* take_remote_frees(Allocator& allocator)
+{
+    auto* chunks = allocator.remote_frees.exchange(nullptr, AK::memory_order_acq_rel);
+    if (chunks)
+        g_malloc_stats.number_of_remote_free_drains++;
+    return chunks;
+}
+
+static void drain_remote_frees(Allocator& allocator)
+{
+    LOCKER(malloc_lock());
+    fold_thread_cache_stats();
+    ssize_t drained = 0;
+    for (auto* entry = take_remote_frees(allocator); entry;) {
+        auto* next = entry->next;
+        return_chunk_to_block(allocator, entry);
+        entry = next;
+        ++drained;
+    }
+    allocator.remote_free_count.fetch_sub(drained, AK::memory_order_relaxed);
+}
+
+static void refill_thread_cache(Allocator& allocator, ThreadCacheBin& bin)
 {
     LOCKER(malloc_lock());
+    fold_thread_cache_stats();
+    g_malloc_stats.number_of_thread_cache_refills++;
+
+    size_t wanted = thread_cache_capacity(allocator) / 2;
+
+    // Chunks freed by other threads come first, they need no block bookkeeping at all.
+    ssize_t drained = 0;
+    for (auto* entry = take_remote_frees(allocator); entry;) {
+        auto* next = entry->next;
+        if (bin.count < wanted) {
+            entry->next = bin.chunks;
+            bin.chunks = entry;
+            ++bin.count;
+        } else {
+            return_chunk_to_block(allocator, entry);
+        }
+        entry = next;
+        ++drained;
+    }
+    allocator.remote_free_count.fetch_sub(drained, AK::memory_order_relaxed);
+
+    while (bin.count < wanted) {
+        auto* entry = (FreelistEntry*)take_chunk_from_blocks(allocator);
+        entry->next = bin.chunks;
+        bin.chunks = entry;
+        ++bin.count;
+    }
+}
 
+static void flush_thread_cache_bin(Allocator& allocator, ThreadCacheBin& bin, size_t count)
+{
+    ASSERT(count && count <= bin.count);
+    auto* first = bin.chunks;
+    auto* last = first;
+    for (size_t i = 1; i < count; ++i)
+        last = last->next;
+    bin.chunks = last->next;
+    bin.count -= count;
+
+    auto* head = allocator.remote_frees.load(AK::memory_order_relaxed);
+    do {
+        last->next = head;
+    } while (!allocator.remote_frees.compare_exchange_strong(head, first, AK::memory_order_acq_rel));
+
+    s_thread_cache.number_of_thread_cache_flushes++;
+    s_thread_cache.number_of_remote_frees += count;
+
+    // Nobody may be allocating from this size class anymore, so don't let the queue
+    // hold on to an unbounded amount of memory.
+    ssize_t queued = allocator.remote_free_count.fetch_add(count, AK::memory_order_relaxed) + count;
+    if (queued > (ssize_t)(4 * thread_cache_capacity(allocator)))
+        drain_remote_frees(allocator);
+}
+
+static void* malloc_impl(size_t size)
+{
     if (s_log_malloc)
         dbgprintf("LibC: malloc(%zu)\n", size);
 
     if (!size)
         return nullptr;
 
-    g_malloc_stats.number_of_malloc_calls++;
+    s_thread_cache.number_of_malloc_calls++;
 
     size_t good_size;
     auto* allocator = allocator_for_size(size, good_size);
 
     if (!allocator) {
+        LOCKER(malloc_lock());
         size_t real_size = round_up_to_power_of_two(sizeof(BigAllocationBlock) + size, ChunkedBlock::block_size);
 #ifdef RECYCLE_BIG_ALLOCATIONS
         if (auto* allocator = big_allocator_for_size(real_size)) {
@@ -214,62 +461,19 @@ static void* malloc_impl(size_t size)
         return &block->m_slot[0];
     }
 
-    ChunkedBlock* block = nullptr;
-
-    for (block = allocator->usable_blocks.head(); block; block = block->next()) {
-        if (block->free_chunks())
-            break;
-    }
-
-    if (!block && allocator->empty_block_count) {
-        g_malloc_stats.number_of_empty_block_hits++;
-        block = allocator->empty_blocks[--allocator->empty_block_count];
-        int rc = madvise(block, ChunkedBlock::block_size, MADV_SET_NONVOLATILE);
-        bool this_block_was_purged = rc == 1;
-        if (rc < 0) {
-            perror("madvise");
-            ASSERT_NOT_REACHED();
-        }
-        rc = mprotect(block, ChunkedBlock::block_size, PROT_READ | PROT_WRITE);
-        if (rc < 0) {
-            perror("mprotect");
-            ASSERT_NOT_REACHED();
-        }
-        if (this_block_was_purged) {
-            g_malloc_stats.number_of_empty_block_purge_hits++;
-            new (block) ChunkedBlock(good_size);
-        }
-        allocator->usable_blocks.append(block);
-    }
+    auto& bin = thread_cache_bin_for(*allocator);
+    if (bin.chunks)
+        s_thread_cache.number_of_thread_cache_hits++;
+    else
+        refill_thread_cache(*allocator, bin);
 
-    if (!block) {
-        g_malloc_stats.number_of_block_allocs++;
-        char buffer[64];
-        snprintf(buffer, sizeof(buffer), "malloc: ChunkedBlock(%zu)", good_size);
-        block = (ChunkedBlock*)os_alloc(ChunkedBlock::block_size, buffer);
-        new (block) ChunkedBlock(good_size);
-        allocator->usable_blocks.append(block);
-        ++allocator->block_count;
-    }
-
-    --block->m_free_chunks;
-    void* ptr = block->m_freelist;
-    ASSERT(ptr);
-    block->m_freelist = block->m_freelist->next;
-    if (block->is_full()) {
-        g_malloc_stats.number_of_blocks_full++;
-#ifdef MALLOC_DEBUG
-        dbgprintf("Block %p is now full in size class %zu\n", block, good_size);
-#endif
-        allocator->usable_blocks.remove(block);
-        allocator->full_blocks.append(block);
-    }
-#ifdef MALLOC_DEBUG
-    dbgprintf("LibC: allocated %p (chunk in block %p, size %zu)\n", ptr, block, block->bytes_per_chunk());
-#endif
+    auto* entry = bin.chunks;
+    bin.chunks = entry->next;
+    --bin.count;
+    void* ptr = entry;
 
     if (s_scrub_malloc)
-        memset(ptr, MALLOC_SCRUB_BYTE, block->m_size);
+        memset(ptr, MALLOC_SCRUB_BYTE, good_size);
 
     ue_notify_malloc(ptr, size);
     return ptr;
@@ -282,14 +486,13 @@ static void free_impl(void* ptr)
     if (!ptr)
         return;
 
-    g_malloc_stats.number_of_free_calls++;
-
-    LOCKER(malloc_lock());
+    s_thread_cache.number_of_free_calls++;
 
     void* block_base = (void*)((FlatPtr)ptr & ChunkedBlock::ChunkedBlock::block_mask);
     size_t magic = *(size_t*)block_base;
 
     if (magic == MAGIC_BIGALLOC_HEADER) {
+        LOCKER(malloc_lock());
         auto* block = (BigAllocationBlock*)block_base;
 #ifdef RECYCLE_BIG_ALLOCATIONS
         if (auto* allocator = big_allocator_for_size(block->m_size)) {
@@ -317,52 +520,20 @@ static void free_impl(void* ptr)
     assert(magic == MAGIC_PAGE_HEADER);
     auto* block = (ChunkedBlock*)block_base;
 
-#ifdef MALLOC_DEBUG
-    dbgprintf("LibC: freeing %p in allocator %p (size=%zu, used=%zu)\n", ptr, block, block->bytes_per_chunk(), block->used_chunks());
-#endif
-
     if (s_scrub_free)
         memset(ptr, FREE_SCRUB_BYTE, block->bytes_per_chunk());
 
+    size_t good_size;
+    auto* allocator = allocator_for_size(block->m_size, good_size);
+    auto& bin = thread_cache_bin_for(*allocator);
     auto* entry = (FreelistEntry*)ptr;
-    entry->next = block->m_freelist;
-    block->m_freelist = entry;
-
-    if (block->is_full()) {
-        size_t good_size;
-        auto* allocator = allocator_for_size(block->m_size, good_size);
-#ifdef MALLOC_DEBUG
-        dbgprintf("Block %p no longer full in size class %zu\n", block, good_size);
-#endif
-        g_malloc_stats.number_of_freed_full_blocks++;
-        allocator->full_blocks.remove(block);
-        allocator->usable_blocks.prepend(block);
-    }
+    entry->next = bin.chunks;
+    bin.chunks = entry;
+    ++bin.count;
 
-    ++block->m_free_chunks;
-
-    if (!block->used_chunks()) {
-        size_t good_size;
-        auto* allocator = allocator_for_size(block->m_size, good_size);
-        if (allocator->block_count < number_of_chunked_blocks_to_keep_around_per_size_class) {
-#ifdef MALLOC_DEBUG
-            dbgprintf("Keeping block %p around for size class %zu\n", block, good_size);
-#endif
-            g_malloc_stats.number_of_keeps++;
-            allocator->usable_blocks.remove(block);
-            allocator->empty_blocks[allocator->empty_block_count++] = block;
-            mprotect(block, ChunkedBlock::block_size, PROT_NONE);
-            madvise(block, ChunkedBlock::block_size, MADV_SET_VOLATILE);
-            return;
-        }
-#ifdef MALLOC_DEBUG
-        dbgprintf("Releasing block %p for size class %zu\n", block, good_size);
-#endif
-        g_malloc_stats.number_of_frees++;
-        allocator->usable_blocks.remove(block);
-        --allocator->block_count;
-        os_free(block, ChunkedBlock::block_size);
-    }
+    size_t capacity = thread_cache_capacity(*allocator);
+    if (bin.count > capacity)
+        flush_thread_cache_bin(*allocator, bin, bin.count - capacity / 2);
 }
 
 [[gnu::flatten]] void* malloc(size_t size)
@@ -394,7 +565,6 @@ size_t malloc_size(void* ptr)
 {
     if (!ptr)
         return 0;
-    LOCKER(malloc_lock());
     void* page_base = (void*)((FlatPtr)ptr & ChunkedBlock::block_mask);
     auto* header = (const CommonHeader*)page_base;
     auto size = header->m_size;
@@ -412,7 +582,6 @@ void* realloc(void* ptr, size_t size)
     if (!size)
         return nullptr;
 
-    LOCKER(malloc_lock());
     auto existing_allocation_size = malloc_size(ptr);
 
     if (size <= existing_allocation_size) {
@@ -447,8 +616,67 @@ void __malloc_init()
     new (&big_allocators()[0])(BigAllocator);
 }
 
+void __malloc_flush_thread_cache()
+{
+    LOCKER(malloc_lock());
+    fold_thread_cache_stats();
+    for (size_t i = 0; i < num_size_classes; ++i) {
+        auto& bin = s_thread_cache.bins[i];
+        while (bin.chunks) {
+            auto* entry = bin.chunks;
+            bin.chunks = entry->next;
+            return_chunk_to_block(allocators()[i], entry);
+        }
+        bin.count = 0;
+    }
+}
+
+void serenity_get_malloc_stats(struct serenity_malloc_stats* stats)
+{
+    LOCKER(malloc_lock());
+    fold_thread_cache_stats();
+    stats->malloc_calls = g_malloc_stats.number_of_malloc_calls;
+    stats->free_calls = g_malloc_stats.number_of_free_calls;
+    stats->thread_cache_hits = g_malloc_stats.number_of_thread_cache_hits;
+    stats->thread_cache_refills = g_malloc_stats.number_of_thread_cache_refills;
+    stats->thread_cache_flushes = g_malloc_stats.number_of_thread_cache_flushes;
+    stats->remote_frees = g_malloc_stats.number_of_remote_frees;
+    stats->remote_free_drains = g_malloc_stats.number_of_remote_free_drains;
+    stats->chunked_blocks = 0;
+    stats->chunked_bytes_free = 0;
+    for (size_t i = 0; i < num_size_classes; ++i) {
+        auto& allocator = allocators()[i];
+        stats->chunked_blocks += allocator.block_count;
+        for (auto* block = allocator.usable_blocks.head(); block; block = block->next())
+            stats->chunked_bytes_free += block->free_chunks() * block->bytes_per_chunk();
+    }
+    stats->big_allocs = g_malloc_stats.number_of_big_allocs;
+    stats->big_allocator_hits = g_malloc_stats.number_of_big_allocator_hits;
+}
+
+void malloc_stats()
+{
+    serenity_malloc_stats stats;
+    serenity_get_malloc_stats(&stats);
+    fprintf(stderr, "malloc calls:         %zu\n", stats.malloc_calls);
+    fprintf(stderr, "free calls:           %zu\n", stats.free_calls);
+    fprintf(stderr, "thread cache hits:    %zu\n", stats.thread_cache_hits);
+    fprintf(stderr, "thread cache refills: %zu\n", stats.thread_cache_refills);
+    fprintf(stderr, "thread cache flushes: %zu\n", stats.thread_cache_flushes);
+    fprintf(stderr, "remote frees:         %zu\n", stats.remote_frees);
+    fprintf(stderr, "remote free drains:   %zu\n", stats.remote_free_drains);
+    fprintf(stderr, "chunked blocks:       %zu\n", stats.chunked_blocks);
+    fprintf(stderr, "chunked bytes free:   %zu\n", stats.chunked_bytes_free);
+    fprintf(stderr, "big allocs:           %zu\n", stats.big_allocs);
+    fprintf(stderr, "big allocator hits:   %zu\n", stats.big_allocator_hits);
+}
+
 void serenity_dump_malloc_stats()
 {
+    {
+        LOCKER(malloc_lock());
+        fold_thread_cache_stats();
+    }
     dbg() << "# malloc() calls: " << g_malloc_stats.number_of_malloc_calls;
     dbg();
     dbg() << "big alloc hits: " << g_malloc_stats.number_of_big_allocator_hits;
@@ -460,6 +688,12 @@ void serenity_dump_malloc_stats()
     dbg() << "block allocs: " << g_malloc_stats.number_of_block_allocs;
     dbg() << "filled blocks: " << g_malloc_stats.number_of_blocks_full;
     dbg();
+    dbg() << "thread cache hits: " << g_malloc_stats.number_of_thread_cache_hits;
+    dbg() << "thread cache refills: " << g_malloc_stats.number_of_thread_cache_refills;
+    dbg() << "thread cache flushes: " << g_malloc_stats.number_of_thread_cache_flushes;
+    dbg() << "remote frees: " << g_malloc_stats.number_of_remote_frees;
+    dbg() << "remote free drains: " << g_malloc_stats.number_of_remote_free_drains;
+    dbg();
     dbg() << "# free() calls: " << g_malloc_stats.number_of_free_calls;
     dbg();
     dbg() << "big alloc keeps: " << g_malloc_stats.number_of_big_allocator_keeps;
@@ -42,6 +42,23 @@ __attribute__((malloc)) __attribute__((alloc_size(1))) void* malloc(size_t);
 __attribute__((malloc)) __attribute__((alloc_size(1, 2))) void* calloc(size_t nmemb, size_t);
 size_t malloc_size(void*);
 void serenity_dump_malloc_stats(void);
+
+struct serenity_malloc_stats {
+    size_t malloc_calls;
+    size_t free_calls;
+    size_t thread_cache_hits;
+    size_t thread_cache_refills;
+    size_t thread_cache_flushes;
+    size_t remote_frees;
+    size_t remote_free_drains;
+    size_t chunked_blocks;
+    size_t chunked_bytes_free;
+    size_t big_allocs;
+    size_t big_allocator_hits;
+};
+void serenity_get_malloc_stats(struct serenity_malloc_stats*);
+void malloc_stats(void);
+
 void free(void*);
 __attribute__((alloc_size(2))) void* realloc(void* ptr, size_t);
 char* getenv(const char* name);
@@ -108,6 +108,8 @@ enum {
     SO_KEEPALIVE,
     SO_TIMESTAMP,
     SO_BROADCAST,
+    SO_SNDBUF,
+    SO_RCVBUF,
 };
 #define SO_RCVTIMEO SO_RCVTIMEO
 #define SO_SNDTIMEO SO_SNDTIMEO
@@ -119,6 +121,8 @@ enum {
 #define SO_KEEPALIVE SO_KEEPALIVE
 #define SO_TIMESTAMP SO_TIMESTAMP
 #define SO_BROADCAST SO_BROADCAST
+#define SO_SNDBUF SO_SNDBUF
+#define SO_RCVBUF SO_RCVBUF
 
 enum {
     SCM_TIMESTAMP,
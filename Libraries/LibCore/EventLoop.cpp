@@ -30,6 +30,7 @@
 #include <AK/JsonObject.h>
 #include <AK/JsonValue.h>
 #include <AK/NeverDestroyed.h>
+#include <AK/NumericLimits.h>
 #include <AK/TemporaryChange.h>
 #include <AK/Time.h>
 #include <LibCore/Event.h>
@@ -46,7 +47,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -80,7 +81,10 @@ static EventLoop* s_main_event_loop;
 static Vector<EventLoop*>* s_event_loop_stack;
 static NeverDestroyed<IDAllocator> s_id_allocator;
 static HashMap<int, NonnullOwnPtr<EventLoopTimer>>* s_timers;
-static HashTable<Notifier*>* s_notifiers;
+// Notifiers are kept per fd, since several of them may watch the same fd with different
+// event masks. The kernel's epoll queue holds one registration per fd with the combined mask.
+static HashMap<int, Vector<Notifier*, 1>>* s_notifiers;
+static int s_epoll_fd = -1;
 int EventLoop::s_wake_pipe_fds[2];
 HashMap<int, EventLoop::SignalHandlers> EventLoop::s_signal_handlers;
 int EventLoop::s_handling_signal = 0;
@@ -227,7 +231,7 @@ EventLoop::EventLoop()
     if (!s_event_loop_stack) {
         s_event_loop_stack = new Vector<EventLoop*>;
         s_timers = new HashMap<int, NonnullOwnPtr<EventLoopTimer>>;
-        s_notifiers = new HashTable<Notifier*>;
+        s_notifiers = new HashMap<int, Vector<Notifier*, 1>>;
     }
 
     if (!s_main_event_loop) {
@@ -242,6 +246,15 @@ EventLoop::EventLoop()
 
 #endif
         ASSERT(rc == 0);
+
+        s_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        ASSERT(s_epoll_fd >= 0);
+        epoll_event wake_event {};
+        wake_event.events = EPOLLIN;
+        wake_event.data.fd = s_wake_pipe_fds[0];
+        rc = epoll_ctl(s_epoll_fd, EPOLL_CTL_ADD, s_wake_pipe_fds[0], &wake_event);
+        ASSERT(rc == 0);
+
         s_event_loop_stack->append(this);
 
         if (!s_rpc_server) {
@@ -528,6 +541,11 @@ void EventLoop::notify_forked(ForkEvent event)
         s_event_loop_stack->clear();
         s_timers->clear();
         s_notifiers->clear();
+        // The epoll queue is shared with the parent, so we must not touch its registrations.
+        if (s_epoll_fd >= 0) {
+            close(s_epoll_fd);
+            s_epoll_fd = -1;
+        }
         s_signal_handlers.clear();
         s_handling_signal = 0;
         s_next_signal_id = 0;
@@ -542,31 +560,7 @@ void EventLoop::notify_forked(ForkEvent event)
 
 void EventLoop::wait_for_event(WaitMode mode)
 {
-    fd_set rfds;
-    fd_set wfds;
 retry:
-    FD_ZERO(&rfds);
-    FD_ZERO(&wfds);
-
-    int max_fd = 0;
-    auto add_fd_to_set = [&max_fd](int fd, fd_set& set) {
-        FD_SET(fd, &set);
-        if (fd > max_fd)
-            max_fd = fd;
-    };
-
-    int max_fd_added = -1;
-    add_fd_to_set(s_wake_pipe_fds[0], rfds);
-    max_fd = max(max_fd, max_fd_added);
-    for (auto& notifier : *s_notifiers) {
-        if (notifier->event_mask() & Notifier::Read)
-            add_fd_to_set(notifier->fd(), rfds);
-        if (notifier->event_mask() & Notifier::Write)
-            add_fd_to_set(notifier->fd(), wfds);
-        if (notifier->event_mask() & Notifier::Exceptional)
-            ASSERT_NOT_REACHED();
-    }
-
     bool queued_events_is_empty;
     {
         LOCKER(m_private->lock);
@@ -574,8 +568,7 @@ retry:
     }
 
     timeval now;
-    struct timeval timeout = { 0, 0 };
-    bool should_wait_forever = false;
+    int timeout_ms = 0;
     if (mode == WaitMode::WaitForEvents && queued_events_is_empty) {
         auto next_timer_expiration = get_next_timer_expiration();
         if (next_timer_expiration.has_value()) {
@@ -583,32 +576,43 @@ retry:
             clock_gettime(CLOCK_MONOTONIC_COARSE, &now_spec);
             now.tv_sec = now_spec.tv_sec;
             now.tv_usec = now_spec.tv_nsec / 1000;
+            timeval timeout;
             timeval_sub(next_timer_expiration.value(), now, timeout);
-            if (timeout.tv_sec < 0 || (timeout.tv_sec == 0 && timeout.tv_usec < 0)) {
-                timeout.tv_sec = 0;
-                timeout.tv_usec = 0;
+            if (timeout.tv_sec >= 0) {
+                // Round up, waking up before the timer has expired would just mean waiting again.
+                // Timers far enough out to overflow an int are clamped; we simply wait again.
+                if (timeout.tv_sec >= NumericLimits<int>::max() / 1000)
+                    timeout_ms = NumericLimits<int>::max();
+                else
+                    timeout_ms = timeout.tv_sec * 1000 + (timeout.tv_usec + 999) / 1000;
             }
         } else {
-            should_wait_forever = true;
+            timeout_ms = -1;
         }
     }
 
-try_select_again:
-    int marked_fd_count = select(max_fd + 1, &rfds, &wfds, nullptr, should_wait_forever ? nullptr : &timeout);
-    if (marked_fd_count < 0) {
+    epoll_event events[64];
+    int event_count;
+    for (;;) {
+        event_count = epoll_wait(s_epoll_fd, events, sizeof(events) / sizeof(events[0]), timeout_ms);
+        if (event_count >= 0)
+            break;
         int saved_errno = errno;
         if (saved_errno == EINTR) {
             if (m_exit_requested)
                 return;
-            goto try_select_again;
+            continue;
         }
 #ifdef EVENTLOOP_DEBUG
-        dbgln("Core::EventLoop::wait_for_event: {} ({}: {})", marked_fd_count, saved_errno, strerror(saved_errno));
+        dbgln("Core::EventLoop::wait_for_event: {} ({}: {})", event_count, saved_errno, strerror(saved_errno));
 #endif
         // Blow up, similar to Core::safe_syscall.
         ASSERT_NOT_REACHED();
     }
-    if (FD_ISSET(s_wake_pipe_fds[0], &rfds)) {
+
+    for (int i = 0; i < event_count; ++i) {
+        if (events[i].data.fd != s_wake_pipe_fds[0])
+            continue;
         int wake_events[8];
         auto nread = read(s_wake_pipe_fds[0], wake_events, sizeof(wake_events));
         if (nread < 0) {
@@ -617,10 +621,10 @@ try_select_again:
         }
         ASSERT(nread > 0);
         bool wake_requested = false;
-        int event_count = nread / sizeof(wake_events[0]);
-        for (int i = 0; i < event_count; i++) {
-            if (wake_events[i] != 0)
-                dispatch_signal(wake_events[i]);
+        int wake_event_count = nread / sizeof(wake_events[0]);
+        for (int j = 0; j < wake_event_count; j++) {
+            if (wake_events[j] != 0)
+                dispatch_signal(wake_events[j]);
             else
                 wake_requested = true;
         }
@@ -658,17 +662,16 @@ try_select_again:
         }
     }
 
-    if (!marked_fd_count)
-        return;
-
-    for (auto& notifier : *s_notifiers) {
-        if (FD_ISSET(notifier->fd(), &rfds)) {
-            if (notifier->event_mask() & Notifier::Event::Read)
-                post_event(*notifier, make<NotifierReadEvent>(notifier->fd()));
-        }
-        if (FD_ISSET(notifier->fd(), &wfds)) {
-            if (notifier->event_mask() & Notifier::Event::Write)
-                post_event(*notifier, make<NotifierWriteEvent>(notifier->fd()));
+    for (int i = 0; i < event_count; ++i) {
+        int fd = events[i].data.fd;
+        auto it = s_notifiers->find(fd);
+        if (it == s_notifiers->end())
+            continue;
+        for (auto* notifier : it->value) {
+            if ((events[i].events & EPOLLIN) && (notifier->event_mask() & Notifier::Event::Read))
+                post_event(*notifier, make<NotifierReadEvent>(fd));
+            if ((events[i].events & EPOLLOUT) && (notifier->event_mask() & Notifier::Event::Write))
+                post_event(*notifier, make<NotifierWriteEvent>(fd));
         }
     }
 }
@@ -731,14 +734,61 @@ bool EventLoop::unregister_timer(int timer_id)
     return true;
 }
 
+static void update_epoll_registration(int fd, const Vector<Notifier*, 1>& notifiers, int op)
+{
+    epoll_event event {};
+    for (auto* notifier : notifiers) {
+        ASSERT(!(notifier->event_mask() & Notifier::Exceptional));
+        if (notifier->event_mask() & Notifier::Read)
+            event.events |= EPOLLIN;
+        if (notifier->event_mask() & Notifier::Write)
+            event.events |= EPOLLOUT;
+    }
+    event.data.fd = fd;
+    int rc = epoll_ctl(s_epoll_fd, op, fd, &event);
+    // If the fd was closed and reused without unregistering its notifiers first,
+    // the kernel has already forgotten about it.
+    if (rc < 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+        rc = epoll_ctl(s_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    // Likewise, there's nothing to update if the fd has been closed while another notifier still watches it.
+    if (rc < 0 && errno == EBADF)
+        return;
+    if (rc < 0)
+        perror("EventLoop: epoll_ctl");
+}
+
 void EventLoop::register_notifier(Badge<Notifier>, Notifier& notifier)
 {
-    s_notifiers->set(&notifier);
+    auto& notifiers = s_notifiers->ensure(notifier.fd());
+    if (notifiers.contains_slow(&notifier))
+        return;
+    int op = notifiers.is_empty() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    notifiers.append(&notifier);
+    update_epoll_registration(notifier.fd(), notifiers, op);
 }
 
 void EventLoop::unregister_notifier(Badge<Notifier>, Notifier& notifier)
 {
-    s_notifiers->remove(&notifier);
+    auto it = s_notifiers->find(notifier.fd());
+    if (it == s_notifiers->end())
+        return;
+    if (!it->value.remove_first_matching([&](auto* entry) { return entry == &notifier; }))
+        return;
+    if (!it->value.is_empty()) {
+        update_epoll_registration(notifier.fd(), it->value, EPOLL_CTL_MOD);
+        return;
+    }
+    s_notifiers->remove(it);
+    // This fails harmlessly if the fd has already been closed.
+    epoll_ctl(s_epoll_fd, EPOLL_CTL_DEL, notifier.fd(), nullptr);
+}
+
+void EventLoop::did_update_notifier(Badge<Notifier>, Notifier& notifier)
+{
+    auto it = s_notifiers->find(notifier.fd());
+    if (it == s_notifiers->end() || !it->value.contains_slow(&notifier))
+        return;
+    update_epoll_registration(notifier.fd(), it->value, EPOLL_CTL_MOD);
 }
 
 void EventLoop::wake()
@@ -111,6 +111,36 @@ bool File::is_directory() const
     return S_ISDIR(stat.st_mode);
 }
 
+ByteBuffer File::read_at(off_t offset, size_t max_size)
+{
+    if (fd() < 0 || !max_size)
+        return {};
+    auto buffer = ByteBuffer::create_uninitialized(max_size);
+    ssize_t nread = pread(fd(), buffer.data(), max_size, offset);
+    if (nread < 0) {
+        set_error(errno);
+        return {};
+    }
+    buffer.trim(nread);
+    return buffer;
+}
+
+bool File::write_at(off_t offset, const u8* data, size_t size)
+{
+    size_t total_nwritten = 0;
+    while (total_nwritten < size) {
+        ssize_t nwritten = pwrite(fd(), data + total_nwritten, size - total_nwritten, offset + total_nwritten);
+        if (nwritten < 0) {
+            set_error(errno);
+            return false;
+        }
+        if (nwritten == 0)
+            return false;
+        total_nwritten += nwritten;
+    }
+    return true;
+}
+
 bool File::is_directory(const String& filename)
 {
     struct stat st;
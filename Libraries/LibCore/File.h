@@ -52,6 +52,11 @@ public:
 
     virtual bool open(IODevice::OpenMode) override;
 
+    // Positional I/O, these neither use nor move the current file offset,
+    // so several threads can use them on the same File at once.
+    ByteBuffer read_at(off_t offset, size_t max_size);
+    bool write_at(off_t offset, const u8* data, size_t size);
+
     enum class ShouldCloseFileDescriptor {
         No = 0,
         Yes
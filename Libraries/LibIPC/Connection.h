@@ -28,6 +28,8 @@
 
 #include <AK/ByteBuffer.h>
 #include <AK/NonnullOwnPtrVector.h>
+#include <AK/ScopeGuard.h>
+#include <AK/SharedBuffer.h>
 #include <LibCore/Event.h>
 #include <LibCore/EventLoop.h>
 #include <LibCore/LocalSocket.h>
@@ -35,9 +37,12 @@
 #include <LibCore/SyscallUtils.h>
 #include <LibCore/Timer.h>
 #include <LibIPC/Message.h>
+#include <LibIPC/MessageRing.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -45,6 +50,10 @@
 
 namespace IPC {
 
+// Takes the place of a message size in the socket stream, and is followed by a shbuf id.
+// It tells the peer that all further messages from us will come through the shared memory transport.
+static constexpr u32 shared_memory_transport_marker = 0xffffffff;
+
 template<typename LocalEndpoint, typename PeerEndpoint>
 class Connection : public Core::Object {
 public:
@@ -60,14 +69,27 @@ public:
         };
     }
 
+    virtual ~Connection() override
+    {
+        flush_send_queue();
+    }
+
     pid_t peer_pid() const { return m_peer_pid; }
 
+    // The shared memory transport needs the shared_buffer promise on both ends, so only
+    // connections with an endpoint declared as [SharedMemoryTransport] use it.
+    static constexpr bool uses_shared_memory_transport()
+    {
+        return LocalEndpoint::uses_shared_memory_transport() || PeerEndpoint::uses_shared_memory_transport();
+    }
+
     template<typename MessageType>
     OwnPtr<MessageType> wait_for_specific_message()
     {
         return wait_for_specific_endpoint_message<MessageType, LocalEndpoint>();
     }
 
+    // Connections are not thread-safe, so this must only be called on the thread running the event loop.
     void post_message(const Message& message)
     {
         // NOTE: If this connection is being shut down, but has not yet been destroyed,
@@ -76,9 +98,6 @@ public:
             return;
 
         auto buffer = message.encode();
-        // Prepend the message size.
-        uint32_t message_size = buffer.data.size();
-        buffer.data.prepend(reinterpret_cast<const u8*>(&message_size), sizeof(message_size));
 
 #ifdef __serenity__
         for (int fd : buffer.fds) {
@@ -93,29 +112,62 @@ public:
             warnln("fd passing is not supported on this platform, sorry :(");
 #endif
 
-        size_t total_nwritten = 0;
-        while (total_nwritten < buffer.data.size()) {
-            auto nwritten = write(m_socket->fd(), buffer.data.data() + total_nwritten, buffer.data.size() - total_nwritten);
-            if (nwritten < 0) {
-                switch (errno) {
-                case EPIPE:
-                    dbg() << *this << "::post_message: Disconnected from peer";
-                    shutdown();
-                    return;
-                case EAGAIN:
-                    dbg() << *this << "::post_message: Peer buffer overflowed";
-                    shutdown();
-                    return;
-                default:
-                    perror("Connection::post_message write");
-                    shutdown();
-                    return;
-                }
-            }
-            total_nwritten += nwritten;
+        // A message with fds can't be dropped, since the fds have already been sent.
+        bool coalesce = message.is_coalescable() && buffer.fds.is_empty();
+        if (!coalesce || !coalesce_with_queued_messages(message, buffer.data.span())) {
+            // Prepend the message size.
+            uint32_t message_size = buffer.data.size();
+            m_send_queue.append(reinterpret_cast<const u8*>(&message_size), sizeof(message_size));
+            m_send_queue.append(buffer.data.data(), buffer.data.size());
         }
 
         m_responsiveness_timer->start();
+
+        if (m_send_queue.size() >= send_queue_flush_threshold) {
+            flush_send_queue();
+            return;
+        }
+
+        if (!m_send_queue_flush_is_scheduled) {
+            m_send_queue_flush_is_scheduled = true;
+            deferred_invoke([this](auto&) {
+                m_send_queue_flush_is_scheduled = false;
+                flush_send_queue();
+            });
+        }
+    }
+
+    // Sends everything post_message() has queued up. This happens once per event loop iteration
+    // and before waiting for a response, so there's rarely a need to call it yourself.
+    void flush_send_queue()
+    {
+        if (m_send_queue.is_empty())
+            return;
+
+        ScopeGuard clear_send_queue = [this] {
+            m_send_queue.clear_with_capacity();
+            m_queued_coalescable_messages.clear_with_capacity();
+        };
+
+        if (!m_socket->is_open())
+            return;
+
+        if (!m_send_ring) {
+            write_to_socket(m_send_queue.data(), m_send_queue.size());
+            return;
+        }
+
+        bool peer_needs_doorbell = false;
+        for (size_t offset = 0; offset < m_send_queue.size();) {
+            uint32_t message_size;
+            memcpy(&message_size, m_send_queue.data() + offset, sizeof(message_size));
+            offset += sizeof(message_size);
+            if (!write_to_send_ring({ m_send_queue.data() + offset, message_size }, peer_needs_doorbell))
+                return;
+            offset += message_size;
+        }
+        if (peer_needs_doorbell)
+            ring_doorbell();
     }
 
     template<typename RequestType, typename... Args>
@@ -143,9 +195,27 @@ protected:
     Core::LocalSocket& socket() { return *m_socket; }
     void set_peer_pid(pid_t pid) { m_peer_pid = pid; }
 
+    // Offers the peer to move the connection to a pair of rings in shared memory.
+    // Once both sides have switched, encoded messages are copied through the rings
+    // instead of the socket, and the socket is only used to pass fds and ring doorbells.
+    // If anything goes wrong here, we simply keep using the socket.
+    void set_up_shared_memory_transport()
+    {
+        ASSERT(uses_shared_memory_transport());
+        ASSERT(!m_shared_memory);
+        auto shared_memory = SharedBuffer::create_with_size(MessageRing::shared_buffer_size(MessageRing::default_capacity));
+        if (!shared_memory || !shared_memory->share_with(m_peer_pid))
+            return;
+        if (!send_shared_memory_transport_marker(shared_memory->shbuf_id()))
+            return;
+        m_shared_memory = move(shared_memory);
+        m_send_ring = make<MessageRing>(m_shared_memory->template data<u8>(), MessageRing::default_capacity, 0);
+    }
+
     template<typename MessageType, typename Endpoint>
     OwnPtr<MessageType> wait_for_specific_endpoint_message()
     {
+        flush_send_queue();
         for (;;) {
             // Double check we don't already have the event waiting for us.
             // Otherwise we might end up blocked for a while for no reason.
@@ -159,33 +229,255 @@ protected:
 
             if (!m_socket->is_open())
                 break;
-            fd_set rfds;
-            FD_ZERO(&rfds);
-            FD_SET(m_socket->fd(), &rfds);
-            int rc = Core::safe_syscall(select, m_socket->fd() + 1, &rfds, nullptr, nullptr, nullptr);
-            if (rc < 0) {
-                perror("select");
-            }
-            ASSERT(rc > 0);
-            ASSERT(FD_ISSET(m_socket->fd(), &rfds));
+            wait_until_socket_is_readable();
             if (!drain_messages_from_peer())
                 break;
         }
         return nullptr;
     }
 
-    bool drain_messages_from_peer()
+    void wait_until_socket_is_readable()
     {
-        Vector<u8> bytes;
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(m_socket->fd(), &rfds);
+        int rc = Core::safe_syscall(select, m_socket->fd() + 1, &rfds, nullptr, nullptr, nullptr);
+        if (rc < 0) {
+            perror("select");
+        }
+        ASSERT(rc > 0);
+        ASSERT(FD_ISSET(m_socket->fd(), &rfds));
+    }
 
-        if (!m_unprocessed_bytes.is_empty()) {
-            bytes.append(m_unprocessed_bytes.data(), m_unprocessed_bytes.size());
-            m_unprocessed_bytes.clear();
+    bool write_to_socket(const u8* data, size_t size)
+    {
+        size_t total_nwritten = 0;
+        while (total_nwritten < size) {
+            auto nwritten = write(m_socket->fd(), data + total_nwritten, size - total_nwritten);
+            if (nwritten < 0) {
+                switch (errno) {
+                case EPIPE:
+                    dbg() << *this << "::post_message: Disconnected from peer";
+                    shutdown();
+                    return false;
+                case EAGAIN:
+                    dbg() << *this << "::post_message: Peer buffer overflowed";
+                    shutdown();
+                    return false;
+                default:
+                    perror("Connection::post_message write");
+                    shutdown();
+                    return false;
+                }
+            }
+            total_nwritten += nwritten;
         }
+        return true;
+    }
+
+    bool ring_doorbell()
+    {
+        u8 doorbell = 0;
+        return write_to_socket(&doorbell, sizeof(doorbell));
+    }
+
+    // Doorbells are left to the caller, who can ring once for a whole batch of messages.
+    bool write_to_send_ring(ReadonlyBytes bytes, bool& peer_needs_doorbell)
+    {
+        size_t offset = 0;
+        bool asked_for_doorbell = false;
+        do {
+            size_t chunk_size = min(bytes.size() - offset, m_send_ring->max_record_size());
+            u32 flags = offset + chunk_size < bytes.size() ? MessageRing::Fragment : MessageRing::None;
+            bool consumer_needs_wakeup = false;
+            auto status = m_send_ring->write(bytes.slice(offset, chunk_size), flags, consumer_needs_wakeup);
+            if (status == MessageRing::Status::Corrupted) {
+                dbg() << *this << "::post_message: Shared memory ring is corrupted";
+                shutdown();
+                return false;
+            }
+            if (status == MessageRing::Status::WouldBlock) {
+                // The peer won't make room unless it knows there's something to read.
+                if (peer_needs_doorbell) {
+                    if (!ring_doorbell())
+                        return false;
+                    peer_needs_doorbell = false;
+                }
+                if (!asked_for_doorbell) {
+                    m_send_ring->set_producer_waiting();
+                    asked_for_doorbell = true;
+                    // The peer may be waiting for room to write to us as well, so make some on our side.
+                    if (!drain_messages_from_peer())
+                        return false;
+                    continue;
+                }
+                // Just like with the socket, a non-blocking connection doesn't wait for a slow peer.
+                if (fcntl(m_socket->fd(), F_GETFL) & O_NONBLOCK) {
+                    dbg() << *this << "::post_message: Peer buffer overflowed";
+                    shutdown();
+                    return false;
+                }
+                wait_until_socket_is_readable();
+                if (!drain_messages_from_peer())
+                    return false;
+                asked_for_doorbell = false;
+                continue;
+            }
+            peer_needs_doorbell |= consumer_needs_wakeup;
+            offset += chunk_size;
+        } while (offset < bytes.size());
+        return true;
+    }
+
+    bool send_shared_memory_transport_marker(int shbuf_id)
+    {
+        u8 marker[sizeof(shared_memory_transport_marker) + sizeof(shbuf_id)];
+        memcpy(marker, &shared_memory_transport_marker, sizeof(shared_memory_transport_marker));
+        memcpy(marker + sizeof(shared_memory_transport_marker), &shbuf_id, sizeof(shbuf_id));
+        return write_to_socket(marker, sizeof(marker));
+    }
+
+    bool did_receive_shared_memory_transport_marker(int shbuf_id)
+    {
+        if (!uses_shared_memory_transport() || m_receive_ring)
+            return false;
+
+        if (m_shared_memory) {
+            // The peer has accepted the buffer we offered, and is sending through it as well.
+            if (shbuf_id != m_shared_memory->shbuf_id())
+                return false;
+            auto capacity = MessageRing::capacity_for_shared_buffer_size(m_shared_memory->size());
+            m_receive_ring = make<MessageRing>(m_shared_memory->template data<u8>(), capacity.value(), 1);
+            return true;
+        }
+
+        // The peer has offered us a buffer, and is already sending through it. Follow suit.
+        auto shared_memory = SharedBuffer::create_from_shbuf_id(shbuf_id);
+        if (!shared_memory)
+            return false;
+        auto capacity = MessageRing::capacity_for_shared_buffer_size(shared_memory->size());
+        if (!capacity.has_value())
+            return false;
+        m_shared_memory = move(shared_memory);
+        m_receive_ring = make<MessageRing>(m_shared_memory->template data<u8>(), capacity.value(), 0);
+        if (!send_shared_memory_transport_marker(shbuf_id))
+            return false;
+        m_send_ring = make<MessageRing>(m_shared_memory->template data<u8>(), capacity.value(), 1);
+        return true;
+    }
+
+    // Overwrites the queued message that the given one supersedes, if any, so that the new one takes its place
+    // in the queue. Otherwise remembers where the given one is about to be appended, and returns false.
+    // NOTE: This reorders messages: the peer gets the newest state ahead of anything that was posted after
+    //       the message it replaced. Only mark messages [Coalesce] if that's fine for them.
+    bool coalesce_with_queued_messages(const Message& message, ReadonlyBytes data)
+    {
+        auto key_buffer = message.coalescing_key();
+        auto& key = key_buffer.data;
+        size_t new_size = sizeof(uint32_t) + data.size();
+
+        for (size_t i = 0; i < m_queued_coalescable_messages.size(); ++i) {
+            auto& queued = m_queued_coalescable_messages[i];
+            if (queued.endpoint_magic != message.endpoint_magic() || queued.message_id != message.message_id())
+                continue;
+            if (queued.key.size() != key.size() || memcmp(queued.key.data(), key.data(), key.size()) != 0)
+                continue;
+
+            // Make room for the new message, shifting everything queued after it if the size changed.
+            size_t old_tail_offset = queued.offset + queued.size;
+            size_t new_tail_offset = queued.offset + new_size;
+            size_t tail_size = m_send_queue.size() - old_tail_offset;
+            if (new_size > queued.size)
+                m_send_queue.resize(m_send_queue.size() + new_size - queued.size);
+            memmove(m_send_queue.data() + new_tail_offset, m_send_queue.data() + old_tail_offset, tail_size);
+            if (new_size < queued.size)
+                m_send_queue.shrink(new_tail_offset + tail_size, true);
+
+            uint32_t message_size = data.size();
+            memcpy(m_send_queue.data() + queued.offset, &message_size, sizeof(message_size));
+            memcpy(m_send_queue.data() + queued.offset + sizeof(message_size), data.data(), data.size());
+
+            for (size_t j = i + 1; j < m_queued_coalescable_messages.size(); ++j)
+                m_queued_coalescable_messages[j].offset = m_queued_coalescable_messages[j].offset - queued.size + new_size;
+            queued.size = new_size;
+            return true;
+        }
+
+        QueuedCoalescableMessage queued { message.endpoint_magic(), message.message_id(), {}, m_send_queue.size(), new_size };
+        queued.key.append(key.data(), key.size());
+        m_queued_coalescable_messages.append(move(queued));
+        return false;
+    }
+
+    // Messages with borrowed parameters share the receive buffer if there is one, and copy their bytes otherwise.
+    bool decode_and_queue_message(ReadonlyBytes bytes, const ByteBuffer& receive_buffer = {})
+    {
+        if (auto message = LocalEndpoint::decode_message(bytes, m_socket->fd(), receive_buffer)) {
+            m_unprocessed_messages.append(message.release_nonnull());
+            return true;
+        }
+        if (auto message = PeerEndpoint::decode_message(bytes, m_socket->fd(), receive_buffer)) {
+            m_unprocessed_messages.append(message.release_nonnull());
+            return true;
+        }
+        return false;
+    }
+
+    bool drain_messages_from_receive_ring()
+    {
+        for (;;) {
+            MessageRing::Record record;
+            auto status = m_receive_ring->read(record);
+            if (status == MessageRing::Status::WouldBlock)
+                return true;
+            if (status == MessageRing::Status::Corrupted) {
+                dbg() << *this << "::drain_messages_from_peer: Shared memory ring is corrupted";
+                shutdown();
+                return false;
+            }
+
+            // The peer can rewrite the ring under our feet at any time, so only ever look at the record once,
+            // while copying it out. The copy also doubles as the receive buffer for borrowed parameters.
+            auto record_bytes = ByteBuffer::copy(record.bytes.data(), record.bytes.size());
+            bool is_fragment = record.flags & MessageRing::Fragment;
+            bool peer_is_waiting_for_room = m_receive_ring->consume(record);
+
+            bool decoded = true;
+            if (is_fragment || !m_partial_message.is_empty()) {
+                if (m_partial_message.size() + record_bytes.size() > max_reassembled_message_size) {
+                    dbg() << *this << "::drain_messages_from_peer: Fragmented message is too large";
+                    shutdown();
+                    return false;
+                }
+                m_partial_message.append(record_bytes.data(), record_bytes.size());
+                if (!is_fragment) {
+                    decoded = decode_and_queue_message(m_partial_message.bytes(), m_partial_message);
+                    m_partial_message.clear();
+                }
+            } else {
+                decoded = decode_and_queue_message(record_bytes.bytes(), record_bytes);
+            }
+
+            if (!decoded) {
+                dbgln("Failed to parse a message");
+                shutdown();
+                return false;
+            }
+            if (peer_is_waiting_for_room && !ring_doorbell())
+                return false;
+        }
+    }
+
+    bool drain_messages_from_peer()
+    {
+        // Messages with borrowed parameters hold on to this buffer, so we receive straight into it.
+        ByteBuffer bytes = move(m_unprocessed_bytes);
+        size_t received_size = bytes.size();
 
         while (m_socket->is_open()) {
-            u8 buffer[4096];
-            ssize_t nread = recv(m_socket->fd(), buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (bytes.size() - received_size < 4096)
+                bytes.grow(max(bytes.size() * 2, received_size + 4096));
+            ssize_t nread = recv(m_socket->fd(), bytes.data() + received_size, bytes.size() - received_size, MSG_DONTWAIT);
             if (nread < 0) {
                 if (errno == EAGAIN)
                     break;
@@ -194,37 +486,53 @@ protected:
                 return false;
             }
             if (nread == 0) {
-                if (bytes.is_empty()) {
+                if (received_size == 0) {
                     deferred_invoke([this](auto&) { die(); });
                 }
                 return false;
             }
-            bytes.append(buffer, nread);
-        }
-
-        if (!bytes.is_empty()) {
-            m_responsiveness_timer->stop();
-            did_become_responsive();
+            received_size += nread;
         }
+        bytes.trim(received_size);
 
         size_t index = 0;
         uint32_t message_size = 0;
-        for (; index + sizeof(message_size) < bytes.size(); index += message_size) {
+        for (; !m_receive_ring && index + sizeof(message_size) < bytes.size(); index += message_size) {
             message_size = *reinterpret_cast<uint32_t*>(bytes.data() + index);
+            if (message_size == shared_memory_transport_marker) {
+                int shbuf_id;
+                if (bytes.size() - index < sizeof(message_size) + sizeof(shbuf_id))
+                    break;
+                memcpy(&shbuf_id, bytes.data() + index + sizeof(message_size), sizeof(shbuf_id));
+                if (!did_receive_shared_memory_transport_marker(shbuf_id)) {
+                    dbg() << *this << "::drain_messages_from_peer: Could not switch to the shared memory transport";
+                    shutdown();
+                    return false;
+                }
+                break;
+            }
             if (message_size == 0 || bytes.size() - index - sizeof(uint32_t) < message_size)
                 break;
             index += sizeof(message_size);
             auto remaining_bytes = ReadonlyBytes { bytes.data() + index, bytes.size() - index };
-            if (auto message = LocalEndpoint::decode_message(remaining_bytes, m_socket->fd())) {
-                m_unprocessed_messages.append(message.release_nonnull());
-            } else if (auto message = PeerEndpoint::decode_message(remaining_bytes, m_socket->fd())) {
-                m_unprocessed_messages.append(message.release_nonnull());
-            } else {
+            if (!decode_and_queue_message(remaining_bytes, bytes)) {
                 dbgln("Failed to parse a message");
                 break;
             }
         }
 
+        if (m_receive_ring) {
+            // Once the peer has switched to shared memory, all it sends over the socket are doorbells.
+            index = bytes.size();
+            if (!drain_messages_from_receive_ring())
+                return false;
+        }
+
+        if (!bytes.is_empty() || !m_unprocessed_messages.is_empty()) {
+            m_responsiveness_timer->stop();
+            did_become_responsive();
+        }
+
         if (index < bytes.size()) {
             // Sometimes we might receive a partial message. That's okay, just stash away
             // the unprocessed bytes and we'll prepend them to the next incoming message
@@ -276,6 +584,27 @@ protected:
     NonnullOwnPtrVector<Message> m_unprocessed_messages;
     ByteBuffer m_unprocessed_bytes;
     pid_t m_peer_pid { -1 };
+
+    // Messages are queued up and flushed together, so a chatty connection makes one write per batch.
+    static constexpr size_t send_queue_flush_threshold = 64 * KiB;
+    struct QueuedCoalescableMessage {
+        i32 endpoint_magic;
+        i32 message_id;
+        Vector<u8, 16> key;
+        size_t offset;
+        size_t size;
+    };
+    Vector<u8> m_send_queue;
+    Vector<QueuedCoalescableMessage> m_queued_coalescable_messages;
+    bool m_send_queue_flush_is_scheduled { false };
+
+    RefPtr<SharedBuffer> m_shared_memory;
+
+    // Fragments are buffered until the whole message is there. A peer that sends more than this drops the connection.
+    static constexpr size_t max_reassembled_message_size = 16 * MiB;
+    OwnPtr<MessageRing> m_send_ring;
+    OwnPtr<MessageRing> m_receive_ring;
+    ByteBuffer m_partial_message;
 };
 
 }
@@ -134,6 +134,41 @@ bool Decoder::decode(ByteBuffer& value)
     return !m_stream.handle_any_error();
 }
 
+bool Decoder::decode(StringView& value)
+{
+    ReadonlyBytes bytes;
+    if (!decode(bytes))
+        return false;
+    value = bytes.is_null() ? StringView {} : StringView { bytes };
+    return true;
+}
+
+bool Decoder::decode(ReadonlyBytes& value)
+{
+    i32 length = 0;
+    m_stream >> length;
+    if (m_stream.handle_any_error())
+        return false;
+    if (length < 0) {
+        value = {};
+        return true;
+    }
+    if (static_cast<size_t>(length) > m_stream.remaining())
+        return false;
+    value = m_stream.bytes().slice(m_stream.offset(), length);
+    return m_stream.discard_or_error(length);
+}
+
+ByteBuffer Decoder::buffer_for_borrowed_parameters(const InputMemoryStream& stream, const ByteBuffer& receive_buffer)
+{
+    auto rest_of_stream = stream.bytes().slice(stream.offset());
+    if (!receive_buffer.is_null()
+        && rest_of_stream.data() >= receive_buffer.data()
+        && rest_of_stream.data() + rest_of_stream.size() == receive_buffer.data() + receive_buffer.size())
+        return receive_buffer;
+    return ByteBuffer::copy(rest_of_stream);
+}
+
 bool Decoder::decode(URL& value)
 {
     String string;
@@ -26,6 +26,7 @@
 
 #pragma once
 
+#include <AK/ByteBuffer.h>
 #include <AK/Forward.h>
 #include <AK/NumericLimits.h>
 #include <AK/StdLibExtras.h>
@@ -62,6 +63,8 @@ public:
     bool decode(float&);
     bool decode(String&);
     bool decode(ByteBuffer&);
+    bool decode(StringView&);
+    bool decode(ReadonlyBytes&);
     bool decode(URL&);
     bool decode(Dictionary&);
     bool decode(File&);
@@ -124,6 +127,11 @@ public:
         return true;
     }
 
+    // StringView and ReadonlyBytes are decoded as views into the stream, so a message with such
+    // parameters keeps the memory it was decoded from alive. That is the buffer it was received in
+    // when the caller can share it, and a copy of the rest of the stream otherwise.
+    static ByteBuffer buffer_for_borrowed_parameters(const InputMemoryStream&, const ByteBuffer& receive_buffer);
+
 private:
     InputMemoryStream& m_stream;
     int m_sockfd { -1 };
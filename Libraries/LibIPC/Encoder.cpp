@@ -131,19 +131,24 @@ Encoder& Encoder::operator<<(const char* value)
 
 Encoder& Encoder::operator<<(const StringView& value)
 {
+    if (value.is_null())
+        return *this << (i32)-1;
+    *this << static_cast<i32>(value.length());
     m_buffer.data.append((const u8*)value.characters_without_null_termination(), value.length());
     return *this;
 }
 
 Encoder& Encoder::operator<<(const String& value)
 {
-    if (value.is_null())
-        return *this << (i32)-1;
-    *this << static_cast<i32>(value.length());
     return *this << value.view();
 }
 
 Encoder& Encoder::operator<<(const ByteBuffer& value)
+{
+    return *this << value.bytes();
+}
+
+Encoder& Encoder::operator<<(ReadonlyBytes value)
 {
     *this << static_cast<i32>(value.size());
     m_buffer.data.append(value.data(), value.size());
@@ -59,6 +59,7 @@ public:
     Encoder& operator<<(const StringView&);
     Encoder& operator<<(const String&);
     Encoder& operator<<(const ByteBuffer&);
+    Encoder& operator<<(ReadonlyBytes);
     Encoder& operator<<(const URL&);
     Encoder& operator<<(const Dictionary&);
     Encoder& operator<<(const File&);
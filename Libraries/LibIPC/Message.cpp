@@ -24,6 +24,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <LibIPC/Encoder.h>
 #include <LibIPC/Message.h>
 
 namespace IPC {
@@ -38,4 +39,12 @@ Message::~Message()
         on_destruction();
 }
 
+MessageBuffer Message::coalescing_key() const
+{
+    MessageBuffer buffer;
+    Encoder encoder(buffer);
+    encode_coalescing_key(encoder);
+    return buffer;
+}
+
 }
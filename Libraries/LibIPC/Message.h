@@ -28,6 +28,7 @@
 
 #include <AK/Function.h>
 #include <AK/Vector.h>
+#include <LibIPC/Forward.h>
 
 namespace IPC {
 
@@ -45,6 +46,12 @@ public:
     virtual const char* message_name() const = 0;
     virtual MessageBuffer encode() const = 0;
 
+    // A coalescable message replaces any earlier one with the same id and coalescing key
+    // that is still waiting in the connection's send queue.
+    virtual bool is_coalescable() const { return false; }
+    virtual void encode_coalescing_key(Encoder&) const { }
+    MessageBuffer coalescing_key() const;
+
     Function<void()> on_destruction;
 
 protected:
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Atomic.h>
+#include <AK/StdLibExtras.h>
+#include <LibIPC/MessageRing.h>
+#include <string.h>
+
+namespace IPC {
+
+static constexpr size_t minimum_capacity = 4 * KiB;
+static constexpr size_t maximum_capacity = 1 * MiB;
+
+static bool is_valid_capacity(size_t capacity)
+{
+    return capacity >= minimum_capacity && capacity <= maximum_capacity && (capacity & (capacity - 1)) == 0;
+}
+
+Optional<size_t> MessageRing::capacity_for_shared_buffer_size(size_t size)
+{
+    if (size < 2 * header_size)
+        return {};
+    size_t capacity = size / 2 - header_size;
+    if (shared_buffer_size(capacity) != size || !is_valid_capacity(capacity))
+        return {};
+    return capacity;
+}
+
+MessageRing::MessageRing(u8* shared_buffer, size_t capacity, size_t index)
+    : m_header(reinterpret_cast<Header*>(shared_buffer + index * header_size))
+    , m_data(shared_buffer + 2 * header_size + index * capacity)
+    , m_capacity(capacity)
+{
+    static_assert(sizeof(Header) <= header_size);
+    ASSERT(is_valid_capacity(capacity));
+    ASSERT(index < 2);
+    // Each position is only ever moved by one side. When the consumer attaches,
+    // the producer may already have written records, but nothing has been
+    // consumed yet, so the published values are where both of us start.
+    m_head = AK::atomic_load(&m_header->head);
+    m_tail = AK::atomic_load(&m_header->tail);
+}
+
+size_t MessageRing::size_in_ring(size_t record_size) const
+{
+    return record_header_size + round_up_to_power_of_two(record_size, record_alignment);
+}
+
+MessageRing::Status MessageRing::write(ReadonlyBytes bytes, u32 flags, bool& consumer_needs_wakeup)
+{
+    ASSERT(bytes.size() <= max_record_size());
+    ASSERT(!(flags & Padding));
+
+    u32 head = AK::atomic_load(&header().head);
+    u32 used = m_tail - head;
+    if (used > m_capacity)
+        return Status::Corrupted;
+
+    // Records are never split at the end of the ring, so the consumer can copy each one out in a single piece.
+    size_t needed = size_in_ring(bytes.size());
+    size_t offset = m_tail & (m_capacity - 1);
+    size_t padding = needed > m_capacity - offset ? m_capacity - offset : 0;
+    if (m_capacity - used < padding + needed)
+        return Status::WouldBlock;
+
+    u32 old_tail = m_tail;
+    if (padding) {
+        RecordHeader padding_header { 0, Padding };
+        memcpy(m_data + offset, &padding_header, sizeof(padding_header));
+        m_tail += padding;
+        offset = 0;
+    }
+
+    RecordHeader record_header { (u32)bytes.size(), flags };
+    memcpy(m_data + offset, &record_header, sizeof(record_header));
+    memcpy(m_data + offset + record_header_size, bytes.data(), bytes.size());
+    m_tail += needed;
+
+    AK::atomic_store(&header().tail, m_tail);
+    // Only look at the head after publishing the tail. Either the consumer sees
+    // the new tail before it goes to sleep, or we see that it has caught up.
+    consumer_needs_wakeup = AK::atomic_load(&header().head) == old_tail;
+    return Status::Ok;
+}
+
+void MessageRing::set_producer_waiting()
+{
+    AK::atomic_store(&header().producer_is_waiting, 1u);
+}
+
+MessageRing::Status MessageRing::read(Record& record)
+{
+    u32 tail = AK::atomic_load(&header().tail);
+    for (;;) {
+        u32 available = tail - m_head;
+        if (available > m_capacity)
+            return Status::Corrupted;
+        if (!available)
+            return Status::WouldBlock;
+        if (available < record_header_size)
+            return Status::Corrupted;
+
+        // Copy the header out, so the peer can't change it after we've checked it.
+        size_t offset = m_head & (m_capacity - 1);
+        RecordHeader record_header;
+        memcpy(&record_header, m_data + offset, sizeof(record_header));
+
+        if (record_header.flags & Padding) {
+            m_head += m_capacity - offset;
+            continue;
+        }
+
+        if (record_header.size > max_record_size())
+            return Status::Corrupted;
+        size_t record_size_in_ring = size_in_ring(record_header.size);
+        if (record_size_in_ring > available || record_size_in_ring > m_capacity - offset)
+            return Status::Corrupted;
+
+        record.bytes = { m_data + offset + record_header_size, record_header.size };
+        record.flags = record_header.flags;
+        record.size_in_ring = record_size_in_ring;
+        return Status::Ok;
+    }
+}
+
+bool MessageRing::consume(const Record& record)
+{
+    m_head += record.size_in_ring;
+    AK::atomic_store(&header().head, m_head);
+    // Same as in write(): publish the head first, then check whether the producer is waiting for it.
+    return AK::atomic_exchange(&header().producer_is_waiting, 0u) != 0;
+}
+
+}
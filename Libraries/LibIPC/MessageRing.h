@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <AK/Optional.h>
+#include <AK/Span.h>
+#include <AK/Types.h>
+
+namespace IPC {
+
+// One direction of the shared memory transport: a ring of message records in
+// memory that both peers have mapped. There is exactly one producer and one
+// consumer, and the only thing they share are the positions in the header.
+//
+// The peer can write anything it likes into shared memory at any time, so each
+// side keeps its own position privately and only ever publishes it. Everything
+// read from the peer's side is validated, and a ring that doesn't make sense
+// is reported as Corrupted.
+class MessageRing {
+public:
+    enum class Status {
+        Ok,
+        WouldBlock,
+        Corrupted,
+    };
+
+    enum RecordFlags : u32 {
+        None = 0,
+        // More records follow that belong to the same message.
+        Fragment = 1 << 0,
+        // Not a real record; the rest of the ring up to the end is unused.
+        Padding = 1 << 1,
+    };
+
+    struct Record {
+        ReadonlyBytes bytes;
+        u32 flags { None };
+        size_t size_in_ring { 0 };
+    };
+
+    static constexpr size_t default_capacity = 64 * KiB;
+
+    // A shared buffer holds two rings, one for each direction: both headers
+    // come first, each on its own cache line, followed by the two data areas.
+    static constexpr size_t header_size = 64;
+    static constexpr size_t shared_buffer_size(size_t capacity) { return 2 * (header_size + capacity); }
+    static Optional<size_t> capacity_for_shared_buffer_size(size_t);
+
+    MessageRing(u8* shared_buffer, size_t capacity, size_t index);
+
+    // The largest record we write. Messages that don't fit are split into fragments.
+    size_t max_record_size() const { return m_capacity / 4 - record_header_size; }
+
+    // Producer side.
+    // Appends a record, and sets consumer_needs_wakeup if the consumer had already
+    // caught up with everything before it, and may be waiting for a doorbell.
+    Status write(ReadonlyBytes, u32 flags, bool& consumer_needs_wakeup);
+    // Asks the consumer for a doorbell once it has made room.
+    // Try writing again after this, the consumer may have done so already.
+    void set_producer_waiting();
+
+    // Consumer side.
+    // Returns the next record. Its bytes point into shared memory that the producer may
+    // rewrite at any time, so copy them out before looking at them, and then consume it.
+    Status read(Record&);
+    // Returns true if the producer is waiting for room, and should get a doorbell.
+    bool consume(const Record&);
+
+private:
+    struct Header {
+        u32 head;
+        u32 tail;
+        u32 producer_is_waiting;
+    };
+
+    struct RecordHeader {
+        u32 size;
+        u32 flags;
+    };
+
+    static constexpr size_t record_header_size = sizeof(RecordHeader);
+    static constexpr size_t record_alignment = 8;
+
+    size_t size_in_ring(size_t record_size) const;
+
+    Header& header() { return *m_header; }
+
+    Header* m_header { nullptr };
+    u8* m_data { nullptr };
+    size_t m_capacity { 0 };
+
+    // Our own copy of the position we own: the tail for the producer, the head for the consumer.
+    u32 m_head { 0 };
+    u32 m_tail { 0 };
+};
+
+}
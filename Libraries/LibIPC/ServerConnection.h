@@ -47,6 +47,8 @@ public:
         ASSERT(this->socket().is_connected());
 
         this->initialize_peer_info();
+        if (this->uses_shared_memory_transport())
+            this->set_up_shared_memory_transport();
     }
 
     virtual void handshake() = 0;
@@ -67,7 +67,11 @@ void ClientConnection::die()
 
 void ClientConnection::did_finish_playing_buffer(Badge<BufferQueue>, int buffer_id)
 {
-    post_message(Messages::AudioClient::FinishedPlayingBuffer(buffer_id));
+    // This is called on the mixer thread, so leave the actual sending to the main thread.
+    Core::EventLoop::main().post_event(*this, make<Core::DeferredInvocationEvent>([buffer_id](auto& object) {
+        static_cast<ClientConnection&>(object).post_message(Messages::AudioClient::FinishedPlayingBuffer(buffer_id));
+    }));
+    Core::EventLoop::wake();
 }
 
 void ClientConnection::did_change_muted_state(Badge<Mixer>, bool muted)
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Types.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+static int wait_for_events(int epoll_fd, epoll_event& event)
+{
+    int count = epoll_wait(epoll_fd, &event, 1, 0);
+    if (count < 0)
+        perror("epoll_wait");
+    return count;
+}
+
+static bool watch(int epoll_fd, int fd, u32 events)
+{
+    epoll_event event {};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("epoll_ctl");
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    int level_pipe[2];
+    int edge_pipe[2];
+    if (pipe(level_pipe) < 0 || pipe(edge_pipe) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    if (!watch(epoll_fd, level_pipe[0], EPOLLIN) || !watch(epoll_fd, edge_pipe[0], EPOLLIN | EPOLLET))
+        return 1;
+
+    epoll_event event {};
+    if (wait_for_events(epoll_fd, event) != 0) {
+        fprintf(stderr, "empty pipes reported as ready\n");
+        return 1;
+    }
+
+    // Level-triggered watches keep being reported until the data has been read.
+    write(level_pipe[1], "x", 1);
+    for (int i = 0; i < 2; ++i) {
+        if (wait_for_events(epoll_fd, event) != 1 || event.data.fd != level_pipe[0] || event.events != EPOLLIN) {
+            fprintf(stderr, "level-triggered pipe not reported as readable\n");
+            return 1;
+        }
+    }
+    char buffer[2];
+    read(level_pipe[0], buffer, 1);
+    if (wait_for_events(epoll_fd, event) != 0) {
+        fprintf(stderr, "drained pipe still reported as ready\n");
+        return 1;
+    }
+
+    // Edge-triggered watches are reported once per notification.
+    write(edge_pipe[1], "x", 1);
+    if (wait_for_events(epoll_fd, event) != 1 || event.data.fd != edge_pipe[0]) {
+        fprintf(stderr, "edge-triggered pipe not reported as readable\n");
+        return 1;
+    }
+    if (wait_for_events(epoll_fd, event) != 0) {
+        fprintf(stderr, "edge-triggered pipe reported twice\n");
+        return 1;
+    }
+    read(edge_pipe[0], buffer, 1);
+
+    // A hang-up is reported even though it wasn't asked for.
+    close(level_pipe[1]);
+    if (wait_for_events(epoll_fd, event) != 1 || event.data.fd != level_pipe[0] || !(event.events & EPOLLHUP)) {
+        fprintf(stderr, "hang-up not reported\n");
+        return 1;
+    }
+
+    // Closing the last fd for a description drops its watch.
+    close(level_pipe[0]);
+    if (wait_for_events(epoll_fd, event) != 0) {
+        fprintf(stderr, "closed fd still reported\n");
+        return 1;
+    }
+
+    // Writing into a pipe nobody reads from anymore is an error.
+    close(edge_pipe[0]);
+    if (!watch(epoll_fd, edge_pipe[1], EPOLLOUT))
+        return 1;
+    if (wait_for_events(epoll_fd, event) != 1 || event.data.fd != edge_pipe[1] || !(event.events & EPOLLERR)) {
+        fprintf(stderr, "error on a pipe without readers not reported\n");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/HashMap.h>
+#include <AK/HashTable.h>
+#include <AK/String.h>
+#include <AK/Vector.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Fills one directory with enough names that ext2 has to index it and split its leaves
+// a number of times, then checks lookups, readdir and unlink. The directory has to live
+// on an ext2 file system with the dir_index feature (mke2fs turns it on by default).
+//
+// To also cover names whose hashes collide, the test reads the hash version and seed from
+// the file system's superblock (which needs read access to the device) and looks for such
+// names with the same hash functions the kernel uses.
+
+static constexpr size_t entry_count = 3000;
+static constexpr size_t collision_group_count = 3;
+
+static constexpr off_t superblock_offset = 1024;
+static constexpr size_t superblock_magic_offset = 56;
+static constexpr size_t superblock_feature_compat_offset = 92;
+static constexpr size_t superblock_hash_seed_offset = 236;
+static constexpr size_t superblock_def_hash_version_offset = 252;
+static constexpr size_t superblock_flags_offset = 352;
+
+static constexpr u16 ext2_magic = 0xef53;
+static constexpr u32 feature_compat_dir_index = 0x20;
+static constexpr u32 flags_unsigned_hash = 0x2;
+
+enum HashVersion : u8 {
+    Legacy,
+    HalfMD4,
+    TEA,
+};
+
+struct HashParameters {
+    HashVersion version { HalfMD4 };
+    bool is_unsigned { false };
+    u32 seed[4] {};
+};
+
+static inline u32 rotate_left(u32 value, unsigned shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static void tea_transform(u32 buffer[4], const u32 in[4])
+{
+    u32 sum = 0;
+    u32 b0 = buffer[0];
+    u32 b1 = buffer[1];
+    for (int i = 0; i < 16; ++i) {
+        sum += 0x9e3779b9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    buffer[0] += b0;
+    buffer[1] += b1;
+}
+
+static void half_md4_transform(u32 buffer[4], const u32 in[8])
+{
+    auto f = [](u32 x, u32 y, u32 z) { return z ^ (x & (y ^ z)); };
+    auto g = [](u32 x, u32 y, u32 z) { return (x & y) + ((x ^ y) & z); };
+    auto h = [](u32 x, u32 y, u32 z) { return x ^ y ^ z; };
+    constexpr u32 k2 = 013240474631;
+    constexpr u32 k3 = 015666365641;
+
+    u32 a = buffer[0];
+    u32 b = buffer[1];
+    u32 c = buffer[2];
+    u32 d = buffer[3];
+
+#define ROUND(function, a, b, c, d, x, s) a = rotate_left(a + function(b, c, d) + (x), s)
+    ROUND(f, a, b, c, d, in[0], 3);
+    ROUND(f, d, a, b, c, in[1], 7);
+    ROUND(f, c, d, a, b, in[2], 11);
+    ROUND(f, b, c, d, a, in[3], 19);
+    ROUND(f, a, b, c, d, in[4], 3);
+    ROUND(f, d, a, b, c, in[5], 7);
+    ROUND(f, c, d, a, b, in[6], 11);
+    ROUND(f, b, c, d, a, in[7], 19);
+
+    ROUND(g, a, b, c, d, in[1] + k2, 3);
+    ROUND(g, d, a, b, c, in[3] + k2, 5);
+    ROUND(g, c, d, a, b, in[5] + k2, 9);
+    ROUND(g, b, c, d, a, in[7] + k2, 13);
+    ROUND(g, a, b, c, d, in[0] + k2, 3);
+    ROUND(g, d, a, b, c, in[2] + k2, 5);
+    ROUND(g, c, d, a, b, in[4] + k2, 9);
+    ROUND(g, b, c, d, a, in[6] + k2, 13);
+
+    ROUND(h, a, b, c, d, in[3] + k3, 3);
+    ROUND(h, d, a, b, c, in[7] + k3, 9);
+    ROUND(h, c, d, a, b, in[2] + k3, 11);
+    ROUND(h, b, c, d, a, in[6] + k3, 15);
+    ROUND(h, a, b, c, d, in[1] + k3, 3);
+    ROUND(h, d, a, b, c, in[5] + k3, 9);
+    ROUND(h, c, d, a, b, in[0] + k3, 11);
+    ROUND(h, b, c, d, a, in[4] + k3, 15);
+#undef ROUND
+
+    buffer[0] += a;
+    buffer[1] += b;
+    buffer[2] += c;
+    buffer[3] += d;
+}
+
+static inline int hash_character(char c, bool is_unsigned)
+{
+    return is_unsigned ? static_cast<int>(static_cast<unsigned char>(c)) : static_cast<int>(static_cast<signed char>(c));
+}
+
+static void fill_input(const char* characters, int length, u32* input, int count, bool is_unsigned)
+{
+    u32 pad = static_cast<u32>(length) | (static_cast<u32>(length) << 8);
+    pad |= pad << 16;
+
+    u32 value = pad;
+    if (length > count * 4)
+        length = count * 4;
+    for (int i = 0; i < length; ++i) {
+        value = hash_character(characters[i], is_unsigned) + (value << 8);
+        if ((i % 4) == 3) {
+            *input++ = value;
+            value = pad;
+            --count;
+        }
+    }
+    if (--count >= 0)
+        *input++ = value;
+    while (--count >= 0)
+        *input++ = pad;
+}
+
+static u32 name_hash(const String& name, const HashParameters& parameters)
+{
+    u32 buffer[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    if (parameters.seed[0] || parameters.seed[1] || parameters.seed[2] || parameters.seed[3])
+        memcpy(buffer, parameters.seed, sizeof(buffer));
+
+    const char* characters = name.characters();
+    int length = name.length();
+    u32 hash = 0;
+
+    switch (parameters.version) {
+    case Legacy: {
+        u32 hash0 = 0x12a3fe2d;
+        u32 hash1 = 0x37abe8f9;
+        for (int i = 0; i < length; ++i) {
+            u32 value = hash1 + (hash0 ^ static_cast<u32>(hash_character(characters[i], parameters.is_unsigned) * 7152373));
+            if (value & 0x80000000)
+                value -= 0x7fffffff;
+            hash1 = hash0;
+            hash0 = value;
+        }
+        hash = hash0 << 1;
+        break;
+    }
+    case HalfMD4: {
+        u32 input[8];
+        for (; length > 0; length -= 32, characters += 32) {
+            fill_input(characters, length, input, 8, parameters.is_unsigned);
+            half_md4_transform(buffer, input);
+        }
+        hash = buffer[1];
+        break;
+    }
+    case TEA: {
+        u32 input[4];
+        for (; length > 0; length -= 16, characters += 16) {
+            fill_input(characters, length, input, 4, parameters.is_unsigned);
+            tea_transform(buffer, input);
+        }
+        hash = buffer[0];
+        break;
+    }
+    }
+
+    hash &= ~1u;
+    if (hash == (0x7fffffffu << 1))
+        hash = (0x7fffffffu - 1) << 1;
+    return hash;
+}
+
+static bool read_hash_parameters(const char* device_path, HashParameters& parameters)
+{
+    int fd = open(device_path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    u8 superblock[1024];
+    bool did_read = pread(fd, superblock, sizeof(superblock), superblock_offset) == sizeof(superblock);
+    close(fd);
+    if (!did_read)
+        return false;
+
+    auto read_u32 = [&](size_t offset) {
+        u32 value;
+        memcpy(&value, superblock + offset, sizeof(value));
+        return value;
+    };
+    u16 magic;
+    memcpy(&magic, superblock + superblock_magic_offset, sizeof(magic));
+    if (magic != ext2_magic || !(read_u32(superblock_feature_compat_offset) & feature_compat_dir_index))
+        return false;
+
+    // New indexes use the default hash version, or half-MD4 if the kernel doesn't know it.
+    u8 version = superblock[superblock_def_hash_version_offset];
+    parameters.version = version <= TEA ? static_cast<HashVersion>(version) : HalfMD4;
+    parameters.is_unsigned = read_u32(superblock_flags_offset) & flags_unsigned_hash;
+    for (size_t i = 0; i < 4; ++i)
+        parameters.seed[i] = read_u32(superblock_hash_seed_offset + i * sizeof(u32));
+    return true;
+}
+
+// Hashes are 31 bits wide, so a few hundred thousand candidates are enough for a couple of collisions.
+static Vector<String> find_colliding_names(const HashParameters& parameters)
+{
+    Vector<String> names;
+    HashMap<u32, u32> candidates;
+    for (u32 i = 0; i < 1u << 20 && names.size() < collision_group_count * 2; ++i) {
+        u32 hash = name_hash(String::format("collision-%x", i), parameters);
+        auto it = candidates.find(hash);
+        if (it == candidates.end()) {
+            candidates.set(hash, i);
+            continue;
+        }
+        names.append(String::format("collision-%x", it->value));
+        names.append(String::format("collision-%x", i));
+    }
+    return names;
+}
+
+static bool check_lookup(const String& directory, const String& name, ino_t expected_inode)
+{
+    struct stat st;
+    auto path = String::format("%s/%s", directory.characters(), name.characters());
+    if (expected_inode == 0) {
+        if (stat(path.characters(), &st) == 0 || errno != ENOENT) {
+            fprintf(stderr, "removed name %s is still found\n", name.characters());
+            return false;
+        }
+        return true;
+    }
+    if (stat(path.characters(), &st) < 0) {
+        fprintf(stderr, "lookup of %s failed: %s\n", name.characters(), strerror(errno));
+        return false;
+    }
+    if (st.st_ino != expected_inode) {
+        fprintf(stderr, "lookup of %s found the wrong inode\n", name.characters());
+        return false;
+    }
+    return true;
+}
+
+static bool read_directory(const String& directory, Vector<String>& names)
+{
+    names.clear();
+    DIR* dir = opendir(directory.characters());
+    if (!dir) {
+        perror("opendir");
+        return false;
+    }
+    while (auto* entry = readdir(dir))
+        names.append(entry->d_name);
+    closedir(dir);
+
+    // The index lives in entries with no inode, none of them may show up as names.
+    if (names.size() < 2 || names[0] != "." || names[1] != "..") {
+        fprintf(stderr, "readdir didn't start with . and ..\n");
+        return false;
+    }
+    names.remove(0);
+    names.remove(0);
+    return true;
+}
+
+static bool check_directory(const String& directory, const HashTable<String>& expected_names, Vector<String>& order)
+{
+    if (!read_directory(directory, order))
+        return false;
+    HashTable<String> seen;
+    for (auto& name : order) {
+        if (!expected_names.contains(name)) {
+            fprintf(stderr, "readdir returned unexpected name %s\n", name.characters());
+            return false;
+        }
+        if (seen.contains(name)) {
+            fprintf(stderr, "readdir returned %s twice\n", name.characters());
+            return false;
+        }
+        seen.set(name);
+    }
+    if (seen.size() != expected_names.size()) {
+        fprintf(stderr, "readdir returned %zu names, expected %zu\n", seen.size(), expected_names.size());
+        return false;
+    }
+
+    // Without changes in between, a second pass has to see the same order.
+    Vector<String> second_order;
+    if (!read_directory(directory, second_order))
+        return false;
+    if (!(second_order == order)) {
+        fprintf(stderr, "readdir order changed between two passes\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char* parent = argc > 1 ? argv[1] : "/home/anon";
+    const char* device_path = argc > 2 ? argv[2] : "/dev/hda";
+
+    Vector<String> colliding_names;
+    HashParameters parameters;
+    if (read_hash_parameters(device_path, parameters))
+        colliding_names = find_colliding_names(parameters);
+    else
+        printf("Couldn't read the hash parameters from %s, not testing hash collisions\n", device_path);
+
+    char directory_template[PATH_MAX];
+    snprintf(directory_template, sizeof(directory_template), "%s/htree.XXXXXX", parent);
+    if (!mkdtemp(directory_template)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    String directory = directory_template;
+    auto target = String::format("%s/target", directory.characters());
+    int fd = open(target.characters(), O_CREAT | O_WRONLY, 0644);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    close(fd);
+    struct stat target_stat;
+    if (stat(target.characters(), &target_stat) < 0) {
+        perror("stat");
+        return 1;
+    }
+    ino_t inode = target_stat.st_ino;
+
+    // Hard links add directory entries without using up inodes. Long names fill leaves
+    // quickly, and the colliding names are spread out so later splits move them around.
+    Vector<String> names;
+    names.append("target");
+    size_t collision_interval = entry_count / (colliding_names.size() + 1);
+    for (size_t i = 0; i < entry_count; ++i) {
+        if (!colliding_names.is_empty() && i % collision_interval == collision_interval - 1 && i / collision_interval < colliding_names.size())
+            names.append(colliding_names[i / collision_interval]);
+        names.append(String::format("entry-%05zu-with-a-fairly-long-name", i));
+    }
+    for (size_t i = 1; i < names.size(); ++i) {
+        auto path = String::format("%s/%s", directory.characters(), names[i].characters());
+        if (link(target.characters(), path.characters()) < 0) {
+            fprintf(stderr, "link %s: %s\n", names[i].characters(), strerror(errno));
+            return 1;
+        }
+    }
+
+    HashTable<String> expected_names;
+    for (auto& name : names) {
+        if (!check_lookup(directory, name, inode))
+            return 1;
+        expected_names.set(name);
+    }
+    Vector<String> order;
+    if (!check_directory(directory, expected_names, order))
+        return 1;
+
+    // Remove every third name and one name of each colliding pair. Removing entries
+    // doesn't move the others, so readdir has to keep the remaining ones in order.
+    HashTable<String> removed_names;
+    for (size_t i = 3; i < names.size(); i += 3)
+        removed_names.set(names[i]);
+    for (size_t i = 0; i < colliding_names.size(); i += 2)
+        removed_names.set(colliding_names[i]);
+    for (auto& name : removed_names) {
+        auto path = String::format("%s/%s", directory.characters(), name.characters());
+        if (unlink(path.characters()) < 0) {
+            fprintf(stderr, "unlink %s: %s\n", name.characters(), strerror(errno));
+            return 1;
+        }
+        expected_names.remove(name);
+    }
+    for (auto& name : names) {
+        if (!check_lookup(directory, name, removed_names.contains(name) ? 0 : inode))
+            return 1;
+    }
+    Vector<String> expected_order;
+    for (auto& name : order) {
+        if (!removed_names.contains(name))
+            expected_order.append(name);
+    }
+    if (!check_directory(directory, expected_names, order))
+        return 1;
+    if (!(order == expected_order)) {
+        fprintf(stderr, "unlink reordered the remaining entries\n");
+        return 1;
+    }
+
+    // Adding the names back reuses the freed space in the leaves they hash to.
+    for (auto& name : removed_names) {
+        auto path = String::format("%s/%s", directory.characters(), name.characters());
+        if (link(target.characters(), path.characters()) < 0) {
+            fprintf(stderr, "link %s: %s\n", name.characters(), strerror(errno));
+            return 1;
+        }
+        expected_names.set(name);
+    }
+    for (auto& name : names) {
+        if (!check_lookup(directory, name, inode))
+            return 1;
+    }
+    if (!check_directory(directory, expected_names, order))
+        return 1;
+
+    for (auto& name : names) {
+        auto path = String::format("%s/%s", directory.characters(), name.characters());
+        if (unlink(path.characters()) < 0) {
+            fprintf(stderr, "unlink %s: %s\n", name.characters(), strerror(errno));
+            return 1;
+        }
+    }
+    if (!check_directory(directory, {}, order))
+        return 1;
+    if (rmdir(directory.characters()) < 0) {
+        perror("rmdir");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const size_t page_size = 4096;
+static const size_t region_count = 64;
+
+static int read_tlb_shootdowns()
+{
+    static char buffer[4096];
+    int fd = open("/proc/memstat", O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    ssize_t nread = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (nread < 0) {
+        perror("read");
+        return -1;
+    }
+    buffer[nread] = '\0';
+    const char* key = "\"tlb_shootdowns\":";
+    const char* value = strstr(buffer, key);
+    if (!value) {
+        fprintf(stderr, "no tlb_shootdowns in /proc/memstat\n");
+        return -1;
+    }
+    return atoi(value + strlen(key));
+}
+
+int main()
+{
+    // Every writable region the parent has mapped gets turned copy-on-write by fork.
+    for (size_t i = 0; i < region_count; ++i) {
+        auto* region = (u8*)mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+        if (region == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        memset(region, i, page_size);
+    }
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    int before = read_tlb_shootdowns();
+    if (before < 0)
+        return 1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        // Stay out of the way until the parent has taken its measurement.
+        char c;
+        read(pipe_fds[0], &c, 1);
+        _exit(0);
+    }
+    int after = read_tlb_shootdowns();
+    write(pipe_fds[1], "x", 1);
+    waitpid(pid, nullptr, 0);
+    if (after < 0)
+        return 1;
+
+    // Fork should shoot down the parent's ranges in a single round. Other processes
+    // may flush in the meantime, so only fail if it looks like a round per region.
+    int rounds = after - before;
+    if (rounds >= (int)region_count / 4) {
+        fprintf(stderr, "fork took %d TLB shootdown rounds for %zu regions\n", rounds, region_count);
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Assertions.h>
+#include <AK/Types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr const char* path = "/tmp/local-socket-buffer-sizes";
+static constexpr size_t chunk_size = 8192;
+
+static int get_buffer_size(int fd, int option)
+{
+    int value = 0;
+    socklen_t value_size = sizeof(value);
+    if (getsockopt(fd, SOL_SOCKET, option, &value, &value_size) < 0)
+        return -errno;
+    return value;
+}
+
+static bool set_buffer_size(int fd, int option, int value)
+{
+    if (setsockopt(fd, SOL_SOCKET, option, &value, sizeof(value)) < 0) {
+        perror("setsockopt");
+        return false;
+    }
+    return true;
+}
+
+static void fill(u8* buffer, size_t size, u8 seed)
+{
+    for (size_t i = 0; i < size; ++i)
+        buffer[i] = (u8)(seed + i * 7);
+}
+
+static int run_client(const sockaddr_un& addr)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    // Sizes are rounded up to a power of two.
+    if (!set_buffer_size(fd, SO_SNDBUF, 5000))
+        return 1;
+    if (get_buffer_size(fd, SO_SNDBUF) != (int)chunk_size) {
+        fprintf(stderr, "SO_SNDBUF was not rounded up\n");
+        return 1;
+    }
+
+    if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return 1;
+    }
+
+    u8 buffer[chunk_size];
+    fill(buffer, chunk_size, 0);
+    if (write(fd, buffer, chunk_size) != (ssize_t)chunk_size) {
+        perror("write");
+        return 1;
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (write(fd, buffer, 1) >= 0 || errno != EAGAIN) {
+        fprintf(stderr, "write into a full send buffer didn't fail with EAGAIN\n");
+        return 1;
+    }
+
+    // Growing the buffer keeps what's in it, and sizes are capped.
+    if (!set_buffer_size(fd, SO_SNDBUF, 64 * MiB))
+        return 1;
+    if (get_buffer_size(fd, SO_SNDBUF) != (int)MiB) {
+        fprintf(stderr, "SO_SNDBUF was not capped\n");
+        return 1;
+    }
+    fill(buffer, chunk_size, 1);
+    if (write(fd, buffer, chunk_size) != (ssize_t)chunk_size) {
+        perror("write after growing the buffer");
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    unlink(path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    ASSERT(strlcpy(addr.sun_path, path, sizeof(addr.sun_path)) < sizeof(addr.sun_path));
+    if (bind(listen_fd, (const sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1) < 0) {
+        perror("bind/listen");
+        return 1;
+    }
+
+    // A listening socket has no buffers of its own.
+    if (get_buffer_size(listen_fd, SO_RCVBUF) != -EINVAL) {
+        fprintf(stderr, "SO_RCVBUF on a listening socket didn't fail with EINVAL\n");
+        return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0)
+        _exit(run_client(addr));
+
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+        perror("accept");
+        return 1;
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "client failed\n");
+        return 1;
+    }
+    unlink(path);
+
+    // The accepted side receives through the buffer the client sends through.
+    if (get_buffer_size(fd, SO_RCVBUF) != (int)MiB) {
+        fprintf(stderr, "accepted socket's SO_RCVBUF doesn't match the client's SO_SNDBUF\n");
+        return 1;
+    }
+
+    u8 expected[chunk_size];
+    u8 buffer[chunk_size];
+    for (u8 seed = 0; seed < 2; ++seed) {
+        fill(expected, chunk_size, seed);
+        size_t nread = 0;
+        while (nread < chunk_size) {
+            ssize_t rc = read(fd, buffer + nread, chunk_size - nread);
+            if (rc <= 0) {
+                perror("read");
+                return 1;
+            }
+            nread += rc;
+        }
+        if (memcmp(buffer, expected, chunk_size) != 0) {
+            fprintf(stderr, "data was lost while resizing the buffer\n");
+            return 1;
+        }
+    }
+
+    printf("PASS\n");
+    return 0;
+}
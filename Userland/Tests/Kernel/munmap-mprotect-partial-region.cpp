@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Types.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const size_t page_size = 4096;
+
+static bool write_crashes(u8* address)
+{
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        *(volatile u8*)address = 0x42;
+        _exit(0);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return false;
+    }
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV;
+}
+
+static bool check_pages(const u8* base, size_t first_page, size_t last_page)
+{
+    for (size_t i = first_page; i <= last_page; ++i) {
+        if (base[i * page_size] != i || base[i * page_size + page_size - 1] != i) {
+            fprintf(stderr, "page %zu lost its contents\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    auto* base = (u8*)mmap(nullptr, 8 * page_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    for (size_t i = 0; i < 8; ++i)
+        memset(base + i * page_size, i, page_size);
+
+    // Protecting the head of a region leaves a replacement region at the same address.
+    if (mprotect(base, page_size, PROT_READ) < 0) {
+        perror("mprotect head");
+        return 1;
+    }
+    if (!write_crashes(base)) {
+        fprintf(stderr, "head page is still writable\n");
+        return 1;
+    }
+
+    // Protecting the middle splits the region into three.
+    if (mprotect(base + 3 * page_size, page_size, PROT_READ) < 0) {
+        perror("mprotect middle");
+        return 1;
+    }
+    if (!write_crashes(base + 3 * page_size)) {
+        fprintf(stderr, "middle page is still writable\n");
+        return 1;
+    }
+    base[2 * page_size] = 2;
+    base[4 * page_size] = 4;
+    if (!check_pages(base, 0, 7))
+        return 1;
+
+    // Unmapping the tail of a region leaves a replacement region at the same address.
+    if (munmap(base + 7 * page_size, page_size) < 0) {
+        perror("munmap tail");
+        return 1;
+    }
+    // Unmapping from the middle of a region splits it in two.
+    if (munmap(base + 5 * page_size, page_size) < 0) {
+        perror("munmap middle");
+        return 1;
+    }
+    if (!check_pages(base, 0, 4) || !check_pages(base, 6, 6))
+        return 1;
+    if (!write_crashes(base + 5 * page_size)) {
+        fprintf(stderr, "unmapped page is still accessible\n");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
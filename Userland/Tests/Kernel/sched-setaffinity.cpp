@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <LibCore/ProcessStatisticsReader.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static pid_t s_worker_tid;
+
+static void* worker(void*)
+{
+    s_worker_tid = gettid();
+    return nullptr;
+}
+
+int main()
+{
+    cpu_set_t all_processors;
+    if (sched_getaffinity(0, sizeof(all_processors), &all_processors) < 0) {
+        perror("sched_getaffinity");
+        return 1;
+    }
+    u32 last_processor = 31 - __builtin_clz(all_processors.__bits[0]);
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(last_processor, &mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) < 0) {
+        perror("sched_setaffinity");
+        return 1;
+    }
+    // Give the scheduler a chance to move us over.
+    sched_yield();
+    cpu_set_t current_mask;
+    if (sched_getaffinity(0, sizeof(current_mask), &current_mask) < 0 || current_mask.__bits[0] != mask.__bits[0]) {
+        fprintf(stderr, "affinity was not updated\n");
+        return 1;
+    }
+
+    CPU_ZERO(&mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) == 0 || errno != EINVAL) {
+        fprintf(stderr, "empty affinity mask was accepted\n");
+        return 1;
+    }
+
+    // A thread that has exited can't be pinned anymore.
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, worker, nullptr) != 0 || pthread_join(thread, nullptr) != 0) {
+        fprintf(stderr, "could not run worker thread\n");
+        return 1;
+    }
+    if (sched_setaffinity(s_worker_tid, sizeof(all_processors), &all_processors) == 0 || errno != ESRCH) {
+        fprintf(stderr, "exited thread was pinned\n");
+        return 1;
+    }
+
+    // Kernel threads, like the idle threads of the kernel process, stay where they are.
+    // Only root gets past the permission check for them, so that's the only way to see the EINVAL.
+    if (geteuid() != 0) {
+        printf("Not running as root, skipping the kernel thread check\n");
+    } else {
+        auto all_processes = Core::ProcessStatisticsReader::get_all();
+        auto kernel_process = all_processes.get(0);
+        if (!kernel_process.has_value() || kernel_process.value().threads.is_empty()) {
+            fprintf(stderr, "could not find the kernel process\n");
+            return 1;
+        }
+        for (auto& kernel_thread : kernel_process.value().threads) {
+            if (sched_setaffinity(kernel_thread.tid, sizeof(all_processors), &all_processors) == 0 || errno != EINVAL) {
+                fprintf(stderr, "kernel thread %d was not rejected with EINVAL\n", kernel_thread.tid);
+                return 1;
+            }
+        }
+    }
+
+    if (sched_setaffinity(0, sizeof(all_processors), &all_processors) < 0) {
+        perror("sched_setaffinity");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+static const char contents[] = "Hello from sendfile!";
+
+static bool read_back(int fd, const char* expected, size_t size)
+{
+    char buffer[sizeof(contents)] {};
+    if (read(fd, buffer, size) != (ssize_t)size || memcmp(buffer, expected, size) != 0) {
+        fprintf(stderr, "pipe got the wrong data\n");
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    char path[] = "/tmp/sendfile.XXXXXX";
+    int file_fd = mkstemp(path);
+    if (file_fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    unlink(path);
+    if (write(file_fd, contents, sizeof(contents)) != sizeof(contents)) {
+        perror("write");
+        return 1;
+    }
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    // With an offset, the file's own offset is left alone.
+    off_t offset = 6;
+    if (sendfile(pipe_fds[1], file_fd, &offset, 4) != 4 || offset != 10) {
+        perror("sendfile with offset");
+        return 1;
+    }
+    if (!read_back(pipe_fds[0], contents + 6, 4))
+        return 1;
+    if (lseek(file_fd, 0, SEEK_CUR) != sizeof(contents)) {
+        fprintf(stderr, "sendfile with an offset moved the file offset\n");
+        return 1;
+    }
+
+    // Without one, sendfile() reads from and advances the file offset.
+    lseek(file_fd, 0, SEEK_SET);
+    if (sendfile(pipe_fds[1], file_fd, nullptr, 5) != 5) {
+        perror("sendfile without offset");
+        return 1;
+    }
+    if (!read_back(pipe_fds[0], contents, 5))
+        return 1;
+    if (lseek(file_fd, 0, SEEK_CUR) != 5) {
+        fprintf(stderr, "sendfile without an offset didn't move the file offset\n");
+        return 1;
+    }
+
+    // Only regular files can be sent from.
+    if (sendfile(pipe_fds[1], pipe_fds[0], nullptr, 1) != -1 || errno != EINVAL) {
+        fprintf(stderr, "sendfile from a pipe was accepted\n");
+        return 1;
+    }
+    int directory_fd = open("/tmp", O_RDONLY | O_DIRECTORY);
+    if (directory_fd < 0) {
+        perror("open");
+        return 1;
+    }
+    if (sendfile(pipe_fds[1], directory_fd, nullptr, 1) != -1 || errno != EINVAL) {
+        fprintf(stderr, "sendfile from a directory was accepted\n");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/Types.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr size_t chunk_count = 256;
+static constexpr size_t thread_malloc_count = 100;
+
+static void* allocate_and_exit(void*)
+{
+    void* chunks[thread_malloc_count];
+    for (size_t i = 0; i < thread_malloc_count; ++i) {
+        chunks[i] = malloc(48);
+        memset(chunks[i], 0, 48);
+    }
+    for (size_t i = 0; i < thread_malloc_count; ++i)
+        free(chunks[i]);
+    return nullptr;
+}
+
+int main()
+{
+    bool failed = false;
+    serenity_malloc_stats before;
+    serenity_get_malloc_stats(&before);
+
+    // Freeing more chunks than a thread cache holds spills some of them.
+    void* chunks[chunk_count];
+    for (size_t i = 0; i < chunk_count; ++i) {
+        chunks[i] = malloc(32);
+        memset(chunks[i], 0, 32);
+    }
+    for (size_t i = 0; i < chunk_count; ++i)
+        free(chunks[i]);
+
+    // Allocating right after a free is served from the thread cache.
+    for (size_t i = 0; i < chunk_count; ++i) {
+        chunks[i] = malloc(32);
+        memset(chunks[i], 0, 32);
+        free(chunks[i]);
+    }
+
+    void* big = malloc(1 * MiB);
+    memset(big, 0, 1 * MiB);
+    free(big);
+
+    serenity_malloc_stats after;
+    serenity_get_malloc_stats(&after);
+    if (after.malloc_calls - before.malloc_calls < 2 * chunk_count + 1) {
+        fprintf(stderr, "Not all malloc calls were counted\n");
+        failed = true;
+    }
+    if (after.free_calls - before.free_calls < 2 * chunk_count + 1) {
+        fprintf(stderr, "Not all free calls were counted\n");
+        failed = true;
+    }
+    if (after.thread_cache_hits - before.thread_cache_hits < chunk_count) {
+        fprintf(stderr, "Not all thread cache hits were counted\n");
+        failed = true;
+    }
+    if (after.thread_cache_refills == before.thread_cache_refills) {
+        fprintf(stderr, "No thread cache refills were counted\n");
+        failed = true;
+    }
+    if (after.thread_cache_flushes == before.thread_cache_flushes) {
+        fprintf(stderr, "No thread cache flushes were counted\n");
+        failed = true;
+    }
+    if (after.remote_frees == before.remote_frees) {
+        fprintf(stderr, "No spilled chunks were counted\n");
+        failed = true;
+    }
+    if (after.big_allocs + after.big_allocator_hits == before.big_allocs + before.big_allocator_hits) {
+        fprintf(stderr, "The big allocation wasn't counted\n");
+        failed = true;
+    }
+    if (after.chunked_blocks == 0) {
+        fprintf(stderr, "No chunked blocks were counted\n");
+        failed = true;
+    }
+
+    // A thread's counters and cached chunks are handed back when it exits.
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, allocate_and_exit, nullptr) != 0 || pthread_join(thread, nullptr) != 0) {
+        perror("pthread");
+        return 1;
+    }
+    serenity_malloc_stats after_thread;
+    serenity_get_malloc_stats(&after_thread);
+    if (after_thread.malloc_calls - after.malloc_calls < thread_malloc_count) {
+        fprintf(stderr, "The exited thread's malloc calls weren't counted\n");
+        failed = true;
+    }
+    if (after_thread.free_calls - after.free_calls < thread_malloc_count) {
+        fprintf(stderr, "The exited thread's free calls weren't counted\n");
+        failed = true;
+    }
+    if (after_thread.chunked_bytes_free == 0) {
+        fprintf(stderr, "The exited thread's chunks weren't returned\n");
+        failed = true;
+    }
+
+    malloc_stats();
+
+    printf(failed ? "FAIL\n" : "PASS\n");
+    return failed ? 1 : 0;
+}
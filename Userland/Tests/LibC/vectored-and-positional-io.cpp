@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+int main()
+{
+    char path[] = "/tmp/vectored-io.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    unlink(path);
+
+    // pwritev() gathers the buffers in order, at the offset, without moving the file offset.
+    char hello[] = "Hello, ";
+    char world[] = "world!";
+    iovec write_vecs[] = { { hello, strlen(hello) }, { world, strlen(world) } };
+    ssize_t nwritten = pwritev(fd, write_vecs, 2, 3);
+    if (nwritten < 0) {
+        perror("pwritev");
+        return 1;
+    }
+    if (nwritten != 13) {
+        fprintf(stderr, "pwritev wrote %zd bytes, expected 13\n", nwritten);
+        return 1;
+    }
+    if (lseek(fd, 0, SEEK_CUR) != 0) {
+        fprintf(stderr, "pwritev moved the file offset\n");
+        return 1;
+    }
+
+    // preadv() scatters into the buffers in order, again without moving the file offset.
+    char first[5] {};
+    char second[9] {};
+    iovec read_vecs[] = { { first, 4 }, { second, 8 } };
+    ssize_t nread = preadv(fd, read_vecs, 2, 4);
+    if (nread < 0) {
+        perror("preadv");
+        return 1;
+    }
+    if (nread != 12 || strcmp(first, "ello") || strcmp(second, ", world!")) {
+        fprintf(stderr, "preadv read %zd bytes, '%s' and '%s'\n", nread, first, second);
+        return 1;
+    }
+    if (lseek(fd, 0, SEEK_CUR) != 0) {
+        fprintf(stderr, "preadv moved the file offset\n");
+        return 1;
+    }
+
+    // A short read stops at the end of the file.
+    memset(first, 0, sizeof(first));
+    memset(second, 0, sizeof(second));
+    nread = preadv(fd, read_vecs, 2, 12);
+    if (nread != 4) {
+        fprintf(stderr, "preadv at the end of the file read %zd bytes, expected 4\n", nread);
+        return 1;
+    }
+
+    // readv() reads from and advances the file offset.
+    lseek(fd, 3, SEEK_SET);
+    memset(first, 0, sizeof(first));
+    memset(second, 0, sizeof(second));
+    nread = readv(fd, read_vecs, 2);
+    if (nread < 0) {
+        perror("readv");
+        return 1;
+    }
+    if (nread != 12 || strcmp(first, "Hell") || strcmp(second, "o, world")) {
+        fprintf(stderr, "readv read %zd bytes, '%s' and '%s'\n", nread, first, second);
+        return 1;
+    }
+    if (lseek(fd, 0, SEEK_CUR) != 15) {
+        fprintf(stderr, "readv didn't advance the file offset\n");
+        return 1;
+    }
+
+    if (pwritev(fd, write_vecs, 2, -1) >= 0 || errno != EINVAL) {
+        fprintf(stderr, "pwritev accepted a negative offset\n");
+        return 1;
+    }
+    if (preadv(fd, read_vecs, 2, -1) >= 0 || errno != EINVAL) {
+        fprintf(stderr, "preadv accepted a negative offset\n");
+        return 1;
+    }
+
+    int directory_fd = open("/tmp", O_RDONLY | O_DIRECTORY);
+    if (directory_fd < 0) {
+        perror("open");
+        return 1;
+    }
+    if (preadv(directory_fd, read_vecs, 2, 0) >= 0 || errno != EISDIR) {
+        fprintf(stderr, "preadv accepted a directory\n");
+        return 1;
+    }
+
+    printf("PASS\n");
+    return 0;
+}
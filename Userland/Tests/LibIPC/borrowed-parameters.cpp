@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018-2020, the SerenityOS developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <AK/TestSuite.h>
+
+#include <AK/ByteBuffer.h>
+#include <AK/MemoryStream.h>
+#include <AK/String.h>
+#include <LibIPC/Decoder.h>
+#include <LibIPC/Encoder.h>
+#include <string.h>
+
+static const u8 raw_bytes[] = { 0, 1, 2, 254, 255 };
+
+static ByteBuffer encode_message()
+{
+    IPC::MessageBuffer message_buffer;
+    IPC::Encoder encoder(message_buffer);
+    encoder << (i32)42;
+    encoder << StringView("Hello friends!");
+    encoder << ReadonlyBytes { raw_bytes, sizeof(raw_bytes) };
+    encoder << StringView {};
+    encoder << StringView("");
+    encoder << String("copied");
+    return ByteBuffer::copy(message_buffer.data.data(), message_buffer.data.size());
+}
+
+static bool points_into(ReadonlyBytes bytes, const ByteBuffer& buffer)
+{
+    return bytes.data() >= buffer.data() && bytes.data() + bytes.size() <= buffer.data() + buffer.size();
+}
+
+TEST_CASE(borrowed_parameters_point_into_the_receive_buffer)
+{
+    auto receive_buffer = encode_message();
+    InputMemoryStream stream { receive_buffer };
+    IPC::Decoder decoder { stream, -1 };
+
+    i32 number = 0;
+    EXPECT(decoder.decode(number));
+    EXPECT_EQ(number, 42);
+
+    StringView view;
+    EXPECT(decoder.decode(view));
+    EXPECT_EQ(view, "Hello friends!");
+    EXPECT(points_into(view.bytes(), receive_buffer));
+
+    ReadonlyBytes bytes;
+    EXPECT(decoder.decode(bytes));
+    EXPECT_EQ(bytes.size(), sizeof(raw_bytes));
+    EXPECT(!memcmp(bytes.data(), raw_bytes, sizeof(raw_bytes)));
+    EXPECT(points_into(bytes, receive_buffer));
+
+    // Null and empty stay distinct, like they do for String.
+    StringView null_view { "not null" };
+    EXPECT(decoder.decode(null_view));
+    EXPECT(null_view.is_null());
+    StringView empty_view;
+    EXPECT(decoder.decode(empty_view));
+    EXPECT(!empty_view.is_null());
+    EXPECT(empty_view.is_empty());
+
+    String string;
+    EXPECT(decoder.decode(string));
+    EXPECT_EQ(string, "copied");
+    EXPECT(stream.eof());
+}
+
+TEST_CASE(buffer_for_borrowed_parameters)
+{
+    auto receive_buffer = encode_message();
+    InputMemoryStream stream { receive_buffer };
+    stream.discard_or_error(sizeof(i32));
+
+    // A message with borrowed parameters can share the rest of the receive buffer instead of copying it.
+    auto shared = IPC::Decoder::buffer_for_borrowed_parameters(stream, receive_buffer);
+    EXPECT(shared.data() == receive_buffer.data());
+
+    // Anything else is copied, since the caller can't keep it alive.
+    auto copy = ByteBuffer::copy(receive_buffer.data(), receive_buffer.size());
+    InputMemoryStream other_stream { copy };
+    other_stream.discard_or_error(sizeof(i32));
+    auto copied = IPC::Decoder::buffer_for_borrowed_parameters(other_stream, receive_buffer);
+    EXPECT(copied.data() != copy.data());
+    EXPECT(copied.data() != receive_buffer.data());
+    EXPECT_EQ(copied.size(), copy.size() - sizeof(i32));
+    EXPECT(!memcmp(copied.data(), copy.data() + sizeof(i32), copied.size()));
+}
+
+TEST_CASE(truncated_string_view_is_rejected)
+{
+    // A length that runs past the end of the message is rejected rather than read out of bounds.
+    IPC::MessageBuffer message_buffer;
+    IPC::Encoder encoder(message_buffer);
+    encoder << (i32)100;
+    encoder << (u8)'x';
+    auto truncated = ByteBuffer::copy(message_buffer.data.data(), message_buffer.data.size());
+    InputMemoryStream stream { truncated };
+    IPC::Decoder decoder { stream, -1 };
+    StringView view;
+    EXPECT(!decoder.decode(view));
+}
+
+TEST_MAIN(BorrowedParameters)